@@ -1,153 +1,358 @@
 // © You i Labs Inc. 2000-2016. All rights reserved.
 //#include "vld.h"
 
-#include "windows.h"
-#include "C3DModelAssimp.h"
-#include "C3DModelFBX.h"
-#include "C3DModelOBJ.h"
+#include "C3DConverter.h"
+#include "CConversionPipeline.h"
+#include "CTaskScheduler.h"
+#include "CLog.h"
+#include "CTimer.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 
 //Command line parsing code
-int opt = 0;
-char* optarg = NULL;
-int optind = 1;
-bool bForceAssimp = false;
+/* Position of the option parser in argv, kept by the caller instead of in globals */
+struct CommandLineState
+{
+    int nIndex;
+    char * pArgument;
+
+    CommandLineState() :
+        nIndex(1),
+        pArgument(NULL)
+    {
+    }
+};
 
-int getopt(int argc, char *const argv[], const char *optstring)
+/* Switches of one run of the tool */
+struct CommandLineOptions
 {
-    if ((optind >= argc) || (argv[optind][0] != '-') || (argv[optind][0] == 0))
+    ConversionOptions Options;
+    bool bPipeOutput;
+    bool bPipeline;                 // convert the models of the run concurrently, see CConversionPipeline
+    uint32_t uPipelineThreads;      // 0 uses one convert thread per core
+
+    CommandLineOptions() :
+        bPipeOutput(false),
+        bPipeline(false),
+        uPipelineThreads(0)
+    {
+    }
+};
+
+int GetOption(int argc, char *const argv[], const char *optstring, CommandLineState &State)
+{
+    if ((State.nIndex >= argc) || (argv[State.nIndex][0] != '-') || (argv[State.nIndex][0] == 0))
     {
         return -1;
     }
 
-    int opt = argv[optind][1];
+    int opt = argv[State.nIndex][1];
     const char *p = strchr(optstring, opt);
 
     if (p == NULL)
     {
         return '?';
     }
-    //if (p[1] == ':')
+    State.nIndex++;
+    if (p[1] == ':')
     {
-        optind++;
-        if (optind >= argc)
+        if (State.nIndex >= argc)
         {
             return '?';
         }
-        optarg = argv[optind];
+        State.pArgument = argv[State.nIndex];
+        State.nIndex++;
     }
     return opt;
 }
 
-uint64_t YiGetTimeuS(void)
+void PrintResult(const ConversionResult &Result)
 {
-    LARGE_INTEGER li;
+    if (!Result.bSuccess)
+    {
+        printf("%s\n", Result.sError.c_str());
+    }
+    else
+    {
+        printf("Wrote %llu bytes.\n", (unsigned long long)Result.uOutputBytes);
+    }
+    for (size_t i = 0; i < Result.PostProcessTimings.size(); i++)
+    {
+        printf("    %-26s %0.03f ms\n", Result.PostProcessTimings[i].sName.c_str(), Result.PostProcessTimings[i].uTimeuS / 1000.0f);
+    }
+}
 
-    static LONGLONG frequency = 0;
-    if (frequency == 0)
+void ConvertModel(const std::string &sName, const CommandLineOptions &CommandLine, C3DConversionContext &Context, CStdoutOutputSink &PipeSink)
+{
+    // measure the time before the update
+    uint64_t uBeforeUpdateTimeuS = CTimer::GetTimeuS();
+
+    // One pipe for the whole run, the converted models are streamed into it back to back.
+    COutputSink * pSink = YI_NULL;
+    if (CommandLine.bPipeOutput)
     {
-        if (!QueryPerformanceFrequency(&li))
+        if (!PipeSink.Open())
         {
-            // This should never fail, but we can set a default value so we don't come back in here
-            frequency = 1;
+            return;
         }
-        frequency = li.QuadPart;
+        pSink = &PipeSink;
     }
 
-    QueryPerformanceCounter(&li);
-    static LONGLONG counterStart = li.QuadPart;
+    ConversionResult Result = Context.Convert(sName, CommandLine.Options, pSink);
+    PrintResult(Result);
+
+    // calculate the total time consumed by the update call by measuring the time after the update
+    uint64_t uConsumedTimeuS = CTimer::GetTimeuS() - uBeforeUpdateTimeuS;
 
-    return (uint64_t)((li.QuadPart - counterStart) * 1000000 / frequency);
+    printf("Time taken to load: %0.02f", uConsumedTimeuS / 1000000.0f);
 }
 
-void ConvertModel(std::string sName, bool bFlipUV)
+// Models of a pipelined run are only queued here, their results are printed once the pipeline finished.
+void SubmitModel(const std::string &sName, const CommandLineOptions &CommandLine, CConversionPipeline &Pipeline, CStdoutOutputSink &PipeSink, std::vector<std::string> &Submitted)
 {
-    // measure the time before the update
-    uint64_t uBeforeUpdateTimeuS = YiGetTimeuS();
-
-    std::string sFile = sName;
-    std::transform(sName.begin(), sName.end(), sName.begin(), ::tolower);
-
-    if (bForceAssimp)
-    {
-        printf("Using ASSIMP Importer for conversion.\n");
-        C3DModelAssimp * pModelViewAssimp = new C3DModelAssimp();
-        pModelViewAssimp->ExportToSTUFormat(sFile, bFlipUV);
-        delete pModelViewAssimp;
-    }
-    else
+    if (!Pipeline.IsRunning())
     {
-        std::string sfbx = ".fbx";
-        size_t start_pos = sName.find(sfbx);
-        if (start_pos != std::string::npos)
-        {
-            printf("Using FBX SDK for conversion.\n");
-            C3DModelFBX * pModelViewFBX = new C3DModelFBX();
-            pModelViewFBX->ExportToSTUFormat(sFile, bFlipUV);
-            delete pModelViewFBX;
-        }
-        else
+        COutputSink * pSink = YI_NULL;
+        if (CommandLine.bPipeOutput)
         {
-            std::string sfbx = ".obj";
-            start_pos = sName.find(sfbx);
-            if (start_pos != std::string::npos)
-            {
-                printf("Using OBJ Importer for conversion.\n");
-                C3DModelOBJ * pModelViewOBJ = new C3DModelOBJ();
-                pModelViewOBJ->ExportToSTUFormat(sFile, bFlipUV);
-                delete pModelViewOBJ;
-            }
-            else
+            if (!PipeSink.Open())
             {
-                printf("Using ASSIMP Importer for conversion.\n");
-                C3DModelAssimp * pModelViewAssimp = new C3DModelAssimp();
-                pModelViewAssimp->ExportToSTUFormat(sFile, bFlipUV);
-                delete pModelViewAssimp;
+                return;
             }
+            pSink = &PipeSink;
+        }
+        if (!Pipeline.Start(CommandLine.uPipelineThreads, 0, pSink))
+        {
+            return;
         }
     }
-    // calculate the total time consumed by the update call by measuring the time after the update
-    uint64_t uConsumedTimeuS = YiGetTimeuS() - uBeforeUpdateTimeuS;
+    if (Pipeline.Submit(sName, CommandLine.Options))
+    {
+        Submitted.push_back(sName);
+    }
+}
 
-    printf("Time taken to load: %0.02f", uConsumedTimeuS / 1000000.0f);
+void FinishPipeline(CConversionPipeline &Pipeline, const std::vector<std::string> &Submitted)
+{
+    if (!Pipeline.IsRunning())
+    {
+        return;
+    }
+    uint64_t uBeforeUpdateTimeuS = CTimer::GetTimeuS();
+    const std::vector<ConversionResult> &Results = Pipeline.Finish();
+    for (size_t i = 0; i < Results.size() && i < Submitted.size(); i++)
+    {
+        printf("%s: ", Submitted[i].c_str());
+        PrintResult(Results[i]);
+    }
+    printf("Time taken to finish the batch: %0.02f", (CTimer::GetTimeuS() - uBeforeUpdateTimeuS) / 1000000.0f);
+}
+
+// What the workers of a parallel export did over the whole run, to tune the -T task size.
+void PrintSchedulerStats()
+{
+    std::vector<TaskWorkerStats> Stats = CTaskScheduler::GetShared().GetStats();
+    for (size_t i = 0; i < Stats.size(); i++)
+    {
+        printf("\n%s %2u: %8llu tasks, %8llu stolen, idle %0.02f s", i + 1 < Stats.size() ? "Worker" : "Waiter", (uint32_t)i,
+            (unsigned long long)Stats[i].uTasksRun, (unsigned long long)Stats[i].uTasksStolen, Stats[i].uIdleTimeuS / 1000000.0f);
+    }
+    printf("\n");
 }
 
 void PrintInfo()
 {
     printf("\n3DConvert converts standard model formats to the You.i Engine format (.stu).\n");
-    printf("\n    Usage: Simple3DTestApp -a -f Modelfile [ -f Modelfile]...");
-    printf("\n    -a  Force Assimp for convert (instead of Autodesk FBX etc)\n\n\n");
+    printf("\n    Usage: Simple3DTestApp -a -m -w -o -s -c -r -p -q -b Bones -t -l -x -T Vertices -B Threads -j -L Level -M MemoryMB -P Profile -S Steps -i -f Modelfile [ -f Modelfile]...");
+    printf("\n    -a  Force Assimp for convert (instead of Autodesk FBX etc)");
+    printf("\n    -m  Write the output through a preallocated memory-mapped file");
+    printf("\n    -w  Write the output on a background thread while the next chunks are encoded");
+    printf("\n    -o  Stream the output to stdout instead of a .stu file (log output moves to stderr)");
+    printf("\n    -s  Export skinned meshes with integer bone indices, 8-bit weights and packed normals (36 bytes per vertex)");
+    printf("\n    -c  Compress animations (drop redundant keys, quantize times and values)");
+    printf("\n    -r  Also export animations resampled at 30 frames per second");
+    printf("\n    -p  Also export baked skinning palettes at 30 frames per second");
+    printf("\n    -q  Quantize baked skinning palettes to 16 bits");
+    printf("\n    -b  Split skinned meshes so each part uses at most this many bones (12 or more)");
+    printf("\n    -t  Export blend shapes as sparse morph targets with their weight curves");
+    printf("\n    -l  Low-memory export: free each mesh as soon as it is written");
+    printf("\n    -x  Out-of-core conversion for OBJ, binary PLY and STL larger than memory, using temp files next to the model");
+    printf("\n    -T  Encode scene trees in parallel, meshes from this many vertices get their own task (0 = 4096); prints worker stats");
+    printf("\n    -B  Convert the -f models concurrently in a pipeline with this many convert threads (0 = one per core)");
+    printf("\n    -j  Log as JSON lines (time, thread, level, tag, message) for batch tooling");
+    printf("\n    -L  Log level: debug, info (default), warning, error or none");
+    printf("\n    -M  Memory budget of the out-of-core conversion in MB (default 512)");
+    printf("\n    -P  Assimp post-processing profile: fast, balanced or quality (default)");
+    printf("\n    -S  Enable or disable single Assimp post-processing steps, e.g. +FindInstances,-ImproveCacheLocality");
+    printf("\n    -i  Apply and time the Assimp post-processing steps one by one instead of in a single pass\n\n\n");
 }
 
 void ProcessCommandArgs(int argc, char ** argv)
 {
     int processed = 0;
+    CommandLineState State;
+    CommandLineOptions CommandLine;
+    ConversionOptions &Options = CommandLine.Options;
+
+    // Kept for the whole run so the importers are set up once for all the -f models.
+    C3DConversionContext Context;
+    CStdoutOutputSink PipeSink;
+    CConversionPipeline Pipeline;
+    std::vector<std::string> Submitted;
+
     if (argc > 1)
     {
-        while ((opt = getopt(argc, argv, "af:")) != -1)
+        int opt;
+        while ((opt = GetOption(argc, argv, "amwoscrpqtlxjib:f:B:L:M:P:S:T:", State)) != -1)
         {
             switch (opt)
             {
             case 'f':
             {
-                ConvertModel(optarg, true);
+                if (CommandLine.bPipeline)
+                {
+                    SubmitModel(State.pArgument, CommandLine, Pipeline, PipeSink, Submitted);
+                }
+                else
+                {
+                    ConvertModel(State.pArgument, CommandLine, Context, PipeSink);
+                }
                 processed++;
                 break;
             }
             case 'a':
             {
-                bForceAssimp = true;
+                Options.bForceAssimp = true;
+                break;
+            }
+            case 'm':
+            {
+                Options.bMappedOutput = true;
+                break;
+            }
+            case 'w':
+            {
+                Options.bAsyncOutput = true;
+                break;
+            }
+            case 'o':
+            {
+                CommandLine.bPipeOutput = true;
+                break;
+            }
+            case 's':
+            {
+                Options.bCompactSkinning = true;
+                break;
+            }
+            case 'c':
+            {
+                Options.bCompressAnimations = true;
+                break;
+            }
+            case 'r':
+            {
+                Options.bResampleAnimations = true;
+                break;
+            }
+            case 'p':
+            {
+                Options.bBakePalettes = true;
+                break;
+            }
+            case 'q':
+            {
+                Options.bQuantizePalettes = true;
+                break;
+            }
+            case 't':
+            {
+                Options.bMorphTargets = true;
+                break;
+            }
+            case 'l':
+            {
+                Options.bLowMemory = true;
+                break;
+            }
+            case 'x':
+            {
+                Options.bOutOfCore = true;
+                break;
+            }
+            case 'T':
+            {
+                uint32_t uMinVertices = (uint32_t)atoi(State.pArgument);
+                Options.bParallelExport = true;
+                Options.uParallelMinVertices = uMinVertices > 0 ? uMinVertices : 4096;
+                break;
+            }
+            case 'B':
+            {
+                CommandLine.bPipeline = true;
+                CommandLine.uPipelineThreads = (uint32_t)atoi(State.pArgument);
+                break;
+            }
+            case 'j':
+            {
+                CLog::SetFormat(LogFormat_JsonLines);
+                break;
+            }
+            case 'L':
+            {
+                LogLevel eLevel;
+                if (!CLog::ParseLevel(State.pArgument, eLevel))
+                {
+                    PrintInfo();
+                    break;
+                }
+                CLog::SetLevel(eLevel);
+                break;
+            }
+            case 'M':
+            {
+                uint32_t uMemoryMB = (uint32_t)atoi(State.pArgument);
+                if (uMemoryMB > 0)
+                {
+                    Options.uOutOfCoreMemory = (uint64_t)uMemoryMB * 1024 * 1024;
+                }
+                break;
+            }
+            case 'b':
+            {
+                Options.uMaxPaletteBones = (uint32_t)atoi(State.pArgument);
+                break;
+            }
+            case 'P':
+            {
+                Options.sPostProcessProfile = State.pArgument;
+                break;
+            }
+            case 'S':
+            {
+                Options.sPostProcessOverrides = State.pArgument;
+                break;
+            }
+            case 'i':
+            {
+                Options.bPostProcessStepTimings = true;
                 break;
             }
             case '?':
-                printf("\n3DConvert converts standard model formats to the You.i Engine format (.stu).\n");
-                printf("\n    Usage: Simple3DTestApp -a -f Modelfile [ -f Modelfile]...");
-                printf("\n    -a  Force Assimp for converting FBX or OBJ (instead of Autodesk FBX etc)\n\n\n");
+                PrintInfo();
                 break;
             default:
                 PrintInfo();
                 break;
             }
         }
+        FinishPipeline(Pipeline, Submitted);
+        if (Options.bParallelExport)
+        {
+            PrintSchedulerStats();
+        }
     }
     else
     {
@@ -159,7 +364,7 @@ void ProcessCommandArgs(int argc, char ** argv)
     }
 }
 
-bool main(int argc, char **argv)
+int main(int argc, char **argv)
 {
     ProcessCommandArgs(argc, argv);
     return 0;
@@ -0,0 +1,415 @@
+// © You i Labs Inc. 2000-2016. All rights reserved.
+
+#include "C3DConverter.h"
+#include "C3DModelXML.h"
+#include "CModelCorpus.h"
+#include "CLog.h"
+#include "CTimer.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#include <direct.h>
+#define MAKE_DIRECTORY(path) _mkdir(path)
+#else
+#include <sys/resource.h>
+#include <sys/stat.h>
+#define MAKE_DIRECTORY(path) mkdir(path, 0755)
+#endif
+
+// End-to-end benchmark: generates the corpus of CModelCorpus, then converts every scene with every importer
+// that reads its format, each case in a process of its own so its peak memory is its own. Every case prints one
+// JSON line on stdout; progress and the converters' log go to stderr.
+
+/* One importer run over one file of the corpus */
+struct BenchCase
+{
+    CorpusSceneSpec Spec;
+    CorpusFormat Format;
+    const char * pConfiguration;    // what the case measures, e.g. "OBJ" or "Assimp parallel"
+    ConversionOptions Options;
+    bool bXML;                      // C3DModelXML, which is not one of the importers of the converter
+};
+
+/* Switches of one run of the benchmark */
+struct BenchOptions
+{
+    std::string sDirectory;
+    uint32_t uScale;
+    uint32_t uRepeats;
+    std::string sFilter;            // only the cases whose name contains it
+    bool bGenerateOnly;
+
+    BenchOptions() :
+        sDirectory("bench_corpus"),
+        uScale(1),
+        uRepeats(3),
+        bGenerateOnly(false)
+    {
+    }
+};
+
+/* What one conversion of a case took */
+struct BenchRun
+{
+    uint64_t uWallTimeuS;
+    ConversionResult Result;
+};
+
+// Largest resident set of this process so far, 0 where unknown.
+static uint64_t GetPeakMemoryBytes()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS Counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &Counters, sizeof(Counters)))
+    {
+        return (uint64_t)Counters.PeakWorkingSetSize;
+    }
+    return 0;
+#else
+    struct rusage Usage;
+    if (getrusage(RUSAGE_SELF, &Usage) != 0)
+    {
+        return 0;
+    }
+#ifdef __APPLE__
+    return (uint64_t)Usage.ru_maxrss;
+#else
+    return (uint64_t)Usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+static uint64_t GetFileSize(const std::string &path)
+{
+    FILE * pFile = fopen(path.c_str(), "rb");
+    if (!pFile)
+    {
+        return 0;
+    }
+    // The scaled up corpus goes past 2GB, long is 32 bits on Windows.
+#ifdef _WIN32
+    uint64_t uSize = _fseeki64(pFile, 0, SEEK_END) == 0 ? (uint64_t)_ftelli64(pFile) : 0;
+#else
+    uint64_t uSize = fseeko(pFile, 0, SEEK_END) == 0 ? (uint64_t)ftello(pFile) : 0;
+#endif
+    fclose(pFile);
+    // -1 when the position is unknown
+    return uSize == (uint64_t)-1 ? 0 : uSize;
+}
+
+static std::string EscapeJSON(const std::string &sText)
+{
+    std::string sEscaped;
+    for (size_t i = 0; i < sText.size(); ++i)
+    {
+        char c = sText[i];
+        if (c == '"' || c == '\\')
+        {
+            sEscaped += '\\';
+            sEscaped += c;
+        }
+        else if ((unsigned char)c < 0x20)
+        {
+            char Escape[8];
+            snprintf(Escape, sizeof(Escape), "\\u%04x", (unsigned int)(unsigned char)c);
+            sEscaped += Escape;
+        }
+        else
+        {
+            sEscaped += c;
+        }
+    }
+    return sEscaped;
+}
+
+static std::string GetCorpusPath(const BenchOptions &Bench, const BenchCase &Case)
+{
+    return Bench.sDirectory + "/" + Case.Spec.sName + CModelCorpus::GetFormatExtension(Case.Format);
+}
+
+static std::string GetCaseName(const BenchCase &Case)
+{
+    return Case.Spec.sName + CModelCorpus::GetFormatExtension(Case.Format) + "/" + Case.pConfiguration;
+}
+
+// Every scene in every format that holds all of it, with every importer of that format.
+static std::vector<BenchCase> BuildCases(const BenchOptions &Bench)
+{
+    std::vector<BenchCase> Cases;
+    std::vector<CorpusSceneSpec> Specs = CModelCorpus::GetDefaultSpecs(Bench.uScale);
+    for (size_t uSpec = 0; uSpec < Specs.size(); ++uSpec)
+    {
+        for (int nFormat = 0; nFormat < CorpusFormat_Count; ++nFormat)
+        {
+            CorpusFormat Format = (CorpusFormat)nFormat;
+            if (!CModelCorpus::CanStore(Specs[uSpec], Format))
+            {
+                continue;
+            }
+
+            BenchCase Case;
+            Case.Spec = Specs[uSpec];
+            Case.Format = Format;
+            Case.bXML = false;
+
+            std::vector<BenchCase> Configurations;
+            switch (Format)
+            {
+            case CorpusFormat_OBJ:
+                Case.pConfiguration = "OBJ";
+                Configurations.push_back(Case);
+                Case.pConfiguration = "Assimp";
+                Case.Options.bForceAssimp = true;
+                Configurations.push_back(Case);
+                Case.pConfiguration = "Out-of-core";
+                Case.Options.bForceAssimp = false;
+                Case.Options.bOutOfCore = true;
+                Configurations.push_back(Case);
+                break;
+            case CorpusFormat_XML:
+                Case.pConfiguration = "XML";
+                Case.bXML = true;
+                Configurations.push_back(Case);
+                break;
+            case CorpusFormat_PLY:
+                Case.pConfiguration = "Assimp";
+                Configurations.push_back(Case);
+                Case.pConfiguration = "Out-of-core";
+                Case.Options.bOutOfCore = true;
+                Configurations.push_back(Case);
+                break;
+            default:
+                Case.pConfiguration = "Assimp";
+                Configurations.push_back(Case);
+                Case.pConfiguration = "Assimp parallel";
+                Case.Options.bParallelExport = true;
+                Configurations.push_back(Case);
+                break;
+            }
+
+            for (size_t i = 0; i < Configurations.size(); ++i)
+            {
+                if (GetCaseName(Configurations[i]).find(Bench.sFilter) != std::string::npos)
+                {
+                    Cases.push_back(Configurations[i]);
+                }
+            }
+        }
+    }
+    return Cases;
+}
+
+static BenchRun RunCase(const BenchCase &Case, const std::string &path, C3DConversionContext &Context)
+{
+    BenchRun Run;
+    uint64_t uStartuS = CTimer::GetTimeuS();
+    if (Case.bXML)
+    {
+        C3DModelXML Model;
+        Run.Result.bSuccess = Model.ExportToSTUFormat(path, true);
+        Run.Result.sImporter = "XML";
+        Run.Result.uOutputBytes = Run.Result.bSuccess ? GetFileSize(path + ".stu") : 0;
+        if (!Run.Result.bSuccess)
+        {
+            Run.Result.sError = "Could not convert '" + path + "'.";
+        }
+    }
+    else
+    {
+        Run.Result = Context.Convert(path, Case.Options);
+    }
+    Run.uWallTimeuS = CTimer::GetTimeuS() - uStartuS;
+    if (Case.bXML)
+    {
+        Run.Result.uTimeuS = Run.uWallTimeuS;
+    }
+    return Run;
+}
+
+// The stages of a run: the Assimp import and post-processing steps, then the export as the rest of the time.
+// The other importers only have the total.
+static std::string FormatStages(const ConversionResult &Result)
+{
+    std::string sStages = "{";
+    uint64_t uStagesuS = 0;
+    for (size_t i = 0; i < Result.PostProcessTimings.size(); ++i)
+    {
+        sStages += "\"" + EscapeJSON(Result.PostProcessTimings[i].sName) + "\":" + std::to_string((unsigned long long)Result.PostProcessTimings[i].uTimeuS) + ",";
+        uStagesuS += Result.PostProcessTimings[i].uTimeuS;
+    }
+    const char * pLast = Result.PostProcessTimings.empty() ? "Convert" : "Export";
+    uint64_t uLastuS = Result.uTimeuS > uStagesuS ? Result.uTimeuS - uStagesuS : 0;
+    return sStages + "\"" + pLast + "\":" + std::to_string((unsigned long long)uLastuS) + "}";
+}
+
+// Runs one case uRepeats times in this process and prints its JSON line. The median run is reported.
+static int RunSingleCase(const BenchOptions &Bench, const BenchCase &Case)
+{
+    // The log must not mix with the results.
+    CLog::SetOutput(stderr);
+    CLog::SetLevel(LogLevel_Warning);
+
+    std::string path = GetCorpusPath(Bench, Case);
+    C3DConversionContext Context;
+    std::vector<BenchRun> Runs;
+    for (uint32_t i = 0; i < std::max<uint32_t>(Bench.uRepeats, 1); ++i)
+    {
+        Runs.push_back(RunCase(Case, path, Context));
+        if (!Runs.back().Result.bSuccess)
+        {
+            break;
+        }
+    }
+
+    std::vector<size_t> Order(Runs.size());
+    for (size_t i = 0; i < Order.size(); ++i)
+    {
+        Order[i] = i;
+    }
+    std::sort(Order.begin(), Order.end(), [&Runs](size_t uLeft, size_t uRight) { return Runs[uLeft].uWallTimeuS < Runs[uRight].uWallTimeuS; });
+    const BenchRun &Median = Runs.back().Result.bSuccess ? Runs[Order[Order.size() / 2]] : Runs.back();
+    const ConversionResult &Result = Median.Result;
+
+    double fTrianglesPerSecond = Median.uWallTimeuS > 0 ? Case.Spec.uTriangles * 1000000.0 / Median.uWallTimeuS : 0.0;
+    printf("{\"case\":\"%s\",\"scene\":\"%s\",\"format\":\"%s\",\"configuration\":\"%s\",\"importer\":\"%s\",\"success\":%s,"
+        "\"triangles\":%u,\"meshes\":%u,\"depth\":%u,\"bones\":%u,\"animation_frames\":%u,\"input_bytes\":%llu,\"output_bytes\":%llu,"
+        "\"runs\":%u,\"wall_us\":%llu,\"wall_min_us\":%llu,\"triangles_per_s\":%.0f,\"stages_us\":%s,\"peak_rss_bytes\":%llu,\"error\":\"%s\"}\n",
+        EscapeJSON(GetCaseName(Case)).c_str(), EscapeJSON(Case.Spec.sName).c_str(), CModelCorpus::GetFormatName(Case.Format), Case.pConfiguration,
+        EscapeJSON(Result.sImporter).c_str(), Result.bSuccess ? "true" : "false", Case.Spec.uTriangles, Case.Spec.uMeshes, Case.Spec.uDepth,
+        Case.Spec.uBones, Case.Spec.uAnimationFrames, (unsigned long long)GetFileSize(path), (unsigned long long)Result.uOutputBytes,
+        (uint32_t)Runs.size(), (unsigned long long)Median.uWallTimeuS, (unsigned long long)Runs[Order[0]].uWallTimeuS, fTrianglesPerSecond,
+        FormatStages(Result).c_str(), (unsigned long long)GetPeakMemoryBytes(), EscapeJSON(Result.sError).c_str());
+    fflush(stdout);
+    CLog::Flush();
+    return Result.bSuccess ? 0 : 1;
+}
+
+static bool GenerateCorpus(const BenchOptions &Bench, const std::vector<BenchCase> &Cases)
+{
+    // Fails harmlessly when the directory exists, Write reports any other problem.
+    MAKE_DIRECTORY(Bench.sDirectory.c_str());
+
+    std::string sLastPath;
+    for (size_t i = 0; i < Cases.size(); ++i)
+    {
+        std::string path = GetCorpusPath(Bench, Cases[i]);
+        if (path == sLastPath)
+        {
+            continue;
+        }
+        fprintf(stderr, "Generating %s\n", path.c_str());
+        if (CModelCorpus::Write(Cases[i].Spec, Cases[i].Format, Bench.sDirectory).empty())
+        {
+            return false;
+        }
+        sLastPath = path;
+    }
+    return true;
+}
+
+// Runs every case in a child process, argv[0] with -c, so the peak memory measured is the case's alone.
+static int RunAllCases(const char * pExecutable, const BenchOptions &Bench, const std::vector<BenchCase> &Cases)
+{
+    int nFailed = 0;
+    for (size_t i = 0; i < Cases.size(); ++i)
+    {
+        fprintf(stderr, "Running %s\n", GetCaseName(Cases[i]).c_str());
+        std::string sCommand = "\"" + std::string(pExecutable) + "\" -d \"" + Bench.sDirectory + "\" -s " + std::to_string((unsigned long long)Bench.uScale) +
+            " -r " + std::to_string((unsigned long long)Bench.uRepeats) + " -k \"" + GetCaseName(Cases[i]) + "\"";
+#ifdef _WIN32
+        // cmd.exe strips the outer quotes of the whole line.
+        sCommand = "\"" + sCommand + "\"";
+#endif
+        fflush(stdout);
+        if (std::system(sCommand.c_str()) != 0)
+        {
+            nFailed++;
+        }
+    }
+    fprintf(stderr, "%u cases, %d failed\n", (uint32_t)Cases.size(), nFailed);
+    return nFailed ? 1 : 0;
+}
+
+static void PrintInfo()
+{
+    fprintf(stderr, "\n3DConvertBench generates a synthetic model corpus and measures every importer on it.\n");
+    fprintf(stderr, "\n    Usage: 3DConvertBench -d Directory -s Scale -r Repeats -f Filter -g");
+    fprintf(stderr, "\n    -d  Directory of the corpus and the .stu files (default bench_corpus)");
+    fprintf(stderr, "\n    -s  Multiply the triangle counts of the corpus (default 1)");
+    fprintf(stderr, "\n    -r  Conversions per case, the median is reported (default 3)");
+    fprintf(stderr, "\n    -f  Only run the cases whose name contains this, e.g. .obj/ or skinned");
+    fprintf(stderr, "\n    -g  Only generate the corpus");
+    fprintf(stderr, "\n    -k  Run the one case with this exact name in this process, without generating the corpus");
+    fprintf(stderr, "\n\n    Prints one JSON line per case on stdout: wall time, time per stage, triangles per second,");
+    fprintf(stderr, "\n    output bytes and peak resident memory.\n\n");
+}
+
+int main(int argc, char **argv)
+{
+    BenchOptions Bench;
+    std::string sCase;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (argv[i][0] != '-' || argv[i][1] == 0)
+        {
+            PrintInfo();
+            return 1;
+        }
+        char Option = argv[i][1];
+        if (Option == 'g')
+        {
+            Bench.bGenerateOnly = true;
+            continue;
+        }
+        if (!strchr("dsrfk", Option) || i + 1 >= argc)
+        {
+            PrintInfo();
+            return 1;
+        }
+        const char * pArgument = argv[++i];
+        switch (Option)
+        {
+        case 'd':
+            Bench.sDirectory = pArgument;
+            break;
+        case 's':
+            Bench.uScale = std::max(atoi(pArgument), 1);
+            break;
+        case 'r':
+            Bench.uRepeats = std::max(atoi(pArgument), 1);
+            break;
+        case 'f':
+            Bench.sFilter = pArgument;
+            break;
+        default:
+            sCase = pArgument;
+            break;
+        }
+    }
+
+    std::vector<BenchCase> Cases = BuildCases(Bench);
+    if (!sCase.empty())
+    {
+        for (size_t i = 0; i < Cases.size(); ++i)
+        {
+            if (GetCaseName(Cases[i]) == sCase)
+            {
+                return RunSingleCase(Bench, Cases[i]);
+            }
+        }
+        fprintf(stderr, "Unknown case '%s'.\n", sCase.c_str());
+        return 1;
+    }
+
+    if (!GenerateCorpus(Bench, Cases))
+    {
+        return 1;
+    }
+    return Bench.bGenerateOnly ? 0 : RunAllCases(argv[0], Bench, Cases);
+}
@@ -0,0 +1,659 @@
+// © You i Labs Inc. 2000-2016. All rights reserved.
+
+#include "C3DModelDataStructures.h"
+#include "CBonePartitioner.h"
+#include "CExportKernels.h"
+#include "CFileExportSTUFormat.h"
+#include "CLog.h"
+#include "CTimer.h"
+
+#include "assimp/mesh.h"
+
+// parseReal lives in the implementation part of tinyobj. Its functions are static, so this copy and the one
+// C3DModelOBJ compiles into the library never meet at link time.
+#define TINYOBJLOADER_IMPLEMENTATION
+#include "tiny_obj_loader.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <memory>
+#include <functional>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Microbenchmarks of the hot loops of the export, each on its own over synthetic input: the WRITE_VALUE buffer
+// growth, the vertex packing of the Assimp export, the bounding box, the chunk name hash, the number
+// parsers of the XML and OBJ importers and the bone influence insertion. Every kernel prints one JSON line on
+// stdout with ns per element and bytes per cycle, and with -p the hardware counters of Linux perf_event.
+
+/* One kernel, ready to run over its whole input once per repetition */
+struct KernelRun
+{
+    std::function<void()> Run;
+    uint64_t uElements;         // what the time is divided by, see the kernel
+    uint64_t uBytes;            // what bytes per cycle counts: the bytes produced, or read by the parsers and reductions
+};
+
+typedef KernelRun (*KernelFactory)(uint32_t uElements);
+
+struct KernelEntry
+{
+    const char * pName;
+    KernelFactory Factory;
+    const char * pDescription;
+};
+
+/* Switches of one run of the benchmark */
+struct MicroBenchOptions
+{
+    uint32_t uElements;
+    uint32_t uMinTimeMs;        // per kernel, repetitions are added until it is reached
+    uint32_t uMinRepetitions;
+    std::string sFilter;
+    bool bPerfCounters;
+    bool bList;
+
+    MicroBenchOptions() :
+        uElements(1 << 20),
+        uMinTimeMs(200),
+        uMinRepetitions(5),
+        bPerfCounters(false),
+        bList(false)
+    {
+    }
+};
+
+// Keep the results of the kernels alive, the compiler would drop the work otherwise.
+static volatile float s_fSink = 0.0f;
+static volatile uint32_t s_uSink = 0;
+
+// Reference cycles of the time stamp counter, 0 where there is none. Not the core clock under turbo or power saving,
+// perf_event counts those.
+static uint64_t ReadTimestampCounter()
+{
+#if (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))) || defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static float RandomFloat(std::mt19937 &Random)
+{
+    return (Random() >> 8) * (1.0f / 16777216.0f);
+}
+
+/* Hardware counters of the calling thread in user space, read together as one perf_event group */
+class CPerfCounters
+{
+public:
+    enum Counter
+    {
+        Counter_Cycles,
+        Counter_CacheMisses,
+        Counter_BranchMisses,
+        Counter_Count
+    };
+
+    CPerfCounters()
+    {
+        for (int i = 0; i < Counter_Count; ++i)
+        {
+            m_Files[i] = -1;
+        }
+    }
+
+    ~CPerfCounters()
+    {
+        Close();
+    }
+
+    /* False where perf_event is missing or not allowed, see /proc/sys/kernel/perf_event_paranoid */
+    bool Open()
+    {
+#ifdef __linux__
+        static const uint64_t Configs[Counter_Count] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES };
+        for (int i = 0; i < Counter_Count; ++i)
+        {
+            struct perf_event_attr Attributes;
+            memset(&Attributes, 0, sizeof(Attributes));
+            Attributes.type = PERF_TYPE_HARDWARE;
+            Attributes.size = sizeof(Attributes);
+            Attributes.config = Configs[i];
+            Attributes.disabled = i == 0;           // the group follows its leader
+            Attributes.exclude_kernel = 1;
+            Attributes.exclude_hv = 1;
+            Attributes.read_format = PERF_FORMAT_GROUP;
+            m_Files[i] = (int)syscall(__NR_perf_event_open, &Attributes, 0, -1, i == 0 ? -1 : m_Files[0], 0);
+            if (m_Files[i] < 0)
+            {
+                Close();
+                return false;
+            }
+        }
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    bool IsOpen() const { return m_Files[0] >= 0; }
+
+    void Start()
+    {
+#ifdef __linux__
+        ioctl(m_Files[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(m_Files[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+    }
+
+    /* Adds the counts since Start() to Counts */
+    void Stop(uint64_t (&Counts)[Counter_Count])
+    {
+#ifdef __linux__
+        ioctl(m_Files[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        uint64_t Values[1 + Counter_Count];
+        if (read(m_Files[0], Values, sizeof(Values)) == (ssize_t)sizeof(Values) && Values[0] == Counter_Count)
+        {
+            for (int i = 0; i < Counter_Count; ++i)
+            {
+                Counts[i] += Values[1 + i];
+            }
+        }
+#else
+        (void)Counts;
+#endif
+    }
+
+private:
+    void Close()
+    {
+        for (int i = Counter_Count - 1; i >= 0; --i)
+        {
+#ifdef __linux__
+            if (m_Files[i] >= 0)
+            {
+                close(m_Files[i]);
+            }
+#endif
+            m_Files[i] = -1;
+        }
+    }
+
+    CPerfCounters(const CPerfCounters &);
+    CPerfCounters &operator=(const CPerfCounters &);
+
+    int m_Files[Counter_Count];
+};
+
+// A node chunk as the exporters write it: a count, the matrix, three colors and two floats, 8 values in 116 bytes.
+static const uint32_t uNodeValues = 8;
+
+static uint32_t WriteNodeValues(std::vector<uint8_t> &Data, uint32_t uIndex)
+{
+    uint32_t uSize = 0;
+    uint32_t uValue = uIndex;
+    glm::mat4 Matrix(1.0f);
+    glm::vec3 Color(0.25f);
+    float fShininess = 8.0f;
+    WRITE_VALUE(uValue);
+    WRITE_VALUE(Matrix);
+    WRITE_VALUE(uValue);
+    WRITE_VALUE(Color);
+    WRITE_VALUE(Color);
+    WRITE_VALUE(Color);
+    WRITE_VALUE(fShininess);
+    WRITE_VALUE(fShininess);
+    return uSize;
+}
+
+/*
+   The kernels. Each factory builds the input of one kernel for uElements vertices (or values, names, influences)
+   and returns the loop to time. The packing, parsing and WRITE_VALUE kernels call the code of CExportKernels.h the
+   converters run, not a copy of it.
+*/
+class CKernelBench
+{
+public:
+
+    static KernelRun WriteValueSmallChunks(uint32_t uElements) { return WriteValues(uElements, 4 * uNodeValues, false); }
+    static KernelRun WriteValueLargeChunk(uint32_t uElements) { return WriteValues(uElements, uElements, false); }
+    static KernelRun WriteValueReserved(uint32_t uElements) { return WriteValues(uElements, uElements, true); }
+
+    static KernelRun EncodeNormals(uint32_t uElements) { return EncodeVertices(uElements, VertexDataType_Normals); }
+    static KernelRun EncodeBones(uint32_t uElements) { return EncodeVertices(uElements, VertexDataType_Bones); }
+    static KernelRun EncodeSkinU8(uint32_t uElements) { return EncodeVertices(uElements, VertexDataType_SkinU8); }
+
+    // The bounds update of every vertex packing loop, on its own.
+    static KernelRun BoundingBox(uint32_t uElements)
+    {
+        std::shared_ptr< std::vector<glm::vec3> > pPositions(new std::vector<glm::vec3>(uElements));
+        std::mt19937 Random(uElements);
+        for (uint32_t i = 0; i < uElements; ++i)
+        {
+            (*pPositions)[i] = glm::vec3(RandomFloat(Random), RandomFloat(Random), RandomFloat(Random)) * 100.0f - 50.0f;
+        }
+
+        KernelRun Kernel;
+        Kernel.uElements = uElements;
+        Kernel.uBytes = (uint64_t)uElements * sizeof(glm::vec3);
+        Kernel.Run = [pPositions]()
+        {
+            const std::vector<glm::vec3> &Positions = *pPositions;
+            float bmin[3], bmax[3];
+            bmin[0] = bmin[1] = bmin[2] = std::numeric_limits<float>::max();
+            bmax[0] = bmax[1] = bmax[2] = -std::numeric_limits<float>::max();
+            for (size_t i = 0; i < Positions.size(); ++i)
+            {
+                bmin[0] = std::min(Positions[i].x, bmin[0]);
+                bmin[1] = std::min(Positions[i].y, bmin[1]);
+                bmin[2] = std::min(Positions[i].z, bmin[2]);
+                bmax[0] = std::max(Positions[i].x, bmax[0]);
+                bmax[1] = std::max(Positions[i].y, bmax[1]);
+                bmax[2] = std::max(Positions[i].z, bmax[2]);
+            }
+            s_fSink = bmin[0] + bmin[1] + bmin[2] + bmax[0] + bmax[1] + bmax[2];
+        };
+        return Kernel;
+    }
+
+    // Chunk and node names as the exporters make them, one in eight of the elements.
+    static KernelRun MakeHashFromName(uint32_t uElements)
+    {
+        std::shared_ptr< std::vector<std::string> > pNames(new std::vector<std::string>());
+        uint32_t uNames = std::max<uint32_t>(uElements / 8, 1);
+        uint64_t uBytes = 0;
+        for (uint32_t i = 0; i < uNames; ++i)
+        {
+            char Name[96];
+            switch (i % 4)
+            {
+            case 0: snprintf(Name, sizeof(Name), "Vx:%u", i); break;
+            case 1: snprintf(Name, sizeof(Name), "Vx:%uBB", i); break;
+            case 2: snprintf(Name, sizeof(Name), "Model:%u", i); break;
+            default: snprintf(Name, sizeof(Name), "Scene.(Node-%u).mesh(Mesh-%u)", i, i / 4); break;
+            }
+            pNames->push_back(Name);
+            uBytes += pNames->back().size();
+        }
+
+        KernelRun Kernel;
+        Kernel.uElements = uNames;
+        Kernel.uBytes = uBytes;
+        Kernel.Run = [pNames]()
+        {
+            uint32_t uHash = 0;
+            for (size_t i = 0; i < pNames->size(); ++i)
+            {
+                uHash ^= CFileExportSTUFormat::MakeHashFromName((*pNames)[i]);
+            }
+            s_uSink = uHash;
+        };
+        return Kernel;
+    }
+
+    // The <vertices> list of an XML model, 3 values per element.
+    static KernelRun ParseVectorString(uint32_t uElements)
+    {
+        std::shared_ptr<std::string> pText(new std::string(MakeNumberList(uElements * 3)));
+
+        KernelRun Kernel;
+        Kernel.uElements = (uint64_t)uElements * 3;
+        Kernel.uBytes = pText->size();
+        Kernel.Run = [pText]()
+        {
+            std::vector<glm::vec3> Vectors;
+            ::ParseVectorString(pText->c_str(), &Vectors);
+            s_uSink = (uint32_t)Vectors.size();
+        };
+        return Kernel;
+    }
+
+    // The same list through the number parser of tinyobj, as the OBJ importer reads the "v" lines.
+    static KernelRun ParseReal(uint32_t uElements)
+    {
+        std::shared_ptr<std::string> pText(new std::string(MakeNumberList(uElements * 3)));
+        uint32_t uValues = uElements * 3;
+
+        KernelRun Kernel;
+        Kernel.uElements = uValues;
+        Kernel.uBytes = pText->size();
+        Kernel.Run = [pText, uValues]()
+        {
+            const char * pToken = pText->c_str();
+            float fSum = 0.0f;
+            for (uint32_t i = 0; i < uValues; ++i)
+            {
+                fSum += (float)tinyobj::parseReal(&pToken);
+            }
+            s_fSink = fSum;
+        };
+        return Kernel;
+    }
+
+    // The influences of a skin, one to six per vertex, added bone after bone as GatherBoneWeights does.
+    static KernelRun AddBoneData(uint32_t uElements)
+    {
+        struct Influence
+        {
+            uint32_t uVertex;
+            uint32_t uBone;
+            float fWeight;
+        };
+        std::vector<Influence> Influences;
+        std::mt19937 Random(uElements);
+        uint32_t uBones = 64;
+        for (uint32_t uVertex = 0; uVertex < uElements; ++uVertex)
+        {
+            uint32_t uCount = 1 + Random() % 6;
+            for (uint32_t i = 0; i < uCount; ++i)
+            {
+                Influence Added = { uVertex, (uVertex / 256 + i * 7) % uBones, RandomFloat(Random) };
+                Influences.push_back(Added);
+            }
+        }
+        std::stable_sort(Influences.begin(), Influences.end(), [](const Influence &Left, const Influence &Right) { return Left.uBone < Right.uBone; });
+        std::shared_ptr< std::vector<Influence> > pInfluences(new std::vector<Influence>(Influences));
+        std::shared_ptr< std::vector<VertexBoneData> > pBones(new std::vector<VertexBoneData>(uElements));
+
+        KernelRun Kernel;
+        Kernel.uElements = Influences.size();
+        Kernel.uBytes = Influences.size() * sizeof(Influence);
+        Kernel.Run = [pInfluences, pBones]()
+        {
+            std::vector<VertexBoneData> &Bones = *pBones;
+            for (size_t i = 0; i < Bones.size(); ++i)
+            {
+                Bones[i].Reset();
+            }
+            const std::vector<Influence> &Input = *pInfluences;
+            for (size_t i = 0; i < Input.size(); ++i)
+            {
+                Bones[Input[i].uVertex].AddBoneData(Input[i].uBone, Input[i].fWeight);
+            }
+            s_fSink = Bones[0].SortedData[0].Weight;
+        };
+        return Kernel;
+    }
+
+private:
+
+    // uElements values written with WRITE_VALUE into chunks of uChunkValues, each in a vector of its own as the
+    // exporters do. bReserve sizes the vector up front, the reference for what the growth costs.
+    static KernelRun WriteValues(uint32_t uElements, uint32_t uChunkValues, bool bReserve)
+    {
+        uint32_t uNodes = std::max<uint32_t>(uElements / uNodeValues, 1);
+        uint32_t uChunkNodes = std::max<uint32_t>(uChunkValues / uNodeValues, 1);
+
+        KernelRun Kernel;
+        Kernel.uElements = (uint64_t)uNodes * uNodeValues;
+        Kernel.uBytes = (uint64_t)uNodes * 116;
+        Kernel.Run = [uNodes, uChunkNodes, bReserve]()
+        {
+            uint32_t uTotal = 0;
+            for (uint32_t uFirst = 0; uFirst < uNodes; uFirst += uChunkNodes)
+            {
+                uint32_t uEnd = std::min(uFirst + uChunkNodes, uNodes);
+                std::vector<uint8_t> Data;
+                if (bReserve)
+                {
+                    Data.reserve((uEnd - uFirst) * 116);
+                }
+                for (uint32_t uNode = uFirst; uNode < uEnd; ++uNode)
+                {
+                    uTotal += WriteNodeValues(Data, uNode);
+                }
+                uTotal += Data[0];
+            }
+            s_uSink = uTotal;
+        };
+        return Kernel;
+    }
+
+    // EncodeAssimpVertices over a mesh with positions, normals, tangents, uvs and four influences per
+    // vertex, into the vertex layout Type.
+    static KernelRun EncodeVertices(uint32_t uElements, VertexDataType Type)
+    {
+        std::shared_ptr<aiMesh> pMesh(new aiMesh());
+        std::shared_ptr< std::vector<VertexBoneData> > pBones(new std::vector<VertexBoneData>());
+        std::mt19937 Random(uElements);
+
+        pMesh->mNumVertices = uElements;
+        pMesh->mVertices = new aiVector3D[uElements];
+        pMesh->mNormals = new aiVector3D[uElements];
+        pMesh->mTangents = new aiVector3D[uElements];
+        pMesh->mBitangents = new aiVector3D[uElements];
+        pMesh->mTextureCoords[0] = new aiVector3D[uElements];
+        pMesh->mNumUVComponents[0] = 2;
+        for (uint32_t i = 0; i < uElements; ++i)
+        {
+            pMesh->mVertices[i] = aiVector3D(RandomFloat(Random), RandomFloat(Random), RandomFloat(Random)) * 100.0f;
+            pMesh->mNormals[i] = aiVector3D(RandomFloat(Random) - 0.5f, 1.0f, RandomFloat(Random) - 0.5f).Normalize();
+            pMesh->mTangents[i] = aiVector3D(1.0f, RandomFloat(Random) - 0.5f, 0.0f).Normalize();
+            pMesh->mBitangents[i] = pMesh->mNormals[i] ^ pMesh->mTangents[i];
+            pMesh->mTextureCoords[0][i] = aiVector3D(RandomFloat(Random), RandomFloat(Random), 0.0f);
+        }
+
+        if (Type != VertexDataType_Normals)
+        {
+            // Only its presence counts, the influences come from Bones.
+            pMesh->mNumBones = 1;
+            pMesh->mBones = new aiBone*[1];
+            pMesh->mBones[0] = new aiBone();
+            pBones->resize(uElements);
+            for (uint32_t i = 0; i < uElements; ++i)
+            {
+                for (uint32_t uInfluence = 0; uInfluence < NUM_BONES_PER_VERTEX; ++uInfluence)
+                {
+                    (*pBones)[i].AddBoneData(Random() % 64, RandomFloat(Random));
+                }
+            }
+        }
+
+        size_t uVertexSize = Type == VertexDataType_Normals ? sizeof(VertexDataWithNormals) :
+            Type == VertexDataType_Bones ? sizeof(VertexDataWithBones) : sizeof(VertexDataWithSkinU8);
+        std::shared_ptr< std::vector<uint8_t> > pTarget(new std::vector<uint8_t>(uVertexSize * uElements));
+
+        KernelRun Kernel;
+        Kernel.uElements = uElements;
+        Kernel.uBytes = pTarget->size();
+        Kernel.Run = [pMesh, pBones, Type, pTarget]()
+        {
+            BonePartitioning Unpartitioned;
+            float bmin[3], bmax[3];
+            EncodeAssimpVertices(&(*pTarget)[0], pMesh.get(), Type, *pBones, Unpartitioned, true, bmin, bmax);
+            s_fSink = bmin[0] + bmax[0];
+        };
+        return Kernel;
+    }
+
+    // uValues numbers as the exporters of XML and OBJ files print them, separated by single spaces.
+    static std::string MakeNumberList(uint32_t uValues)
+    {
+        std::mt19937 Random(uValues);
+        std::string sText;
+        sText.reserve(uValues * 10);
+        for (uint32_t i = 0; i < uValues; ++i)
+        {
+            char Number[32];
+            snprintf(Number, sizeof(Number), i ? " %.6g" : "%.6g", RandomFloat(Random) * 200.0f - 100.0f);
+            sText += Number;
+        }
+        return sText;
+    }
+};
+
+static const KernelEntry s_Kernels[] =
+{
+    { "write_value_small_chunks", &CKernelBench::WriteValueSmallChunks, "WRITE_VALUE into a new vector every 32 values, as for node and model chunks" },
+    { "write_value_large_chunk", &CKernelBench::WriteValueLargeChunk, "WRITE_VALUE into one vector growing to all values" },
+    { "write_value_reserved", &CKernelBench::WriteValueReserved, "WRITE_VALUE into one vector reserved up front, the reference for the growth" },
+    { "encode_vertices_normals", &CKernelBench::EncodeNormals, "EncodeAssimpVertices into VertexDataWithNormals" },
+    { "encode_vertices_bones", &CKernelBench::EncodeBones, "EncodeAssimpVertices into VertexDataWithBones" },
+    { "encode_vertices_skin_u8", &CKernelBench::EncodeSkinU8, "EncodeAssimpVertices into VertexDataWithSkinU8" },
+    { "bounding_box", &CKernelBench::BoundingBox, "Min and max of the positions, as in the packing loops" },
+    { "make_hash_from_name", &CKernelBench::MakeHashFromName, "CFileExportSTUFormat::MakeHashFromName over chunk and node names" },
+    { "parse_vector_string", &CKernelBench::ParseVectorString, "ParseVectorString of the XML importer over a list of numbers" },
+    { "tinyobj_parse_real", &CKernelBench::ParseReal, "tinyobj::parseReal over the same list" },
+    { "add_bone_data", &CKernelBench::AddBoneData, "VertexBoneData::AddBoneData, influences added bone after bone" },
+};
+
+static void RunKernel(const KernelEntry &Entry, const MicroBenchOptions &Bench, CPerfCounters * pCounters)
+{
+    KernelRun Kernel = Entry.Factory(Bench.uElements);
+
+    // Once untimed: pages in the output and warms the caches and the branch predictors.
+    Kernel.Run();
+
+    std::vector<uint64_t> Times;
+    uint64_t uMinTicks = 0;
+    uint64_t Counts[CPerfCounters::Counter_Count] = { 0 };
+    uint64_t uStartNs = CTimer::GetTimeNs();
+    while (Times.size() < Bench.uMinRepetitions || CTimer::GetTimeNs() - uStartNs < Bench.uMinTimeMs * 1000000ull)
+    {
+        if (pCounters)
+        {
+            pCounters->Start();
+        }
+        uint64_t uTicks = ReadTimestampCounter();
+        uint64_t uTimeNs = CTimer::GetTimeNs();
+        Kernel.Run();
+        uTimeNs = CTimer::GetTimeNs() - uTimeNs;
+        uTicks = ReadTimestampCounter() - uTicks;
+        if (pCounters)
+        {
+            pCounters->Stop(Counts);
+        }
+
+        if (Times.empty() || uTimeNs < *std::min_element(Times.begin(), Times.end()))
+        {
+            uMinTicks = uTicks;
+        }
+        Times.push_back(uTimeNs);
+    }
+
+    std::sort(Times.begin(), Times.end());
+    double fElements = (double)std::max<uint64_t>(Kernel.uElements, 1);
+    double fRepetitions = (double)Times.size();
+
+    // Core cycles from perf_event, averaged over the repetitions, else the time stamp counter of the fastest one.
+    const char * pCycleSource = "none";
+    double fCycles = 0.0;
+    if (pCounters && Counts[CPerfCounters::Counter_Cycles] > 0)
+    {
+        pCycleSource = "perf";
+        fCycles = Counts[CPerfCounters::Counter_Cycles] / fRepetitions;
+    }
+    else if (uMinTicks > 0)
+    {
+        pCycleSource = "tsc";
+        fCycles = (double)uMinTicks;
+    }
+
+    printf("{\"kernel\":\"%s\",\"elements\":%llu,\"bytes\":%llu,\"repetitions\":%u,\"ns_per_element\":%.4f,\"ns_per_element_median\":%.4f,"
+        "\"cycles_per_element\":%.4f,\"bytes_per_cycle\":%.4f,\"cycle_source\":\"%s\"",
+        Entry.pName, (unsigned long long)Kernel.uElements, (unsigned long long)Kernel.uBytes, (uint32_t)Times.size(), Times.front() / fElements,
+        Times[Times.size() / 2] / fElements, fCycles / fElements, fCycles > 0.0 ? Kernel.uBytes / fCycles : 0.0, pCycleSource);
+    if (pCounters)
+    {
+        printf(",\"cache_misses_per_element\":%.6f,\"branch_misses_per_element\":%.6f",
+            Counts[CPerfCounters::Counter_CacheMisses] / fRepetitions / fElements, Counts[CPerfCounters::Counter_BranchMisses] / fRepetitions / fElements);
+    }
+    printf("}\n");
+    fflush(stdout);
+}
+
+static void PrintInfo()
+{
+    fprintf(stderr, "\n3DConvertMicroBench times the hot loops of the converters on synthetic input.\n");
+    fprintf(stderr, "\n    Usage: 3DConvertMicroBench -n Elements -t Milliseconds -k Filter -p -l");
+    fprintf(stderr, "\n    -n  Vertices (or values, influences) per kernel (default 1048576)");
+    fprintf(stderr, "\n    -t  Minimum time per kernel in ms, repetitions are added until it is reached (default 200)");
+    fprintf(stderr, "\n    -k  Only run the kernels whose name contains this");
+    fprintf(stderr, "\n    -p  Also count cycles, cache misses and branch misses with perf_event (Linux)");
+    fprintf(stderr, "\n    -l  List the kernels");
+    fprintf(stderr, "\n\n    Prints one JSON line per kernel on stdout: ns per element (fastest and median repetition),");
+    fprintf(stderr, "\n    cycles per element and bytes per cycle.\n\n");
+}
+
+int main(int argc, char **argv)
+{
+    MicroBenchOptions Bench;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (argv[i][0] != '-' || argv[i][1] == 0)
+        {
+            PrintInfo();
+            return 1;
+        }
+        char Option = argv[i][1];
+        if (Option == 'p' || Option == 'l')
+        {
+            Bench.bPerfCounters = Bench.bPerfCounters || Option == 'p';
+            Bench.bList = Bench.bList || Option == 'l';
+            continue;
+        }
+        if (!strchr("ntk", Option) || i + 1 >= argc)
+        {
+            PrintInfo();
+            return 1;
+        }
+        const char * pArgument = argv[++i];
+        switch (Option)
+        {
+        case 'n':
+            Bench.uElements = (uint32_t)std::max(atoi(pArgument), 1);
+            break;
+        case 't':
+            Bench.uMinTimeMs = (uint32_t)std::max(atoi(pArgument), 0);
+            break;
+        default:
+            Bench.sFilter = pArgument;
+            break;
+        }
+    }
+
+    uint32_t uKernels = (uint32_t)(sizeof(s_Kernels) / sizeof(s_Kernels[0]));
+    if (Bench.bList)
+    {
+        for (uint32_t i = 0; i < uKernels; ++i)
+        {
+            printf("%-28s %s\n", s_Kernels[i].pName, s_Kernels[i].pDescription);
+        }
+        return 0;
+    }
+
+    // The converters log while they are set up, that must not mix with the results.
+    CLog::SetOutput(stderr);
+
+    CPerfCounters Counters;
+    if (Bench.bPerfCounters && !Counters.Open())
+    {
+        fprintf(stderr, "perf_event is not available, timing without hardware counters.\n");
+    }
+
+    for (uint32_t i = 0; i < uKernels; ++i)
+    {
+        if (std::string(s_Kernels[i].pName).find(Bench.sFilter) != std::string::npos)
+        {
+            RunKernel(s_Kernels[i], Bench, Counters.IsOpen() ? &Counters : YI_NULL);
+        }
+    }
+    CLog::Flush();
+    return 0;
+}
@@ -0,0 +1,238 @@
+#include "C3DConverter.h"
+#include "C3DModelAssimp.h"
+#include "C3DModelFBX.h"
+#include "C3DModelOBJ.h"
+#include "C3DModelOutOfCore.h"
+#include "CImporterRegistry.h"
+#include "CLog.h"
+#include "CTimer.h"
+
+#include <fstream>
+#include <algorithm>
+
+#define LOG_INFO(...) STU_LOG_INFO("C3DConverter", __VA_ARGS__)
+
+template <typename ModelType>
+static void ApplyOutputOptions(ModelType &Model, const ConversionOptions &Options, COutputSink * pSink)
+{
+    Model.SetMappedOutput(Options.bMappedOutput);
+    Model.SetAsyncOutput(Options.bAsyncOutput);
+    Model.SetOutputSink(pSink);
+}
+
+// Assimp and the FBX SDK converters share the animation and skinning switches.
+template <typename ModelType>
+static void ApplyOptions(ModelType &Model, const ConversionOptions &Options, COutputSink * pSink)
+{
+    ApplyOutputOptions(Model, Options, pSink);
+    Model.SetCompactSkinning(Options.bCompactSkinning);
+    Model.SetAnimationCompression(Options.bCompressAnimations);
+    Model.SetAnimationResampling(Options.bResampleAnimations);
+    Model.SetBakedPalettes(Options.bBakePalettes, 30.0f, Options.bQuantizePalettes);
+    Model.SetBonePartitioning(Options.uMaxPaletteBones > 0, Options.uMaxPaletteBones);
+    Model.SetMorphTargets(Options.bMorphTargets);
+    Model.SetLowMemoryExport(Options.bLowMemory);
+    Model.SetParallelExport(Options.bParallelExport, Options.uParallelMinVertices);
+}
+
+// Capabilities the options need from the importer itself. Skinning, animation and morph switches are not
+// listed, they only matter for models that have such data and importers without support just export none.
+static uint32_t GetRequiredCapabilities(const ConversionOptions &Options)
+{
+    std::string sProfile = Options.sPostProcessProfile;
+    std::transform(sProfile.begin(), sProfile.end(), sProfile.begin(), ::tolower);
+    bool bPostProcessing = !Options.sPostProcessOverrides.empty() || sProfile != "quality";
+    uint32_t uCapabilities = bPostProcessing ? ImporterCapability_PostProcessing : ImporterCapability_None;
+    return Options.bOutOfCore ? uCapabilities | ImporterCapability_BoundedMemory : uCapabilities;
+}
+
+static uint64_t GetFileSize(const std::string &path)
+{
+    std::ifstream File(path.c_str(), std::ios::binary | std::ios::ate);
+    return File ? (uint64_t)File.tellg() : 0;
+}
+
+static void FinishResult(ConversionResult &Result, bool bSuccess, const std::string &sName, const std::string &sError, COutputSink * pSink, uint64_t uSinkStart, uint64_t uStartuS)
+{
+    Result.bSuccess = bSuccess;
+    Result.uTimeuS = CTimer::GetTimeuS() - uStartuS;
+
+    // The messages of the conversion come out before whatever the caller prints about it.
+    CLog::Flush();
+    if (!bSuccess)
+    {
+        Result.sError = "Could not convert '" + sName + "' with the " + Result.sImporter + " importer.";
+        if (!sError.empty())
+        {
+            Result.sError += " " + sError;
+        }
+        return;
+    }
+    Result.uOutputBytes = pSink ? pSink->GetSize() - uSinkStart : GetFileSize(sName + ".stu");
+}
+
+C3DConversionContext::C3DConversionContext() :
+    m_pFBX(YI_NULL),
+    m_pOBJ(YI_NULL),
+    m_pAssimp(YI_NULL),
+    m_pOutOfCore(YI_NULL)
+{
+}
+
+C3DConversionContext::~C3DConversionContext()
+{
+    delete m_pFBX;
+    delete m_pOBJ;
+    delete m_pAssimp;
+    delete m_pOutOfCore;
+}
+
+ConversionResult C3DConversionContext::Convert(const std::string &path, const ConversionOptions &Options, COutputSink * pSink)
+{
+    ConversionResult Result;
+    uint64_t uStartuS = CTimer::GetTimeuS();
+    uint64_t uSinkStart = pSink ? pSink->GetSize() : 0;
+    bool bSuccess = false;
+    std::string sError;
+    std::vector<std::string> OutputFiles;
+
+    ModelFormat Format = CImporterRegistry::DetectFormat(path);
+    ImporterType Importer = SelectImporter(path, Options);
+    Result.sImporter = CImporterRegistry::GetImporterName(Importer);
+    LOG_INFO("Using %s importer for %s model.\n", Result.sImporter.c_str(), CImporterRegistry::GetFormatName(Format));
+
+    if (Importer == ImporterType_FBXSDK)
+    {
+        if (!m_pFBX)
+        {
+            m_pFBX = new C3DModelFBX();
+        }
+        ApplyOptions(*m_pFBX, Options, pSink);
+        bSuccess = m_pFBX->ExportToSTUFormat(path, Options.bFlipUV);
+        sError = m_pFBX->GetLastError();
+        m_pFBX->Reset();
+    }
+    else if (Importer == ImporterType_OBJ)
+    {
+        if (!m_pOBJ)
+        {
+            m_pOBJ = new C3DModelOBJ();
+        }
+        ApplyOutputOptions(*m_pOBJ, Options, pSink);
+        bSuccess = m_pOBJ->ExportToSTUFormat(path, Options.bFlipUV);
+        sError = m_pOBJ->GetLastError();
+        m_pOBJ->Reset();
+    }
+    else if (Importer == ImporterType_OutOfCore)
+    {
+        if (!m_pOutOfCore)
+        {
+            m_pOutOfCore = new C3DModelOutOfCore();
+        }
+        ApplyOutputOptions(*m_pOutOfCore, Options, pSink);
+        m_pOutOfCore->SetMemoryBudget(Options.uOutOfCoreMemory);
+        m_pOutOfCore->SetTempDirectory(Options.sTempDirectory);
+        bSuccess = m_pOutOfCore->ExportToSTUFormat(path, Options.bFlipUV);
+        sError = m_pOutOfCore->GetLastError();
+        OutputFiles = m_pOutOfCore->GetOutputFiles();
+        m_pOutOfCore->Reset();
+    }
+    else
+    {
+        if (!m_pAssimp)
+        {
+            m_pAssimp = new C3DModelAssimp();
+        }
+        ApplyOptions(*m_pAssimp, Options, pSink);
+        m_pAssimp->SetPostProcessing(Options.sPostProcessProfile, Options.sPostProcessOverrides);
+        m_pAssimp->SetPostProcessStepTimings(Options.bPostProcessStepTimings);
+        bSuccess = m_pAssimp->ExportToSTUFormat(path, Options.bFlipUV);
+        sError = m_pAssimp->GetLastError();
+        Result.PostProcessTimings = m_pAssimp->GetPostProcessTimings();
+        m_pAssimp->Reset();
+    }
+
+    FinishResult(Result, bSuccess, path, sError, pSink, uSinkStart, uStartuS);
+    if (bSuccess && !pSink && OutputFiles.size() > 1)
+    {
+        // Models past the 4GB limit of a .stu continue in numbered files.
+        for (size_t i = 1; i < OutputFiles.size(); i++)
+        {
+            Result.uOutputBytes += GetFileSize(OutputFiles[i]);
+        }
+    }
+    return Result;
+}
+
+ConversionResult C3DConversionContext::Convert(const std::vector<SourceFile> &Files, const ConversionOptions &Options, COutputSink * pSink)
+{
+    ConversionResult Result;
+    uint64_t uStartuS = CTimer::GetTimeuS();
+    uint64_t uSinkStart = pSink ? pSink->GetSize() : 0;
+
+    if (Files.empty() || !Files[0].pData || Files[0].uSize == 0)
+    {
+        Result.sImporter = CImporterRegistry::GetImporterName(ImporterType_Assimp);
+        Result.sError = "No model data given.";
+        return Result;
+    }
+
+    // Only Assimp reads from memory today, the registry still picks so a faster memory reader is used once added.
+    ModelFormat Format = CImporterRegistry::DetectFormat(Files[0].pData, Files[0].uSize, Files[0].sName);
+    ImporterType Importer = CImporterRegistry::SelectImporter(Format, GetRequiredCapabilities(Options) | ImporterCapability_MemorySource);
+    Result.sImporter = CImporterRegistry::GetImporterName(Importer);
+    LOG_INFO("Using %s importer for %s model.\n", Result.sImporter.c_str(), CImporterRegistry::GetFormatName(Format));
+
+    if (!m_pAssimp)
+    {
+        m_pAssimp = new C3DModelAssimp();
+    }
+    ApplyOptions(*m_pAssimp, Options, pSink);
+    m_pAssimp->SetPostProcessing(Options.sPostProcessProfile, Options.sPostProcessOverrides);
+    m_pAssimp->SetPostProcessStepTimings(Options.bPostProcessStepTimings);
+    m_pAssimp->SetSourceData(Files[0].pData, Files[0].uSize);
+    for (size_t i = 1; i < Files.size(); i++)
+    {
+        m_pAssimp->AddSourceFile(Files[i].sName, Files[i].pData, Files[i].uSize);
+    }
+    bool bSuccess = m_pAssimp->ExportToSTUFormat(Files[0].sName, Options.bFlipUV);
+    std::string sError = m_pAssimp->GetLastError();
+    Result.PostProcessTimings = m_pAssimp->GetPostProcessTimings();
+    m_pAssimp->Reset();
+
+    FinishResult(Result, bSuccess, Files[0].sName, sError, pSink, uSinkStart, uStartuS);
+    return Result;
+}
+
+ImporterType C3DConversionContext::SelectImporter(const std::string &path, const ConversionOptions &Options)
+{
+    if (Options.bForceAssimp)
+    {
+        return ImporterType_Assimp;
+    }
+    ImporterType Importer = CImporterRegistry::SelectImporter(CImporterRegistry::DetectFormat(path), GetRequiredCapabilities(Options));
+    if (Importer == ImporterType_OutOfCore && !C3DModelOutOfCore::CanRead(path))
+    {
+        // ASCII PLY shares the format with binary PLY but is only read in memory.
+        Importer = ImporterType_Assimp;
+    }
+    return Importer;
+}
+
+ConversionResult C3DConverter::Convert(const std::string &path, const ConversionOptions &Options, COutputSink * pSink)
+{
+    C3DConversionContext Context;
+    return Context.Convert(path, Options, pSink);
+}
+
+ConversionResult C3DConverter::Convert(const void * pData, size_t uSize, const std::string &sName, const ConversionOptions &Options, COutputSink * pSink)
+{
+    SourceFile File = { sName, pData, uSize };
+    return Convert(std::vector<SourceFile>(1, File), Options, pSink);
+}
+
+ConversionResult C3DConverter::Convert(const std::vector<SourceFile> &Files, const ConversionOptions &Options, COutputSink * pSink)
+{
+    C3DConversionContext Context;
+    return Context.Convert(Files, Options, pSink);
+}
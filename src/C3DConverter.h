@@ -0,0 +1,137 @@
+#ifndef _YES_3D_CONVERTER
+#define _YES_3D_CONVERTER
+
+#include "CFileExportSTUFormat.h"
+#include "CAssimpPostProcess.h"
+#include "CImporterRegistry.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/* Options of a single conversion, the same switches as the 3DConvert command line */
+struct ConversionOptions
+{
+    bool bFlipUV;
+    bool bForceAssimp;              // use Assimp even where the FBX SDK or the OBJ importer would be picked
+    bool bMappedOutput;             // only used when writing a .stu file
+    bool bAsyncOutput;
+    bool bCompactSkinning;
+    bool bCompressAnimations;
+    bool bResampleAnimations;
+    bool bBakePalettes;
+    bool bQuantizePalettes;
+    uint32_t uMaxPaletteBones;      // 0 disables bone partitioning
+    bool bMorphTargets;
+    bool bLowMemory;                // Assimp and FBX SDK: free mesh data as soon as it is written
+    bool bParallelExport;           // Assimp: encode the scene tree as tasks on the shared CTaskScheduler; FBX SDK: skin weights only
+    uint32_t uParallelMinVertices;  // smallest mesh (or weight range) that gets a task of its own
+    bool bOutOfCore;                // OBJ, PLY and STL: bounded-memory conversion through temp files, see C3DModelOutOfCore
+    uint64_t uOutOfCoreMemory;      // memory budget of the out-of-core conversion in bytes
+    std::string sTempDirectory;     // temp files of the out-of-core conversion, next to the model when empty
+    std::string sPostProcessProfile;    // Assimp only: "fast", "balanced" or "quality"
+    std::string sPostProcessOverrides;  // Assimp only: "+Step,-Step", see CAssimpPostProcess
+    bool bPostProcessStepTimings;       // Assimp only: apply and time the post-processing steps one by one
+
+    ConversionOptions() :
+        bFlipUV(true),
+        bForceAssimp(false),
+        bMappedOutput(false),
+        bAsyncOutput(false),
+        bCompactSkinning(false),
+        bCompressAnimations(false),
+        bResampleAnimations(false),
+        bBakePalettes(false),
+        bQuantizePalettes(false),
+        uMaxPaletteBones(0),
+        bMorphTargets(false),
+        bLowMemory(false),
+        bParallelExport(false),
+        uParallelMinVertices(4096),
+        bOutOfCore(false),
+        uOutOfCoreMemory(512ull * 1024 * 1024),
+        sPostProcessProfile("quality"),
+        bPostProcessStepTimings(false)
+    {
+    }
+};
+
+/* A model, or a file it references, held in memory */
+struct SourceFile
+{
+    std::string sName;
+    const void * pData;             // not copied, must outlive the conversion
+    size_t uSize;
+};
+
+/* Outcome of a single conversion */
+struct ConversionResult
+{
+    bool bSuccess;
+    std::string sImporter;          // "Assimp", "FBX SDK", "OBJ" or "Out-of-core"
+    std::string sError;             // empty on success
+    uint64_t uOutputBytes;          // bytes written to the sink or the .stu file(s)
+    uint64_t uTimeuS;               // wall time of import and export
+    std::vector<PostProcessStepTiming> PostProcessTimings;  // Assimp only: import and every post-processing step
+
+    ConversionResult() :
+        bSuccess(false),
+        uOutputBytes(0),
+        uTimeuS(0)
+    {
+    }
+};
+
+class C3DModelFBX;
+class C3DModelOBJ;
+class C3DModelAssimp;
+class C3DModelOutOfCore;
+
+/* Converters kept from one conversion to the next, for batch workers that convert many models in a row. Each
+   importer is created on first use and only reset between models, so its setup (the Assimp importer and its
+   IO plugins, the FBX converter) is paid once per worker instead of once per model. Not thread safe, use one
+   context per worker thread. */
+class C3DConversionContext
+{
+public:
+    C3DConversionContext();
+    ~C3DConversionContext();
+
+    /* Same as C3DConverter::Convert, reusing this context's importers */
+    ConversionResult Convert(const std::string &path, const ConversionOptions &Options, COutputSink * pSink = YI_NULL);
+
+    /* Same as C3DConverter::Convert for memory sources, reusing this context's importers */
+    ConversionResult Convert(const std::vector<SourceFile> &Files, const ConversionOptions &Options, COutputSink * pSink = YI_NULL);
+
+    /* Importer Convert would use for the model at path */
+    static ImporterType SelectImporter(const std::string &path, const ConversionOptions &Options);
+
+private:
+    C3DConversionContext(const C3DConversionContext &);
+    C3DConversionContext &operator=(const C3DConversionContext &);
+
+    C3DModelFBX * m_pFBX;
+    C3DModelOBJ * m_pOBJ;
+    C3DModelAssimp * m_pAssimp;
+    C3DModelOutOfCore * m_pOutOfCore;
+};
+
+/* In-process entry point to the converters, for tools and services that convert many models without spawning
+   a process per model. Every call sets up its own importers, batches should keep a C3DConversionContext instead. */
+class C3DConverter
+{
+public:
+
+    /* Convert the model at path into pSink (not owned), or into path + ".stu" when pSink is YI_NULL */
+    static ConversionResult Convert(const std::string &path, const ConversionOptions &Options, COutputSink * pSink = YI_NULL);
+
+    /* Convert uSize bytes of model data at pData. sName names the model and its extension gives the format.
+       Memory sources are always read with Assimp, the FBX SDK and OBJ importers only read files. */
+    static ConversionResult Convert(const void * pData, size_t uSize, const std::string &sName, const ConversionOptions &Options, COutputSink * pSink = YI_NULL);
+
+    /* Convert the model Files[0] from memory. The other files are served to the importer when the model references
+       them (material libraries, textures, external buffers); references not found among them are read from disk. */
+    static ConversionResult Convert(const std::vector<SourceFile> &Files, const ConversionOptions &Options, COutputSink * pSink = YI_NULL);
+};
+
+#endif // _YES_3D_CONVERTER
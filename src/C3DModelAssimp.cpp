@@ -1,4 +1,5 @@
 #include "C3DModelAssimp.h"
+#include "CLog.h"
 
 #include <assimp/postprocess.h>
 #include <assimp/scene.h>
@@ -12,15 +13,20 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <climits>
+#include <mutex>
 
-#define STU_EXPORT_SEQUENTIAL 1 //When enabled we write to the file at each model (much better memory usage, but may be slightly slower)
+#include "CParallelFor.h"
+#include "CTaskScheduler.h"
+#include "CAssimpIOSystem.h"
+#include "CExportKernels.h"
+#include "CAssimpPostProcess.h"
+#include "CTimer.h"
 
-#define WRITE_VALUE(x)          Data.insert(Data.end(), (uint8_t *)&(x), (uint8_t *)&(x) + sizeof(x)); uSize += sizeof(x);
-#define WRITE_VALUES(x, c)      Data.insert(Data.end(), (uint8_t *)&(x), (uint8_t *)&(x) + sizeof(x) * (c)); uSize += sizeof(x) * (c);
-#define WRITE_BYTES(x, y, c)    Data.insert(Data.end(), (uint8_t *)(x), (uint8_t *)(x) + sizeof(y) * (c)); uSize += sizeof(y) * (c);
+#define STU_EXPORT_SEQUENTIAL 1 //When enabled we write to the file at each model (much better memory usage, but may be slightly slower)
 
-#define LOG_ERROR(...) printf("C3DModelAssimp:"); printf(__VA_ARGS__);
-#define LOG_INFO(...) printf("C3DModelAssimp:"); printf(__VA_ARGS__);
+#define LOG_ERROR(...) STU_LOG_ERROR("C3DModelAssimp", __VA_ARGS__)
+#define LOG_INFO(...) STU_LOG_INFO("C3DModelAssimp", __VA_ARGS__)
+#define LOG_DEBUG(...) STU_LOG_DEBUG("C3DModelAssimp", __VA_ARGS__)
 
 static const std::string LOG_TAG("C3DModelAssimp");
 
@@ -50,10 +56,94 @@ glm::mat4 CopyMatrix3x3AssimpToGL(aiMatrix3x3 m)
 
 C3DModelAssimp::C3DModelAssimp()
     : m_pAIScene(YI_NULL),
+    m_pOwnedScene(YI_NULL),
+    m_bLowMemory(false),
+    m_bParallelExport(false),
+    m_uParallelMinVertices(4096),
     m_bFlipUVonY(false),
+    m_bMappedOutput(false),
+    m_bAsyncOutput(false),
+    m_pOutputSink(YI_NULL),
+    m_pSourceData(YI_NULL),
+    m_uSourceSize(0),
+    m_sPostProcessProfile("quality"),
+    m_bPostProcessStepTimings(false),
+    m_bCompactSkinning(false),
+    m_bCompressAnimations(false),
+    m_bResampleAnimations(false),
+    m_fResampleFrameRate(30.0f),
+    m_bBakePalettes(false),
+    m_bQuantizePalettes(false),
+    m_fPaletteFrameRate(30.0f),
+    m_bPartitionBones(false),
+    m_uMaxPaletteBones(MAX_BONES),
+    m_bExportMorphTargets(false),
+    m_fMorphTolerance(0.00001f),
     m_uNumBones(0),
+    m_VertexDataType(VertexDataType_Simple),
     m_bHasAnimations(false)
 {
+    m_uUniqueNodeID = 0;
+    m_uUniqueMeshID = 0;
+    InitializeLogger();
+}
+
+C3DModelAssimp::~C3DModelAssimp()
+{
+    delete m_pOwnedScene;
+}
+
+void C3DModelAssimp::Reset()
+{
+    m_importer.FreeScene();
+    delete m_pOwnedScene;
+    m_pOwnedScene = YI_NULL;
+    m_pAIScene = YI_NULL;
+    m_MeshReferences.clear();
+    m_TotalMeshCount = 0;
+    m_uSubModelCount = 0;
+    m_uSubModelVertexCount = 0;
+    m_uUniqueNodeID = 0;
+    m_uUniqueMeshID = 0;
+    m_Entries.clear();
+    m_Export.Reset();
+    m_sSTUPath.clear();
+    m_sLastError.clear();
+    m_pSourceData = YI_NULL;
+    m_uSourceSize = 0;
+    m_SourceFiles.clear();
+    m_PostProcessTimings.clear();
+    m_NodeExports.clear();
+    m_MeshExports.clear();
+    m_MorphMeshExports.clear();
+    m_Nodes.clear();
+    m_BoneMapping.clear();
+    m_uNumBones = 0;
+    m_BoneInfo.clear();
+    mAnimations.clear();
+    m_VertexDataType = VertexDataType_Simple;
+    m_bHasAnimations = false;
+}
+
+// The Assimp logger is a process-wide singleton, it is created by the first converter and kept until exit
+// instead of reopening the log file for every model.
+static std::mutex gLoggerMutex;
+static bool gbLoggerCreated = false;
+
+static void KillLogger()
+{
+    Assimp::DefaultLogger::kill();
+}
+
+void C3DModelAssimp::InitializeLogger()
+{
+    std::lock_guard<std::mutex> Lock(gLoggerMutex);
+    if (gbLoggerCreated)
+    {
+        return;
+    }
+    gbLoggerCreated = true;
+
     // Change this line to normal if you not want to analyse the import process
     //Assimp::Logger::LogSeverity severity = Assimp::Logger::NORMAL;
     Assimp::Logger::LogSeverity severity = Assimp::Logger::VERBOSE;
@@ -66,12 +156,7 @@ C3DModelAssimp::C3DModelAssimp()
 
     // Now I am ready for logging my stuff
     Assimp::DefaultLogger::get()->info("this is my info-call");
-}
-
-C3DModelAssimp::~C3DModelAssimp()
-{
-    // Kill it after the work is done
-    Assimp::DefaultLogger::kill();
+    atexit(KillLogger);
 }
 
 bool C3DModelAssimp::ImportAssimp(const std::string &path, bool bFlipUV)
@@ -79,7 +164,12 @@ bool C3DModelAssimp::ImportAssimp(const std::string &path, bool bFlipUV)
     LOG_INFO("Attempting to load '%s' 3D model.", path.c_str());
 
     // TODO we support Texture UVCords transforms, we might be able to get rid of aiProcess_TransformUVCoords at a later time...
-    uint32_t uFlags = aiProcessPreset_TargetRealtime_Quality | aiProcess_TransformUVCoords;
+    uint32_t uFlags = 0;
+    if (!CAssimpPostProcess::GetProfileFlags(m_sPostProcessProfile, uFlags))
+    {
+        m_sLastError = "Unknown post-processing profile '" + m_sPostProcessProfile + "'.";
+        return false;
+    }
 
     if (CFileExportSTUFormat::EndsWithIgnoreCase(path, ".x"))
     {
@@ -98,13 +188,45 @@ bool C3DModelAssimp::ImportAssimp(const std::string &path, bool bFlipUV)
     {
         uFlags = aiProcess_SplitLargeMeshes;
     }
+
+    // Explicit step overrides win over the profile and the format defaults.
+    if (!CAssimpPostProcess::ApplyOverrides(m_sPostProcessOverrides, uFlags))
+    {
+        m_sLastError = "Invalid post-processing overrides '" + m_sPostProcessOverrides + "'.";
+        return false;
+    }
     m_importer.SetPropertyInteger(AI_CONFIG_PP_SLM_TRIANGLE_LIMIT, USHRT_MAX - 1);
     m_importer.SetPropertyInteger(AI_CONFIG_PP_SLM_VERTEX_LIMIT, USHRT_MAX - 1);
-    const aiScene* pLayout = m_importer.ReadFile(path, uFlags);
+
+    // Files are mapped rather than read through stdio, memory sources are served by the same layer so their
+    // external references resolve like those of a file on disk. The importer owns the IO system.
+    CAssimpIOSystem * pIOSystem = new CAssimpIOSystem();
+    if (m_pSourceData)
+    {
+        pIOSystem->AddMemoryFile(path, m_pSourceData, m_uSourceSize);
+    }
+    for (size_t i = 0; i < m_SourceFiles.size(); i++)
+    {
+        pIOSystem->AddMemoryFile(m_SourceFiles[i].sName, m_SourceFiles[i].pData, m_SourceFiles[i].uSize);
+    }
+    m_importer.SetIOHandler(pIOSystem);
+
+    // Import without post-processing, so the import and the steps are timed apart.
+    m_PostProcessTimings.clear();
+    uint64_t uStartuS = CTimer::GetTimeuS();
+    const aiScene* pLayout = m_importer.ReadFile(path, 0);
+    PostProcessStepTiming ImportTiming = { "Import", CTimer::GetTimeuS() - uStartuS };
+    m_PostProcessTimings.push_back(ImportTiming);
+
+    if (pLayout)
+    {
+        pLayout = CAssimpPostProcess::Apply(m_importer, uFlags, m_bPostProcessStepTimings, m_PostProcessTimings);
+    }
 
     if (!pLayout)
     {
         LOG_ERROR("Could not load '%s' model: %s", path.c_str(), m_importer.GetErrorString());
+        m_sLastError = m_importer.GetErrorString();
         return false;
     }
 
@@ -131,12 +253,15 @@ bool C3DModelAssimp::ExportToSTUFormat(const std::string &path, bool bFlipUV)
 
     m_sSTUPath = path;
     m_sSTUPath.append(".stu");
-    std::remove(m_sSTUPath.c_str());
+    if (!m_pOutputSink)
+    {
+        std::remove(m_sSTUPath.c_str());
+    }
 
     m_bFlipUVonY = bFlipUV;
     m_Entries.clear();
-    m_Bones.clear();
     m_TotalMeshCount = 0;
+    m_sLastError.clear();
 
     if (!ImportAssimp(path, bFlipUV))
     {
@@ -145,9 +270,30 @@ bool C3DModelAssimp::ExportToSTUFormat(const std::string &path, bool bFlipUV)
 
     if (m_pAIScene->mNumMeshes == 0)
     {
+        m_sLastError = "The model has no meshes.";
         return false;
     }
 
+    // Low-memory mode owns the scene so its meshes can be emptied once exported. A mesh can be shared by
+    // several nodes, so it is only released after the last node using it.
+    if (m_bLowMemory)
+    {
+        m_pOwnedScene = m_importer.GetOrphanedScene();
+        m_pAIScene = m_pOwnedScene;
+        m_MeshReferences.assign(m_pAIScene->mNumMeshes, 0);
+        std::vector<const aiNode *> Nodes(1, m_pAIScene->mRootNode);
+        while (!Nodes.empty())
+        {
+            const aiNode *pNode = Nodes.back();
+            Nodes.pop_back();
+            for (uint32_t i = 0; i < pNode->mNumMeshes; ++i)
+            {
+                m_MeshReferences[pNode->mMeshes[i]]++;
+            }
+            Nodes.insert(Nodes.end(), pNode->mChildren, pNode->mChildren + pNode->mNumChildren);
+        }
+    }
+
     m_Entries.resize(m_pAIScene->mNumMeshes);
 
     // Count the number of vertices to allocate for possible bones.
@@ -160,26 +306,78 @@ bool C3DModelAssimp::ExportToSTUFormat(const std::string &path, bool bFlipUV)
             bHasBones = true;
         }
     }
-    if (bHasBones)
+    if (m_pOutputSink)
     {
-        m_Bones.resize(NumVertices);
+        if (!m_Export.BeginStream(m_pOutputSink, m_bAsyncOutput))
+        {
+            return false;
+        }
+    }
+    else if (m_bMappedOutput)
+    {
+        if (!m_Export.BeginMappedFile(m_sSTUPath, ComputeExportSize()))
+        {
+            return false;
+        }
+    }
+    else if (m_bAsyncOutput)
+    {
+        if (!m_Export.BeginStream(m_sSTUPath, true))
+        {
+            return false;
+        }
     }
 
     if (m_pAIScene->HasAnimations())
     {
         m_VertexDataType = VertexDataType_Bones;
         m_bHasAnimations = true;
+        if (m_bResampleAnimations)
+        {
+            ExportResampledAnimations();
+        }
         ExportAnimations();
     }
 
     ExportTextures();
-    ExportSceneTree();
+    if (m_bLowMemory)
+    {
+        ReleaseTextures();
+    }
+    if (!ExportSceneTree())
+    {
+        return false;
+    }
+
+    // The weight tracks address the mesh names the scene tree assigned.
+    if (m_bHasAnimations && m_bExportMorphTargets)
+    {
+        ExportMorphAnimations();
+    }
 
-    m_Bones.resize(0);    //No longer required
-    m_Bones.clear();
     if (bHasBones)
     {
+        ParseNodeHierarchy();
         ExportBones();
+        ExportSkeleton();
+        if (m_bBakePalettes && m_bHasAnimations)
+        {
+            ExportBonePalettes();
+        }
+    }
+
+    // Sequential export stores each chunk as soon as it is made, without looking back at the result.
+    if (m_Export.HasAppendFailed())
+    {
+        return false;
+    }
+    if (m_Export.IsMapped())
+    {
+        return m_Export.EndMappedFile();
+    }
+    if (m_Export.IsStreaming())
+    {
+        return m_Export.EndStream();
     }
 
 #if !STU_EXPORT_SEQUENTIAL
@@ -189,12 +387,134 @@ bool C3DModelAssimp::ExportToSTUFormat(const std::string &path, bool bFlipUV)
     return true;
 }
 
+void C3DModelAssimp::ParseAnimations()
+{
+    mAnimations.clear();
+    mAnimations.resize(m_pAIScene->mNumAnimations);
+
+    for (uint32_t i = 0; i < m_pAIScene->mNumAnimations; i++)
+    {
+        const aiAnimation *pLayoutAnimation = m_pAIScene->mAnimations[i];
+        Animation &animation = mAnimations[i];
+        animation.mName = pLayoutAnimation->mName.C_Str();
+        animation.mTicksPerSecond = pLayoutAnimation->mTicksPerSecond;
+        animation.mDuration = pLayoutAnimation->mDuration;
+
+        animation.mChannels.resize(pLayoutAnimation->mNumChannels);
+        for (uint32_t j = 0; j < pLayoutAnimation->mNumChannels; j++)
+        {
+            const aiNodeAnim *pLayoutChannel = pLayoutAnimation->mChannels[j];
+            NodeAnim &channel = animation.mChannels[j];
+            channel.mNodeName = pLayoutChannel->mNodeName.C_Str();
+            channel.mNodeHash = CFileExportSTUFormat::MakeHashFromName(channel.mNodeName);
+            channel.mPreState = (AnimBehaviour)pLayoutChannel->mPreState;
+            channel.mPostState = (AnimBehaviour)pLayoutChannel->mPostState;
+
+            channel.mPositionKeys.resize(pLayoutChannel->mNumPositionKeys);
+            for (uint32_t k = 0; k < pLayoutChannel->mNumPositionKeys; k++)
+            {
+                const aiVectorKey &key = pLayoutChannel->mPositionKeys[k];
+                channel.mPositionKeys[k].mTime = key.mTime;
+                channel.mPositionKeys[k].mValue = glm::vec3(key.mValue.x, key.mValue.y, key.mValue.z);
+            }
+            channel.mRotationKeys.resize(pLayoutChannel->mNumRotationKeys);
+            for (uint32_t k = 0; k < pLayoutChannel->mNumRotationKeys; k++)
+            {
+                const aiQuatKey &key = pLayoutChannel->mRotationKeys[k];
+                channel.mRotationKeys[k].mTime = key.mTime;
+                channel.mRotationKeys[k].mValue = glm::quat(key.mValue.w, key.mValue.x, key.mValue.y, key.mValue.z);
+            }
+            channel.mScalingKeys.resize(pLayoutChannel->mNumScalingKeys);
+            for (uint32_t k = 0; k < pLayoutChannel->mNumScalingKeys; k++)
+            {
+                const aiVectorKey &key = pLayoutChannel->mScalingKeys[k];
+                channel.mScalingKeys[k].mTime = key.mTime;
+                channel.mScalingKeys[k].mValue = glm::vec3(key.mValue.x, key.mValue.y, key.mValue.z);
+            }
+        }
+
+        animation.mMeshChannels.resize(pLayoutAnimation->mNumMeshChannels);
+        for (uint32_t j = 0; j < pLayoutAnimation->mNumMeshChannels; j++)
+        {
+            const aiMeshAnim *pLayoutChannel = pLayoutAnimation->mMeshChannels[j];
+            MeshAnim &channel = animation.mMeshChannels[j];
+            channel.mName = pLayoutChannel->mName.C_Str();
+            channel.mNumKeys = pLayoutChannel->mNumKeys;
+            channel.mKeys.resize(pLayoutChannel->mNumKeys);
+            for (uint32_t k = 0; k < pLayoutChannel->mNumKeys; k++)
+            {
+                channel.mKeys[k].mTime = pLayoutChannel->mKeys[k].mTime;
+                channel.mKeys[k].mValue = pLayoutChannel->mKeys[k].mValue;
+            }
+        }
+    }
+}
+
+void C3DModelAssimp::ParseMorphAnimations()
+{
+    // A mesh channel selects every mesh of its name, and each key selects one anim mesh of those. As weight curves
+    // that is 1 for the selected target and 0 for the others, held until the next key. The tracks address the
+    // exported names, which stay unique when names repeat or a mesh is instanced by several nodes.
+    for (size_t i = 0; i < mAnimations.size(); i++)
+    {
+        Animation &animation = mAnimations[i];
+        animation.mMorphChannels.clear();
+        for (size_t j = 0; j < animation.mMeshChannels.size(); j++)
+        {
+            const MeshAnim &channel = animation.mMeshChannels[j];
+            for (size_t m = 0; m < m_MorphMeshExports.size(); m++)
+            {
+                const MorphMeshExport &Mesh = m_MorphMeshExports[m];
+                if (Mesh.sSourceName != channel.mName)
+                {
+                    continue;
+                }
+                for (uint32_t t = 0; t < Mesh.uNumTargets; t++)
+                {
+                    MorphWeightAnim weights;
+                    weights.mMeshName = Mesh.sName;
+                    weights.mTarget = t;
+                    weights.mInterpolation = MorphInterpolation_STEP;
+                    weights.mKeys.resize(channel.mKeys.size());
+                    for (size_t k = 0; k < channel.mKeys.size(); k++)
+                    {
+                        weights.mKeys[k].mTime = channel.mKeys[k].mTime;
+                        weights.mKeys[k].mValue = channel.mKeys[k].mValue == t ? 1.0f : 0.0f;
+                    }
+                    animation.mMorphChannels.push_back(weights);
+                }
+            }
+        }
+    }
+}
+
 void C3DModelAssimp::ExportAnimations()
 {
     uint32_t uSize = 0;
     uint8_t bytes[128] = { 0 };
     std::vector< uint8_t > Data;
 
+    if (m_bCompressAnimations)
+    {
+        if (mAnimations.empty())
+        {
+            ParseAnimations();
+        }
+        // Reduce a copy; the resampled and baked exports still sample the original keys.
+        std::vector<Animation> Reduced = mAnimations;
+        for (size_t i = 0; i < Reduced.size(); i++)
+        {
+            CAnimationTools::ReduceKeys(Reduced[i], m_AnimationCompression);
+        }
+        uSize = CAnimationTools::WriteCompressedAnimations(Reduced, m_AnimationCompression, Data);
+#if STU_EXPORT_SEQUENTIAL
+        m_Export.AppendChunkToFile(m_sSTUPath, "AnimationsQ", &Data.at(0), uSize);
+#else
+        m_Export.WriteChunk("AnimationsQ", std::move(Data));
+#endif
+        return;
+    }
+
     WRITE_VALUE(m_pAIScene->mNumAnimations);
 
     for (uint32_t i = 0; i < m_pAIScene->mNumAnimations; i++)
@@ -262,7 +582,173 @@ void C3DModelAssimp::ExportAnimations()
 #if STU_EXPORT_SEQUENTIAL
     m_Export.AppendChunkToFile(m_sSTUPath, "Animations", &Data.at(0), uSize);
 #else
-    m_Export.WriteChunk("Animations", &Data.at(0), uSize);
+    m_Export.WriteChunk("Animations", std::move(Data));
+#endif
+}
+
+void C3DModelAssimp::ExportResampledAnimations()
+{
+    uint32_t uSize = 0;
+    std::vector< uint8_t > Data;
+
+    if (mAnimations.empty())
+    {
+        ParseAnimations();
+    }
+    uSize = CAnimationTools::WriteResampledAnimations(mAnimations, m_fResampleFrameRate, Data);
+
+#if STU_EXPORT_SEQUENTIAL
+    m_Export.AppendChunkToFile(m_sSTUPath, "AnimationsFR", &Data.at(0), uSize);
+#else
+    m_Export.WriteChunk("AnimationsFR", std::move(Data));
+#endif
+}
+
+void C3DModelAssimp::ParseNodeHierarchy()
+{
+    m_Nodes.clear();
+
+    // Depth first with an explicit stack; a node is always added before its children.
+    std::vector< std::pair<const aiNode *, int32_t> > Stack(1, std::make_pair((const aiNode *)m_pAIScene->mRootNode, (int32_t)-1));
+    while (!Stack.empty())
+    {
+        const aiNode *pLayoutNode = Stack.back().first;
+        int32_t nParent = Stack.back().second;
+        Stack.pop_back();
+
+        SkeletonNode node;
+        node.mName = pLayoutNode->mName.C_Str();
+        node.mNameHash = CFileExportSTUFormat::MakeHashFromName(node.mName);
+        node.mParent = nParent;
+        node.mLocalTransform = CopyMatrixAssimpToGL(pLayoutNode->mTransformation);
+        m_Nodes.push_back(node);
+
+        int32_t nIndex = (int32_t)m_Nodes.size() - 1;
+        for (uint32_t i = pLayoutNode->mNumChildren; i > 0; --i)
+        {
+            Stack.push_back(std::make_pair((const aiNode *)pLayoutNode->mChildren[i - 1], nIndex));
+        }
+    }
+}
+
+void C3DModelAssimp::ExportSkeleton()
+{
+    std::vector< uint8_t > Data;
+
+    uint32_t uSize = CAnimationTools::WriteSkeleton(m_Nodes, m_BoneMapping, m_BoneInfo, Data);
+
+#if STU_EXPORT_SEQUENTIAL
+    m_Export.AppendChunkToFile(m_sSTUPath, "Skeleton", &Data.at(0), uSize);
+#else
+    m_Export.WriteChunk("Skeleton", std::move(Data));
+#endif
+}
+
+void C3DModelAssimp::ExportBonePartitions(const std::string &sName, const BonePartitioning &Partitioning)
+{
+    std::vector< uint8_t > Data;
+
+    uint32_t uSize = CBonePartitioner::WritePartitions(Partitioning, Data);
+
+#if STU_EXPORT_SEQUENTIAL
+    m_Export.AppendChunkToFile(m_sSTUPath, sName, &Data.at(0), uSize);
+#else
+    m_Export.WriteChunk(sName, std::move(Data));
+#endif
+}
+
+void C3DModelAssimp::ExportMorphTargets(const std::string &sName, const aiMesh *pLayoutMesh, const BonePartitioning &Partitioning)
+{
+    std::vector< uint8_t > Data;
+    std::vector<MorphTarget> Targets(pLayoutMesh->mNumAnimMeshes);
+
+    // Vertices duplicated by the bone partitioning move with their source vertex.
+    std::vector<uint32_t> OutputToSource;
+    if (!Partitioning.DuplicatedVertices.empty())
+    {
+        OutputToSource.resize(pLayoutMesh->mNumVertices + Partitioning.DuplicatedVertices.size());
+        for (uint32_t vertId = 0; vertId < OutputToSource.size(); ++vertId)
+        {
+            OutputToSource[vertId] = Partitioning.GetSourceVertex(vertId, pLayoutMesh->mNumVertices);
+        }
+    }
+
+    std::vector<glm::vec3> PositionDeltas(pLayoutMesh->mNumVertices);
+    std::vector<glm::vec3> NormalDeltas;
+    for (uint32_t t = 0; t < pLayoutMesh->mNumAnimMeshes; ++t)
+    {
+        const aiAnimMesh *pAnimMesh = pLayoutMesh->mAnimMeshes[t];
+        Targets[t].mName = pLayoutMesh->mName.C_Str() + std::string(".target(") + std::to_string(t) + ")";
+        if (pAnimMesh->mNumVertices != pLayoutMesh->mNumVertices)
+        {
+            LOG_ERROR("Morph target %u of '%s' has %u vertices instead of %u, skipped.\n", t, pLayoutMesh->mName.C_Str(), pAnimMesh->mNumVertices, pLayoutMesh->mNumVertices);
+            continue;
+        }
+
+        bool bNormals = pAnimMesh->mNormals && pLayoutMesh->HasNormals();
+        NormalDeltas.resize(bNormals ? pLayoutMesh->mNumVertices : 0);
+        for (uint32_t vertId = 0; vertId < pLayoutMesh->mNumVertices; ++vertId)
+        {
+            aiVector3D Delta = pAnimMesh->mVertices ? pAnimMesh->mVertices[vertId] - pLayoutMesh->mVertices[vertId] : aiVector3D();
+            PositionDeltas[vertId] = glm::vec3(Delta.x, Delta.y, Delta.z);
+            if (bNormals)
+            {
+                Delta = pAnimMesh->mNormals[vertId] - pLayoutMesh->mNormals[vertId];
+                NormalDeltas[vertId] = glm::vec3(Delta.x, Delta.y, Delta.z);
+            }
+        }
+        CMorphTargets::MakeSparse(PositionDeltas, NormalDeltas, OutputToSource, m_fMorphTolerance, Targets[t]);
+    }
+
+    uint32_t uSize = CMorphTargets::WriteMorphTargets(Targets, Data);
+
+#if STU_EXPORT_SEQUENTIAL
+    m_Export.AppendChunkToFile(m_sSTUPath, sName, &Data.at(0), uSize);
+#else
+    m_Export.WriteChunk(sName, std::move(Data));
+#endif
+}
+
+void C3DModelAssimp::ExportMorphAnimations()
+{
+    std::vector< uint8_t > Data;
+
+    if (mAnimations.empty())
+    {
+        ParseAnimations();
+    }
+    ParseMorphAnimations();
+    if (!CMorphTargets::HasMorphAnimations(mAnimations))
+    {
+        return;
+    }
+
+    uint32_t uSize = CMorphTargets::WriteMorphAnimations(mAnimations, Data);
+
+#if STU_EXPORT_SEQUENTIAL
+    m_Export.AppendChunkToFile(m_sSTUPath, "MorphAnimations", &Data.at(0), uSize);
+#else
+    m_Export.WriteChunk("MorphAnimations", std::move(Data));
+#endif
+}
+
+void C3DModelAssimp::ExportBonePalettes()
+{
+    uint32_t uSize = 0;
+    std::vector< uint8_t > Data;
+
+    if (mAnimations.empty())
+    {
+        ParseAnimations();
+    }
+
+    glm::mat4 GlobalInverse = glm::inverse(CopyMatrixAssimpToGL(m_pAIScene->mRootNode->mTransformation));
+    uSize = CAnimationTools::WriteBonePalettes(mAnimations, m_Nodes, m_BoneMapping, m_BoneInfo, GlobalInverse, m_fPaletteFrameRate, m_bQuantizePalettes, Data);
+
+#if STU_EXPORT_SEQUENTIAL
+    m_Export.AppendChunkToFile(m_sSTUPath, "BonePalettes", &Data.at(0), uSize);
+#else
+    m_Export.WriteChunk("BonePalettes", std::move(Data));
 #endif
 }
 
@@ -296,7 +782,7 @@ void C3DModelAssimp::ExportBones()
 #if STU_EXPORT_SEQUENTIAL
     m_Export.AppendChunkToFile(m_sSTUPath, "Bones", &Data.at(0), uSize);
 #else
-    m_Export.WriteChunk("Bones", &Data.at(0), uSize);
+    m_Export.WriteChunk("Bones", std::move(Data));
 #endif
 }
 
@@ -357,40 +843,167 @@ void C3DModelAssimp::ExportTextures()
 #if STU_EXPORT_SEQUENTIAL
     m_Export.AppendChunkToFile(m_sSTUPath, "Textures", &Data.at(0), uSize);
 #else
-    m_Export.WriteChunk("Textures", &Data.at(0), uSize);
+    m_Export.WriteChunk("Textures", std::move(Data));
 #endif
 }
 
-void C3DModelAssimp::ExportSceneTree()
+void C3DModelAssimp::ReleaseMeshData(uint32_t uMesh)
+{
+    aiMesh *pMesh = m_pOwnedScene->mMeshes[uMesh];
+
+    delete[] pMesh->mVertices;
+    delete[] pMesh->mNormals;
+    delete[] pMesh->mTangents;
+    delete[] pMesh->mBitangents;
+    pMesh->mVertices = pMesh->mNormals = pMesh->mTangents = pMesh->mBitangents = YI_NULL;
+    for (uint32_t a = 0; a < AI_MAX_NUMBER_OF_TEXTURECOORDS; a++)
+    {
+        delete[] pMesh->mTextureCoords[a];
+        pMesh->mTextureCoords[a] = YI_NULL;
+    }
+    for (uint32_t a = 0; a < AI_MAX_NUMBER_OF_COLOR_SETS; a++)
+    {
+        delete[] pMesh->mColors[a];
+        pMesh->mColors[a] = YI_NULL;
+    }
+    pMesh->mNumVertices = 0;
+
+    delete[] pMesh->mFaces;
+    pMesh->mFaces = YI_NULL;
+    pMesh->mNumFaces = 0;
+
+    for (uint32_t a = 0; a < pMesh->mNumBones; a++)
+    {
+        delete pMesh->mBones[a];
+    }
+    delete[] pMesh->mBones;
+    pMesh->mBones = YI_NULL;
+    pMesh->mNumBones = 0;
+
+    for (uint32_t a = 0; a < pMesh->mNumAnimMeshes; a++)
+    {
+        delete pMesh->mAnimMeshes[a];
+    }
+    delete[] pMesh->mAnimMeshes;
+    pMesh->mAnimMeshes = YI_NULL;
+    pMesh->mNumAnimMeshes = 0;
+}
+
+void C3DModelAssimp::ReleaseTextures()
+{
+    // Meshes only refer to embedded textures by index, which stays valid in the written names.
+    for (uint32_t i = 0; i < m_pOwnedScene->mNumTextures; i++)
+    {
+        delete m_pOwnedScene->mTextures[i];
+    }
+    delete[] m_pOwnedScene->mTextures;
+    m_pOwnedScene->mTextures = YI_NULL;
+    m_pOwnedScene->mNumTextures = 0;
+}
+
+bool C3DModelAssimp::ExportSceneTree()
 {
-    uint32_t uIndex = 0;
     m_uSubModelCount = 0;
     m_uSubModelVertexCount = 0;
+    m_uUniqueNodeID = 0;
+    m_uUniqueMeshID = 0;
+    m_NodeExports.clear();
+    m_MeshExports.clear();
+    m_MorphMeshExports.clear();
+
+    // Names, bone indices, vertex layouts and chunk numbers depend on the nodes and meshes before them, so they
+    // are assigned in export order first. The rest of a mesh only depends on the mesh and can be encoded anywhere.
+    PlanSubTree(m_pAIScene->mRootNode);
+
+    // Low-memory export frees every mesh as soon as it is written, encoding ahead would hold them all.
+    bool bEncoded = m_bParallelExport && !m_bLowMemory;
+    if (bEncoded)
+    {
+        CTaskScheduler &Scheduler = CTaskScheduler::GetShared();
+        CTaskGroup Group;
+        SpawnSubTree(Scheduler, Group, 0);
+        Scheduler.Wait(Group);
+    }
+
+    ExportSubTree(0, bEncoded);
+
+    bool bResult = true;
+    for (size_t i = 0; i < m_MeshExports.size(); ++i)
+    {
+        if (m_MeshExports[i].bFailed)
+        {
+            LOG_ERROR("Mesh '%s' could not be exported, the model is incomplete.", m_MeshExports[i].sName.c_str());
+            bResult = false;
+        }
+    }
 
-    ExportSubTree(m_pAIScene->mRootNode, uIndex);
+    std::vector<NodeExport>().swap(m_NodeExports);
+    std::vector<MeshExport>().swap(m_MeshExports);
+    return bResult;
 }
 
-void C3DModelAssimp::WriteVertexChunk(std::string sName, uint32_t uCurrentMesh, const aiMesh *pLayoutMesh, VertexDataType m_VertexDataType)
+// Fills a compact skinned layout (VertexDataWithSkinU8/U16) and grows the bounding box.
+template <class VertexData>
+static void WriteCompactSkinnedVertices(VertexData *pVertices, const aiMesh *pLayoutMesh, const std::vector<VertexBoneData> &Bones, const BonePartitioning &Partitioning, bool bFlipUVonY, float bmin[3], float bmax[3])
 {
-    uint32_t uSize = 0;
-    uint8_t bytes[128] = { 0 };
-    std::vector< uint8_t > Data;
-    VertexDataWithNormals Vertex;
-    float bmin[3], bmax[3];
+    VertexBoneData Unskinned;
+    VertexData Vertex;
+
+    uint32_t uNumVertices = pLayoutMesh->mNumVertices + (uint32_t)Partitioning.DuplicatedVertices.size();
+    for (uint32_t vertId = 0; vertId < uNumVertices; ++vertId)
+    {
+        uint32_t srcId = Partitioning.GetSourceVertex(vertId, pLayoutMesh->mNumVertices);
+        Vertex.position.x = pLayoutMesh->mVertices[srcId].x;
+        Vertex.position.y = pLayoutMesh->mVertices[srcId].y;
+        Vertex.position.z = pLayoutMesh->mVertices[srcId].z;
+        bmin[0] = std::min(Vertex.position.x, bmin[0]);
+        bmin[1] = std::min(Vertex.position.y, bmin[1]);
+        bmin[2] = std::min(Vertex.position.z, bmin[2]);
+        bmax[0] = std::max(Vertex.position.x, bmax[0]);
+        bmax[1] = std::max(Vertex.position.y, bmax[1]);
+        bmax[2] = std::max(Vertex.position.z, bmax[2]);
+        glm::vec3 Normal(0.0f);
+        if (pLayoutMesh->HasNormals())
+        {
+            Normal = glm::vec3(pLayoutMesh->mNormals[srcId].x, pLayoutMesh->mNormals[srcId].y, pLayoutMesh->mNormals[srcId].z);
+        }
+        EncodeOctahedralNormal(Normal, Vertex.normal);
+        Vertex.texcoord = glm::vec2(0.0f);
+        Vertex.tangent[0] = Vertex.tangent[1] = Vertex.tangent[2] = Vertex.tangent[3] = 0;
+        if (pLayoutMesh->HasTextureCoords(0))
+        {
+            Vertex.texcoord.x = pLayoutMesh->mTextureCoords[0][srcId].x;
+            Vertex.texcoord.y = bFlipUVonY ? 1.0f - pLayoutMesh->mTextureCoords[0][srcId].y : pLayoutMesh->mTextureCoords[0][srcId].y;
+            if (pLayoutMesh->HasTangentsAndBitangents() && pLayoutMesh->HasNormals())
+            {
+                const aiVector3D& n = pLayoutMesh->mNormals[srcId];
+                const aiVector3D& t = pLayoutMesh->mTangents[srcId];
+                const aiVector3D& b = pLayoutMesh->mBitangents[srcId];
+                float handedness = (n ^ t) * b < 0.0f ? -1.0f : 1.0f;
+                EncodeTangent(glm::vec3(t.x, t.y, t.z), handedness, Vertex.tangent);
+            }
+        }
+
+        bool bSkinned = pLayoutMesh->HasBones() && vertId < Bones.size();
+        EncodeCompactSkin(bSkinned ? Bones[vertId] : Unskinned, Vertex.boneIds, Vertex.boneWeights);
+        pVertices[vertId] = Vertex;
+    }
+}
 
+void EncodeAssimpVertices(uint8_t *pTarget, const aiMesh *pLayoutMesh, VertexDataType Type, const std::vector<VertexBoneData> &Bones,
+    const BonePartitioning &Partitioning, bool bFlipUVonY, float bmin[3], float bmax[3])
+{
     bmin[0] = bmin[1] = bmin[2] = std::numeric_limits<float>::max();
     bmax[0] = bmax[1] = bmax[2] = -std::numeric_limits<float>::max();
 
-    switch (m_VertexDataType)
+    // Bone partitioning appends copies of vertices shared between partitions.
+    uint32_t uNumVertices = pLayoutMesh->mNumVertices + (uint32_t)Partitioning.DuplicatedVertices.size();
+
+    switch (Type)
     {
     case VertexDataType_Simple:
     {
-        Data.reserve(sizeof(VertexDataSimple) * pLayoutMesh->mNumVertices);
-        if (Data.capacity() < (sizeof(VertexDataSimple) * pLayoutMesh->mNumVertices))
-        {
-            LOG_ERROR("Ran out of memory while exporting vertices from '%s' model.", m_sSTUPath.c_str());
-            return;
-        }
+        VertexDataSimple * pVertices = (VertexDataSimple *)pTarget;
         VertexDataSimple Vertex;
         for (uint32_t vertId = 0; vertId < pLayoutMesh->mNumVertices; ++vertId)
         {
@@ -403,18 +1016,13 @@ void C3DModelAssimp::WriteVertexChunk(std::string sName, uint32_t uCurrentMesh,
             bmax[0] = std::max(Vertex.position.x, bmax[0]);
             bmax[1] = std::max(Vertex.position.y, bmax[1]);
             bmax[2] = std::max(Vertex.position.z, bmax[2]);
-            WRITE_VALUE(Vertex);
+            pVertices[vertId] = Vertex;
         }
         break;
     }
     case VertexDataType_Points:
     {
-        Data.reserve(sizeof(VertexDataPoints) * pLayoutMesh->mNumVertices);
-        if (Data.capacity() < (sizeof(VertexDataPoints) * pLayoutMesh->mNumVertices))
-        {
-            LOG_ERROR("Ran out of memory while exporting vertices from '%s' model.", m_sSTUPath.c_str());
-            return;
-        }
+        VertexDataPoints * pVertices = (VertexDataPoints *)pTarget;
         VertexDataPoints Vertex;
         for (uint32_t vertId = 0; vertId < pLayoutMesh->mNumVertices; ++vertId)
         {
@@ -430,18 +1038,13 @@ void C3DModelAssimp::WriteVertexChunk(std::string sName, uint32_t uCurrentMesh,
             Vertex.color.r = pLayoutMesh->mColors[0][vertId].r;
             Vertex.color.g = pLayoutMesh->mColors[0][vertId].g;
             Vertex.color.b = pLayoutMesh->mColors[0][vertId].b;
-            WRITE_VALUE(Vertex);
+            pVertices[vertId] = Vertex;
         }
         break;
-    }
-    case VertexDataType_Textured:
-    {
-        Data.reserve(sizeof(VertexDataTextured) * pLayoutMesh->mNumVertices);
-        if (Data.capacity() < (sizeof(VertexDataTextured) * pLayoutMesh->mNumVertices))
-        {
-            LOG_ERROR("Ran out of memory while exporting vertices from '%s' model.", m_sSTUPath.c_str());
-            return;
-        }
+    }
+    case VertexDataType_Textured:
+    {
+        VertexDataTextured * pVertices = (VertexDataTextured *)pTarget;
         VertexDataTextured Vertex;
         for (uint32_t vertId = 0; vertId < pLayoutMesh->mNumVertices; ++vertId)
         {
@@ -455,19 +1058,14 @@ void C3DModelAssimp::WriteVertexChunk(std::string sName, uint32_t uCurrentMesh,
             bmax[1] = std::max(Vertex.position.y, bmax[1]);
             bmax[2] = std::max(Vertex.position.z, bmax[2]);
             Vertex.texcoord.x = pLayoutMesh->mTextureCoords[0][vertId].x;
-            Vertex.texcoord.y = m_bFlipUVonY ? 1.0f - pLayoutMesh->mTextureCoords[0][vertId].y : pLayoutMesh->mTextureCoords[0][vertId].y;
-            WRITE_VALUE(Vertex);
+            Vertex.texcoord.y = bFlipUVonY ? 1.0f - pLayoutMesh->mTextureCoords[0][vertId].y : pLayoutMesh->mTextureCoords[0][vertId].y;
+            pVertices[vertId] = Vertex;
         }
         break;
     }
     case VertexDataType_Normals:
     {
-        Data.reserve(sizeof(VertexDataWithNormals) * pLayoutMesh->mNumVertices);
-        if (Data.capacity() < (sizeof(VertexDataWithNormals) * pLayoutMesh->mNumVertices))
-        {
-            LOG_ERROR("Ran out of memory while exporting vertices from '%s' model.", m_sSTUPath.c_str());
-            return;
-        }
+        VertexDataWithNormals * pVertices = (VertexDataWithNormals *)pTarget;
         VertexDataWithNormals Vertex;
         for (uint32_t vertId = 0; vertId < pLayoutMesh->mNumVertices; ++vertId)
         {
@@ -488,7 +1086,7 @@ void C3DModelAssimp::WriteVertexChunk(std::string sName, uint32_t uCurrentMesh,
                 // texture uv + packed tangent
                 glm::vec3 tc = glm::vec3(pLayoutMesh->mTextureCoords[0][vertId].x, pLayoutMesh->mTextureCoords[0][vertId].y, pLayoutMesh->mTextureCoords[0][vertId].z);
                 Vertex.texcoord.x = pLayoutMesh->mTextureCoords[0][vertId].x;
-                Vertex.texcoord.y = m_bFlipUVonY ? 1.0f - pLayoutMesh->mTextureCoords[0][vertId].y : pLayoutMesh->mTextureCoords[0][vertId].y;
+                Vertex.texcoord.y = bFlipUVonY ? 1.0f - pLayoutMesh->mTextureCoords[0][vertId].y : pLayoutMesh->mTextureCoords[0][vertId].y;
                 if (pLayoutMesh->HasTangentsAndBitangents())
                 {
                     float tx = (float)(int32_t)((pLayoutMesh->mTangents[vertId].x*0.5f + 0.5f)*255.0f);
@@ -508,26 +1106,22 @@ void C3DModelAssimp::WriteVertexChunk(std::string sName, uint32_t uCurrentMesh,
                 Vertex.texcoord.x = 0.0f;
                 Vertex.texcoord.y = 0.0f;
             }
-            WRITE_VALUE(Vertex);
+            pVertices[vertId] = Vertex;
         }
         break;
     }
 
     case VertexDataType_Bones:
     {
-        Data.reserve(sizeof(VertexDataWithBones) * pLayoutMesh->mNumVertices);
-        if (Data.capacity() < (sizeof(VertexDataWithBones) * pLayoutMesh->mNumVertices))
-        {
-            LOG_ERROR("Ran out of memory while exporting vertices from '%s' model.", m_sSTUPath.c_str());
-            return;
-        }
+        VertexDataWithBones * pVertices = (VertexDataWithBones *)pTarget;
         VertexDataWithBones Vertex;
 
-        for (uint32_t vertId = 0; vertId < pLayoutMesh->mNumVertices; ++vertId)
+        for (uint32_t vertId = 0; vertId < uNumVertices; ++vertId)
         {
-            Vertex.position.x = pLayoutMesh->mVertices[vertId].x;
-            Vertex.position.y = pLayoutMesh->mVertices[vertId].y;
-            Vertex.position.z = pLayoutMesh->mVertices[vertId].z;
+            uint32_t srcId = Partitioning.GetSourceVertex(vertId, pLayoutMesh->mNumVertices);
+            Vertex.position.x = pLayoutMesh->mVertices[srcId].x;
+            Vertex.position.y = pLayoutMesh->mVertices[srcId].y;
+            Vertex.position.z = pLayoutMesh->mVertices[srcId].z;
             bmin[0] = std::min(Vertex.position.x, bmin[0]);
             bmin[1] = std::min(Vertex.position.y, bmin[1]);
             bmin[2] = std::min(Vertex.position.z, bmin[2]);
@@ -536,9 +1130,9 @@ void C3DModelAssimp::WriteVertexChunk(std::string sName, uint32_t uCurrentMesh,
             bmax[2] = std::max(Vertex.position.z, bmax[2]);
             if (pLayoutMesh->HasNormals())
             {
-                Vertex.normal.x = pLayoutMesh->mNormals[vertId].x;
-                Vertex.normal.y = pLayoutMesh->mNormals[vertId].y;
-                Vertex.normal.z = pLayoutMesh->mNormals[vertId].z;
+                Vertex.normal.x = pLayoutMesh->mNormals[srcId].x;
+                Vertex.normal.y = pLayoutMesh->mNormals[srcId].y;
+                Vertex.normal.z = pLayoutMesh->mNormals[srcId].z;
             }
             else
             {
@@ -549,17 +1143,17 @@ void C3DModelAssimp::WriteVertexChunk(std::string sName, uint32_t uCurrentMesh,
             if (pLayoutMesh->HasTextureCoords(0))
             {
                 // texture uv + packed tangent
-                glm::vec3 tc = glm::vec3(pLayoutMesh->mTextureCoords[0][vertId].x, pLayoutMesh->mTextureCoords[0][vertId].y, pLayoutMesh->mTextureCoords[0][vertId].z);
-                Vertex.texcoord.x = pLayoutMesh->mTextureCoords[0][vertId].x;
-                Vertex.texcoord.y = m_bFlipUVonY ? 1.0f - pLayoutMesh->mTextureCoords[0][vertId].y : pLayoutMesh->mTextureCoords[0][vertId].y;
+                glm::vec3 tc = glm::vec3(pLayoutMesh->mTextureCoords[0][srcId].x, pLayoutMesh->mTextureCoords[0][srcId].y, pLayoutMesh->mTextureCoords[0][srcId].z);
+                Vertex.texcoord.x = pLayoutMesh->mTextureCoords[0][srcId].x;
+                Vertex.texcoord.y = bFlipUVonY ? 1.0f - pLayoutMesh->mTextureCoords[0][srcId].y : pLayoutMesh->mTextureCoords[0][srcId].y;
                 if (pLayoutMesh->HasTangentsAndBitangents())
                 {
-                    float tx = (float)(int32_t)((pLayoutMesh->mTangents[vertId].x*0.5f + 0.5f)*255.0f);
-                    float ty = (float)(int32_t)int((pLayoutMesh->mTangents[vertId].y*0.5f + 0.5f)*255.0f);
-                    float tz = (float)(int32_t)int((pLayoutMesh->mTangents[vertId].z*0.5f + 0.5f)*255.0f);
-                    aiVector3D& n = pLayoutMesh->mNormals[vertId];
-                    aiVector3D& t = pLayoutMesh->mTangents[vertId];
-                    aiVector3D& b = pLayoutMesh->mBitangents[vertId];
+                    float tx = (float)(int32_t)((pLayoutMesh->mTangents[srcId].x*0.5f + 0.5f)*255.0f);
+                    float ty = (float)(int32_t)int((pLayoutMesh->mTangents[srcId].y*0.5f + 0.5f)*255.0f);
+                    float tz = (float)(int32_t)int((pLayoutMesh->mTangents[srcId].z*0.5f + 0.5f)*255.0f);
+                    aiVector3D& n = pLayoutMesh->mNormals[srcId];
+                    aiVector3D& t = pLayoutMesh->mTangents[srcId];
+                    aiVector3D& b = pLayoutMesh->mBitangents[srcId];
                     float handedness = (n ^ t) * b < 0.0f ? -1.0f : 1.0f;
                     // (n ^ t) * b = dot(cross(n, t), b)
                     tc.z = (tx + ty / 256.0f + tz / 65536.0f) * handedness;
@@ -578,18 +1172,18 @@ void C3DModelAssimp::WriteVertexChunk(std::string sName, uint32_t uCurrentMesh,
             float boneWeight1 = 0;
             float boneWeight2 = 0;
             float boneWeight3 = 0;
-            if (pLayoutMesh->HasBones())
+            if (pLayoutMesh->HasBones() && vertId < Bones.size())
             {
-            uint32_t uRealVertex = vertId + m_Entries[m_TotalMeshCount + uCurrentMesh].uBaseVertex;
-                boneWeight0 = m_Bones[uRealVertex].SortedData[0].Weight;
-                boneWeight1 = m_Bones[uRealVertex].SortedData[1].Weight;
-                boneWeight2 = m_Bones[uRealVertex].SortedData[2].Weight;
-                boneWeight3 = m_Bones[uRealVertex].SortedData[3].Weight;
-
-                packedboneids1 = float(m_Bones[uRealVertex].SortedData[0].ID) +
-                    float(m_Bones[uRealVertex].SortedData[1].ID) / 256.0f;    //256 allows for up to 200+ bones matrices before clashing.
-                packedboneids2 = float(m_Bones[uRealVertex].SortedData[2].ID) +
-                    float(m_Bones[uRealVertex].SortedData[3].ID) / 256.0f;
+                uint32_t uRealVertex = vertId;
+                boneWeight0 = Bones[uRealVertex].SortedData[0].Weight;
+                boneWeight1 = Bones[uRealVertex].SortedData[1].Weight;
+                boneWeight2 = Bones[uRealVertex].SortedData[2].Weight;
+                boneWeight3 = Bones[uRealVertex].SortedData[3].Weight;
+
+                packedboneids1 = float(Bones[uRealVertex].SortedData[0].ID) +
+                    float(Bones[uRealVertex].SortedData[1].ID) / 256.0f;    //256 allows for up to 200+ bones matrices before clashing.
+                packedboneids2 = float(Bones[uRealVertex].SortedData[2].ID) +
+                    float(Bones[uRealVertex].SortedData[3].ID) / 256.0f;
             }
             Vertex.bones.x = boneWeight0;
             Vertex.bones.y = boneWeight1;
@@ -597,16 +1191,62 @@ void C3DModelAssimp::WriteVertexChunk(std::string sName, uint32_t uCurrentMesh,
             Vertex.bones.w = boneWeight3;
             Vertex.texcoord.w = packedboneids1;
             Vertex.normal.w = packedboneids2;
-            WRITE_VALUE(Vertex);
+            pVertices[vertId] = Vertex;
         }
         break;
     }
+
+    case VertexDataType_SkinU8:
+    {
+        VertexDataWithSkinU8 * pVertices = (VertexDataWithSkinU8 *)pTarget;
+        WriteCompactSkinnedVertices(pVertices, pLayoutMesh, Bones, Partitioning, bFlipUVonY, bmin, bmax);
+        break;
+    }
+
+    case VertexDataType_SkinU16:
+    {
+        VertexDataWithSkinU16 * pVertices = (VertexDataWithSkinU16 *)pTarget;
+        WriteCompactSkinnedVertices(pVertices, pLayoutMesh, Bones, Partitioning, bFlipUVonY, bmin, bmax);
+        break;
+    }
     }
+}
+
+void C3DModelAssimp::WriteVertexChunk(MeshExport &Mesh)
+{
+    uint32_t uSize = 0;
+    std::vector< uint8_t > Data;
+    float bmin[3], bmax[3];
+
+    if (!Mesh.Vertices.empty())
+    {
+        // Encoded ahead by the parallel export.
+        memcpy(bmin, Mesh.BoundsMin, sizeof(bmin));
+        memcpy(bmax, Mesh.BoundsMax, sizeof(bmax));
+        Data.swap(Mesh.Vertices);
+    }
+    else
+    {
+        uint32_t uNumVertices = Mesh.pMesh->mNumVertices + (uint32_t)Mesh.Partitioning.DuplicatedVertices.size();
+        uint8_t * pTarget = m_Export.GetChunkTarget(Mesh.sVertexChunk, GetVertexDataSize(Mesh.VertexType) * uNumVertices, Data);
+        if (!pTarget)
+        {
+            LOG_ERROR("Ran out of memory while exporting vertices from '%s' model.", m_sSTUPath.c_str());
+            Mesh.bFailed = true;
+            return;
+        }
+        EncodeAssimpVertices(pTarget, Mesh.pMesh, Mesh.VertexType, Mesh.Bones, Mesh.Partitioning, m_bFlipUVonY, bmin, bmax);
+    }
+
+    // In mapped mode the vertices were written straight into the output file, unless they were encoded ahead.
+    if (!Data.empty())
+    {
 #if STU_EXPORT_SEQUENTIAL
-    m_Export.AppendChunkToFile(m_sSTUPath, sName, &Data.at(0), (int32_t)Data.size());
+        m_Export.AppendChunkToFile(m_sSTUPath, Mesh.sVertexChunk, &Data.at(0), (int32_t)Data.size());
 #else
-    m_Export.WriteChunk(sChunkname, &Data.at(0), (int32_t)Data.size());
+        m_Export.WriteChunk(Mesh.sVertexChunk, std::move(Data));
 #endif
+    }
     std::vector< uint8_t >().swap(Data);
 
     //Write BBox chunk:
@@ -618,74 +1258,197 @@ void C3DModelAssimp::WriteVertexChunk(std::string sName, uint32_t uCurrentMesh,
     WRITE_VALUE(bmax[2]);
 
 #if STU_EXPORT_SEQUENTIAL
-    m_Export.AppendChunkToFile(m_sSTUPath, sName + "BB", &Data.at(0), (int32_t)Data.size());
+    m_Export.AppendChunkToFile(m_sSTUPath, Mesh.sVertexChunk + "BB", &Data.at(0), (int32_t)Data.size());
 #else
-    Export.WriteChunk(sName + "BB", &Data.at(0), (int32_t)Data.size());
+    m_Export.WriteChunk(Mesh.sVertexChunk + "BB", std::move(Data));
 #endif
     std::vector< uint8_t >().swap(Data);
 }
 
-void C3DModelAssimp::ExportSubTree(const aiNode* pLayoutNode, uint32_t uIndex)
+VertexDataType C3DModelAssimp::SelectVertexDataType(const aiMesh *pLayoutMesh, VertexDataType Current)
 {
-    uint32_t uSize = 0;
-    uint32_t uValue;
-    uint8_t bytes[128] = { 0 };
-    std::vector< uint8_t > Data;
+    if (pLayoutMesh->HasNormals())
+    {
+        // Once animations forced the bone layout, every mesh with normals keeps it.
+        if (Current == VertexDataType_Bones)
+        {
+            return VertexDataType_Bones;
+        }
+        if (pLayoutMesh->HasTextureCoords(0))
+        {
+            return VertexDataType_Normals;
+        }
+        else if (pLayoutMesh->HasVertexColors(0))
+        {
+            return VertexDataType_Points;
+        }
+        return VertexDataType_Simple;
+    }
 
-    std::string nodeName;
-    static uint32_t sUniqueAssimpUnknownID = 0;
-    if (strlen(pLayoutNode->mName.C_Str()) > 0)
+    if (pLayoutMesh->HasTextureCoords(0))
     {
-        nodeName = std::string("assimp.(") + pLayoutNode->mName.C_Str() + "-" + std::to_string(sUniqueAssimpUnknownID++) + ")";
+        return VertexDataType_Textured;
     }
-    else
+    else if (pLayoutMesh->HasVertexColors(0))
     {
-        nodeName = std::string("assimp.(UNKNOWN-") + std::to_string(sUniqueAssimpUnknownID++) + ")";
+        return VertexDataType_Points;
     }
-    LOG_INFO("Found node '%s'\n", nodeName.c_str());
+    return VertexDataType_Simple;
+}
 
-    aiMatrix4x4 m;
-    glm::mat4 matrix;
+// The bones of an aiMesh as the skin clusters GatherSkinWeights reads.
+struct AssimpSkin
+{
+    const aiMesh *pMesh;
+    const std::vector<uint32_t> &BoneIndices;
 
-    WRITE_VALUE(pLayoutNode->mNumChildren);
+    uint32_t GetClusterCount() const { return pMesh->mNumBones; }
+    uint32_t GetBone(uint32_t c) const { return BoneIndices[c]; }
+    uint32_t GetWeightCount(uint32_t c) const { return pMesh->mBones[c]->mNumWeights; }
+    bool GetWeight(uint32_t c, uint32_t j, uint32_t &uVertex, float &fWeight) const
+    {
+        uVertex = pMesh->mBones[c]->mWeights[j].mVertexId;
+        fWeight = pMesh->mBones[c]->mWeights[j].mWeight;
+        return true;
+    }
+};
 
-    uSize += CFileExportSTUFormat::CopyString(nodeName.c_str(), &Data);
+static void GatherBoneWeights(const aiMesh *pLayoutMesh, const std::vector<uint32_t> &BoneIndices, std::vector<VertexBoneData> &Bones)
+{
+    AssimpSkin Skin = { pLayoutMesh, BoneIndices };
+    GatherSkinWeights(Skin, Bones, 16384);
+}
 
-    uSize += CFileExportSTUFormat::CopyString(pLayoutNode->mName.C_Str(), &Data);
+uint64_t C3DModelAssimp::ComputeExportSize()
+{
+    // Sizing pass for the mapped output. Vertex and bounding box chunks are exact; the small
+    // node, animation, texture and bone chunks are estimated generously.
+    uint64_t uSize = CFileExportSTUFormat::GetFileHeaderFootprint();
 
-    // Get node transformation matrix
-    m = pLayoutNode->mTransformation;
-    matrix = CopyMatrixAssimpToGL(m);
+    if (m_pAIScene->HasAnimations())
+    {
+        uint64_t uAnimSize = sizeof(uint32_t);
+        for (uint32_t i = 0; i < m_pAIScene->mNumAnimations; i++)
+        {
+            const aiAnimation *pAnimation = m_pAIScene->mAnimations[i];
+            uAnimSize += CFileExportSTUFormat::uMaxTextLength + 1 + sizeof(double) * 2 + sizeof(uint32_t) * 2;
+            for (uint32_t j = 0; j < pAnimation->mNumChannels; j++)
+            {
+                const aiNodeAnim *pChannel = pAnimation->mChannels[j];
+                uAnimSize += CFileExportSTUFormat::uMaxTextLength + 1 + sizeof(uint32_t) * 5;
+                uAnimSize += (uint64_t)(pChannel->mNumPositionKeys + pChannel->mNumScalingKeys) * sizeof(VectorKey);
+                uAnimSize += (uint64_t)pChannel->mNumRotationKeys * sizeof(QuatKey);
+            }
+            for (uint32_t j = 0; j < pAnimation->mNumMeshChannels; j++)
+            {
+                uAnimSize += CFileExportSTUFormat::uMaxTextLength + 1 + sizeof(uint32_t);
+                uAnimSize += (uint64_t)pAnimation->mMeshChannels[j]->mNumKeys * sizeof(MeshKey);
+            }
+        }
+        uSize += sizeof(CFileExportSTUFormat::STU_HEADER) + uAnimSize;
+    }
 
-    WRITE_VALUE(matrix);
+    uint64_t uTextureSize = sizeof(uint32_t);
+    for (uint32_t i = 0; i < m_pAIScene->mNumTextures; i++)
+    {
+        const aiTexture *pTexture = m_pAIScene->mTextures[i];
+        uTextureSize += sizeof(uint32_t) * 3 + CFileExportSTUFormat::uMaxTextLength + 1;
+        uTextureSize += pTexture->mHeight == 0 ? pTexture->mWidth : (uint64_t)pTexture->mWidth * pTexture->mHeight * sizeof(aiTexel);
+    }
+    uSize += sizeof(CFileExportSTUFormat::STU_HEADER) + uTextureSize;
 
-    WRITE_VALUE(pLayoutNode->mNumMeshes);
+    uint32_t uNumBones = 0;
+    for (uint32_t i = 0; i < m_pAIScene->mNumMeshes; i++)
+    {
+        uNumBones += m_pAIScene->mMeshes[i]->mNumBones;
+    }
+    if (uNumBones > 0)
+    {
+        uSize += sizeof(CFileExportSTUFormat::STU_HEADER) + sizeof(uint32_t) * 2 + (uint64_t)uNumBones * (sizeof(uint32_t) * 2 + sizeof(BoneInfo));
+    }
+
+    VertexDataType Type = m_pAIScene->HasAnimations() ? VertexDataType_Bones : m_VertexDataType;
+    std::vector<const aiNode *> Nodes(1, m_pAIScene->mRootNode);
+    while (!Nodes.empty())
+    {
+        const aiNode *pNode = Nodes.back();
+        Nodes.pop_back();
+
+        uint64_t uNodeSize = sizeof(uint32_t) * 2 + sizeof(glm::mat4) + (CFileExportSTUFormat::uMaxTextLength + 1) * 2;
+        for (uint32_t i = 0; i < pNode->mNumMeshes; ++i)
+        {
+            const aiMesh *pMesh = m_pAIScene->mMeshes[pNode->mMeshes[i]];
+
+            // names, counts, material colors and up to two texture names
+            uNodeSize += (CFileExportSTUFormat::uMaxTextLength + 1) * 4 + sizeof(uint32_t) * 10 + sizeof(aiColor3D) * 3 + sizeof(float) * 3;
+            uNodeSize += (uint64_t)pMesh->mNumFaces * 3 * sizeof(uint16_t);
+
+            if (pMesh->mNumVertices > 0)
+            {
+                Type = SelectVertexDataType(pMesh, Type);
+                uSize += CFileExportSTUFormat::GetChunkFootprint(GetVertexDataSize(Type) * pMesh->mNumVertices);
+                uSize += CFileExportSTUFormat::GetChunkFootprint(sizeof(float) * 6);
+            }
+        }
+        uSize += CFileExportSTUFormat::GetChunkFootprint((uint32_t)uNodeSize);
+
+        for (uint32_t i = 0; i < pNode->mNumChildren; ++i)
+        {
+            Nodes.push_back(pNode->mChildren[i]);
+        }
+    }
+
+    return uSize;
+}
+
+void C3DModelAssimp::PlanSubTree(const aiNode* pLayoutNode)
+{
+    uint32_t uNode = (uint32_t)m_NodeExports.size();
+    m_NodeExports.push_back(NodeExport());
+    NodeExport &Node = m_NodeExports.back();
+    Node.pNode = pLayoutNode;
+    Node.uFirstMesh = (uint32_t)m_MeshExports.size();
+
+    if (strlen(pLayoutNode->mName.C_Str()) > 0)
+    {
+        Node.sName = std::string("assimp.(") + pLayoutNode->mName.C_Str() + "-" + std::to_string(m_uUniqueNodeID++) + ")";
+    }
+    else
+    {
+        Node.sName = std::string("assimp.(UNKNOWN-") + std::to_string(m_uUniqueNodeID++) + ")";
+    }
+    LOG_DEBUG("Found node '%s'\n", Node.sName.c_str());
 
-    // You.i engine does not support multi-mesh, so for now, let's create a child node per mesh.
     for (uint32_t i = 0; i < pLayoutNode->mNumMeshes; ++i)
     {
+        m_MeshExports.push_back(MeshExport());
+        MeshExport &Mesh = m_MeshExports.back();
         const aiMesh *pLayoutMesh = m_pAIScene->mMeshes[pLayoutNode->mMeshes[i]];
-        const aiMaterial *pLayoutMaterial = m_pAIScene->mMaterials[pLayoutMesh->mMaterialIndex];
+        Mesh.pMesh = pLayoutMesh;
+        Mesh.uMesh = pLayoutNode->mMeshes[i];
+        Mesh.bFailed = false;
 
-        std::string meshName;
-        static uint32_t sUniqueAssimpUnknownMeshID = 0;
         if (strlen(pLayoutMesh->mName.C_Str()) > 0)
         {
-            meshName = nodeName + ".mesh(" + pLayoutMesh->mName.C_Str() + "-" + std::to_string(sUniqueAssimpUnknownMeshID++) + ").id(" + std::to_string(i) + ")";
+            Mesh.sName = m_NodeExports[uNode].sName + ".mesh(" + pLayoutMesh->mName.C_Str() + "-" + std::to_string(m_uUniqueMeshID++) + ").id(" + std::to_string(i) + ")";
         }
         else
         {
-            meshName = nodeName + ".mesh(UNKNOWN-" + std::to_string(sUniqueAssimpUnknownMeshID++) + ").id(" + std::to_string(i) + ")";
+            Mesh.sName = m_NodeExports[uNode].sName + ".mesh(UNKNOWN-" + std::to_string(m_uUniqueMeshID++) + ").id(" + std::to_string(i) + ")";
         }
-        LOG_INFO("Found mesh '%s'\n", meshName.c_str());
-        std::string VBOName = meshName + ".VBO";
-        std::string IBOName = meshName + ".IBO";
+        LOG_DEBUG("Found mesh '%s'\n", Mesh.sName.c_str());
 
-        uSize += CFileExportSTUFormat::CopyString(meshName.c_str(), &Data);
-
-        uSize += CFileExportSTUFormat::CopyString(pLayoutMesh->mName.C_Str(), &Data);
+        if (m_bExportMorphTargets && pLayoutMesh->mNumVertices > 0 && pLayoutMesh->mNumAnimMeshes > 0)
+        {
+            MorphMeshExport MorphMesh;
+            MorphMesh.sSourceName = pLayoutMesh->mName.C_Str();
+            MorphMesh.sName = Mesh.sName;
+            MorphMesh.uNumTargets = pLayoutMesh->mNumAnimMeshes;
+            m_MorphMeshExports.push_back(MorphMesh);
+        }
 
-        //LoadBones
+        //LoadBones: influences are only stored for the mesh being exported, and only when it is skinned.
+        Mesh.BoneIndices.resize(pLayoutMesh->mNumBones);
         for (uint32_t k = 0; k < pLayoutMesh->mNumBones; k++)
         {
             uint32_t BoneIndex = 0;
@@ -696,7 +1459,8 @@ void C3DModelAssimp::ExportSubTree(const aiNode* pLayoutNode, uint32_t uIndex)
             {
                 BoneIndex = m_uNumBones;
                 m_uNumBones++;
-                if (m_uNumBones > MAX_BONES)
+                // Partitioned meshes only need MAX_BONES per palette, not in total.
+                if (m_uNumBones > MAX_BONES && !m_bPartitionBones)
                 {
                     LOG_ERROR("3D object Exceeded maximum bone count");
                     //m_uNumBones = MAX_BONES; //Can be capped here, or passes throuugh
@@ -711,93 +1475,234 @@ void C3DModelAssimp::ExportSubTree(const aiNode* pLayoutNode, uint32_t uIndex)
                 BoneIndex = m_BoneMapping[BoneHash];
             }
 
-            for (uint32_t j = 0; j < pLayoutMesh->mBones[k]->mNumWeights; j++)
-            {
-                uint32_t VertexID = m_Entries[m_TotalMeshCount + i].uBaseVertex + pLayoutMesh->mBones[k]->mWeights[j].mVertexId;
-                float Weight = pLayoutMesh->mBones[k]->mWeights[j].mWeight;
-                m_Bones[VertexID].AddBoneData(BoneIndex, Weight);
-            }
+            Mesh.BoneIndices[k] = BoneIndex;
         }
-        if (m_bHasAnimations)
+        Mesh.uNumBones = m_uNumBones;
+
+        Mesh.VertexType = m_VertexDataType;
+        if (pLayoutMesh->mNumVertices > 0)
         {
-            uValue = 1;
+            m_VertexDataType = SelectVertexDataType(pLayoutMesh, m_VertexDataType);
+            Mesh.VertexType = m_VertexDataType;
+            Mesh.sVertexChunk = std::string("Vx:") + std::to_string(m_uSubModelVertexCount++);
         }
-        else
+    }
+
+    for (uint32_t i = 0; i < pLayoutNode->mNumChildren; ++i)
+    {
+        PlanSubTree(pLayoutNode->mChildren[i]);
+    }
+    m_NodeExports[uNode].uSubTreeEnd = (uint32_t)m_NodeExports.size();
+}
+
+bool C3DModelAssimp::EncodeMesh(MeshExport &Mesh, CTaskScheduler *pScheduler)
+{
+    const aiMesh *pLayoutMesh = Mesh.pMesh;
+
+    if (pLayoutMesh->HasBones())
+    {
+        Mesh.Bones.assign(pLayoutMesh->mNumVertices, VertexBoneData());
+        GatherBoneWeights(pLayoutMesh, Mesh.BoneIndices, Mesh.Bones);
+    }
+
+    // Skinned triangle meshes are regrouped so every partition fits the shader palette.
+    if (m_bPartitionBones && Mesh.VertexType == VertexDataType_Bones && pLayoutMesh->HasBones() && pLayoutMesh->mPrimitiveTypes == aiPrimitiveType_TRIANGLE)
+    {
+        std::vector<uint32_t> Triangles;
+        Triangles.reserve(pLayoutMesh->mNumFaces * 3);
+        for (uint32_t faceID = 0; faceID < pLayoutMesh->mNumFaces; ++faceID)
         {
-            uValue = 0;
+            const aiFace *pFace = &pLayoutMesh->mFaces[faceID];
+            Triangles.insert(Triangles.end(), pFace->mIndices, pFace->mIndices + pFace->mNumIndices);
         }
-        WRITE_VALUE(uValue);
+        // SplitLargeMeshes only keeps the input within 16-bit indices, the copies shared between partitions can push
+        // it past them. Such a mesh is better exported whole, over the palette size, than with wrapped indices.
+        if (CBonePartitioner::Partition(Triangles, Mesh.Bones, m_uMaxPaletteBones, Mesh.Partitioning) &&
+            (uint64_t)pLayoutMesh->mNumVertices + Mesh.Partitioning.DuplicatedVertices.size() > (uint64_t)USHRT_MAX + 1)
+        {
+            LOG_ERROR("Bone partitioning of mesh '%s' needs %u vertices, more than 16-bit indices address. It is exported unpartitioned.\n",
+                Mesh.sName.c_str(), pLayoutMesh->mNumVertices + (uint32_t)Mesh.Partitioning.DuplicatedVertices.size());
+            Mesh.Partitioning.Clear();
+        }
+        if (!Mesh.Partitioning.IsEmpty())
+        {
+            Mesh.Bones.swap(Mesh.Partitioning.Bones);
+            LOG_INFO("Split mesh '%s' into %u bone partitions (%u duplicated vertices)\n", Mesh.sName.c_str(), (uint32_t)Mesh.Partitioning.Partitions.size(), (uint32_t)Mesh.Partitioning.DuplicatedVertices.size());
+        }
+    }
 
-        uValue = pLayoutMesh->mNumVertices;
-        WRITE_VALUE(uValue);
+    if (pLayoutMesh->mNumVertices > 0 && m_bCompactSkinning && Mesh.VertexType == VertexDataType_Bones)
+    {
+        // Every bone index used by this mesh had been assigned when it was planned; partitioned meshes only need palette-local IDs.
+        Mesh.VertexType = GetCompactSkinningType(Mesh.Partitioning.IsEmpty() ? Mesh.uNumBones : m_uMaxPaletteBones);
+    }
 
-        if (pLayoutMesh->mNumVertices > 0)
+    // Encoded ahead for the parallel export only, otherwise the vertices go straight into their chunk.
+    if (pScheduler && pLayoutMesh->mNumVertices > 0)
+    {
+        uint32_t uNumVertices = pLayoutMesh->mNumVertices + (uint32_t)Mesh.Partitioning.DuplicatedVertices.size();
+        Mesh.Vertices.resize(GetVertexDataSize(Mesh.VertexType) * uNumVertices);
+        EncodeAssimpVertices(&Mesh.Vertices[0], Mesh.pMesh, Mesh.VertexType, Mesh.Bones, Mesh.Partitioning, m_bFlipUVonY, Mesh.BoundsMin, Mesh.BoundsMax);
+    }
+
+    std::vector<uint16_t> &indices = Mesh.Indices;
+    if (!Mesh.Partitioning.IsEmpty())
+    {
+        indices.reserve(Mesh.Partitioning.Indices.size());
+        for (size_t indexId = 0; indexId < Mesh.Partitioning.Indices.size(); ++indexId)
         {
-            if (pLayoutMesh->HasNormals())
+            uint32_t vertId = Mesh.Partitioning.Indices[indexId];
+            if (vertId > USHRT_MAX)
             {
-                if (m_VertexDataType != VertexDataType_Bones)
-                {
-                    if (pLayoutMesh->HasTextureCoords(0))
-                    {
-                        m_VertexDataType = VertexDataType_Normals;
-                    }
-                    else if (pLayoutMesh->HasVertexColors(0))
-                    {
-                        m_VertexDataType = VertexDataType_Points;
-                    }
-                    else
-                    {
-                        m_VertexDataType = VertexDataType_Simple;
-                    }
-                }
+                LOG_ERROR("Bone partitioning pushed mesh '%s' past 16-bit indices!", Mesh.sName.c_str());
+                Mesh.bFailed = true;
+                break;
+            }
+            indices.push_back((uint16_t)vertId);
         }
-            else
+    }
+    else if (pLayoutMesh->mPrimitiveTypes != aiPrimitiveType_POINT)
+    {
+        for (uint32_t faceID = 0; faceID < pLayoutMesh->mNumFaces; ++faceID)
+        {
+            const aiFace *pFace = &pLayoutMesh->mFaces[faceID];
+            for (uint32_t indexId = 0; indexId < pFace->mNumIndices; ++indexId)
             {
-                if (pLayoutMesh->HasTextureCoords(0))
-                {
-                    m_VertexDataType = VertexDataType_Textured;
-                }
-                else if (pLayoutMesh->HasVertexColors(0))
-                {
-                    m_VertexDataType = VertexDataType_Points;
-                }
-                else
+                //SR: This "can't" exceed USHRT_MAX since we use the import flag in assimp to max out before it.
+                uint32_t vertId = pFace->mIndices[indexId];
+                if (vertId > USHRT_MAX)
                 {
-                    m_VertexDataType = VertexDataType_Simple;
+                    LOG_ERROR("Assimp failed to split large mesh '%s'!", Mesh.sName.c_str());
+                    Mesh.bFailed = true;
+                    break;
                 }
+                indices.push_back((uint16_t)vertId);
+            }
+            if (Mesh.bFailed)
+            {
+                break;
             }
-            WRITE_VALUE(m_VertexDataType);
+        }
+    }
+
+    // Wrapped indices would silently draw the wrong triangles, none are written instead.
+    if (Mesh.bFailed)
+    {
+        std::vector<uint16_t>().swap(indices);
+    }
+    return !Mesh.bFailed;
+}
+
+// A task per node: it spawns its children first, so idle workers steal whole subtrees, then encodes its own
+// meshes and hands the large ones to tasks of their own.
+void C3DModelAssimp::SpawnSubTree(CTaskScheduler &Scheduler, CTaskGroup &Group, uint32_t uNode)
+{
+    const NodeExport &Node = m_NodeExports[uNode];
+    for (uint32_t uChild = uNode + 1; uChild < Node.uSubTreeEnd; uChild = m_NodeExports[uChild].uSubTreeEnd)
+    {
+        Scheduler.Spawn(Group, [this, &Scheduler, &Group, uChild] { SpawnSubTree(Scheduler, Group, uChild); });
+    }
+    for (uint32_t i = 0; i < Node.pNode->mNumMeshes; ++i)
+    {
+        MeshExport &Mesh = m_MeshExports[Node.uFirstMesh + i];
+        if (Mesh.pMesh->mNumVertices >= m_uParallelMinVertices)
+        {
+            Scheduler.Spawn(Group, [this, &Scheduler, &Mesh] { EncodeMesh(Mesh, &Scheduler); });
+        }
+        else
+        {
+            EncodeMesh(Mesh, &Scheduler);
+        }
+    }
+}
+
+void C3DModelAssimp::ExportSubTree(uint32_t uNode, bool bEncoded)
+{
+    uint32_t uSize = 0;
+    uint32_t uValue;
+    uint8_t bytes[128] = { 0 };
+    std::vector< uint8_t > Data;
+
+    const NodeExport &Node = m_NodeExports[uNode];
+    const aiNode *pLayoutNode = Node.pNode;
+
+    aiMatrix4x4 m;
+    glm::mat4 matrix;
+
+    WRITE_VALUE(pLayoutNode->mNumChildren);
+
+    uSize += CFileExportSTUFormat::CopyString(Node.sName.c_str(), &Data);
+
+    uSize += CFileExportSTUFormat::CopyString(pLayoutNode->mName.C_Str(), &Data);
+
+    // Get node transformation matrix
+    m = pLayoutNode->mTransformation;
+    matrix = CopyMatrixAssimpToGL(m);
+
+    WRITE_VALUE(matrix);
+
+    WRITE_VALUE(pLayoutNode->mNumMeshes);
 
-            std::string sVertexChunkname = std::string("Vx:") + std::to_string(m_uSubModelVertexCount ++);
-            WriteVertexChunk(sVertexChunkname, i, pLayoutMesh, m_VertexDataType);
+    // You.i engine does not support multi-mesh, so for now, let's create a child node per mesh.
+    for (uint32_t i = 0; i < pLayoutNode->mNumMeshes; ++i)
+    {
+        MeshExport &Mesh = m_MeshExports[Node.uFirstMesh + i];
+        const aiMesh *pLayoutMesh = Mesh.pMesh;
+        const aiMaterial *pLayoutMaterial = m_pAIScene->mMaterials[pLayoutMesh->mMaterialIndex];
+
+        uSize += CFileExportSTUFormat::CopyString(Mesh.sName.c_str(), &Data);
+
+        uSize += CFileExportSTUFormat::CopyString(pLayoutMesh->mName.C_Str(), &Data);
+
+        if (!bEncoded)
+        {
+            EncodeMesh(Mesh, YI_NULL);
+        }
+
+        if (m_bHasAnimations)
+        {
+            uValue = 1;
+        }
+        else
+        {
+            uValue = 0;
         }
+        WRITE_VALUE(uValue);
 
-        std::vector<uint16_t> indices;
+        uValue = pLayoutMesh->mNumVertices + (uint32_t)Mesh.Partitioning.DuplicatedVertices.size();
+        WRITE_VALUE(uValue);
 
-        if (pLayoutMesh->mPrimitiveTypes != aiPrimitiveType_POINT)
+        if (pLayoutMesh->mNumVertices > 0)
         {
-            for (uint32_t faceID = 0; faceID < pLayoutMesh->mNumFaces; ++faceID)
+            WRITE_VALUE(Mesh.VertexType);
+
+            WriteVertexChunk(Mesh);
+            if (!Mesh.Partitioning.IsEmpty())
             {
-                const aiFace *pFace = &pLayoutMesh->mFaces[faceID];
-                for (uint32_t indexId = 0; indexId < pFace->mNumIndices; ++indexId)
-                {
-                    //SR: This "can't" exceed USHRT_MAX since we use the import flag in assimp to max out before it.
-                    uint32_t vertId = pFace->mIndices[indexId];
-                    if (vertId > USHRT_MAX)
-                    {
-                        LOG_ERROR("Assimp failed to split large mesh!");
-                    }
-                    indices.push_back((uint16_t)vertId);
-                }
+                ExportBonePartitions(Mesh.sVertexChunk + "BP", Mesh.Partitioning);
+            }
+            if (m_bExportMorphTargets && pLayoutMesh->mNumAnimMeshes > 0)
+            {
+                ExportMorphTargets(Mesh.sVertexChunk + "MT", pLayoutMesh, Mesh.Partitioning);
             }
         }
 
-        uValue = (int32_t)indices.size();
+        uValue = (int32_t)Mesh.Indices.size();
         WRITE_VALUE(uValue);
 
         if (uValue)
         {
-            WRITE_VALUES(indices[0], (int32_t)indices.size());
+            WRITE_VALUES(Mesh.Indices[0], (int32_t)Mesh.Indices.size());
+        }
+
+        // Only the primitive type and the material are read from here on.
+        std::vector<uint16_t>().swap(Mesh.Indices);
+        std::vector<uint8_t>().swap(Mesh.Vertices);
+        std::vector<VertexBoneData>().swap(Mesh.Bones);
+        Mesh.Partitioning.Clear();
+        if (m_bLowMemory && --m_MeshReferences[Mesh.uMesh] == 0)
+        {
+            ReleaseMeshData(Mesh.uMesh);
         }
 
         uValue = PrimitiveType_TRIANGLE;
@@ -939,11 +1844,11 @@ void C3DModelAssimp::ExportSubTree(const aiNode* pLayoutNode, uint32_t uIndex)
 #if STU_EXPORT_SEQUENTIAL
     m_Export.AppendChunkToFile(m_sSTUPath, sChunkname, &Data.at(0), (int32_t)Data.size());
 #else
-    m_Export.WriteChunk(sChunkname, &Data.at(0), (int32_t)Data.size());
+    m_Export.WriteChunk(sChunkname, std::move(Data));
 #endif
 
-    for (uint32_t i = 0; i < pLayoutNode->mNumChildren; ++i)
+    for (uint32_t uChild = uNode + 1; uChild < Node.uSubTreeEnd; uChild = m_NodeExports[uChild].uSubTreeEnd)
     {
-        ExportSubTree(pLayoutNode->mChildren[i], m_uSubModelCount);
+        ExportSubTree(uChild, bEncoded);
     }
 }
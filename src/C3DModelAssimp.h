@@ -3,12 +3,18 @@
 
 #include "CFileExportSTUFormat.h"
 #include "C3DModelDataStructures.h"
+#include "CAnimationTools.h"
+#include "CBonePartitioner.h"
+#include "CMorphTargets.h"
+#include "CAssimpPostProcess.h"
 
 #include "assimp/Importer.hpp"
 #include <map>
 
 struct aiNode;
 struct aiMesh;
+class CTaskScheduler;
+class CTaskGroup;
 
 class C3DModelAssimp
 {
@@ -16,19 +22,131 @@ public:
     C3DModelAssimp();
     virtual ~C3DModelAssimp();
 
+    /* Release the imported scene and everything kept from the last model, including memory sources and timings,
+       so the converter and its Assimp importer can be reused for the next model. Options are kept. */
+    void Reset();
+
     bool ExportToSTUFormat(const std::string &path);
     bool ExportToSTUFormat(const std::string &path, bool bFlipUV = true);
 
+    /* Write the .stu through a preallocated memory mapping instead of appending chunk by chunk */
+    void SetMappedOutput(bool bMapped) { m_bMappedOutput = bMapped; }
+
+    /* Hand finished chunks to a background writer thread so encoding overlaps disk I/O. Ignored in mapped mode. */
+    void SetAsyncOutput(bool bAsync) { m_bAsyncOutput = bAsync; }
+
+    /* Write the .stu into pSink (not owned) instead of a file next to the model, e.g. a memory buffer or stdout */
+    void SetOutputSink(COutputSink * pSink) { m_pOutputSink = pSink; }
+
+    /* Read the model from uSize bytes at pData (not copied, must outlive the export) instead of the file at path.
+       The path still names the model; its extension tells Assimp the format. Pass YI_NULL to read files again. */
+    void SetSourceData(const void * pData, size_t uSize) { m_pSourceData = pData; m_uSourceSize = uSize; }
+
+    /* Serve a file the model references (material library, texture, buffer) from memory instead of the disk */
+    void AddSourceFile(const std::string &sName, const void * pData, size_t uSize) { SourceFile File = { sName, pData, uSize }; m_SourceFiles.push_back(File); }
+
+    /* Export skinned meshes with integer bone indices, unorm8 weights and packed normals and tangents instead of floats */
+    void SetCompactSkinning(bool bCompact) { m_bCompactSkinning = bCompact; }
+
+    /* Reduce and quantize animation keys, written as an "AnimationsQ" chunk instead of "Animations" */
+    void SetAnimationCompression(bool bCompress, const AnimationCompressionSettings &Settings = AnimationCompressionSettings()) { m_bCompressAnimations = bCompress; m_AnimationCompression = Settings; }
+
+    /* Also write every animation sampled at a fixed rate as an "AnimationsFR" chunk */
+    void SetAnimationResampling(bool bResample, float fFrameRate = 30.0f) { m_bResampleAnimations = bResample; m_fResampleFrameRate = fFrameRate; }
+
+    /* Also write fully evaluated 3x4 skinning palettes for every animation frame as a "BonePalettes" chunk */
+    void SetBakedPalettes(bool bBake, float fFrameRate = 30.0f, bool bQuantize = false) { m_bBakePalettes = bBake; m_fPaletteFrameRate = fFrameRate; m_bQuantizePalettes = bQuantize; }
+
+    /* Split skinned meshes into partitions of at most uMaxBones bones, with palette-local vertex bone IDs and a "Vx:NBP" palette table */
+    void SetBonePartitioning(bool bPartition, uint32_t uMaxBones = MAX_BONES) { m_bPartitionBones = bPartition; m_uMaxPaletteBones = uMaxBones; }
+
+    /* Export blend shapes as sparse quantized deltas ("Vx:NMT") and their weight curves ("MorphAnimations") */
+    void SetMorphTargets(bool bExport, float fTolerance = 0.00001f) { m_bExportMorphTargets = bExport; m_fMorphTolerance = fTolerance; }
+
+    /* Take the scene over from the importer and free every mesh's vertex, face and bone arrays (and the embedded
+       textures) as soon as their chunks are written, instead of keeping the whole scene until the end */
+    void SetLowMemoryExport(bool bLowMemory) { m_bLowMemory = bLowMemory; }
+
+    /* Assimp post-processing: a profile ("fast", "balanced" or "quality") and "+Step,-Step" overrides, see CAssimpPostProcess */
+    void SetPostProcessing(const std::string &sProfile, const std::string &sOverrides = "") { m_sPostProcessProfile = sProfile; m_sPostProcessOverrides = sOverrides; }
+
+    /* Encode the meshes of the scene tree ahead of writing them, as node and mesh tasks on the shared CTaskScheduler.
+       Meshes with fewer than uMinTaskVertices vertices are encoded by the task of their node. The output is the same
+       as that of a sequential export. Ignored in low-memory mode. */
+    void SetParallelExport(bool bParallel, uint32_t uMinTaskVertices = 4096) { m_bParallelExport = bParallel; m_uParallelMinVertices = uMinTaskVertices; }
+
+    /* Apply and time the post-processing steps one by one instead of in a single pass. Slower, as every step that
+       needs one builds its own spatial sort. */
+    void SetPostProcessStepTimings(bool bPerStep) { m_bPostProcessStepTimings = bPerStep; }
+
+    /* Time of the import and of the post-processing of the last conversion, per step with SetPostProcessStepTimings */
+    const std::vector<PostProcessStepTiming> & GetPostProcessTimings() const { return m_PostProcessTimings; }
+
+    /* Why the last ExportToSTUFormat failed, as the importer reported it. Empty when it succeeded or gave no reason. */
+    const std::string & GetLastError() const { return m_sLastError; }
+
 private:
+    // A node of the scene tree, in export order (depth first, parents before children).
+    struct NodeExport
+    {
+        const aiNode * pNode;
+        std::string sName;
+        uint32_t uFirstMesh;        // in m_MeshExports
+        uint32_t uSubTreeEnd;       // first node after the subtree, the first child is the next node
+    };
+
+    // A mesh of a node. PlanSubTree fills in what depends on the meshes before it, EncodeMesh the rest.
+    struct MeshExport
+    {
+        const aiMesh * pMesh;
+        uint32_t uMesh;                     // in the scene
+        std::string sName;
+        std::vector<uint32_t> BoneIndices;  // model bone of every bone of the mesh
+        uint32_t uNumBones;                 // model bones once this mesh's were added
+        VertexDataType VertexType;
+        std::string sVertexChunk;           // "Vx:N", empty without vertices
+        std::vector<VertexBoneData> Bones;
+        BonePartitioning Partitioning;
+        std::vector<uint16_t> Indices;
+        std::vector<uint8_t> Vertices;      // parallel export: the vertex chunk, encoded ahead
+        float BoundsMin[3];
+        float BoundsMax[3];
+        bool bFailed;                       // its indices do not fit 16 bits or its vertices could not be stored, the export fails
+    };
+
+    // A mesh of a node that has morph targets, kept past the scene tree for the weight tracks that address it.
+    struct MorphMeshExport
+    {
+        std::string sSourceName;            // the aiMesh name, which mesh channels select
+        std::string sName;                  // the exported name, unique
+        uint32_t uNumTargets;
+    };
+
+    static void InitializeLogger();
 
     bool ImportAssimp(const std::string &path, bool bFlipUV = true);
     void ParseAnimations();
-    void ExportSubTree(const aiNode* pLayoutNode, uint32_t uIndex);
-    void ExportSceneTree();
+    void ParseMorphAnimations();
+    void PlanSubTree(const aiNode* pLayoutNode);
+    bool EncodeMesh(MeshExport &Mesh, CTaskScheduler *pScheduler);
+    void SpawnSubTree(CTaskScheduler &Scheduler, CTaskGroup &Group, uint32_t uNode);
+    void ExportSubTree(uint32_t uNode, bool bEncoded);
+    bool ExportSceneTree();
     void ExportBones();
     void ExportAnimations();
+    void ExportResampledAnimations();
+    void ExportSkeleton();
+    void ExportBonePalettes();
+    void ExportBonePartitions(const std::string &sName, const BonePartitioning &Partitioning);
+    void ExportMorphTargets(const std::string &sName, const aiMesh *pLayoutMesh, const BonePartitioning &Partitioning);
+    void ExportMorphAnimations();
+    void ParseNodeHierarchy();
     void ExportTextures();
-    void WriteVertexChunk(std::string sName, uint32_t uCurrentMesh, const aiMesh *pLayoutMesh, VertexDataType m_VertexDataType);
+    void ReleaseMeshData(uint32_t uMesh);
+    void ReleaseTextures();
+    void WriteVertexChunk(MeshExport &Mesh);
+    uint64_t ComputeExportSize();
+    static VertexDataType SelectVertexDataType(const aiMesh *pLayoutMesh, VertexDataType Current);
 
     struct MeshEntry {
         MeshEntry()
@@ -41,19 +159,60 @@ private:
     uint32_t m_uSubModelCount;
     uint32_t m_uSubModelVertexCount;
 
+    // Make node and mesh names unique, restarted for every model so names never depend on earlier conversions.
+    uint32_t m_uUniqueNodeID;
+    uint32_t m_uUniqueMeshID;
+
     std::vector<MeshEntry> m_Entries;
+    std::vector<NodeExport> m_NodeExports;
+    std::vector<MeshExport> m_MeshExports;
+    std::vector<MorphMeshExport> m_MorphMeshExports;
 
     Assimp::Importer m_importer;
     const aiScene * m_pAIScene;
+    aiScene * m_pOwnedScene;                // low-memory mode: the scene taken from m_importer
+    std::vector<uint32_t> m_MeshReferences; // low-memory mode: nodes still to export per mesh
+    bool m_bLowMemory;
+    bool m_bParallelExport;
+    uint32_t m_uParallelMinVertices;
 
     CFileExportSTUFormat m_Export;
     std::string m_sSTUPath;
+    std::string m_sLastError;
     bool m_bFlipUVonY;
+    bool m_bMappedOutput;
+    bool m_bAsyncOutput;
+    COutputSink * m_pOutputSink;
+    const void * m_pSourceData;
+    size_t m_uSourceSize;
+    struct SourceFile
+    {
+        std::string sName;
+        const void * pData;
+        size_t uSize;
+    };
+    std::vector<SourceFile> m_SourceFiles;
+    std::string m_sPostProcessProfile;
+    std::string m_sPostProcessOverrides;
+    bool m_bPostProcessStepTimings;
+    std::vector<PostProcessStepTiming> m_PostProcessTimings;
+    bool m_bCompactSkinning;
+    bool m_bCompressAnimations;
+    AnimationCompressionSettings m_AnimationCompression;
+    bool m_bResampleAnimations;
+    float m_fResampleFrameRate;
+    bool m_bBakePalettes;
+    bool m_bQuantizePalettes;
+    float m_fPaletteFrameRate;
+    bool m_bPartitionBones;
+    uint32_t m_uMaxPaletteBones;
+    bool m_bExportMorphTargets;
+    float m_fMorphTolerance;
+    std::vector<SkeletonNode> m_Nodes;
 
     std::map<uint32_t, uint32_t> m_BoneMapping; // maps a bone name to its index
     uint32_t m_uNumBones;
     std::vector<BoneInfo> m_BoneInfo;
-    std::vector<VertexBoneData> m_Bones;
     std::vector<Animation> mAnimations;
     VertexDataType m_VertexDataType;
     bool m_bHasAnimations;
@@ -1,10 +1,14 @@
 #ifndef _YES_3D_MODEL_DATA_STRUCTURES
 #define _YES_3D_MODEL_DATA_STRUCTURES
 
+#include "CLog.h"
+#include "CParallelFor.h"
+
 #include <string>
 #include <stdint.h>
 #include <vector>
 #include <algorithm>
+#include <cmath>
 #include <glm/glm.hpp>
 #include <glm/gtc/epsilon.hpp>
 #include <glm/gtc/matrix_access.hpp>
@@ -68,6 +72,30 @@ struct MeshAnim
     std::vector<MeshKey> mKeys;
 };
 
+struct FloatKey
+{
+    double mTime;
+    float mValue;
+};
+
+// How a morph weight curve goes from one key to the next.
+enum MorphInterpolation
+{
+    MorphInterpolation_LINEAR = 0,
+
+    // A key holds its weight until the next key
+    MorphInterpolation_STEP = 1,
+};
+
+// Weight curve of one morph target, addressed by mesh name and target index within that mesh.
+struct MorphWeightAnim
+{
+    std::string mMeshName;
+    uint32_t mTarget;
+    MorphInterpolation mInterpolation;
+    std::vector<FloatKey> mKeys;
+};
+
 struct Animation
 {
     std::string mName;
@@ -75,6 +103,16 @@ struct Animation
     double mTicksPerSecond;
     std::vector<NodeAnim> mChannels;
     std::vector<MeshAnim> mMeshChannels;
+    std::vector<MorphWeightAnim> mMorphChannels;
+};
+
+// Morph target that only keeps the vertices it moves.
+struct MorphTarget
+{
+    std::string mName;
+    std::vector<uint32_t> mIndices;         // ascending vertex indices
+    std::vector<glm::vec3> mPositionDeltas;
+    std::vector<glm::vec3> mNormalDeltas;   // empty when the target does not change normals
 };
 
 struct VertexDataSimple
@@ -109,6 +147,32 @@ struct VertexDataWithBones
     glm::vec4 bones;
 };
 
+// Compact skinned vertex: the normal octahedron encoded in two snorm16, the tangent in snorm8 with the sign of the
+// bitangent in w, integer bone indices and unorm8 weights that always sum to 255. 36 bytes instead of the 60 of
+// VertexDataWithBones.
+struct VertexDataWithSkinU8
+{
+    glm::vec3 position;
+    glm::vec2 texcoord;
+    int16_t normal[2];
+    int8_t tangent[4];
+    uint8_t boneIds[NUM_BONES_PER_VERTEX];
+    uint8_t boneWeights[NUM_BONES_PER_VERTEX];
+};
+static_assert(sizeof(VertexDataWithSkinU8) == 36, "VertexDataWithSkinU8 must stay tightly packed");
+
+// Same as VertexDataWithSkinU8, for skeletons with more than 256 bones. 40 bytes.
+struct VertexDataWithSkinU16
+{
+    glm::vec3 position;
+    glm::vec2 texcoord;
+    int16_t normal[2];
+    int8_t tangent[4];
+    uint16_t boneIds[NUM_BONES_PER_VERTEX];
+    uint8_t boneWeights[NUM_BONES_PER_VERTEX];
+};
+static_assert(sizeof(VertexDataWithSkinU16) == 40, "VertexDataWithSkinU16 must stay tightly packed");
+
 enum VertexDataType
 {
     VertexDataType_Simple,
@@ -116,8 +180,39 @@ enum VertexDataType
     VertexDataType_Textured,
     VertexDataType_Normals,
     VertexDataType_Bones,
+    VertexDataType_SkinU8,
+    VertexDataType_SkinU16,
 };
 
+// Compact skinning layout able to address uNumBones bones
+inline VertexDataType GetCompactSkinningType(uint32_t uNumBones)
+{
+    return uNumBones <= 256 ? VertexDataType_SkinU8 : VertexDataType_SkinU16;
+}
+
+// Size in bytes of one vertex of the given type, as written to the Vx: chunks
+inline uint32_t GetVertexDataSize(VertexDataType Type)
+{
+    switch (Type)
+    {
+    case VertexDataType_Simple:
+        return sizeof(VertexDataSimple);
+    case VertexDataType_Points:
+        return sizeof(VertexDataPoints);
+    case VertexDataType_Textured:
+        return sizeof(VertexDataTextured);
+    case VertexDataType_Normals:
+        return sizeof(VertexDataWithNormals);
+    case VertexDataType_Bones:
+        return sizeof(VertexDataWithBones);
+    case VertexDataType_SkinU8:
+        return sizeof(VertexDataWithSkinU8);
+    case VertexDataType_SkinU16:
+        return sizeof(VertexDataWithSkinU16);
+    }
+    return 0;
+}
+
 enum PrimitiveType
 {
     PrimitiveType_POINT = 0x1,
@@ -153,6 +248,15 @@ enum TextureType
     TextureType_UNKNOWN
 };
 
+// One node of the scene hierarchy. Node lists are kept parent-first, so mParent is always lower than the node's own index.
+struct SkeletonNode
+{
+    std::string mName;
+    uint32_t mNameHash;
+    int32_t mParent;                // -1 for roots
+    glm::mat4 mLocalTransform;      // bind pose, relative to the parent
+};
+
 struct BoneInfo
 {
     glm::mat4 BoneOffset;
@@ -165,6 +269,7 @@ struct BoneInfo
     }
 };
 
+// Top-K bone influences of a single vertex, kept inline (no heap) and sorted by descending weight.
 struct VertexBoneData
 {
     struct Data
@@ -173,56 +278,50 @@ struct VertexBoneData
         float Weight;
     };
 
-    std::vector<Data> SortedData;
+    Data SortedData[NUM_BONES_PER_VERTEX];
 
 #define YI_FBX_REPORT_DROPPED_VERTEX_BONE_DATA 0
 
     VertexBoneData::VertexBoneData()
     {
-        SortedData.reserve(NUM_BONES_PER_VERTEX * 2);
         Reset();
     }
 
     void VertexBoneData::Reset()
     {
-        SortedData.clear();
-
         Data data = { 0, 0.0f };
-        SortedData.resize(NUM_BONES_PER_VERTEX, data);
+        std::fill(SortedData, SortedData + NUM_BONES_PER_VERTEX, data);
     }
 
+    /* Inserts the influence in weight order; the lightest influence falls off the end once all slots are used. */
     void VertexBoneData::AddBoneData(uint32_t BoneID, float Weight)
     {
-        Data newData = { BoneID, Weight };
-
-        bool bInserted = false;
-        std::vector<Data>::iterator it = SortedData.begin(), end = SortedData.end();
-        while (it != end)
+        uint32_t uSlot = 0;
+        while (uSlot < NUM_BONES_PER_VERTEX && !(Weight > SortedData[uSlot].Weight))
         {
-            if (Weight > (*it).Weight)
-            {
-                SortedData.insert(it, newData);
-                bInserted = true;
-                break;
-            }
-            ++it;
+            ++uSlot;
         }
 
-        if (!bInserted)
+        if (uSlot == NUM_BONES_PER_VERTEX)
         {
-            SortedData.push_back(newData);
+#if YI_FBX_REPORT_DROPPED_VERTEX_BONE_DATA
+            STU_LOG_DEBUG("VertexBoneData", "Too many bones affect a single vertex, dropped BoneID = %3d, Weight = %f", BoneID, Weight);
+#endif
+            return;
         }
 
 #if YI_FBX_REPORT_DROPPED_VERTEX_BONE_DATA
-        if (SortedData.size() > NUM_BONES_PER_VERTEX * 2)
+        if (SortedData[NUM_BONES_PER_VERTEX - 1].Weight > 0.0f)
         {
-            YI_LOGE(LOG_TAG, "3D Model has TOO MANY VERTEX BONE DATA (%zu) affecting a single vertex", SortedData.size() - NUM_BONES_PER_VERTEX);
-            for (size_t i = 0; i < SortedData.size() - NUM_BONES_PER_VERTEX; ++i)
-            {
-                YI_LOGE(LOG_TAG, "    BoneID = %3d, Weight = %f%s", SortedData[i].ID, SortedData[i].Weight, (i >= NUM_BONES_PER_VERTEX ? " (DROPPED!)" : ""));
-            }
+            STU_LOG_DEBUG("VertexBoneData", "Too many bones affect a single vertex, dropped BoneID = %3d, Weight = %f", SortedData[NUM_BONES_PER_VERTEX - 1].ID, SortedData[NUM_BONES_PER_VERTEX - 1].Weight);
         }
 #endif
+        for (uint32_t i = NUM_BONES_PER_VERTEX - 1; i > uSlot; --i)
+        {
+            SortedData[i] = SortedData[i - 1];
+        }
+        SortedData[uSlot].ID = BoneID;
+        SortedData[uSlot].Weight = Weight;
     }
 
     static bool VertexBoneData::IsGreater(Data &a, Data &b)
@@ -231,6 +330,157 @@ struct VertexBoneData
     }
 };
 
+// Adds the weights of the skin clusters of Skin to Bones, one VertexBoneData per vertex, on the shared task pool.
+// Skin must provide GetClusterCount(), GetBone(c), GetWeightCount(c) and GetWeight(c, j, uVertex, fWeight), the
+// latter returning false for a weight to skip. The weights are first bucketed by ranges of uVerticesPerRange
+// vertices with a counting sort, so each task reads only the weights of its own vertices, needs no locking, and
+// every vertex sees its influences in the same order as a serial pass.
+template <typename SkinType>
+inline void GatherSkinWeights(const SkinType &Skin, std::vector<VertexBoneData> &Bones, uint32_t uVerticesPerRange)
+{
+    struct Influence
+    {
+        uint32_t uVertex;
+        uint32_t uBone;
+        float fWeight;
+    };
+
+    uint32_t uVertices = (uint32_t)Bones.size();
+    uVerticesPerRange = std::max<uint32_t>(uVerticesPerRange, 1);
+    uint32_t uRanges = (uVertices + uVerticesPerRange - 1) / uVerticesPerRange;
+    uint32_t uVertex = 0;
+    float fWeight = 0.0f;
+
+    if (uRanges <= 1)
+    {
+        for (uint32_t c = 0; c < Skin.GetClusterCount(); ++c)
+        {
+            for (uint32_t j = 0; j < Skin.GetWeightCount(c); ++j)
+            {
+                if (Skin.GetWeight(c, j, uVertex, fWeight) && uVertex < uVertices)
+                {
+                    Bones[uVertex].AddBoneData(Skin.GetBone(c), fWeight);
+                }
+            }
+        }
+        return;
+    }
+
+    std::vector<uint32_t> RangeStart(uRanges + 1, 0);
+    for (uint32_t c = 0; c < Skin.GetClusterCount(); ++c)
+    {
+        for (uint32_t j = 0; j < Skin.GetWeightCount(c); ++j)
+        {
+            if (Skin.GetWeight(c, j, uVertex, fWeight) && uVertex < uVertices)
+            {
+                RangeStart[uVertex / uVerticesPerRange + 1]++;
+            }
+        }
+    }
+    for (uint32_t r = 0; r < uRanges; ++r)
+    {
+        RangeStart[r + 1] += RangeStart[r];
+    }
+
+    std::vector<Influence> Influences(RangeStart[uRanges]);
+    std::vector<uint32_t> RangeNext(RangeStart.begin(), RangeStart.end() - 1);
+    for (uint32_t c = 0; c < Skin.GetClusterCount(); ++c)
+    {
+        uint32_t uBone = Skin.GetBone(c);
+        for (uint32_t j = 0; j < Skin.GetWeightCount(c); ++j)
+        {
+            if (Skin.GetWeight(c, j, uVertex, fWeight) && uVertex < uVertices)
+            {
+                Influence &Added = Influences[RangeNext[uVertex / uVerticesPerRange]++];
+                Added.uVertex = uVertex;
+                Added.uBone = uBone;
+                Added.fWeight = fWeight;
+            }
+        }
+    }
+
+    CParallelFor::Run(uRanges, 1, [&](uint32_t uBegin, uint32_t uEnd)
+    {
+        for (uint32_t i = RangeStart[uBegin]; i < RangeStart[uEnd]; ++i)
+        {
+            Bones[Influences[i].uVertex].AddBoneData(Influences[i].uBone, Influences[i].fWeight);
+        }
+    });
+}
+
+inline int16_t EncodeSnorm16(float fValue)
+{
+    return (int16_t)std::floor(std::min(std::max(fValue, -1.0f), 1.0f) * 32767.0f + 0.5f);
+}
+
+inline int8_t EncodeSnorm8(float fValue)
+{
+    return (int8_t)std::floor(std::min(std::max(fValue, -1.0f), 1.0f) * 127.0f + 0.5f);
+}
+
+// Octahedral encoding of a unit normal: projected on the octahedron |x| + |y| + |z| = 1, the lower half folded over
+// the upper one, then stored as two snorm16. A zero normal decodes to +z.
+inline void EncodeOctahedralNormal(const glm::vec3 &Normal, int16_t (&Encoded)[2])
+{
+    float fSum = std::abs(Normal.x) + std::abs(Normal.y) + std::abs(Normal.z);
+    if (!(fSum > 0.0f))
+    {
+        Encoded[0] = Encoded[1] = 0;
+        return;
+    }
+    float x = Normal.x / fSum;
+    float y = Normal.y / fSum;
+    if (Normal.z < 0.0f)
+    {
+        float fFoldedX = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        y = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = fFoldedX;
+    }
+    Encoded[0] = EncodeSnorm16(x);
+    Encoded[1] = EncodeSnorm16(y);
+}
+
+// Tangent as snorm8, fHandedness (the sign of dot(cross(n, t), b)) in w.
+inline void EncodeTangent(const glm::vec3 &Tangent, float fHandedness, int8_t (&Encoded)[4])
+{
+    Encoded[0] = EncodeSnorm8(Tangent.x);
+    Encoded[1] = EncodeSnorm8(Tangent.y);
+    Encoded[2] = EncodeSnorm8(Tangent.z);
+    Encoded[3] = fHandedness < 0.0f ? -127 : 127;
+}
+
+// Quantizes the weights of Bones to unorm8, renormalized so they sum to exactly 255. The rounding error of each
+// weight is carried into the next one so the total never drifts. A vertex without influences is bound fully to bone 0.
+template <typename IndexType>
+inline void EncodeCompactSkin(const VertexBoneData &Bones, IndexType (&BoneIds)[NUM_BONES_PER_VERTEX], uint8_t (&BoneWeights)[NUM_BONES_PER_VERTEX])
+{
+    float fTotal = 0.0f;
+    for (uint32_t i = 0; i < NUM_BONES_PER_VERTEX; ++i)
+    {
+        BoneIds[i] = (IndexType)Bones.SortedData[i].ID;
+        fTotal += std::max(Bones.SortedData[i].Weight, 0.0f);
+    }
+
+    if (!(fTotal > 0.0f))
+    {
+        std::fill(BoneWeights, BoneWeights + NUM_BONES_PER_VERTEX, (uint8_t)0);
+        BoneWeights[0] = 255;
+        return;
+    }
+
+    int32_t nRemaining = 255;
+    float fError = 0.0f;
+    for (uint32_t i = 0; i < NUM_BONES_PER_VERTEX - 1; ++i)
+    {
+        float fExact = std::max(Bones.SortedData[i].Weight, 0.0f) * 255.0f / fTotal + fError;
+        int32_t nQuantized = std::min(std::max((int32_t)(fExact + 0.5f), (int32_t)0), nRemaining);
+        fError = fExact - (float)nQuantized;
+        nRemaining -= nQuantized;
+        BoneWeights[i] = (uint8_t)nQuantized;
+    }
+    BoneWeights[NUM_BONES_PER_VERTEX - 1] = (uint8_t)nRemaining;
+}
+
 //Stu's hack for files that we don't support in formats that embed the file name. HINT: Make copies as .png first!
 class CImagePreProcess
 {
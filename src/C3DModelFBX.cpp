@@ -1,6 +1,10 @@
 #include "C3DModelFBX.h"
+#include "CLog.h"
 
 #include "FBXHelper.h"
+#include "CParallelFor.h"
+#include "CTaskScheduler.h"
+#include "CExportKernels.h"
 
 #define HAS_STB_IMAGE 0
 
@@ -10,8 +14,9 @@
 #include "../../../core/dist/src/thirdparty/stb_image.h" // to test image format that are incorrectly named.
 #endif
 
-#define LOG_ERROR(...) printf("C3DModelFBX:"); printf(__VA_ARGS__);
-#define LOG_INFO(...) printf("C3DModelFBX:"); printf(__VA_ARGS__);
+#define LOG_ERROR(...) STU_LOG_ERROR("C3DModelFBX", __VA_ARGS__)
+#define LOG_INFO(...) STU_LOG_INFO("C3DModelFBX", __VA_ARGS__)
+#define LOG_DEBUG(...) STU_LOG_DEBUG("C3DModelFBX", __VA_ARGS__)
 
 #ifdef _WIN32
     #define PATH_SEP '\\'
@@ -21,10 +26,6 @@
 
 #define STU_EXPORT_SEQUENTIAL 1 //When enabled we write to the file at each model (much better memory usage, but may be slightly slower)
 
-#define WRITE_VALUE(x)       do {Data.insert(Data.end(), (uint8_t *)&(x), (uint8_t *)&(x) + sizeof(x)); uSize += sizeof(x);} while((void)0,0)
-#define WRITE_VALUES(x, c)   do {Data.insert(Data.end(), (uint8_t *)&(x), (uint8_t *)&(x) + sizeof(x) * (c)); uSize += sizeof(x) * (c);} while((void)0,0)
-#define WRITE_BYTES(x, y, c) do {Data.insert(Data.end(), (uint8_t *)(x), (uint8_t *)(x) + sizeof(y) * (c)); uSize += sizeof(y) * (c);} while((void)0,0)
-
 static inline glm::mat4 ConvertFbxToGLM(const FbxAMatrix &m)
 {
     glm::mat4 matrix;
@@ -271,22 +272,82 @@ static inline FbxAMatrix GetGeometry(FbxNode* pNode)
     return FbxAMatrix(lT, lR, lS);
 }
 
+// Blend shape channels of a mesh across all its blend shape deformers; the index is the morph target index.
+static void GetBlendShapeChannels(FbxMesh *pMesh, std::vector<FbxBlendShapeChannel *> &Channels)
+{
+    Channels.clear();
+    int blendShapeCount = pMesh->GetDeformerCount(FbxDeformer::eBlendShape);
+    for (int blendShapeIndex = 0; blendShapeIndex < blendShapeCount; ++blendShapeIndex)
+    {
+        FbxBlendShape *pBlendShape = static_cast<FbxBlendShape *>(pMesh->GetDeformer(blendShapeIndex, FbxDeformer::eBlendShape));
+        for (int channelIndex = 0; channelIndex < pBlendShape->GetBlendShapeChannelCount(); ++channelIndex)
+        {
+            Channels.push_back(pBlendShape->GetBlendShapeChannel(channelIndex));
+        }
+    }
+}
+
 C3DModelFBX::C3DModelFBX() :
+  m_bMappedOutput(false),
+  m_bAsyncOutput(false),
+  m_pOutputSink(YI_NULL),
+  m_bCompactSkinning(false),
+  m_bCompressAnimations(false),
+  m_bResampleAnimations(false),
+  m_fResampleFrameRate(30.0f),
+  m_bBakePalettes(false),
+  m_bQuantizePalettes(false),
+  m_fPaletteFrameRate(30.0f),
+  m_bPartitionBones(false),
+  m_uMaxPaletteBones(MAX_BONES),
+  m_bExportMorphTargets(false),
+  m_fMorphTolerance(0.00001f),
   m_uNumBones(0),
+  m_VertexDataType(VertexDataType_Simple),
   m_bHasAnimations(false)
 {
+    // The SDK is prepared on the first conversion, see ExportToSTUFormat.
     m_pFBXManager = NULL;
     m_pFBXScene = NULL;
-
-    // Prepare the FBX SDK.
-    InitializeSdkObjects(m_pFBXManager, m_pFBXScene);
-
+    m_CurrentAnimLayer = NULL;
+    m_bLowMemory = false;
+    m_bParallelExport = false;
+    m_uParallelMinVertices = 4096;
+    m_uUniqueNodeID = 0;
+    m_uUniqueMeshID = 0;
 }
 
 C3DModelFBX::~C3DModelFBX()
 {
-    // Destroy all objects created by the FBX SDK.
-    DestroySdkObjects(m_pFBXManager, true);
+    FbxArrayDelete(m_AnimStackNameArray);
+}
+
+void C3DModelFBX::Reset()
+{
+    m_path.clear();
+    m_sSTUPath.clear();
+    m_sLastError.clear();
+    m_uSubModelCount = 0;
+    m_uSubModelVertexCount = 0;
+    m_uUniqueNodeID = 0;
+    m_uUniqueMeshID = 0;
+    m_Export.Reset();
+    m_Partitioning.Clear();
+    m_Nodes.clear();
+    m_BoneMapping.clear();
+    m_uNumBones = 0;
+    m_BoneInfo.clear();
+    m_Bones.clear();
+    mAnimations.clear();
+    m_MorphWeightTracks.clear();
+    m_MorphMeshExports.clear();
+    m_VertexDataType = VertexDataType_Simple;
+    m_bHasAnimations = false;
+    FbxArrayDelete(m_AnimStackNameArray);
+    m_CurrentAnimLayer = NULL;
+    m_fbxSkinMeshes.clear();
+    m_fbxSkeletons.clear();
+    m_MeshExports.clear();
 }
 
 bool C3DModelFBX::ExportToSTUFormat(const std::string &path)
@@ -295,16 +356,42 @@ bool C3DModelFBX::ExportToSTUFormat(const std::string &path)
 }
 
 bool C3DModelFBX::ExportToSTUFormat(const std::string &path, bool bFlipUV)
+{
+    // Creating the manager and loading the IO plugins is the slow part of the SDK setup, so the manager is
+    // shared by the whole process and only the scene lives as long as the conversion.
+    m_pFBXManager = GetSharedSdkManager();
+    m_sLastError.clear();
+
+    std::lock_guard<std::mutex> Lock(GetSharedSdkMutex());
+    m_pFBXScene = FbxScene::Create(m_pFBXManager, "My Scene");
+    if (!m_pFBXScene)
+    {
+        LOG_ERROR("Unable to create FBX scene!\n");
+        m_sLastError = "Unable to create FBX scene.";
+        return false;
+    }
+
+    bool bSuccess = ExportScene(path, bFlipUV);
+
+    m_pFBXScene->Destroy();
+    m_pFBXScene = NULL;
+    return bSuccess;
+}
+
+bool C3DModelFBX::ExportScene(const std::string &path, bool bFlipUV)
 {
     m_path = path;
 
     m_sSTUPath = path;
     m_sSTUPath.append(".stu");
-    std::remove(m_sSTUPath.c_str());
+    if (!m_pOutputSink)
+    {
+        std::remove(m_sSTUPath.c_str());
+    }
 
-    if (!LoadScene(m_pFBXManager, m_pFBXScene, m_path.c_str()))
+    if (!LoadScene(m_pFBXManager, m_pFBXScene, m_path.c_str(), &m_sLastError))
     {
-        LOG_ERROR("An error occurred while loading the scene...");
+        LOG_ERROR("An error occurred while loading the scene: %s", m_sLastError.c_str());
         return false;
     }
 
@@ -391,19 +478,74 @@ bool C3DModelFBX::ExportToSTUFormat(const std::string &path, bool bFlipUV)
         m_VertexDataType = VertexDataType_Bones;
     }
 
+    if (m_pOutputSink)
+    {
+        if (!m_Export.BeginStream(m_pOutputSink, m_bAsyncOutput))
+        {
+            return false;
+        }
+    }
+    else if (m_bMappedOutput)
+    {
+        if (!m_Export.BeginMappedFile(m_sSTUPath, ComputeExportSize()))
+        {
+            return false;
+        }
+    }
+    else if (m_bAsyncOutput)
+    {
+        if (!m_Export.BeginStream(m_sSTUPath, true))
+        {
+            return false;
+        }
+    }
+
     m_bHasAnimations = ParseAnimations(); // MC: TODO
 
     if (m_bHasAnimations)
     {
+        if (m_bResampleAnimations)
+        {
+            ExportResampledAnimations();
+        }
         ExportAnimations();
     }
 
     ExportTextures();
-    ExportSceneTree();
+    if (!ExportSceneTree())
+    {
+        return false;
+    }
+
+    // The weight tracks address the mesh names the scene tree assigned.
+    if (m_bHasAnimations && m_bExportMorphTargets)
+    {
+        ExportMorphAnimations();
+    }
 
     if (m_fbxSkeletons.size() > 0)
     {
+        ParseNodeHierarchy();
         ExportBones();
+        ExportSkeleton();
+        if (m_bBakePalettes && m_bHasAnimations)
+        {
+            ExportBonePalettes();
+        }
+    }
+
+    // Sequential export stores each chunk as soon as it is made, without looking back at the result.
+    if (m_Export.HasAppendFailed())
+    {
+        return false;
+    }
+    if (m_Export.IsMapped())
+    {
+        return m_Export.EndMappedFile();
+    }
+    if (m_Export.IsStreaming())
+    {
+        return m_Export.EndStream();
     }
 
 #if !STU_EXPORT_SEQUENTIAL
@@ -413,6 +555,61 @@ bool C3DModelFBX::ExportToSTUFormat(const std::string &path, bool bFlipUV)
     return true;
 }
 
+uint64_t C3DModelFBX::ComputeExportSize()
+{
+    // Sizing pass for the mapped output. Vertex and bounding box chunks are exact (the scene is
+    // already triangulated); node chunks and the animation chunk are estimated generously.
+    uint64_t uSize = CFileExportSTUFormat::GetFileHeaderFootprint();
+    uint32_t uNumClusters = 0;
+
+    std::vector<FbxNode *> Nodes(1, m_pFBXScene->GetRootNode());
+    while (!Nodes.empty())
+    {
+        FbxNode *pNode = Nodes.back();
+        Nodes.pop_back();
+
+        uint64_t uNodeSize = sizeof(uint32_t) * 2 + sizeof(glm::mat4) + (CFileExportSTUFormat::uMaxTextLength + 1) * 2;
+        for (int i = 0; i < pNode->GetNodeAttributeCount(); i++)
+        {
+            FbxNodeAttribute *attr = pNode->GetNodeAttributeByIndex(i);
+            if (attr->GetAttributeType() != FbxNodeAttribute::eMesh)
+            {
+                continue;
+            }
+            FbxMesh *pMesh = (FbxMesh*)attr;
+            if (pMesh->GetPolygonCount() == 0)
+            {
+                continue;
+            }
+
+            // Every mesh is worst-case sized with the largest vertex layout.
+            uSize += CFileExportSTUFormat::GetChunkFootprint(sizeof(VertexDataWithBones) * pMesh->GetPolygonVertexCount());
+            uSize += CFileExportSTUFormat::GetChunkFootprint(sizeof(float) * 6);
+            uNodeSize += (CFileExportSTUFormat::uMaxTextLength + 1) * 4 + sizeof(uint32_t) * 10 + sizeof(glm::vec3) * 3 + sizeof(float) * 3;
+
+            for (int skinIndex = 0; skinIndex < pMesh->GetDeformerCount(FbxDeformer::eSkin); ++skinIndex)
+            {
+                uNumClusters += static_cast<FbxSkin *>(pMesh->GetDeformer(skinIndex, FbxDeformer::eSkin))->GetClusterCount();
+            }
+        }
+        uSize += CFileExportSTUFormat::GetChunkFootprint((uint32_t)uNodeSize);
+
+        for (int i = 0; i < pNode->GetChildCount(); ++i)
+        {
+            Nodes.push_back(pNode->GetChild(i));
+        }
+    }
+
+    if (uNumClusters > 0)
+    {
+        uSize += CFileExportSTUFormat::GetChunkFootprint(sizeof(uint32_t) * 2 + uNumClusters * (sizeof(uint32_t) * 2 + sizeof(BoneInfo)));
+    }
+
+    // Animation keys are only known after ParseAnimations, which has not run yet; any
+    // shortfall is covered by growing the mapping.
+    return uSize;
+}
+
 void C3DModelFBX::ParseSkeletons()
 {
     m_fbxSkinMeshes.clear();
@@ -653,18 +850,50 @@ bool C3DModelFBX::ParseAnimationLayer(Animation &animation, FbxTime &start, FbxT
 
     }
 
-// TODO mesh animation. Example from C3DConvertAssimp:
-//    for (uint32_t j = 0; j < mAnimations[i].mNumMeshChannels; j++)
-//    {
-//        for (uint32_t k = 0; k < mAnimations[i].mMeshChannels[j]->mNumKeys; k++)
-//        {
-//            MeshKey key;
-//            key.mTime = mAnimations[i].mMeshChannels[j]->mKeys[k].mTime;
-//            key.mValue = mAnimations[i].mMeshChannels[j]->mKeys[k].mValue;
-//            Data.insert(Data.end(), (uint8_t *)&key, (uint8_t *)&key + sizeof(key));
-//            uSize += sizeof(key);
-//        }
-//    }
+    // Blend shape weights of the meshes on this node, as morph weight curves (DeformPercent is 0..100). They are
+    // addressed to the exported mesh names by ParseMorphAnimations, once the scene tree has assigned them.
+    for (int attributeId = 0; m_bExportMorphTargets && attributeId < pNode->GetNodeAttributeCount(); ++attributeId)
+    {
+        FbxNodeAttribute *pAttribute = pNode->GetNodeAttributeByIndex(attributeId);
+        if (pAttribute->GetAttributeType() != FbxNodeAttribute::eMesh)
+        {
+            continue;
+        }
+        FbxMesh *pMesh = (FbxMesh *)pAttribute;
+
+        std::vector<FbxBlendShapeChannel *> BlendShapeChannels;
+        GetBlendShapeChannels(pMesh, BlendShapeChannels);
+        for (size_t channelIndex = 0; channelIndex < BlendShapeChannels.size(); ++channelIndex)
+        {
+            FbxAnimCurve *pWeightCurve = BlendShapeChannels[channelIndex]->DeformPercent.GetCurve(pAnimLayer);
+            if (!pWeightCurve || pWeightCurve->KeyGetCount() == 0)
+            {
+                continue;
+            }
+
+            char lTimeString[256];
+            MorphWeightTrack track;
+            track.uAnimation = (uint32_t)mAnimations.size() - 1;
+            track.pMesh = pMesh;
+            MorphWeightAnim &weights = track.Weights;
+            weights.mTarget = (uint32_t)channelIndex;
+            weights.mInterpolation = MorphInterpolation_STEP;
+            weights.mKeys.resize(pWeightCurve->KeyGetCount());
+            for (int i = 0; i < pWeightCurve->KeyGetCount(); ++i)
+            {
+                weights.mKeys[i].mTime = atof(pWeightCurve->KeyGetTime(i).GetTimeString(lTimeString, 256));
+                weights.mKeys[i].mValue = pWeightCurve->KeyGetValue(i) / 100.0f;
+
+                // Cubic keys are written as linear, only curves that hold every key stay steps.
+                if (i + 1 < pWeightCurve->KeyGetCount() && pWeightCurve->KeyGetInterpolation(i) != FbxAnimCurveDef::eInterpolationConstant)
+                {
+                    weights.mInterpolation = MorphInterpolation_LINEAR;
+                }
+            }
+            m_MorphWeightTracks.push_back(track);
+            bFoundAnimation = true;
+        }
+    }
 
     for (int childNodeId = 0; childNodeId < pNode->GetChildCount(); ++childNodeId)
     {
@@ -679,6 +908,23 @@ void C3DModelFBX::ExportAnimations()
     uint32_t uSize = 0;
     std::vector< uint8_t > Data;
 
+    if (m_bCompressAnimations)
+    {
+        // Reduce a copy; the resampled and baked exports still sample the original keys.
+        std::vector<Animation> Reduced = mAnimations;
+        for (size_t i = 0; i < Reduced.size(); i++)
+        {
+            CAnimationTools::ReduceKeys(Reduced[i], m_AnimationCompression);
+        }
+        uSize = CAnimationTools::WriteCompressedAnimations(Reduced, m_AnimationCompression, Data);
+#if STU_EXPORT_SEQUENTIAL
+        m_Export.AppendChunkToFile(m_sSTUPath, "AnimationsQ", &Data.at(0), uSize);
+#else
+        m_Export.WriteChunk("AnimationsQ", std::move(Data));
+#endif
+        return;
+    }
+
     uint32_t uValue = (uint32_t)mAnimations.size();
     WRITE_VALUE(uValue);
 
@@ -758,41 +1004,117 @@ void C3DModelFBX::ExportAnimations()
 #if STU_EXPORT_SEQUENTIAL
     m_Export.AppendChunkToFile(m_sSTUPath, "Animations", &Data.at(0), uSize);
 #else
-    m_Export.WriteChunk("Animations", &Data.at(0), uSize);
+    m_Export.WriteChunk("Animations", std::move(Data));
 #endif
 
 }
 
+void C3DModelFBX::ExportResampledAnimations()
+{
+    std::vector< uint8_t > Data;
+    uint32_t uSize = CAnimationTools::WriteResampledAnimations(mAnimations, m_fResampleFrameRate, Data);
+
+#if STU_EXPORT_SEQUENTIAL
+    m_Export.AppendChunkToFile(m_sSTUPath, "AnimationsFR", &Data.at(0), uSize);
+#else
+    m_Export.WriteChunk("AnimationsFR", std::move(Data));
+#endif
+}
+
+void C3DModelFBX::ParseNodeHierarchy()
+{
+    m_Nodes.clear();
+    ParseSubNodeHierarchy(m_pFBXScene->GetRootNode(), -1);
+}
+
+void C3DModelFBX::ParseSubNodeHierarchy(FbxNode* pNode, int32_t nParent)
+{
+    SkeletonNode node;
+    node.mName = pNode->GetName();
+    node.mNameHash = CFileExportSTUFormat::MakeHashFromName(node.mName);
+    node.mParent = nParent;
+    node.mLocalTransform = ConvertFbxToGLM(pNode->EvaluateLocalTransform());
+    m_Nodes.push_back(node);
+
+    int32_t nIndex = (int32_t)m_Nodes.size() - 1;
+    for (int childNodeId = 0; childNodeId < pNode->GetChildCount(); ++childNodeId)
+    {
+        ParseSubNodeHierarchy(pNode->GetChild(childNodeId), nIndex);
+    }
+}
+
+void C3DModelFBX::ExportSkeleton()
+{
+    std::vector< uint8_t > Data;
+
+    uint32_t uSize = CAnimationTools::WriteSkeleton(m_Nodes, m_BoneMapping, m_BoneInfo, Data);
+
+#if STU_EXPORT_SEQUENTIAL
+    m_Export.AppendChunkToFile(m_sSTUPath, "Skeleton", &Data.at(0), uSize);
+#else
+    m_Export.WriteChunk("Skeleton", std::move(Data));
+#endif
+}
+
+void C3DModelFBX::ExportBonePartitions(const std::string &sName)
+{
+    std::vector< uint8_t > Data;
+
+    uint32_t uSize = CBonePartitioner::WritePartitions(m_Partitioning, Data);
+
+#if STU_EXPORT_SEQUENTIAL
+    m_Export.AppendChunkToFile(m_sSTUPath, sName, &Data.at(0), uSize);
+#else
+    m_Export.WriteChunk(sName, std::move(Data));
+#endif
+}
+
+void C3DModelFBX::ExportBonePalettes()
+{
+    std::vector< uint8_t > Data;
+
+    // FBX bone offsets already hold the global bind pose inverse, so no extra root correction is needed.
+    uint32_t uSize = CAnimationTools::WriteBonePalettes(mAnimations, m_Nodes, m_BoneMapping, m_BoneInfo, glm::mat4(), m_fPaletteFrameRate, m_bQuantizePalettes, Data);
+
+#if STU_EXPORT_SEQUENTIAL
+    m_Export.AppendChunkToFile(m_sSTUPath, "BonePalettes", &Data.at(0), uSize);
+#else
+    m_Export.WriteChunk("BonePalettes", std::move(Data));
+#endif
+}
+
 void C3DModelFBX::ExportTextures()
 {
     // FBX SDK Always extracts the embedded textures, so we will always have no
     // embedded textures (unless we decide to manually embed them later)
 }
 
-void C3DModelFBX::ExportSceneTree()
+bool C3DModelFBX::ExportSceneTree()
 {
     m_uSubModelCount = 0;
     m_uSubModelVertexCount = 0;
-    ExportSubTree(m_pFBXScene->GetRootNode());
+    m_uUniqueNodeID = 0;
+    m_uUniqueMeshID = 0;
+    m_MorphMeshExports.clear();
+    return ExportSubTree(m_pFBXScene->GetRootNode());
 }
 
-void C3DModelFBX::ExportSubTree(FbxNode* pNode)
+bool C3DModelFBX::ExportSubTree(FbxNode* pNode)
 {
     uint32_t uSize = 0;
     uint32_t uValue;
     std::vector< uint8_t > Data;
 
     std::string nodeName;
-    static uint32_t sUniqueFbxUnknownID = 0;
     if (strlen(pNode->GetName()) > 0)
     {
-        nodeName = std::string("Fbx.(") + pNode->GetName() + "-" + std::to_string(sUniqueFbxUnknownID++) + ")";
+        nodeName = std::string("Fbx.(") + pNode->GetName() + "-" + std::to_string(m_uUniqueNodeID++) + ")";
     }
     else
     {
-        nodeName = std::string("Fbx.(UNKNOWN-") + std::to_string(sUniqueFbxUnknownID++) + ")";
+        nodeName = std::string("Fbx.(UNKNOWN-") + std::to_string(m_uUniqueNodeID++) + ")";
     }
-    LOG_INFO("Found node '%s'\n", nodeName.c_str());
+    LOG_DEBUG("Found node '%s'\n", nodeName.c_str());
 
     uint32_t childCount = (uint32_t)pNode->GetChildCount();
     WRITE_VALUE(childCount);
@@ -855,22 +1177,21 @@ void C3DModelFBX::ExportSubTree(FbxNode* pNode)
 
 
         std::string meshName;
-        static uint32_t sUniqueFbxUnknownMeshID = 0;
         if (strlen(pMesh->GetName()) > 0)
         {
-            meshName = nodeName + ".mesh(" + pMesh->GetName() + "-" + std::to_string(sUniqueFbxUnknownMeshID++) + ")";
+            meshName = nodeName + ".mesh(" + pMesh->GetName() + "-" + std::to_string(m_uUniqueMeshID++) + ")";
         }
         else
         {
-            meshName = nodeName + ".mesh(UNKNOWN-" + std::to_string(sUniqueFbxUnknownMeshID++) + ")";
+            meshName = nodeName + ".mesh(UNKNOWN-" + std::to_string(m_uUniqueMeshID++) + ")";
         }
-        LOG_INFO("Found mesh '%s'\n", meshName.c_str());
+        LOG_DEBUG("Found mesh '%s'\n", meshName.c_str());
         std::string VBOName = meshName + ".VBO";
         std::string IBOName = meshName + ".IBO";
 
         if (pMaterial)
         {
-            LOG_INFO("Found material '%s'\n", pMaterial->GetName());
+            LOG_DEBUG("Found material '%s'\n", pMaterial->GetName());
         }
 
         uSize += CFileExportSTUFormat::CopyString(meshName.c_str(), &Data);
@@ -927,12 +1248,75 @@ void C3DModelFBX::ExportSubTree(FbxNode* pNode)
         }
 
 
+        // Skinned meshes are regrouped so every partition fits the shader palette. FBX meshes are written
+        // as one vertex per polygon corner, so partitions are runs of corners and nothing is duplicated.
+        m_Partitioning.Clear();
+        if (m_bPartitionBones && m_VertexDataType == VertexDataType_Bones && !m_Bones.empty())
+        {
+            std::vector<uint32_t> Corners;
+            std::vector<VertexBoneData> CornerBones;
+            bool bTriangles = true;
+            for (int polygonId = 0; polygonId < pMesh->GetPolygonCount(); ++polygonId)
+            {
+                bTriangles = bTriangles && pMesh->GetPolygonSize(polygonId) == 3;
+                for (int polygonVertexId = 0; polygonVertexId < pMesh->GetPolygonSize(polygonId); ++polygonVertexId)
+                {
+                    int controlPointId = pMesh->GetPolygonVertex(polygonId, polygonVertexId);
+                    Corners.push_back((uint32_t)Corners.size());
+                    CornerBones.push_back(controlPointId < (int)m_Bones.size() ? m_Bones[controlPointId] : VertexBoneData());
+                }
+            }
+            if (!bTriangles)
+            {
+                LOG_ERROR("Mesh '%s' is not triangulated, skipping bone partitioning.\n", meshName.c_str());
+            }
+            else if (CBonePartitioner::Partition(Corners, CornerBones, m_uMaxPaletteBones, m_Partitioning))
+            {
+                m_Bones.swap(m_Partitioning.Bones);
+                LOG_INFO("Split mesh '%s' into %u bone partitions\n", meshName.c_str(), (uint32_t)m_Partitioning.Partitions.size());
+            }
+        }
+
+        if (m_bCompactSkinning && m_VertexDataType == VertexDataType_Bones)
+        {
+            // LoadBones() has assigned every bone index used by this mesh by now; partitioned meshes only need palette-local IDs.
+            m_VertexDataType = GetCompactSkinningType(m_Partitioning.IsEmpty() ? m_uNumBones : m_uMaxPaletteBones);
+        }
+
         FbxFileTexture *pDiffuseTexture = GetMaterialFileTexture(pMaterial, FbxSurfaceMaterial::sDiffuse);
 
         WRITE_VALUE(m_VertexDataType);
 
         std::string sChunkname = std::string("Vx:") + std::to_string(m_uSubModelVertexCount++);
-        ExportVertices(m_Export, m_sSTUPath, sChunkname, pMesh, pDiffuseTexture);
+        if (!ExportVertices(m_Export, m_sSTUPath, sChunkname, pMesh, pDiffuseTexture))
+        {
+            LOG_ERROR("Mesh '%s' could not be exported, the model is incomplete.", meshName.c_str());
+            return false;
+        }
+        if (!m_Partitioning.IsEmpty())
+        {
+            ExportBonePartitions(sChunkname + "BP");
+        }
+        if (m_bExportMorphTargets && pMesh->GetDeformerCount(FbxDeformer::eBlendShape) > 0)
+        {
+            ExportMorphTargets(sChunkname + "MT", pMesh);
+
+            MorphMeshExport MorphMesh;
+            MorphMesh.pMesh = pMesh;
+            MorphMesh.sName = meshName;
+            m_MorphMeshExports.push_back(MorphMesh);
+        }
+
+        // The rest of the mesh entry only comes from the material. A mesh shared by several nodes is kept
+        // until the last of them has been exported.
+        if (m_bLowMemory && ++m_MeshExports[pMesh] >= pMesh->GetNodeCount())
+        {
+            m_MeshExports.erase(pMesh);
+            pMesh->Destroy();
+            pMesh = NULL;
+            std::vector<VertexBoneData>().swap(m_Bones);
+            m_Partitioning.Clear();
+        }
 
         // TODO Figure out how to get indices from FBX (do they need vertices to
         // begin with? unless I'm wrong, it looks like they're all coming in as
@@ -1070,13 +1454,17 @@ void C3DModelFBX::ExportSubTree(FbxNode* pNode)
 #if STU_EXPORT_SEQUENTIAL
     m_Export.AppendChunkToFile(m_sSTUPath, sChunkname, &Data.at(0), (uint32_t)Data.size());
 #else
-    m_Export.WriteChunk(sChunkname, &Data.at(0), (uint32_t)Data.size());
+    m_Export.WriteChunk(sChunkname, std::move(Data));
 #endif
 
     for (int i = 0; i < pNode->GetChildCount(); ++i)
     {
-        ExportSubTree(pNode->GetChild(i));
+        if (!ExportSubTree(pNode->GetChild(i)))
+        {
+            return false;
+        }
     }
+    return true;
 }
 
 void C3DModelFBX::ExportBones()
@@ -1108,7 +1496,7 @@ void C3DModelFBX::ExportBones()
 #if STU_EXPORT_SEQUENTIAL
     m_Export.AppendChunkToFile(m_sSTUPath, "Bones", &Data.at(0), uSize);
 #else
-    m_Export.WriteChunk("Bones", &Data.at(0), uSize);
+    m_Export.WriteChunk("Bones", std::move(Data));
 #endif
 }
 
@@ -1196,17 +1584,14 @@ void ExportVerticesTexcoord(int polygonId, int polygonVertexId, int controlPoint
     }
 }
 
-template <class VertexData>
-void ExportVerticesNormal(int controlPointId, int vertexId, VertexData &Vertex, FbxMesh *pMesh)
+// The compact skinning layouts store a 3 component normal.
+static inline void SetVectorW(glm::vec4 &Vector, float fValue) { Vector.w = fValue; }
+static inline void SetVectorW(glm::vec3 &, float) {}
+
+// Normal of one polygon corner, for meshes and blend shapes alike.
+static FbxVector4 GetElementNormal(FbxGeometryElementNormal* pElement, int controlPointId, int vertexId)
 {
     FbxVector4 value;
-    FbxGeometryElementNormal* pElement = pMesh->GetElementNormal();
-
-    if (!pElement)
-    {
-        LOG_ERROR("Missing vertex normals from the '%s' mesh", pMesh->GetName());
-        return;
-    }
 
     switch (pElement->GetMappingMode())
     {
@@ -1250,11 +1635,26 @@ void ExportVerticesNormal(int controlPointId, int vertexId, VertexData &Vertex,
         }
         default: break;
     }
+    return value;
+}
+
+template <class VertexData>
+void ExportVerticesNormal(int controlPointId, int vertexId, VertexData &Vertex, FbxMesh *pMesh)
+{
+    FbxGeometryElementNormal* pElement = pMesh->GetElementNormal();
+
+    if (!pElement)
+    {
+        LOG_ERROR("Missing vertex normals from the '%s' mesh", pMesh->GetName());
+        return;
+    }
+
+    FbxVector4 value = GetElementNormal(pElement, controlPointId, vertexId);
 
     Vertex.normal.x = (float)value[0];
     Vertex.normal.y = (float)value[1];
     Vertex.normal.z = (float)value[2];
-    Vertex.normal.w = (float)value[3];
+    SetVectorW(Vertex.normal, (float)value[3]);
 }
 
 template <class VertexData>
@@ -1360,11 +1760,39 @@ template <> void ExportVerticesNormal<VertexDataSimple>(int, int, VertexDataSimp
 template <> void ExportVerticesNormal<VertexDataPoints>(int, int, VertexDataPoints&, FbxMesh *) {}
 template <> void ExportVerticesNormal<VertexDataTextured>(int, int, VertexDataTextured&, FbxMesh *) {}
 
+// Compact layouts store the normal octahedron encoded; the FBX export writes no tangents.
+template <class VertexData>
+static void ExportVerticesCompactNormal(int controlPointId, int vertexId, VertexData &Vertex, FbxMesh *pMesh)
+{
+    Vertex.tangent[0] = Vertex.tangent[1] = Vertex.tangent[2] = Vertex.tangent[3] = 0;
+
+    FbxGeometryElementNormal* pElement = pMesh->GetElementNormal();
+    if (!pElement)
+    {
+        LOG_ERROR("Missing vertex normals from the '%s' mesh", pMesh->GetName());
+        EncodeOctahedralNormal(glm::vec3(0.0f), Vertex.normal);
+        return;
+    }
+
+    FbxVector4 value = GetElementNormal(pElement, controlPointId, vertexId);
+    EncodeOctahedralNormal(glm::vec3((float)value[0], (float)value[1], (float)value[2]), Vertex.normal);
+}
+template <> void ExportVerticesNormal<VertexDataWithSkinU8>(int controlPointId, int vertexId, VertexDataWithSkinU8 &Vertex, FbxMesh *pMesh)
+{
+    ExportVerticesCompactNormal(controlPointId, vertexId, Vertex, pMesh);
+}
+template <> void ExportVerticesNormal<VertexDataWithSkinU16>(int controlPointId, int vertexId, VertexDataWithSkinU16 &Vertex, FbxMesh *pMesh)
+{
+    ExportVerticesCompactNormal(controlPointId, vertexId, Vertex, pMesh);
+}
+
 // Disabled for these since they don't have colors...
 template <> void ExportVerticesColor<VertexDataSimple>(int, int, VertexDataSimple&, FbxMesh *) {}
 template <> void ExportVerticesColor<VertexDataTextured>(int, int, VertexDataTextured&, FbxMesh *) {}
 template <> void ExportVerticesColor<VertexDataWithNormals>(int, int, VertexDataWithNormals&, FbxMesh *) {}
 template <> void ExportVerticesColor<VertexDataWithBones>(int, int, VertexDataWithBones&, FbxMesh *) {}
+template <> void ExportVerticesColor<VertexDataWithSkinU8>(int, int, VertexDataWithSkinU8&, FbxMesh *) {}
+template <> void ExportVerticesColor<VertexDataWithSkinU16>(int, int, VertexDataWithSkinU16&, FbxMesh *) {}
 
 // Disabled for these since they don't have bone ID/Weights...
 template <> void ExportVerticesBoneIdAndWeight<VertexDataSimple>(int, VertexDataSimple &, std::vector<VertexBoneData> &) {}
@@ -1372,9 +1800,19 @@ template <> void ExportVerticesBoneIdAndWeight<VertexDataPoints>(int, VertexData
 template <> void ExportVerticesBoneIdAndWeight<VertexDataTextured>(int, VertexDataTextured &, std::vector<VertexBoneData> &) {}
 template <> void ExportVerticesBoneIdAndWeight<VertexDataWithNormals>(int, VertexDataWithNormals &, std::vector<VertexBoneData> &) {}
 
+// Compact layouts carry integer bone indices and unorm8 weights summing to 255.
+template <> void ExportVerticesBoneIdAndWeight<VertexDataWithSkinU8>(int controlPointId, VertexDataWithSkinU8 &Vertex, std::vector<VertexBoneData> &Bones)
+{
+    EncodeCompactSkin(controlPointId < (int)Bones.size() ? Bones[controlPointId] : VertexBoneData(), Vertex.boneIds, Vertex.boneWeights);
+}
+template <> void ExportVerticesBoneIdAndWeight<VertexDataWithSkinU16>(int controlPointId, VertexDataWithSkinU16 &Vertex, std::vector<VertexBoneData> &Bones)
+{
+    EncodeCompactSkin(controlPointId < (int)Bones.size() ? Bones[controlPointId] : VertexBoneData(), Vertex.boneIds, Vertex.boneWeights);
+}
+
 
 template <typename VertexData>
-void ExportVerticesOfType(CFileExportSTUFormat &Export, const std::string &path, std::string sChunkname, FbxMesh *pMesh, FbxTexture *pDiffuseTexture, bool bFlipUVonY, std::vector<VertexBoneData> &Bones)
+bool ExportVerticesOfType(CFileExportSTUFormat &Export, const std::string &path, const std::string &sChunkname, FbxMesh *pMesh, FbxTexture *pDiffuseTexture, bool bFlipUVonY, std::vector<VertexBoneData> &Bones, const std::vector<uint32_t> &CornerOrder)
 {
     // Since we can potentially have more than one UV (because of
     // multi-texturing), we have to pick the 'diffuse' one, and here is
@@ -1410,6 +1848,20 @@ void ExportVerticesOfType(CFileExportSTUFormat &Export, const std::string &path,
     bmin[0] = bmin[1] = bmin[2] = std::numeric_limits<float>::max();
     bmax[0] = bmax[1] = bmax[2] = -std::numeric_limits<float>::max();
 
+    VertexData * pVertices = (VertexData *)Export.GetChunkTarget(sChunkname, sizeof(VertexData) * pMesh->GetPolygonVertexCount(), Data);
+    if (!pVertices)
+    {
+        LOG_ERROR("Ran out of memory while exporting vertices from '%s' model.", path.c_str());
+        return false;
+    }
+
+    // Bone partitioning regroups the corners; influences are then stored per corner instead of per control point.
+    std::vector<uint32_t> CornerPosition(CornerOrder.size());
+    for (size_t i = 0; i < CornerOrder.size(); ++i)
+    {
+        CornerPosition[CornerOrder[i]] = (uint32_t)i;
+    }
+
     VertexData Vertex;
     int vertexId = 0;
     const int polygonCount = pMesh->GetPolygonCount();
@@ -1433,22 +1885,22 @@ void ExportVerticesOfType(CFileExportSTUFormat &Export, const std::string &path,
             ExportVerticesTexcoord(polygonId, polygonVertexId, controlPointId, vertexId, Vertex, pMesh, pDiffuseTexture, elementUVIndex, bFlipUVonY);
             ExportVerticesNormal(controlPointId, vertexId, Vertex, pMesh);
             ExportVerticesColor(controlPointId, vertexId, Vertex, pMesh);
-            ExportVerticesBoneIdAndWeight(controlPointId, Vertex, Bones);
+            ExportVerticesBoneIdAndWeight(CornerPosition.empty() ? controlPointId : vertexId, Vertex, Bones);
 
-            WRITE_VALUE(Vertex);
+            pVertices[CornerPosition.empty() ? vertexId : CornerPosition[vertexId]] = Vertex;
 
             ++vertexId;
         }
     }
-    if (Data.size() == 0)
+    // In mapped mode the vertices were written straight into the output file.
+    if (!Export.IsMapped())
     {
-        return;
-    }
 #if STU_EXPORT_SEQUENTIAL
-    Export.AppendChunkToFile(path, sChunkname, &Data.at(0), (int32_t)Data.size());
+        Export.AppendChunkToFile(path, sChunkname, &Data.at(0), (int32_t)Data.size());
 #else
-    Export.WriteChunk(sChunkname, &Data.at(0), (int32_t)Data.size());
+        Export.WriteChunk(sChunkname, std::move(Data));
 #endif
+    }
     std::vector< uint8_t >().swap(Data);
 
     //Write BBox chunk:
@@ -1462,53 +1914,196 @@ void ExportVerticesOfType(CFileExportSTUFormat &Export, const std::string &path,
 #if STU_EXPORT_SEQUENTIAL
     Export.AppendChunkToFile(path, sChunkname + "BB", &Data.at(0), (uint32_t)Data.size());
 #else
-    Export.WriteChunk(sChunkname + "BB", &Data.at(0), Data.size());
+    Export.WriteChunk(sChunkname + "BB", std::move(Data));
 #endif
     std::vector< uint8_t >().swap(Data);
+    return true;
 }
 
-void C3DModelFBX::ExportVertices(CFileExportSTUFormat &Export, const std::string &path, std::string sChunkname, FbxMesh *pMesh, FbxTexture *pDiffuseTexture)
+bool C3DModelFBX::ExportVertices(CFileExportSTUFormat &Export, const std::string &path, const std::string &sChunkname, FbxMesh *pMesh, FbxTexture *pDiffuseTexture)
 {
+    bool bResult = false;
+
     switch (m_VertexDataType)
     {
         case VertexDataType_Simple:
         {
-            ExportVerticesOfType<VertexDataSimple>(Export, path, sChunkname, pMesh, pDiffuseTexture, m_bFlipUVonY, m_Bones);
+            bResult = ExportVerticesOfType<VertexDataSimple>(Export, path, sChunkname, pMesh, pDiffuseTexture, m_bFlipUVonY, m_Bones, m_Partitioning.Indices);
             break;
         }
         case VertexDataType_Points:
         {
-            ExportVerticesOfType<VertexDataPoints>(Export, path, sChunkname, pMesh, pDiffuseTexture, m_bFlipUVonY, m_Bones);
+            bResult = ExportVerticesOfType<VertexDataPoints>(Export, path, sChunkname, pMesh, pDiffuseTexture, m_bFlipUVonY, m_Bones, m_Partitioning.Indices);
             break;
         }
         case VertexDataType_Textured:
         {
-            ExportVerticesOfType<VertexDataTextured>(Export, path, sChunkname, pMesh, pDiffuseTexture, m_bFlipUVonY, m_Bones);
+            bResult = ExportVerticesOfType<VertexDataTextured>(Export, path, sChunkname, pMesh, pDiffuseTexture, m_bFlipUVonY, m_Bones, m_Partitioning.Indices);
             break;
         }
         case VertexDataType_Normals:
         {
-            ExportVerticesOfType<VertexDataWithNormals>(Export, path, sChunkname, pMesh, pDiffuseTexture, m_bFlipUVonY, m_Bones);
+            bResult = ExportVerticesOfType<VertexDataWithNormals>(Export, path, sChunkname, pMesh, pDiffuseTexture, m_bFlipUVonY, m_Bones, m_Partitioning.Indices);
             break;
         }
         case VertexDataType_Bones:
         {
-            ExportVerticesOfType<VertexDataWithBones>(Export, path, sChunkname, pMesh, pDiffuseTexture, m_bFlipUVonY, m_Bones);
+            bResult = ExportVerticesOfType<VertexDataWithBones>(Export, path, sChunkname, pMesh, pDiffuseTexture, m_bFlipUVonY, m_Bones, m_Partitioning.Indices);
             break;
         }
+        case VertexDataType_SkinU8:
+        {
+            bResult = ExportVerticesOfType<VertexDataWithSkinU8>(Export, path, sChunkname, pMesh, pDiffuseTexture, m_bFlipUVonY, m_Bones, m_Partitioning.Indices);
+            break;
+        }
+        case VertexDataType_SkinU16:
+        {
+            bResult = ExportVerticesOfType<VertexDataWithSkinU16>(Export, path, sChunkname, pMesh, pDiffuseTexture, m_bFlipUVonY, m_Bones, m_Partitioning.Indices);
+            break;
+        }
+    }
+    return bResult;
+}
+
+void C3DModelFBX::ExportMorphTargets(const std::string &sName, FbxMesh *pMesh)
+{
+    std::vector< uint8_t > Data;
+    std::vector<FbxBlendShapeChannel *> BlendShapeChannels;
+    GetBlendShapeChannels(pMesh, BlendShapeChannels);
+    std::vector<MorphTarget> Targets(BlendShapeChannels.size());
+
+    FbxVector4 *pBasePoints = pMesh->GetControlPoints();
+    FbxGeometryElementNormal *pBaseNormals = pMesh->GetElementNormal();
+    const int polygonCount = pMesh->GetPolygonCount();
+
+    // Deltas are gathered per polygon corner, the unit written to the vertex chunk.
+    std::vector<glm::vec3> PositionDeltas(pMesh->GetPolygonVertexCount());
+    std::vector<glm::vec3> NormalDeltas;
+    for (size_t channelIndex = 0; channelIndex < BlendShapeChannels.size(); ++channelIndex)
+    {
+        FbxBlendShapeChannel *pChannel = BlendShapeChannels[channelIndex];
+        Targets[channelIndex].mName = pChannel->GetName();
+
+        // In-between shapes are not exported, only the full target.
+        FbxShape *pShape = pChannel->GetTargetShapeCount() > 0 ? pChannel->GetTargetShape(pChannel->GetTargetShapeCount() - 1) : NULL;
+        if (!pShape || pShape->GetControlPointsCount() != pMesh->GetControlPointsCount())
+        {
+            LOG_ERROR("Blend shape '%s' of '%s' does not match the mesh, skipped.\n", pChannel->GetName(), pMesh->GetName());
+            continue;
+        }
+        FbxVector4 *pShapePoints = pShape->GetControlPoints();
+        FbxGeometryElementNormal *pShapeNormals = pShape->GetElementNormal();
+        bool bNormals = pBaseNormals && pShapeNormals;
+        NormalDeltas.resize(bNormals ? PositionDeltas.size() : 0);
+
+        int vertexId = 0;
+        for (int polygonId = 0; polygonId < polygonCount; polygonId++)
+        {
+            for (int polygonVertexId = 0; polygonVertexId < pMesh->GetPolygonSize(polygonId); polygonVertexId++)
+            {
+                int controlPointId = pMesh->GetPolygonVertex(polygonId, polygonVertexId);
+                FbxVector4 Delta = pShapePoints[controlPointId] - pBasePoints[controlPointId];
+                PositionDeltas[vertexId] = glm::vec3((float)Delta[0], (float)Delta[1], (float)Delta[2]);
+                if (bNormals)
+                {
+                    Delta = GetElementNormal(pShapeNormals, controlPointId, vertexId) - GetElementNormal(pBaseNormals, controlPointId, vertexId);
+                    NormalDeltas[vertexId] = glm::vec3((float)Delta[0], (float)Delta[1], (float)Delta[2]);
+                }
+                ++vertexId;
+            }
+        }
+
+        // Bone partitioning writes the corners in m_Partitioning.Indices order.
+        CMorphTargets::MakeSparse(PositionDeltas, NormalDeltas, m_Partitioning.Indices, m_fMorphTolerance, Targets[channelIndex]);
+    }
+
+    uint32_t uSize = CMorphTargets::WriteMorphTargets(Targets, Data);
+
+#if STU_EXPORT_SEQUENTIAL
+    m_Export.AppendChunkToFile(m_sSTUPath, sName, &Data.at(0), uSize);
+#else
+    m_Export.WriteChunk(sName, std::move(Data));
+#endif
+}
+
+void C3DModelFBX::ParseMorphAnimations()
+{
+    // A curve belongs to a mesh, which is written once per node that instances it. Every exported name gets a track.
+    for (size_t i = 0; i < mAnimations.size(); i++)
+    {
+        mAnimations[i].mMorphChannels.clear();
+    }
+    for (size_t t = 0; t < m_MorphWeightTracks.size(); t++)
+    {
+        const MorphWeightTrack &track = m_MorphWeightTracks[t];
+        for (size_t m = 0; m < m_MorphMeshExports.size(); m++)
+        {
+            if (m_MorphMeshExports[m].pMesh != track.pMesh || track.uAnimation >= mAnimations.size())
+            {
+                continue;
+            }
+            MorphWeightAnim weights = track.Weights;
+            weights.mMeshName = m_MorphMeshExports[m].sName;
+            mAnimations[track.uAnimation].mMorphChannels.push_back(weights);
+        }
+    }
+}
+
+void C3DModelFBX::ExportMorphAnimations()
+{
+    std::vector< uint8_t > Data;
+
+    ParseMorphAnimations();
+    if (!CMorphTargets::HasMorphAnimations(mAnimations))
+    {
+        return;
     }
+
+    uint32_t uSize = CMorphTargets::WriteMorphAnimations(mAnimations, Data);
+
+#if STU_EXPORT_SEQUENTIAL
+    m_Export.AppendChunkToFile(m_sSTUPath, "MorphAnimations", &Data.at(0), uSize);
+#else
+    m_Export.WriteChunk("MorphAnimations", std::move(Data));
+#endif
 }
 
+struct SkinClusterWeights
+{
+    uint32_t uBoneIndex;
+    int nCount;
+    const int *pIndices;
+    const double *pWeights;
+};
+
+// The clusters of a mesh as GatherSkinWeights reads them. Zero weights are skipped, they would take a slot.
+struct FbxSkinWeights
+{
+    const std::vector<SkinClusterWeights> &Clusters;
+
+    uint32_t GetClusterCount() const { return (uint32_t)Clusters.size(); }
+    uint32_t GetBone(uint32_t c) const { return Clusters[c].uBoneIndex; }
+    uint32_t GetWeightCount(uint32_t c) const { return (uint32_t)std::max(Clusters[c].nCount, 0); }
+    bool GetWeight(uint32_t c, uint32_t j, uint32_t &uVertex, float &fWeight) const
+    {
+        uVertex = (uint32_t)Clusters[c].pIndices[j];
+        fWeight = (float)Clusters[c].pWeights[j];
+        return !glm::epsilonEqual(fWeight, 0.0f, glm::epsilon<float>());
+    }
+};
+
 void C3DModelFBX::LoadBones(FbxMesh *pMesh)
 {
     m_Bones.clear();
 
     int skinCount = pMesh->GetDeformerCount(FbxDeformer::eSkin);
 
+    // Influences are indexed by control point and only allocated for skinned meshes.
     if (skinCount > 0)
     {
-        m_Bones.resize(pMesh->GetPolygonVertexCount());
+        m_Bones.assign(pMesh->GetControlPointsCount(), VertexBoneData());
     }
+    std::vector<SkinClusterWeights> Clusters;
 
     FbxAMatrix geometryTransform = GetGeometryTransformation(pMesh->GetNode());
 
@@ -1529,7 +2124,8 @@ void C3DModelFBX::LoadBones(FbxMesh *pMesh)
             {
                 BoneIndex = m_uNumBones;
                 m_uNumBones++;
-                if (m_uNumBones > MAX_BONES)
+                // Partitioned meshes only need MAX_BONES per palette, not in total.
+                if (m_uNumBones > MAX_BONES && !m_bPartitionBones)
                 {
                     LOG_ERROR("3D object Exceeded maximum bone count");
                     //m_uNumBones = MAX_BONES; //Can be capped here, or passes throuugh
@@ -1554,20 +2150,16 @@ void C3DModelFBX::LoadBones(FbxMesh *pMesh)
                 BoneIndex = m_BoneMapping[BoneHash];
             }
 
-            int indexCount = pCluster->GetControlPointIndicesCount();
-            int* Indices = pCluster->GetControlPointIndices();
-            double* Weights = pCluster->GetControlPointWeights();
-
-            for (int indexID = 0; indexID < indexCount; ++indexID)
-            {
-                int VertexID = Indices[indexID];
-                float Weight = (float)Weights[indexID];
-                if (!glm::epsilonEqual(Weight, 0.0f, glm::epsilon<float>()))
-                {
-                    //LOG_ERROR("Vertex #%d influenced by bone #%d (%s) (weight=%f)", VertexID, BoneIndex, BoneName.c_str(), Weight);
-                    m_Bones[VertexID].AddBoneData(BoneIndex, Weight);
-                }
-            }
+            SkinClusterWeights Cluster;
+            Cluster.uBoneIndex = BoneIndex;
+            Cluster.nCount = pCluster->GetControlPointIndicesCount();
+            Cluster.pIndices = pCluster->GetControlPointIndices();
+            Cluster.pWeights = pCluster->GetControlPointWeights();
+            Clusters.push_back(Cluster);
         }
     }
+
+    // The cluster arrays were fetched above, the workers do not call into the SDK.
+    FbxSkinWeights Skin = { Clusters };
+    GatherSkinWeights(Skin, m_Bones, m_bParallelExport ? m_uParallelMinVertices : 16384);
 }
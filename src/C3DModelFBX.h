@@ -3,6 +3,9 @@
 
 #include "CFileExportSTUFormat.h"
 #include "C3DModelDataStructures.h"
+#include "CAnimationTools.h"
+#include "CBonePartitioner.h"
+#include "CMorphTargets.h"
 
 #include <fbxsdk.h>
 #include <map>
@@ -13,32 +16,125 @@ public:
     C3DModelFBX();
     virtual ~C3DModelFBX();
 
+    /* Drop everything kept from the last model so the converter can be reused for the next one. The FBX scene
+       itself only lives for the duration of ExportToSTUFormat. Options are kept. */
+    void Reset();
+
     bool ExportToSTUFormat(const std::string &path);
     bool ExportToSTUFormat(const std::string &path, bool bFlipUV = true);
 
+    /* Write the .stu through a preallocated memory mapping instead of appending chunk by chunk */
+    void SetMappedOutput(bool bMapped) { m_bMappedOutput = bMapped; }
+
+    /* Hand finished chunks to a background writer thread so encoding overlaps disk I/O. Ignored in mapped mode. */
+    void SetAsyncOutput(bool bAsync) { m_bAsyncOutput = bAsync; }
+
+    /* Write the .stu into pSink (not owned) instead of a file next to the model, e.g. a memory buffer or stdout */
+    void SetOutputSink(COutputSink * pSink) { m_pOutputSink = pSink; }
+
+    /* Export skinned meshes with integer bone indices, unorm8 weights and packed normals and tangents instead of floats */
+    void SetCompactSkinning(bool bCompact) { m_bCompactSkinning = bCompact; }
+
+    /* Reduce and quantize animation keys, written as an "AnimationsQ" chunk instead of "Animations" */
+    void SetAnimationCompression(bool bCompress, const AnimationCompressionSettings &Settings = AnimationCompressionSettings()) { m_bCompressAnimations = bCompress; m_AnimationCompression = Settings; }
+
+    /* Also write every animation sampled at a fixed rate as an "AnimationsFR" chunk */
+    void SetAnimationResampling(bool bResample, float fFrameRate = 30.0f) { m_bResampleAnimations = bResample; m_fResampleFrameRate = fFrameRate; }
+
+    /* Also write fully evaluated 3x4 skinning palettes for every animation frame as a "BonePalettes" chunk */
+    void SetBakedPalettes(bool bBake, float fFrameRate = 30.0f, bool bQuantize = false) { m_bBakePalettes = bBake; m_fPaletteFrameRate = fFrameRate; m_bQuantizePalettes = bQuantize; }
+
+    /* Split skinned meshes into partitions of at most uMaxBones bones, with palette-local vertex bone IDs and a "Vx:NBP" palette table */
+    void SetBonePartitioning(bool bPartition, uint32_t uMaxBones = MAX_BONES) { m_bPartitionBones = bPartition; m_uMaxPaletteBones = uMaxBones; }
+
+    /* Export blend shapes as sparse quantized deltas ("Vx:NMT") and their weight curves ("MorphAnimations") */
+    void SetMorphTargets(bool bExport, float fTolerance = 0.00001f) { m_bExportMorphTargets = bExport; m_fMorphTolerance = fTolerance; }
+
+    /* Destroy every mesh (control points, polygons and layer elements) as soon as its vertex chunks are written,
+       instead of keeping the whole scene until the end */
+    void SetLowMemoryExport(bool bLowMemory) { m_bLowMemory = bLowMemory; }
+
+    /* Gather skin weights on the shared CTaskScheduler, in ranges of at least uMinTaskVertices control points.
+       The scene tree itself is walked sequentially, the FBX SDK objects must not be used from several threads. */
+    void SetParallelExport(bool bParallel, uint32_t uMinTaskVertices = 4096) { m_bParallelExport = bParallel; m_uParallelMinVertices = uMinTaskVertices; }
+
+    /* Why the last ExportToSTUFormat failed, as the importer reported it. Empty when it succeeded or gave no reason. */
+    const std::string & GetLastError() const { return m_sLastError; }
+
 private:
+    // A blend shape weight curve as read with the animations. The mesh only identifies it, low-memory export may
+    // destroy the mesh before the tracks are written.
+    struct MorphWeightTrack
+    {
+        uint32_t uAnimation;                // index in mAnimations
+        const FbxMesh *pMesh;
+        MorphWeightAnim Weights;            // without mesh name
+    };
+
+    // A mesh with blend shapes under the name a node exported it as; an instanced mesh has one per node.
+    struct MorphMeshExport
+    {
+        const FbxMesh *pMesh;
+        std::string sName;                  // the exported name, unique
+    };
+
+    bool ExportScene(const std::string &path, bool bFlipUV);
     void ParseSkeletons();
     void ParseSubSkeletons(FbxNode* pNode);
     bool ParseAnimations();
     bool ParseAnimationLayer(Animation &animation, FbxTime &start, FbxTime &end, FbxAnimLayer* pAnimLayer, FbxNode* pNode);
     void ExportAnimations();
+    void ExportResampledAnimations();
+    void ExportSkeleton();
+    void ExportBonePalettes();
+    void ExportBonePartitions(const std::string &sName);
+    void ExportMorphTargets(const std::string &sName, FbxMesh *pMesh);
+    void ParseMorphAnimations();
+    void ExportMorphAnimations();
+    void ParseNodeHierarchy();
+    void ParseSubNodeHierarchy(FbxNode* pNode, int32_t nParent);
     void ExportTextures();
-    void ExportSceneTree();
-    void ExportSubTree(FbxNode* pNode);
+    bool ExportSceneTree();
+    bool ExportSubTree(FbxNode* pNode);
     void ExportBones();
-    void ExportVertices(CFileExportSTUFormat &Export, const std::string &path, std::string sChunkname, FbxMesh *pMesh, FbxTexture *pDiffuseTexture);
+    bool ExportVertices(CFileExportSTUFormat &Export, const std::string &path, const std::string &sChunkname, FbxMesh *pMesh, FbxTexture *pDiffuseTexture);
     void LoadBones(FbxMesh *pMesh);
+    uint64_t ComputeExportSize();
 
     std::string m_path;
     uint32_t m_uSubModelCount;
     uint32_t m_uSubModelVertexCount;
+
+    // Make node and mesh names unique, restarted for every model so names never depend on earlier conversions.
+    uint32_t m_uUniqueNodeID;
+    uint32_t m_uUniqueMeshID;
+
     bool m_bFlipUVonY;
+    bool m_bMappedOutput;
+    bool m_bAsyncOutput;
+    COutputSink * m_pOutputSink;
+    bool m_bCompactSkinning;
+    bool m_bCompressAnimations;
+    AnimationCompressionSettings m_AnimationCompression;
+    bool m_bResampleAnimations;
+    float m_fResampleFrameRate;
+    bool m_bBakePalettes;
+    bool m_bQuantizePalettes;
+    float m_fPaletteFrameRate;
+    bool m_bPartitionBones;
+    uint32_t m_uMaxPaletteBones;
+    BonePartitioning m_Partitioning;
+    bool m_bExportMorphTargets;
+    float m_fMorphTolerance;
+    std::vector<SkeletonNode> m_Nodes;
 
     std::map<uint32_t, uint32_t> m_BoneMapping; // maps a bone name to its index
     uint32_t m_uNumBones;
     std::vector<BoneInfo> m_BoneInfo;
     std::vector<VertexBoneData> m_Bones;
     std::vector<Animation> mAnimations;
+    std::vector<MorphWeightTrack> m_MorphWeightTracks;
+    std::vector<MorphMeshExport> m_MorphMeshExports;
     VertexDataType m_VertexDataType;
     bool m_bHasAnimations;
 
@@ -48,8 +144,13 @@ private:
     FbxAnimLayer * m_CurrentAnimLayer;
     std::vector<FbxMesh*> m_fbxSkinMeshes;
     std::vector<FbxSkeleton*> m_fbxSkeletons;
+    bool m_bLowMemory;
+    bool m_bParallelExport;
+    uint32_t m_uParallelMinVertices;
+    std::map<FbxMesh*, int> m_MeshExports;     // low-memory mode: nodes already exported per mesh
     CFileExportSTUFormat m_Export;
     std::string m_sSTUPath;
+    std::string m_sLastError;
 };
 
 #endif // _YES_3D_MODEL_FBX
@@ -1,5 +1,7 @@
 #include "C3DModelOBJ.h"
 #include "C3DModelDataStructures.h"
+#include "CLog.h"
+#include "CExportKernels.h"
 #include <climits>
 #include <iostream>
 
@@ -9,12 +11,9 @@
 #define TINYOBJLOADER_IMPLEMENTATION
 #include "tiny_obj_loader.h"
 
-#define LOG_ERROR(...) printf("C3DModelOBJ:"); printf(__VA_ARGS__);
-#define LOG_INFO(...) printf("C3DModelOBJ:"); printf(__VA_ARGS__);
-
-#define WRITE_VALUE(x)          Data.insert(Data.end(), (uint8_t *)&(x), (uint8_t *)&(x) + sizeof(x)); uSize += sizeof(x);
-#define WRITE_VALUES(x, c)      Data.insert(Data.end(), (uint8_t *)&(x), (uint8_t *)&(x) + sizeof(x) * (c)); uSize += sizeof(x) * (c);
-#define WRITE_BYTES(x, y, c)    Data.insert(Data.end(), (uint8_t *)(x), (uint8_t *)(x) + sizeof(y) * (c)); uSize += sizeof(y) * (c);
+#define LOG_ERROR(...) STU_LOG_ERROR("C3DModelOBJ", __VA_ARGS__)
+#define LOG_INFO(...) STU_LOG_INFO("C3DModelOBJ", __VA_ARGS__)
+#define LOG_DEBUG(...) STU_LOG_DEBUG("C3DModelOBJ", __VA_ARGS__)
 
 static const std::string LOG_TAG("C3DModelOBJ");
 
@@ -44,10 +43,15 @@ static void CalcNormal(float N[3], float v0[3], float v1[3], float v2[3])
 }
 
 C3DModelOBJ::C3DModelOBJ() :
-  m_bFlipUVonY(false),
   m_TotalMeshCount(0),
   m_uSubModelCount(0),
-  m_uSubModelVertexCount(0)
+  m_uSubModelVertexCount(0),
+  m_bFlipUVonY(false),
+  m_bMappedOutput(false),
+  m_bAsyncOutput(false),
+  m_pOutputSink(YI_NULL),
+  m_uUniqueOBJUnknownID(0),
+  m_uUniqueOBJUnknownMeshID(0)
 {
     m_SolidColor[0] = 0.5f;
     m_SolidColor[1] = 0.5f;
@@ -58,6 +62,18 @@ C3DModelOBJ::~C3DModelOBJ()
 {
 }
 
+void C3DModelOBJ::Reset()
+{
+    m_TotalMeshCount = 0;
+    m_uSubModelCount = 0;
+    m_uSubModelVertexCount = 0;
+    m_Entries.clear();
+    m_Export.Reset();
+    m_uUniqueOBJUnknownID = 0;
+    m_uUniqueOBJUnknownMeshID = 0;
+    m_sLastError.clear();
+}
+
 bool C3DModelOBJ::ExportToSTUFormat(const std::string &path)
 {
     m_uSubModelCount = 0;
@@ -65,7 +81,7 @@ bool C3DModelOBJ::ExportToSTUFormat(const std::string &path)
     return ExportToSTUFormat(path, true);
 }
 
-static void WriteVertexChunk(CFileExportSTUFormat Export, const std::string &path, bool bFlipUV, std::string sName, tinyobj::mesh_t mesh, tinyobj::attrib_t attrib)
+static bool WriteVertexChunk(CFileExportSTUFormat &Export, const std::string &path, bool bFlipUV, const std::string &sName, const tinyobj::mesh_t &mesh, const tinyobj::attrib_t &attrib)
 {
     uint32_t uSize = 0;
     uint8_t bytes[128] = { 0 };
@@ -78,11 +94,11 @@ static void WriteVertexChunk(CFileExportSTUFormat Export, const std::string &pat
     if (attrib.normals.size() > 0)
     {
         VertexDataWithNormals Vertex;
-        Data.reserve(sizeof(VertexDataWithNormals) * mesh.indices.size());
-        if (Data.capacity() < (sizeof(VertexDataWithNormals) * mesh.indices.size()))
+        VertexDataWithNormals * pVertices = (VertexDataWithNormals *)Export.GetChunkTarget(sName, (uint32_t)(sizeof(VertexDataWithNormals) * mesh.indices.size()), Data);
+        if (!pVertices)
         {
             LOG_ERROR("Ran out of memory while exporting vertices from '%s' model.", path.c_str());
-            return;
+            return false;
         }
         for (size_t f = 0; f < mesh.indices.size(); f++)
         {
@@ -110,18 +126,18 @@ static void WriteVertexChunk(CFileExportSTUFormat Export, const std::string &pat
                 Vertex.texcoord.x = attrib.texcoords[2 * idx0.texcoord_index];
                 Vertex.texcoord.y = bFlipUV ? 1.0f - attrib.texcoords[2 * idx0.texcoord_index + 1] : attrib.texcoords[2 * idx0.texcoord_index + 1];
             }
-            WRITE_VALUE(Vertex);
+            pVertices[f] = Vertex;
             //LOG_ERROR("Vx( %.02f,  %.02f, %.02f )", Vertex.position.x, Vertex.position.y, Vertex.position.z);
         }
     }
     else
     {
         VertexDataTextured Vertex;
-        Data.reserve(sizeof(VertexDataTextured) * mesh.indices.size());
-        if (Data.capacity() < (sizeof(VertexDataTextured) * mesh.indices.size()))
+        VertexDataTextured * pVertices = (VertexDataTextured *)Export.GetChunkTarget(sName, (uint32_t)(sizeof(VertexDataTextured) * mesh.indices.size()), Data);
+        if (!pVertices)
         {
             LOG_ERROR("Ran out of memory while exporting vertices from '%s' model.", path.c_str());
-            return;
+            return false;
         }
         for (size_t f = 0; f < mesh.indices.size(); f++)
         {
@@ -144,16 +160,20 @@ static void WriteVertexChunk(CFileExportSTUFormat Export, const std::string &pat
                 Vertex.texcoord.x = attrib.texcoords[2 * idx0.texcoord_index];
                 Vertex.texcoord.y = bFlipUV ? 1.0f - attrib.texcoords[2 * idx0.texcoord_index + 1] : attrib.texcoords[2 * idx0.texcoord_index + 1];
             }
-            WRITE_VALUE(Vertex);
+            pVertices[f] = Vertex;
         }
     }
-#if STU_EXPORT_SEQUENTIAL
     std::string sSTUPath = path;
     sSTUPath.append(".stu");
-    Export.AppendChunkToFile(sSTUPath, sName, &Data.at(0), (uint32_t)Data.size());
+    // In mapped mode the vertices were written straight into the output file.
+    if (!Export.IsMapped())
+    {
+#if STU_EXPORT_SEQUENTIAL
+        Export.AppendChunkToFile(sSTUPath, sName, &Data.at(0), (uint32_t)Data.size());
 #else
-    Export.WriteChunk(sName, &Data.at(0), (uint32_t)Data.size());
+        Export.WriteChunk(sName, std::move(Data));
 #endif
+    }
     std::vector< uint8_t >().swap(Data);
 
     //Write BBox chunk:
@@ -167,9 +187,10 @@ static void WriteVertexChunk(CFileExportSTUFormat Export, const std::string &pat
 #if STU_EXPORT_SEQUENTIAL
     Export.AppendChunkToFile(sSTUPath, sName + "BB", &Data.at(0), (int32_t)Data.size());
 #else
-    Export.WriteChunk(sName + "BB", &Data.at(0), (int32_t)Data.size());
+    Export.WriteChunk(sName + "BB", std::move(Data));
 #endif
     std::vector< uint8_t >().swap(Data);
+    return true;
 }
 
 bool C3DModelOBJ::ExportToSTUFormat(const std::string &path, bool bFlipUV)
@@ -185,6 +206,9 @@ bool C3DModelOBJ::ExportToSTUFormat(const std::string &path, bool bFlipUV)
     m_bFlipUVonY = bFlipUV;
     m_Entries.clear();
     m_TotalMeshCount = 0;
+    m_uUniqueOBJUnknownID = 0;
+    m_uUniqueOBJUnknownMeshID = 0;
+    m_sLastError.clear();
 
     std::vector<tinyobj::material_t> materials;
     std::map<std::string, uint32_t> textures;
@@ -201,6 +225,7 @@ bool C3DModelOBJ::ExportToSTUFormat(const std::string &path, bool bFlipUV)
 
     if (!ret) {
         LOG_ERROR("Could not load '%s' model.", path.c_str());
+        m_sLastError = err;
         return false;
     }
 
@@ -213,6 +238,42 @@ bool C3DModelOBJ::ExportToSTUFormat(const std::string &path, bool bFlipUV)
 
     m_Entries.resize((int)shapes.size());
 
+    if (m_pOutputSink)
+    {
+        if (!m_Export.BeginStream(m_pOutputSink, m_bAsyncOutput))
+        {
+            return false;
+        }
+    }
+    else if (m_bMappedOutput)
+    {
+        // Sizing pass: the vertex chunks are exact, the node chunks are estimated.
+        uint32_t uVertexSize = attrib.normals.size() > 0 ? sizeof(VertexDataWithNormals) : sizeof(VertexDataTextured);
+        uint64_t uReserve = CFileExportSTUFormat::GetFileHeaderFootprint();
+        for (size_t s = 0; s < shapes.size(); s++)
+        {
+            uReserve += CFileExportSTUFormat::GetChunkFootprint((uint32_t)(uVertexSize * shapes[s].mesh.indices.size()));
+            uReserve += CFileExportSTUFormat::GetChunkFootprint(sizeof(float) * 6);
+            uReserve += CFileExportSTUFormat::GetChunkFootprint((CFileExportSTUFormat::uMaxTextLength + 1) * 6 + 256);
+        }
+
+        std::string sSTUPath = path;
+        sSTUPath.append(".stu");
+        if (!m_Export.BeginMappedFile(sSTUPath, uReserve))
+        {
+            return false;
+        }
+    }
+    else if (m_bAsyncOutput)
+    {
+        std::string sSTUPath = path;
+        sSTUPath.append(".stu");
+        if (!m_Export.BeginStream(sSTUPath, true))
+        {
+            return false;
+        }
+    }
+
     // Append `default` material
     tinyobj::material_t defaultcolor = tinyobj::material_t();
     defaultcolor.ambient[0] = defaultcolor.diffuse[0] = defaultcolor.specular[0] = m_SolidColor[0];
@@ -235,7 +296,7 @@ bool C3DModelOBJ::ExportToSTUFormat(const std::string &path, bool bFlipUV)
         {
             nodeName = std::string("OBJ.(UNKNOWN-") + std::to_string(m_uUniqueOBJUnknownID++) + ")";
         }
-        LOG_INFO("Found node '%s'\n", nodeName.c_str());
+        LOG_DEBUG("Found node '%s'\n", nodeName.c_str());
 
         glm::mat4 matrix;
 
@@ -253,14 +314,13 @@ bool C3DModelOBJ::ExportToSTUFormat(const std::string &path, bool bFlipUV)
         WRITE_VALUE(uValue);
 
         std::string meshName;
-        static uint32_t sUniqueOBJUnknownMeshID = 0;
         if (strlen(shapes[s].name.c_str()) > 0)
         {
-            meshName = nodeName + ".mesh(" + shapes[s].name.c_str() + "-" + std::to_string(sUniqueOBJUnknownMeshID++) + ")";
+            meshName = nodeName + ".mesh(" + shapes[s].name.c_str() + "-" + std::to_string(m_uUniqueOBJUnknownMeshID++) + ")";
         }
         else
         {
-            meshName = nodeName + ".mesh(UNKNOWN-" + std::to_string(sUniqueOBJUnknownMeshID++) + ")";
+            meshName = nodeName + ".mesh(UNKNOWN-" + std::to_string(m_uUniqueOBJUnknownMeshID++) + ")";
         }
         std::string VBOName = meshName + ".VBO";
         std::string IBOName = meshName + ".IBO";
@@ -279,7 +339,11 @@ bool C3DModelOBJ::ExportToSTUFormat(const std::string &path, bool bFlipUV)
         WRITE_VALUE(uValue);
 
         std::string sVertexChunkname = std::string("Vx:") + std::to_string(m_uSubModelVertexCount ++);
-        WriteVertexChunk(m_Export, path, bFlipUV, sVertexChunkname, shapes[s].mesh, attrib);
+        if (!WriteVertexChunk(m_Export, path, bFlipUV, sVertexChunkname, shapes[s].mesh, attrib))
+        {
+            LOG_ERROR("Mesh '%s' could not be exported, the model is incomplete.", meshName.c_str());
+            return false;
+        }
 
         uValue = 0;// shapes[s].mesh.indices.size();
         WRITE_VALUE(uValue);
@@ -361,13 +425,27 @@ bool C3DModelOBJ::ExportToSTUFormat(const std::string &path, bool bFlipUV)
         sSTUPath.append(".stu");
         m_Export.AppendChunkToFile(sSTUPath, sChunkname, &Data.at(0), (uint32_t)Data.size());
 #else
-        m_Export.WriteChunk(sChunkname, &Data.at(0), (uint32_t)Data.size());
+        m_Export.WriteChunk(sChunkname, std::move(Data));
 #endif
     }
 
+    // Sequential export stores each chunk as soon as it is made, without looking back at the result.
+    if (m_Export.HasAppendFailed())
+    {
+        return false;
+    }
+    if (m_Export.IsMapped())
+    {
+        return m_Export.EndMappedFile();
+    }
+    if (m_Export.IsStreaming())
+    {
+        return m_Export.EndStream();
+    }
+
 #if !STU_EXPORT_SEQUENTIAL
     std::string sSTUPath = path;
-    sSTUPath.Append(".stu");
+    sSTUPath.append(".stu");
     m_Export.ExportFile(sSTUPath);
 #endif
 
@@ -9,10 +9,25 @@ public:
     C3DModelOBJ();
     virtual ~C3DModelOBJ();
 
+    /* Drop everything kept from the last model so the converter can be reused for the next one. Options are kept. */
+    void Reset();
+
     bool ExportToSTUFormat(const std::string &path);
     bool ExportToSTUFormat(const std::string &path, bool bFlipUV = true);
     void SetDefaultSolidColor(float fRed, float fGreen, float fBlue) { m_SolidColor[0] = fRed; m_SolidColor[1] = fGreen;  m_SolidColor[2] = fBlue; }
 
+    /* Write the .stu through a preallocated memory mapping instead of appending chunk by chunk */
+    void SetMappedOutput(bool bMapped) { m_bMappedOutput = bMapped; }
+
+    /* Hand finished chunks to a background writer thread so encoding overlaps disk I/O. Ignored in mapped mode. */
+    void SetAsyncOutput(bool bAsync) { m_bAsyncOutput = bAsync; }
+
+    /* Write the .stu into pSink (not owned) instead of a file next to the model, e.g. a memory buffer or stdout */
+    void SetOutputSink(COutputSink * pSink) { m_pOutputSink = pSink; }
+
+    /* Why the last ExportToSTUFormat failed, as the importer reported it. Empty when it succeeded or gave no reason. */
+    const std::string & GetLastError() const { return m_sLastError; }
+
 private:
 
     void ExportSceneTree();
@@ -32,8 +47,13 @@ private:
 
     CFileExportSTUFormat m_Export;
     bool m_bFlipUVonY;
+    bool m_bMappedOutput;
+    bool m_bAsyncOutput;
+    COutputSink * m_pOutputSink;
     uint32_t m_uUniqueOBJUnknownID;
+    uint32_t m_uUniqueOBJUnknownMeshID;
     float m_SolidColor[3];
+    std::string m_sLastError;
 };
 
 #endif // _YES_3D_MODEL_OBJ
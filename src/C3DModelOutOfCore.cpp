@@ -0,0 +1,1608 @@
+#include "C3DModelOutOfCore.h"
+#include "C3DModelDataStructures.h"
+#include "CExternalSort.h"
+#include "CImporterRegistry.h"
+#include "CLog.h"
+#include "CExportKernels.h"
+
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <unordered_map>
+
+#define LOG_ERROR(...) STU_LOG_ERROR("C3DModelOutOfCore", __VA_ARGS__)
+#define LOG_INFO(...) STU_LOG_INFO("C3DModelOutOfCore", __VA_ARGS__)
+
+static const uint64_t NO_INDEX = ~0ull;
+
+// Same limits the Assimp path splits meshes at, so every index fits in 16 bits.
+static const uint32_t MAX_PART_VERTICES = USHRT_MAX - 1;
+static const uint32_t MAX_PART_TRIANGLES = USHRT_MAX - 1;
+
+// Largest amount of chunk data a .stu can describe, uStreamedSize itself is reserved.
+static const uint64_t MAX_FILE_DATA = CFileExportSTUFormat::uStreamedSize - 1;
+
+// Bytes of the source model held in memory at a time.
+static const size_t READ_WINDOW = 16 * 1024 * 1024;
+
+// Estimated memory per unique position while welding (table entry and accumulated vertex), and how far
+// buckets are split before welding whatever is left in one go.
+static const uint64_t WELD_BYTES_PER_CORNER = 96;
+static const uint32_t MAX_WELD_BUCKETS = 64;
+static const uint32_t MAX_WELD_DEPTH = 4;
+
+enum VertexAttribute
+{
+    VertexAttribute_Normal = 0x1,
+    VertexAttribute_Texcoord = 0x2,
+    VertexAttribute_Color = 0x4,
+};
+
+// Attribute indices of one polygon corner, NO_INDEX where the corner has none.
+struct CornerKey
+{
+    uint64_t uPosition;
+    uint64_t uTexcoord;
+    uint64_t uNormal;
+
+    bool operator==(const CornerKey &Other) const
+    {
+        return uPosition == Other.uPosition && uTexcoord == Other.uTexcoord && uNormal == Other.uNormal;
+    }
+};
+
+struct CornerKeyHash
+{
+    size_t operator()(const CornerKey &Key) const
+    {
+        uint64_t h = Key.uPosition * 0x9E3779B97F4A7C15ull;
+        h ^= (Key.uTexcoord + 0x7F4A7C15ull) * 0xC2B2AE3D27D4EB4Full;
+        h ^= (Key.uNormal + 0x165667B1ull) * 0x165667B19E3779F9ull;
+        return (size_t)(h ^ (h >> 29));
+    }
+};
+
+struct TriangleRecord
+{
+    CornerKey Corners[3];
+};
+
+struct VertexRecord
+{
+    float Position[3];
+    float Normal[3];
+    float Texcoord[2];
+    float Color[3];
+};
+
+struct TexcoordRecord
+{
+    float Texcoord[2];
+};
+
+struct NormalRecord
+{
+    float Normal[3];
+};
+
+// Output vertex uSlot needs attribute uIndex.
+struct SlotRequest
+{
+    uint64_t uIndex;
+    uint64_t uSlot;
+};
+
+struct SlotRequestByIndex
+{
+    bool operator()(const SlotRequest &A, const SlotRequest &B) const { return A.uIndex < B.uIndex; }
+};
+
+template <typename T>
+struct SlotValue
+{
+    uint64_t uSlot;
+    T Value;
+};
+
+template <typename T>
+struct SlotValueBySlot
+{
+    bool operator()(const SlotValue<T> &A, const SlotValue<T> &B) const { return A.uSlot < B.uSlot; }
+};
+
+// STL corner before welding, uCorner is triangle * 3 + corner.
+struct StlCorner
+{
+    uint64_t uCorner;
+    float Position[3];
+    float Normal[3];
+};
+
+struct CornerVertex
+{
+    uint64_t uCorner;
+    uint64_t uVertex;
+};
+
+struct CornerVertexByCorner
+{
+    bool operator()(const CornerVertex &A, const CornerVertex &B) const { return A.uCorner < B.uCorner; }
+};
+
+typedef CExternalSorter<CornerVertex, CornerVertexByCorner> CornerVertexSorter;
+
+// Exact position, -0 folded into +0 so both weld together.
+struct PositionKey
+{
+    uint32_t Bits[3];
+
+    PositionKey(const float Position[3])
+    {
+        for (uint32_t c = 0; c < 3; ++c)
+        {
+            float fValue = Position[c] + 0.0f;
+            memcpy(&Bits[c], &fValue, sizeof(float));
+        }
+    }
+
+    bool operator==(const PositionKey &Other) const
+    {
+        return Bits[0] == Other.Bits[0] && Bits[1] == Other.Bits[1] && Bits[2] == Other.Bits[2];
+    }
+};
+
+static uint64_t HashPosition(const PositionKey &Key, uint64_t uSeed)
+{
+    uint64_t h = (uSeed + 1) * 0x9E3779B97F4A7C15ull;
+    for (uint32_t c = 0; c < 3; ++c)
+    {
+        h ^= Key.Bits[c];
+        h *= 0xFF51AFD7ED558CCDull;
+        h ^= h >> 33;
+    }
+    return h;
+}
+
+struct PositionKeyHash
+{
+    size_t operator()(const PositionKey &Key) const { return (size_t)HashPosition(Key, 0); }
+};
+
+// Sequential reader over a fixed window of the source file, for text lines and binary records alike.
+class CWindowReader
+{
+public:
+    CWindowReader() : m_pFile(NULL), m_uBegin(0), m_uEnd(0), m_bEOF(false) {}
+    ~CWindowReader() { Close(); }
+
+    bool Open(const std::string &path)
+    {
+        Close();
+        m_pFile = fopen(path.c_str(), "rb");
+        if (!m_pFile)
+        {
+            return false;
+        }
+        // One spare byte so the last line can always be terminated.
+        m_Window.resize(READ_WINDOW + 1);
+        return true;
+    }
+
+    void Close()
+    {
+        if (m_pFile)
+        {
+            fclose(m_pFile);
+            m_pFile = NULL;
+        }
+        m_uBegin = m_uEnd = 0;
+        m_bEOF = false;
+    }
+
+    /* Next line, terminated and without its end of line characters, or NULL at the end of the file. The line
+       stays valid until the next read. */
+    char * NextLine()
+    {
+        for (;;)
+        {
+            char * pBegin = &m_Window[m_uBegin];
+            char * pNewLine = (char *)memchr(pBegin, '\n', m_uEnd - m_uBegin);
+            if (pNewLine || m_bEOF)
+            {
+                size_t uLength = pNewLine ? (size_t)(pNewLine - pBegin) : m_uEnd - m_uBegin;
+                if (!pNewLine && uLength == 0)
+                {
+                    return NULL;
+                }
+                m_uBegin += pNewLine ? uLength + 1 : uLength;
+                while (uLength > 0 && pBegin[uLength - 1] == '\r')
+                {
+                    uLength--;
+                }
+                pBegin[uLength] = '\0';
+                return pBegin;
+            }
+            if (m_uBegin == 0 && m_uEnd == m_Window.size() - 1)
+            {
+                // A single line longer than the window.
+                m_Window.resize((m_Window.size() - 1) * 2 + 1);
+            }
+            Refill();
+        }
+    }
+
+    bool Read(void * pData, size_t uSize)
+    {
+        uint8_t * pTarget = (uint8_t *)pData;
+        while (uSize > 0)
+        {
+            if (m_uBegin == m_uEnd)
+            {
+                if (m_bEOF)
+                {
+                    return false;
+                }
+                Refill();
+                continue;
+            }
+            size_t uCopy = std::min(uSize, m_uEnd - m_uBegin);
+            memcpy(pTarget, &m_Window[m_uBegin], uCopy);
+            m_uBegin += uCopy;
+            pTarget += uCopy;
+            uSize -= uCopy;
+        }
+        return true;
+    }
+
+private:
+    void Refill()
+    {
+        memmove(&m_Window[0], &m_Window[m_uBegin], m_uEnd - m_uBegin);
+        m_uEnd -= m_uBegin;
+        m_uBegin = 0;
+        size_t uRequested = m_Window.size() - 1 - m_uEnd;
+        size_t uRead = fread(&m_Window[m_uEnd], 1, uRequested, m_pFile);
+        m_uEnd += uRead;
+        if (uRead < uRequested)
+        {
+            m_bEOF = true;
+        }
+    }
+
+    FILE * m_pFile;
+    std::vector<char> m_Window;
+    size_t m_uBegin;
+    size_t m_uEnd;
+    bool m_bEOF;
+};
+
+static uint64_t GetFileSize(const std::string &path)
+{
+    FILE * pFile = fopen(path.c_str(), "rb");
+    if (!pFile)
+    {
+        return 0;
+    }
+    // Scans are well past 2GB, use the 64 bit seek of the platform.
+#ifdef _WIN32
+    uint64_t uSize = _fseeki64(pFile, 0, SEEK_END) == 0 ? (uint64_t)_ftelli64(pFile) : 0;
+#else
+    uint64_t uSize = fseeko(pFile, 0, SEEK_END) == 0 ? (uint64_t)ftello(pFile) : 0;
+#endif
+    fclose(pFile);
+    return uSize;
+}
+
+static bool IsBlank(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+// Parse up to uCount floats from pText, returns how many were found.
+static uint32_t ParseFloats(char *&pText, float * pValues, uint32_t uCount)
+{
+    for (uint32_t i = 0; i < uCount; ++i)
+    {
+        char * pEnd;
+        pValues[i] = strtof(pText, &pEnd);
+        if (pEnd == pText)
+        {
+            return i;
+        }
+        pText = pEnd;
+    }
+    return uCount;
+}
+
+// OBJ indices are 1 based, negative ones count back from the last element read so far.
+static bool ParseObjIndex(char *&pText, uint64_t uCount, uint64_t &uIndex)
+{
+    char * pEnd;
+    long long nIndex = strtoll(pText, &pEnd, 10);
+    if (pEnd == pText)
+    {
+        return false;
+    }
+    pText = pEnd;
+    if (nIndex > 0)
+    {
+        uIndex = (uint64_t)(nIndex - 1);
+        return true;
+    }
+    if (nIndex < 0 && (uint64_t)(-nIndex) <= uCount)
+    {
+        uIndex = uCount - (uint64_t)(-nIndex);
+        return true;
+    }
+    return false;
+}
+
+static bool CreateTempFile(CTempFile &File, const std::string &sDirectory, const char * pPrefix)
+{
+    return File.Create(sDirectory, std::string("stu-") + pPrefix);
+}
+
+bool C3DModelOutOfCore::CanRead(const std::string &path)
+{
+    ModelFormat Format = CImporterRegistry::DetectFormat(path);
+    if (Format != ModelFormat_PLY)
+    {
+        return Format == ModelFormat_OBJ || Format == ModelFormat_STL;
+    }
+
+    // The format line comes right after the magic, only comments may come first.
+    CWindowReader Reader;
+    if (!Reader.Open(path))
+    {
+        return false;
+    }
+    char * pLine;
+    for (uint32_t uLine = 0; uLine < 16 && (pLine = Reader.NextLine()) != NULL; ++uLine)
+    {
+        if (strncmp(pLine, "format ", 7) == 0)
+        {
+            return strncmp(pLine + 7, "binary_", 7) == 0;
+        }
+    }
+    return false;
+}
+
+C3DModelOutOfCore::C3DModelOutOfCore() :
+    m_bMappedOutput(false),
+    m_bAsyncOutput(false),
+    m_pOutputSink(YI_NULL),
+    m_uMemoryBudget(uDefaultMemoryBudget),
+    m_uNumVertices(0),
+    m_uNumTexcoords(0),
+    m_uNumNormals(0),
+    m_uNumTriangles(0),
+    m_uAttributes(0),
+    m_bSeparateTexcoords(false),
+    m_bSeparateNormals(false),
+    m_uNumSlots(0),
+    m_uFileData(0),
+    m_uFileChunkCount(0)
+{
+    m_SolidColor[0] = 0.5f;
+    m_SolidColor[1] = 0.5f;
+    m_SolidColor[2] = 0.5f;
+}
+
+C3DModelOutOfCore::~C3DModelOutOfCore()
+{
+    Reset();
+}
+
+void C3DModelOutOfCore::Reset()
+{
+    m_Export.Reset();
+    m_Vertices.Close();
+    m_Texcoords.Close();
+    m_Normals.Close();
+    m_Triangles.Close();
+    m_Indices.Close();
+    m_Requests.Close();
+    m_Resolved.Close();
+    m_uNumVertices = 0;
+    m_uNumTexcoords = 0;
+    m_uNumNormals = 0;
+    m_uNumTriangles = 0;
+    m_uAttributes = 0;
+    m_bSeparateTexcoords = false;
+    m_bSeparateNormals = false;
+    std::vector<PartInfo>().swap(m_Parts);
+    m_uNumSlots = 0;
+    m_OutputFiles.clear();
+    m_uFileData = 0;
+    m_uFileChunkCount = 0;
+    m_sWorkDirectory.clear();
+}
+
+bool C3DModelOutOfCore::ExportToSTUFormat(const std::string &path, bool bFlipUV)
+{
+    Reset();
+    m_sLastError.clear();
+    m_sWorkDirectory = m_sTempDirectory.empty() ? path.substr(0, path.find_last_of("/\\") + 1) : m_sTempDirectory;
+
+    bool bRead = false;
+    ModelFormat Format = CImporterRegistry::DetectFormat(path);
+    if (Format == ModelFormat_OBJ)
+    {
+        bRead = ReadOBJ(path);
+    }
+    else if (Format == ModelFormat_PLY)
+    {
+        bRead = ReadPLY(path);
+    }
+    else if (Format == ModelFormat_STL)
+    {
+        bRead = ReadSTL(path);
+    }
+    else
+    {
+        LOG_ERROR("'%s' is not an OBJ, PLY or STL model.\n", path.c_str());
+        m_sLastError = "Only OBJ, PLY and STL models are converted out of core.";
+    }
+    if (!bRead)
+    {
+        if (m_sLastError.empty())
+        {
+            m_sLastError = "Could not read the model into the temporary files.";
+        }
+        Reset();
+        return false;
+    }
+
+    LOG_INFO("Read '%s': %llu vertices, %llu texcoords, %llu normals, %llu triangles.\n", path.c_str(), (unsigned long long)m_uNumVertices,
+        (unsigned long long)m_uNumTexcoords, (unsigned long long)m_uNumNormals, (unsigned long long)m_uNumTriangles);
+
+    bool bSuccess = SplitParts() && ResolveVertices();
+    if (!bSuccess)
+    {
+        m_sLastError = "Could not split the model into parts in the temporary files.";
+    }
+    else if (!WriteParts(path, bFlipUV))
+    {
+        bSuccess = false;
+        if (m_sLastError.empty())
+        {
+            m_sLastError = "Could not write the .stu output.";
+        }
+    }
+    if (bSuccess)
+    {
+        LOG_INFO("Wrote %u parts into %u file(s).\n", (uint32_t)m_Parts.size(), m_pOutputSink ? 1 : (uint32_t)m_OutputFiles.size());
+    }
+
+    // The temp files are deleted right away, they can be as large as the model.
+    std::vector<std::string> OutputFiles;
+    OutputFiles.swap(m_OutputFiles);
+    Reset();
+
+    // The parts completed before the failure are no use without the rest of the model.
+    if (!bSuccess)
+    {
+        for (size_t i = 0; i < OutputFiles.size(); ++i)
+        {
+            LOG_ERROR("Deleting incomplete output '%s'.\n", OutputFiles[i].c_str());
+            remove(OutputFiles[i].c_str());
+        }
+        OutputFiles.clear();
+    }
+    m_OutputFiles.swap(OutputFiles);
+    return bSuccess;
+}
+
+bool C3DModelOutOfCore::ReadOBJ(const std::string &path)
+{
+    CWindowReader Reader;
+    if (!Reader.Open(path))
+    {
+        LOG_ERROR("Could not open '%s'.\n", path.c_str());
+        return false;
+    }
+    if (!CreateTempFile(m_Vertices, m_sWorkDirectory, "vertices") || !CreateTempFile(m_Texcoords, m_sWorkDirectory, "texcoords") ||
+        !CreateTempFile(m_Normals, m_sWorkDirectory, "normals") || !CreateTempFile(m_Triangles, m_sWorkDirectory, "triangles"))
+    {
+        return false;
+    }
+
+    std::vector<CornerKey> Polygon;
+    uint64_t uInvalidFaces = 0;
+    char * pLine;
+    while ((pLine = Reader.NextLine()) != NULL)
+    {
+        while (IsBlank(*pLine))
+        {
+            pLine++;
+        }
+
+        bool bWritten = true;
+        if (pLine[0] == 'v' && IsBlank(pLine[1]))
+        {
+            VertexRecord Vertex = VertexRecord();
+            char * pText = pLine + 1;
+            ParseFloats(pText, Vertex.Position, 3);
+            // "v x y z r g b", the vertex color extension most scanners write.
+            if (ParseFloats(pText, Vertex.Color, 3) == 3)
+            {
+                m_uAttributes |= VertexAttribute_Color;
+            }
+            else
+            {
+                Vertex.Color[0] = Vertex.Color[1] = Vertex.Color[2] = 0.0f;
+            }
+            bWritten = m_Vertices.WriteRecord(Vertex);
+            m_uNumVertices++;
+        }
+        else if (pLine[0] == 'v' && pLine[1] == 't' && IsBlank(pLine[2]))
+        {
+            TexcoordRecord Texcoord = TexcoordRecord();
+            char * pText = pLine + 2;
+            ParseFloats(pText, Texcoord.Texcoord, 2);
+            bWritten = m_Texcoords.WriteRecord(Texcoord);
+            m_uNumTexcoords++;
+        }
+        else if (pLine[0] == 'v' && pLine[1] == 'n' && IsBlank(pLine[2]))
+        {
+            NormalRecord Normal = NormalRecord();
+            char * pText = pLine + 2;
+            ParseFloats(pText, Normal.Normal, 3);
+            bWritten = m_Normals.WriteRecord(Normal);
+            m_uNumNormals++;
+        }
+        else if (pLine[0] == 'f' && IsBlank(pLine[1]))
+        {
+            Polygon.clear();
+            bool bValid = true;
+            char * pText = pLine + 1;
+            for (;;)
+            {
+                while (IsBlank(*pText))
+                {
+                    pText++;
+                }
+                if (*pText == '\0' || *pText == '#')
+                {
+                    break;
+                }
+
+                // v, v/vt, v//vn or v/vt/vn
+                CornerKey Key = { NO_INDEX, NO_INDEX, NO_INDEX };
+                bValid = ParseObjIndex(pText, m_uNumVertices, Key.uPosition);
+                if (bValid && *pText == '/')
+                {
+                    pText++;
+                    if (*pText != '/')
+                    {
+                        bValid = ParseObjIndex(pText, m_uNumTexcoords, Key.uTexcoord);
+                    }
+                    if (bValid && *pText == '/')
+                    {
+                        pText++;
+                        bValid = ParseObjIndex(pText, m_uNumNormals, Key.uNormal);
+                    }
+                }
+                if (!bValid)
+                {
+                    break;
+                }
+                m_bSeparateTexcoords = m_bSeparateTexcoords || Key.uTexcoord != NO_INDEX;
+                m_bSeparateNormals = m_bSeparateNormals || Key.uNormal != NO_INDEX;
+                Polygon.push_back(Key);
+            }
+
+            if (!bValid || Polygon.size() < 3)
+            {
+                uInvalidFaces++;
+                continue;
+            }
+            for (size_t i = 1; i + 1 < Polygon.size() && bWritten; ++i)
+            {
+                TriangleRecord Triangle;
+                Triangle.Corners[0] = Polygon[0];
+                Triangle.Corners[1] = Polygon[i];
+                Triangle.Corners[2] = Polygon[i + 1];
+                bWritten = m_Triangles.WriteRecord(Triangle);
+                m_uNumTriangles++;
+            }
+        }
+
+        if (!bWritten)
+        {
+            return false;
+        }
+    }
+
+    if (uInvalidFaces > 0)
+    {
+        LOG_ERROR("Skipped %llu faces of '%s' with invalid indices.\n", (unsigned long long)uInvalidFaces, path.c_str());
+    }
+    if (m_bSeparateTexcoords)
+    {
+        m_uAttributes |= VertexAttribute_Texcoord;
+    }
+    if (m_bSeparateNormals)
+    {
+        m_uAttributes |= VertexAttribute_Normal;
+    }
+    return true;
+}
+
+enum PlyType
+{
+    PlyType_Int8,
+    PlyType_UInt8,
+    PlyType_Int16,
+    PlyType_UInt16,
+    PlyType_Int32,
+    PlyType_UInt32,
+    PlyType_Float32,
+    PlyType_Float64,
+    PlyType_Invalid,
+};
+
+struct PlyProperty
+{
+    std::string sName;
+    PlyType Type;
+    PlyType CountType;      // PlyType_Invalid unless the property is a list
+    int32_t nTarget;        // float of VertexRecord it is stored in, -1 if it is not read
+};
+
+struct PlyElement
+{
+    std::string sName;
+    uint64_t uCount;
+    std::vector<PlyProperty> Properties;
+};
+
+static PlyType GetPlyType(const std::string &sName)
+{
+    static const char * pNames[][2] =
+    {
+        { "char", "int8" }, { "uchar", "uint8" }, { "short", "int16" }, { "ushort", "uint16" },
+        { "int", "int32" }, { "uint", "uint32" }, { "float", "float32" }, { "double", "float64" },
+    };
+    for (uint32_t t = 0; t < PlyType_Invalid; ++t)
+    {
+        if (sName == pNames[t][0] || sName == pNames[t][1])
+        {
+            return (PlyType)t;
+        }
+    }
+    return PlyType_Invalid;
+}
+
+static uint32_t GetPlyTypeSize(PlyType Type)
+{
+    static const uint32_t uSizes[] = { 1, 1, 2, 2, 4, 4, 4, 8 };
+    return Type < PlyType_Invalid ? uSizes[Type] : 0;
+}
+
+static bool ReadPlyValue(CWindowReader &Reader, PlyType Type, bool bSwap, double &dValue)
+{
+    uint8_t Bytes[8];
+    uint32_t uSize = GetPlyTypeSize(Type);
+    if (!Reader.Read(Bytes, uSize))
+    {
+        return false;
+    }
+    if (bSwap)
+    {
+        std::reverse(Bytes, Bytes + uSize);
+    }
+    switch (Type)
+    {
+    case PlyType_Int8: { int8_t v; memcpy(&v, Bytes, 1); dValue = v; break; }
+    case PlyType_UInt8: { uint8_t v; memcpy(&v, Bytes, 1); dValue = v; break; }
+    case PlyType_Int16: { int16_t v; memcpy(&v, Bytes, 2); dValue = v; break; }
+    case PlyType_UInt16: { uint16_t v; memcpy(&v, Bytes, 2); dValue = v; break; }
+    case PlyType_Int32: { int32_t v; memcpy(&v, Bytes, 4); dValue = v; break; }
+    case PlyType_UInt32: { uint32_t v; memcpy(&v, Bytes, 4); dValue = v; break; }
+    case PlyType_Float32: { float v; memcpy(&v, Bytes, 4); dValue = v; break; }
+    case PlyType_Float64: { double v; memcpy(&v, Bytes, 8); dValue = v; break; }
+    default: return false;
+    }
+    return true;
+}
+
+// Offset of the named vertex property in VertexRecord, in floats.
+static int32_t GetPlyVertexTarget(const std::string &sName)
+{
+    static const char * pNames[][3] =
+    {
+        { "x", "", "" }, { "y", "", "" }, { "z", "", "" },
+        { "nx", "normal_x", "" }, { "ny", "normal_y", "" }, { "nz", "normal_z", "" },
+        { "u", "s", "texture_u" }, { "v", "t", "texture_v" },
+        { "red", "r", "diffuse_red" }, { "green", "g", "diffuse_green" }, { "blue", "b", "diffuse_blue" },
+    };
+    for (int32_t t = 0; t < (int32_t)(sizeof(pNames) / sizeof(pNames[0])); ++t)
+    {
+        for (uint32_t n = 0; n < 3; ++n)
+        {
+            if (pNames[t][n][0] && sName == pNames[t][n])
+            {
+                return t;
+            }
+        }
+    }
+    return -1;
+}
+
+bool C3DModelOutOfCore::ReadPLY(const std::string &path)
+{
+    CWindowReader Reader;
+    if (!Reader.Open(path))
+    {
+        LOG_ERROR("Could not open '%s'.\n", path.c_str());
+        return false;
+    }
+
+    std::vector<PlyElement> Elements;
+    bool bBinary = false;
+    bool bSwap = false;
+    bool bHeader = false;
+    char * pLine = Reader.NextLine();
+    if (!pLine || strcmp(pLine, "ply") != 0)
+    {
+        LOG_ERROR("'%s' is not a PLY file.\n", path.c_str());
+        return false;
+    }
+    while ((pLine = Reader.NextLine()) != NULL)
+    {
+        char Word[3][64] = { { 0 } };
+        int nWords = sscanf(pLine, "%63s %63s %63s", Word[0], Word[1], Word[2]);
+        std::string sKeyword = nWords > 0 ? Word[0] : "";
+        if (sKeyword == "end_header")
+        {
+            bHeader = true;
+            break;
+        }
+        else if (sKeyword == "format" && nWords >= 2)
+        {
+            uint16_t uOne = 1;
+            bool bLittleEndianHost = *(uint8_t *)&uOne == 1;
+            bBinary = strcmp(Word[1], "binary_little_endian") == 0 || strcmp(Word[1], "binary_big_endian") == 0;
+            bSwap = bBinary && (strcmp(Word[1], "binary_little_endian") == 0) != bLittleEndianHost;
+        }
+        else if (sKeyword == "element" && nWords == 3)
+        {
+            PlyElement Element;
+            Element.sName = Word[1];
+            Element.uCount = strtoull(Word[2], NULL, 10);
+            Elements.push_back(Element);
+        }
+        else if (sKeyword == "property" && !Elements.empty())
+        {
+            PlyProperty Property;
+            Property.nTarget = -1;
+            if (strcmp(Word[1], "list") == 0)
+            {
+                char Name[2][64] = { { 0 } };
+                if (sscanf(pLine, "%*s %*s %*s %63s %63s", Name[0], Name[1]) != 2)
+                {
+                    LOG_ERROR("Invalid PLY property '%s'.\n", pLine);
+                    return false;
+                }
+                Property.CountType = GetPlyType(Word[2]);
+                Property.Type = GetPlyType(Name[0]);
+                Property.sName = Name[1];
+                if (Property.CountType == PlyType_Invalid)
+                {
+                    LOG_ERROR("Invalid PLY property '%s'.\n", pLine);
+                    return false;
+                }
+            }
+            else
+            {
+                Property.CountType = PlyType_Invalid;
+                Property.Type = GetPlyType(Word[1]);
+                Property.sName = Word[2];
+                if (Elements.back().sName == "vertex")
+                {
+                    Property.nTarget = GetPlyVertexTarget(Property.sName);
+                }
+            }
+            if (Property.Type == PlyType_Invalid)
+            {
+                LOG_ERROR("Invalid PLY property '%s'.\n", pLine);
+                return false;
+            }
+            Elements.back().Properties.push_back(Property);
+        }
+    }
+    if (!bHeader)
+    {
+        LOG_ERROR("'%s' has no PLY header.\n", path.c_str());
+        return false;
+    }
+    if (!bBinary)
+    {
+        LOG_ERROR("'%s' is an ASCII PLY, only binary PLY is read out of core.\n", path.c_str());
+        return false;
+    }
+
+    if (!CreateTempFile(m_Vertices, m_sWorkDirectory, "vertices") || !CreateTempFile(m_Triangles, m_sWorkDirectory, "triangles"))
+    {
+        return false;
+    }
+
+    std::vector<uint64_t> Polygon;
+    uint64_t uInvalidFaces = 0;
+    for (size_t e = 0; e < Elements.size(); ++e)
+    {
+        const PlyElement &Element = Elements[e];
+        bool bVertices = Element.sName == "vertex";
+        bool bFaces = Element.sName == "face";
+        if (bVertices)
+        {
+            for (size_t p = 0; p < Element.Properties.size(); ++p)
+            {
+                int32_t nTarget = Element.Properties[p].nTarget;
+                m_uAttributes |= nTarget >= 3 && nTarget < 6 ? VertexAttribute_Normal : 0;
+                m_uAttributes |= nTarget >= 6 && nTarget < 8 ? VertexAttribute_Texcoord : 0;
+                m_uAttributes |= nTarget >= 8 ? VertexAttribute_Color : 0;
+            }
+        }
+
+        for (uint64_t i = 0; i < Element.uCount; ++i)
+        {
+            VertexRecord Vertex = VertexRecord();
+            for (size_t p = 0; p < Element.Properties.size(); ++p)
+            {
+                const PlyProperty &Property = Element.Properties[p];
+                double dValue = 0.0;
+                if (Property.CountType == PlyType_Invalid)
+                {
+                    if (!ReadPlyValue(Reader, Property.Type, bSwap, dValue))
+                    {
+                        LOG_ERROR("'%s' ends in the middle of element '%s'.\n", path.c_str(), Element.sName.c_str());
+                        return false;
+                    }
+                    if (Property.nTarget >= 8 && Property.Type != PlyType_Float32 && Property.Type != PlyType_Float64)
+                    {
+                        // Integer colors are normalized by the range of their type.
+                        dValue /= Property.Type == PlyType_UInt16 || Property.Type == PlyType_Int16 ? 65535.0 : 255.0;
+                    }
+                    if (Property.nTarget >= 0)
+                    {
+                        ((float *)&Vertex)[Property.nTarget] = (float)dValue;
+                    }
+                    continue;
+                }
+
+                bool bIndices = bFaces && (Property.sName == "vertex_indices" || Property.sName == "vertex_index");
+                if (!ReadPlyValue(Reader, Property.CountType, bSwap, dValue))
+                {
+                    LOG_ERROR("'%s' ends in the middle of element '%s'.\n", path.c_str(), Element.sName.c_str());
+                    return false;
+                }
+                uint64_t uCount = (uint64_t)dValue;
+                Polygon.clear();
+                for (uint64_t c = 0; c < uCount; ++c)
+                {
+                    if (!ReadPlyValue(Reader, Property.Type, bSwap, dValue))
+                    {
+                        LOG_ERROR("'%s' ends in the middle of element '%s'.\n", path.c_str(), Element.sName.c_str());
+                        return false;
+                    }
+                    if (bIndices)
+                    {
+                        Polygon.push_back(dValue >= 0.0 ? (uint64_t)dValue : NO_INDEX);
+                    }
+                }
+                if (!bIndices)
+                {
+                    continue;
+                }
+                if (Polygon.size() < 3 || std::find(Polygon.begin(), Polygon.end(), NO_INDEX) != Polygon.end())
+                {
+                    uInvalidFaces++;
+                    continue;
+                }
+                for (size_t c = 1; c + 1 < Polygon.size(); ++c)
+                {
+                    TriangleRecord Triangle;
+                    CornerKey Corners[3] = { { Polygon[0], NO_INDEX, NO_INDEX }, { Polygon[c], NO_INDEX, NO_INDEX }, { Polygon[c + 1], NO_INDEX, NO_INDEX } };
+                    std::copy(Corners, Corners + 3, Triangle.Corners);
+                    if (!m_Triangles.WriteRecord(Triangle))
+                    {
+                        return false;
+                    }
+                    m_uNumTriangles++;
+                }
+            }
+
+            if (bVertices)
+            {
+                if (!m_Vertices.WriteRecord(Vertex))
+                {
+                    return false;
+                }
+                m_uNumVertices++;
+            }
+        }
+    }
+
+    if (uInvalidFaces > 0)
+    {
+        LOG_ERROR("Skipped %llu faces of '%s' with invalid indices.\n", (unsigned long long)uInvalidFaces, path.c_str());
+    }
+    return true;
+}
+
+// Corners of one STL facet, all with the area weighted facet normal so welded vertices get smooth normals.
+static bool WriteStlFacet(CTempFile &Corners, uint64_t uTriangle, const float Positions[3][3])
+{
+    glm::vec3 P0(Positions[0][0], Positions[0][1], Positions[0][2]);
+    glm::vec3 P1(Positions[1][0], Positions[1][1], Positions[1][2]);
+    glm::vec3 P2(Positions[2][0], Positions[2][1], Positions[2][2]);
+    glm::vec3 Normal = glm::cross(P1 - P0, P2 - P0);
+
+    for (uint32_t c = 0; c < 3; ++c)
+    {
+        StlCorner Corner;
+        Corner.uCorner = uTriangle * 3 + c;
+        memcpy(Corner.Position, Positions[c], sizeof(Corner.Position));
+        Corner.Normal[0] = Normal.x;
+        Corner.Normal[1] = Normal.y;
+        Corner.Normal[2] = Normal.z;
+        if (!Corners.WriteRecord(Corner))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool C3DModelOutOfCore::ReadSTL(const std::string &path)
+{
+    CWindowReader Reader;
+    if (!Reader.Open(path))
+    {
+        LOG_ERROR("Could not open '%s'.\n", path.c_str());
+        return false;
+    }
+    std::unique_ptr<CTempFile> pCorners(new CTempFile());
+    if (!CreateTempFile(*pCorners, m_sWorkDirectory, "corners") || !CreateTempFile(m_Vertices, m_sWorkDirectory, "vertices") ||
+        !CreateTempFile(m_Triangles, m_sWorkDirectory, "triangles"))
+    {
+        return false;
+    }
+
+    // Binary files are recognized by their size, ASCII files also start with "solid" but do not match it.
+    uint8_t Header[84] = { 0 };
+    uint32_t uNumFacets = 0;
+    bool bBinary = Reader.Read(Header, sizeof(Header));
+    if (bBinary)
+    {
+        memcpy(&uNumFacets, Header + 80, sizeof(uint32_t));
+        bBinary = GetFileSize(path) == 84 + 50 * (uint64_t)uNumFacets;
+    }
+
+    if (bBinary)
+    {
+        for (uint32_t t = 0; t < uNumFacets; ++t)
+        {
+            uint8_t Facet[50];
+            float Positions[3][3];
+            if (!Reader.Read(Facet, sizeof(Facet)))
+            {
+                LOG_ERROR("'%s' ends after %u of %u facets.\n", path.c_str(), t, uNumFacets);
+                return false;
+            }
+            // Skips the stored normal, it is often left at zero.
+            memcpy(Positions, Facet + 12, sizeof(Positions));
+            if (!WriteStlFacet(*pCorners, m_uNumTriangles++, Positions))
+            {
+                return false;
+            }
+        }
+    }
+    else
+    {
+        if (!Reader.Open(path))
+        {
+            LOG_ERROR("Could not open '%s'.\n", path.c_str());
+            return false;
+        }
+        std::vector<glm::vec3> Polygon;
+        char * pLine;
+        while ((pLine = Reader.NextLine()) != NULL)
+        {
+            while (IsBlank(*pLine))
+            {
+                pLine++;
+            }
+            if (strncmp(pLine, "vertex", 6) == 0 && IsBlank(pLine[6]))
+            {
+                glm::vec3 Position(0.0f);
+                char * pText = pLine + 6;
+                ParseFloats(pText, &Position.x, 3);
+                Polygon.push_back(Position);
+            }
+            else if (strncmp(pLine, "endfacet", 8) == 0)
+            {
+                for (size_t c = 1; c + 1 < Polygon.size(); ++c)
+                {
+                    float Positions[3][3];
+                    memcpy(Positions[0], &Polygon[0].x, sizeof(Positions[0]));
+                    memcpy(Positions[1], &Polygon[c].x, sizeof(Positions[1]));
+                    memcpy(Positions[2], &Polygon[c + 1].x, sizeof(Positions[2]));
+                    if (!WriteStlFacet(*pCorners, m_uNumTriangles++, Positions))
+                    {
+                        return false;
+                    }
+                }
+                Polygon.clear();
+            }
+        }
+    }
+    Reader.Close();
+
+    CornerVertexSorter CornerVertices(m_sWorkDirectory, m_uMemoryBudget / 4);
+    if (!WeldCorners(*pCorners, 0, CornerVertices) || !CornerVertices.Finish())
+    {
+        return false;
+    }
+    pCorners.reset();
+
+    // Corners come back in triangle order.
+    for (uint64_t t = 0; t < m_uNumTriangles; ++t)
+    {
+        TriangleRecord Triangle;
+        for (uint32_t c = 0; c < 3; ++c)
+        {
+            CornerVertex Corner;
+            if (!CornerVertices.Next(Corner))
+            {
+                LOG_ERROR("Lost corners while welding '%s'.\n", path.c_str());
+                return false;
+            }
+            CornerKey Key = { Corner.uVertex, NO_INDEX, NO_INDEX };
+            Triangle.Corners[c] = Key;
+        }
+        if (!m_Triangles.WriteRecord(Triangle))
+        {
+            return false;
+        }
+    }
+    m_uAttributes = VertexAttribute_Normal;
+    return true;
+}
+
+template <typename SorterType>
+bool C3DModelOutOfCore::WeldCorners(CTempFile &Corners, uint32_t uDepth, SorterType &CornerVertices)
+{
+    uint64_t uNumCorners = Corners.GetRecordCount<StlCorner>();
+    uint64_t uWeldBudget = std::max<uint64_t>(m_uMemoryBudget / 2, 1);
+    if (!Corners.Rewind())
+    {
+        return false;
+    }
+
+    if (uNumCorners * WELD_BYTES_PER_CORNER > uWeldBudget && uDepth < MAX_WELD_DEPTH)
+    {
+        // Equal positions always land in the same bucket, so buckets are welded independently.
+        uint32_t uNumBuckets = (uint32_t)std::min<uint64_t>((uNumCorners * WELD_BYTES_PER_CORNER + uWeldBudget - 1) / uWeldBudget, MAX_WELD_BUCKETS);
+        // Every open bucket holds a stdio buffer, so the buffers of all buckets have to fit the budget as well.
+        uNumBuckets = (uint32_t)std::min<uint64_t>(uNumBuckets, uWeldBudget / CTempFile::uBufferSize);
+        uNumBuckets = std::max<uint32_t>(uNumBuckets, 2);
+        std::vector< std::unique_ptr<CTempFile> > Buckets(uNumBuckets);
+        for (uint32_t b = 0; b < uNumBuckets; ++b)
+        {
+            Buckets[b].reset(new CTempFile());
+            if (!CreateTempFile(*Buckets[b], m_sWorkDirectory, "weld"))
+            {
+                return false;
+            }
+        }
+        StlCorner Corner;
+        while (Corners.ReadRecord(Corner))
+        {
+            uint32_t uBucket = (uint32_t)(HashPosition(PositionKey(Corner.Position), uDepth + 1) % uNumBuckets);
+            if (!Buckets[uBucket]->WriteRecord(Corner))
+            {
+                return false;
+            }
+        }
+        Corners.Close();
+        for (uint32_t b = 0; b < uNumBuckets; ++b)
+        {
+            if (!WeldCorners(*Buckets[b], uDepth + 1, CornerVertices))
+            {
+                return false;
+            }
+            Buckets[b].reset();
+        }
+        return true;
+    }
+
+    std::unordered_map<PositionKey, uint32_t, PositionKeyHash> Welded;
+    std::vector<VertexRecord> Vertices;
+    StlCorner Corner;
+    while (Corners.ReadRecord(Corner))
+    {
+        std::pair<std::unordered_map<PositionKey, uint32_t, PositionKeyHash>::iterator, bool> Result =
+            Welded.insert(std::make_pair(PositionKey(Corner.Position), (uint32_t)Vertices.size()));
+        if (Result.second)
+        {
+            VertexRecord Vertex = VertexRecord();
+            memcpy(Vertex.Position, Corner.Position, sizeof(Vertex.Position));
+            Vertices.push_back(Vertex);
+        }
+        VertexRecord &Vertex = Vertices[Result.first->second];
+        for (uint32_t c = 0; c < 3; ++c)
+        {
+            Vertex.Normal[c] += Corner.Normal[c];
+        }
+    }
+
+    for (size_t v = 0; v < Vertices.size(); ++v)
+    {
+        float * pNormal = Vertices[v].Normal;
+        float fLength = sqrtf(pNormal[0] * pNormal[0] + pNormal[1] * pNormal[1] + pNormal[2] * pNormal[2]);
+        if (fLength > 0.0f)
+        {
+            pNormal[0] /= fLength;
+            pNormal[1] /= fLength;
+            pNormal[2] /= fLength;
+        }
+    }
+    if (!Vertices.empty() && !m_Vertices.Write(&Vertices[0], (uint64_t)Vertices.size() * sizeof(VertexRecord)))
+    {
+        return false;
+    }
+
+    if (!Corners.Rewind())
+    {
+        return false;
+    }
+    while (Corners.ReadRecord(Corner))
+    {
+        CornerVertex Entry = { Corner.uCorner, m_uNumVertices + Welded[PositionKey(Corner.Position)] };
+        if (!CornerVertices.Add(Entry))
+        {
+            return false;
+        }
+    }
+    m_uNumVertices += Vertices.size();
+    Corners.Close();
+    return true;
+}
+
+bool C3DModelOutOfCore::SplitParts()
+{
+    m_Parts.clear();
+    m_uNumSlots = 0;
+    if (!CreateTempFile(m_Indices, m_sWorkDirectory, "indices") || !CreateTempFile(m_Requests, m_sWorkDirectory, "requests"))
+    {
+        return false;
+    }
+
+    if (m_uNumTriangles == 0)
+    {
+        // Point cloud, the parts are runs of the vertex file.
+        for (uint64_t v = 0; v < m_uNumVertices; v += MAX_PART_VERTICES)
+        {
+            PartInfo Part = { (uint32_t)std::min<uint64_t>(MAX_PART_VERTICES, m_uNumVertices - v), 0 };
+            m_Parts.push_back(Part);
+        }
+        return true;
+    }
+
+    std::unordered_map<CornerKey, uint16_t, CornerKeyHash> Local;
+    Local.reserve(MAX_PART_VERTICES);
+    PartInfo Part = { 0, 0 };
+    TriangleRecord Triangle;
+    if (!m_Triangles.Rewind())
+    {
+        return false;
+    }
+    while (m_Triangles.ReadRecord(Triangle))
+    {
+        const CornerKey * pCorners = Triangle.Corners;
+        uint32_t uNew = 0;
+        for (uint32_t c = 0; c < 3; ++c)
+        {
+            bool bRepeated = (c > 0 && pCorners[c] == pCorners[0]) || (c > 1 && pCorners[c] == pCorners[1]);
+            uNew += !bRepeated && Local.find(pCorners[c]) == Local.end() ? 1 : 0;
+        }
+        if (Part.uIndexCount > 0 && (Local.size() + uNew > MAX_PART_VERTICES || Part.uIndexCount / 3 >= MAX_PART_TRIANGLES))
+        {
+            m_Parts.push_back(Part);
+            Part.uVertexCount = 0;
+            Part.uIndexCount = 0;
+            Local.clear();
+        }
+
+        uint16_t Indices[3];
+        for (uint32_t c = 0; c < 3; ++c)
+        {
+            std::unordered_map<CornerKey, uint16_t, CornerKeyHash>::iterator It = Local.find(pCorners[c]);
+            if (It == Local.end())
+            {
+                // Every new corner is the next output vertex ("slot"), its attributes are resolved later.
+                It = Local.insert(std::make_pair(pCorners[c], (uint16_t)Local.size())).first;
+                if (!m_Requests.WriteRecord(pCorners[c]))
+                {
+                    return false;
+                }
+                m_uNumSlots++;
+            }
+            Indices[c] = It->second;
+        }
+        if (!m_Indices.Write(Indices, sizeof(Indices)))
+        {
+            return false;
+        }
+        Part.uIndexCount += 3;
+        Part.uVertexCount = (uint32_t)Local.size();
+    }
+    if (Part.uIndexCount > 0)
+    {
+        m_Parts.push_back(Part);
+    }
+    m_Triangles.Close();
+    return true;
+}
+
+// Look up the attribute of every slot that references one. Requests are sorted by attribute index so the
+// attribute file is read once, front to back, then the results are sorted back into slot order.
+template <typename T>
+static bool JoinAttribute(CTempFile &Requests, uint64_t CornerKey::*pIndex, CTempFile &Attributes, uint64_t uNumAttributes,
+    const std::string &sTempDirectory, uint64_t uMemoryBudget, CExternalSorter< SlotValue<T>, SlotValueBySlot<T> > &Result)
+{
+    CExternalSorter<SlotRequest, SlotRequestByIndex> Sorter(sTempDirectory, uMemoryBudget);
+    if (!Requests.Rewind())
+    {
+        return false;
+    }
+    CornerKey Key;
+    for (uint64_t uSlot = 0; Requests.ReadRecord(Key); ++uSlot)
+    {
+        SlotRequest Request = { Key.*pIndex, uSlot };
+        if (Request.uIndex != NO_INDEX && !Sorter.Add(Request))
+        {
+            return false;
+        }
+    }
+    if (!Sorter.Finish() || !Attributes.Rewind())
+    {
+        return false;
+    }
+
+    uint64_t uRead = 0;
+    uint64_t uMissing = 0;
+    SlotValue<T> Value = SlotValue<T>();
+    SlotRequest Request;
+    while (Sorter.Next(Request))
+    {
+        SlotValue<T> Missing = SlotValue<T>();
+        if (Request.uIndex >= uNumAttributes)
+        {
+            uMissing++;
+            Missing.uSlot = Request.uSlot;
+            if (!Result.Add(Missing))
+            {
+                return false;
+            }
+            continue;
+        }
+        while (uRead <= Request.uIndex)
+        {
+            if (!Attributes.ReadRecord(Value.Value))
+            {
+                return false;
+            }
+            uRead++;
+        }
+        Value.uSlot = Request.uSlot;
+        if (!Result.Add(Value))
+        {
+            return false;
+        }
+    }
+    if (uMissing > 0)
+    {
+        LOG_ERROR("%llu corners reference missing attributes, they are set to zero.\n", (unsigned long long)uMissing);
+    }
+    return Result.Finish();
+}
+
+bool C3DModelOutOfCore::ResolveVertices()
+{
+    if (m_uNumTriangles == 0)
+    {
+        return true;
+    }
+
+    // Three result streams are merged at the end, a fourth sorter orders the requests.
+    uint64_t uBudget = std::max<uint64_t>(m_uMemoryBudget / 4, 1);
+    CExternalSorter< SlotValue<VertexRecord>, SlotValueBySlot<VertexRecord> > Vertices(m_sWorkDirectory, uBudget);
+    CExternalSorter< SlotValue<TexcoordRecord>, SlotValueBySlot<TexcoordRecord> > Texcoords(m_sWorkDirectory, uBudget);
+    CExternalSorter< SlotValue<NormalRecord>, SlotValueBySlot<NormalRecord> > Normals(m_sWorkDirectory, uBudget);
+
+    if (!JoinAttribute(m_Requests, &CornerKey::uPosition, m_Vertices, m_uNumVertices, m_sWorkDirectory, uBudget, Vertices))
+    {
+        return false;
+    }
+    m_Vertices.Close();
+    if (m_bSeparateTexcoords && !JoinAttribute(m_Requests, &CornerKey::uTexcoord, m_Texcoords, m_uNumTexcoords, m_sWorkDirectory, uBudget, Texcoords))
+    {
+        return false;
+    }
+    m_Texcoords.Close();
+    if (m_bSeparateNormals && !JoinAttribute(m_Requests, &CornerKey::uNormal, m_Normals, m_uNumNormals, m_sWorkDirectory, uBudget, Normals))
+    {
+        return false;
+    }
+    m_Normals.Close();
+    m_Requests.Close();
+    Texcoords.Finish();
+    Normals.Finish();
+
+    if (!CreateTempFile(m_Resolved, m_sWorkDirectory, "resolved"))
+    {
+        return false;
+    }
+    SlotValue<TexcoordRecord> Texcoord;
+    SlotValue<NormalRecord> Normal;
+    bool bTexcoord = Texcoords.Next(Texcoord);
+    bool bNormal = Normals.Next(Normal);
+    for (uint64_t uSlot = 0; uSlot < m_uNumSlots; ++uSlot)
+    {
+        SlotValue<VertexRecord> Vertex;
+        if (!Vertices.Next(Vertex) || Vertex.uSlot != uSlot)
+        {
+            LOG_ERROR("Lost vertex %llu while resolving attributes.\n", (unsigned long long)uSlot);
+            return false;
+        }
+        if (bTexcoord && Texcoord.uSlot == uSlot)
+        {
+            memcpy(Vertex.Value.Texcoord, Texcoord.Value.Texcoord, sizeof(Texcoord.Value.Texcoord));
+            bTexcoord = Texcoords.Next(Texcoord);
+        }
+        if (bNormal && Normal.uSlot == uSlot)
+        {
+            memcpy(Vertex.Value.Normal, Normal.Value.Normal, sizeof(Normal.Value.Normal));
+            bNormal = Normals.Next(Normal);
+        }
+        if (!m_Resolved.WriteRecord(Vertex.Value))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static VertexDataType GetOutputType(uint32_t uAttributes)
+{
+    if (uAttributes & VertexAttribute_Normal)
+    {
+        return VertexDataType_Normals;
+    }
+    if (uAttributes & VertexAttribute_Texcoord)
+    {
+        return VertexDataType_Textured;
+    }
+    return (uAttributes & VertexAttribute_Color) ? VertexDataType_Points : VertexDataType_Simple;
+}
+
+static void EncodeVertices(const std::vector<VertexRecord> &Vertices, VertexDataType Type, bool bFlipUV, std::vector<uint8_t> &Data, float bmin[3], float bmax[3])
+{
+    uint32_t uSize = 0;
+    bmin[0] = bmin[1] = bmin[2] = std::numeric_limits<float>::max();
+    bmax[0] = bmax[1] = bmax[2] = -std::numeric_limits<float>::max();
+    Data.reserve(Vertices.size() * GetVertexDataSize(Type));
+
+    for (size_t v = 0; v < Vertices.size(); ++v)
+    {
+        const VertexRecord &Source = Vertices[v];
+        glm::vec3 Position(Source.Position[0], Source.Position[1], Source.Position[2]);
+        float fV = bFlipUV ? 1.0f - Source.Texcoord[1] : Source.Texcoord[1];
+        for (uint32_t c = 0; c < 3; ++c)
+        {
+            bmin[c] = std::min(Position[c], bmin[c]);
+            bmax[c] = std::max(Position[c], bmax[c]);
+        }
+
+        if (Type == VertexDataType_Normals)
+        {
+            VertexDataWithNormals Vertex;
+            Vertex.position = Position;
+            Vertex.normal = glm::vec4(Source.Normal[0], Source.Normal[1], Source.Normal[2], 0.0f);
+            Vertex.texcoord = glm::vec4(Source.Texcoord[0], fV, 0.0f, 0.0f);
+            WRITE_VALUE(Vertex);
+        }
+        else if (Type == VertexDataType_Textured)
+        {
+            VertexDataTextured Vertex;
+            Vertex.position = Position;
+            Vertex.texcoord = glm::vec2(Source.Texcoord[0], fV);
+            WRITE_VALUE(Vertex);
+        }
+        else if (Type == VertexDataType_Points)
+        {
+            VertexDataPoints Vertex;
+            Vertex.position = Position;
+            Vertex.color = glm::vec3(Source.Color[0], Source.Color[1], Source.Color[2]);
+            WRITE_VALUE(Vertex);
+        }
+        else
+        {
+            VertexDataSimple Vertex;
+            Vertex.position = Position;
+            WRITE_VALUE(Vertex);
+        }
+    }
+}
+
+// Single mesh node without children, the same layout the OBJ path writes.
+static void EncodeModel(const std::string &sNodeName, const std::string &sMeshName, const std::string &sName, uint32_t uVertexCount, VertexDataType Type,
+    const std::vector<uint16_t> &Indices, PrimitiveType Primitive, const float SolidColor[3], std::vector<uint8_t> &Data)
+{
+    uint32_t uSize = 0;
+    uint32_t uValue;
+    glm::mat4 matrix;
+
+    uValue = 0; //No children
+    WRITE_VALUE(uValue);
+    uSize += CFileExportSTUFormat::CopyString(sNodeName.c_str(), &Data);
+    uSize += CFileExportSTUFormat::CopyString(sName.c_str(), &Data);
+    WRITE_VALUE(matrix);
+
+    uValue = 1; //Always 1 mesh
+    WRITE_VALUE(uValue);
+    uSize += CFileExportSTUFormat::CopyString(sMeshName.c_str(), &Data);
+    uSize += CFileExportSTUFormat::CopyString(sName.c_str(), &Data);
+
+    uValue = 0; //Always no animation
+    WRITE_VALUE(uValue);
+    WRITE_VALUE(uVertexCount);
+    uValue = Type;
+    WRITE_VALUE(uValue);
+
+    uValue = (uint32_t)Indices.size();
+    WRITE_VALUE(uValue);
+    if (uValue)
+    {
+        WRITE_VALUES(Indices[0], uValue);
+    }
+
+    uValue = Primitive;
+    WRITE_VALUE(uValue);
+    uValue = 0; //Always 2 sides
+    WRITE_VALUE(uValue);
+
+    float fShininess = 8.0f;
+    float fAlpha = 1.0f;
+    WRITE_VALUES(SolidColor[0], 3);
+    WRITE_VALUES(SolidColor[0], 3);
+    WRITE_VALUES(SolidColor[0], 3);
+    WRITE_VALUE(fShininess);
+    WRITE_VALUE(fAlpha);
+
+    uValue = TextureType_COLOR_DIFFUSE;
+    WRITE_VALUE(uValue);
+    WRITE_VALUE(fAlpha);
+    uValue = TextureType_UNKNOWN;
+    WRITE_VALUE(uValue);
+}
+
+uint64_t C3DModelOutOfCore::EstimateFileSize(size_t uFirstPart, uint32_t uVertexSize, size_t uNameLength) const
+{
+    // The model chunk holds the indices, four names derived from the model name and a fixed part.
+    static const uint64_t uModelBytes = 256;
+
+    uint64_t uData = 0;
+    for (size_t p = uFirstPart; p < m_Parts.size() && uData < MAX_FILE_DATA; ++p)
+    {
+        const PartInfo &Part = m_Parts[p];
+        uData += CFileExportSTUFormat::GetChunkFootprint(Part.uVertexCount * uVertexSize) +
+            CFileExportSTUFormat::GetChunkFootprint(6 * sizeof(float)) +
+            CFileExportSTUFormat::GetChunkFootprint((uint32_t)(uModelBytes + 4 * uNameLength + Part.uIndexCount * sizeof(uint16_t)));
+    }
+    return CFileExportSTUFormat::GetFileHeaderFootprint() + std::min(uData, MAX_FILE_DATA);
+}
+
+bool C3DModelOutOfCore::BeginOutputFile(const std::string &path, uint64_t uReserveSize)
+{
+    m_uFileData = 0;
+    m_uFileChunkCount = 0;
+    if (m_pOutputSink)
+    {
+        return m_Export.BeginStream(m_pOutputSink, m_bAsyncOutput);
+    }
+    m_OutputFiles.push_back(path);
+    if (m_bMappedOutput)
+    {
+        // Only an estimate, the mapping grows if the parts take more and is trimmed to what they took.
+        return m_Export.BeginMappedFile(path, uReserveSize);
+    }
+    return m_Export.BeginStream(path, m_bAsyncOutput);
+}
+
+bool C3DModelOutOfCore::EndOutputFile()
+{
+    return m_Export.IsMapped() ? m_Export.EndMappedFile() : m_Export.EndStream();
+}
+
+bool C3DModelOutOfCore::WriteParts(const std::string &path, bool bFlipUV)
+{
+    VertexDataType Type = GetOutputType(m_uAttributes);
+    PrimitiveType Primitive = m_uNumTriangles > 0 ? PrimitiveType_TRIANGLE : PrimitiveType_POINT;
+    CTempFile &Source = m_uNumTriangles > 0 ? m_Resolved : m_Vertices;
+    if ((m_Parts.size() > 0 && !Source.Rewind()) || (m_uNumTriangles > 0 && !m_Indices.Rewind()))
+    {
+        return false;
+    }
+    std::string sName = CFileExportSTUFormat::RemoveFoldersFromPaths(path);
+    if (!BeginOutputFile(path + ".stu", EstimateFileSize(0, GetVertexDataSize(Type), sName.size())))
+    {
+        return false;
+    }
+
+    std::vector<VertexRecord> Vertices;
+    std::vector<uint16_t> Indices;
+    for (size_t p = 0; p < m_Parts.size(); ++p)
+    {
+        const PartInfo &Part = m_Parts[p];
+        Vertices.resize(Part.uVertexCount);
+        Indices.resize(Part.uIndexCount);
+        if (!Source.Read(&Vertices[0], (uint64_t)Part.uVertexCount * sizeof(VertexRecord)) ||
+            (Part.uIndexCount > 0 && !m_Indices.Read(&Indices[0], (uint64_t)Part.uIndexCount * sizeof(uint16_t))))
+        {
+            LOG_ERROR("Could not read back part %u of '%s'.\n", (uint32_t)p, path.c_str());
+            return false;
+        }
+
+        float bmin[3], bmax[3];
+        std::vector<uint8_t> VertexData;
+        EncodeVertices(Vertices, Type, bFlipUV, VertexData, bmin, bmax);
+
+        std::vector<uint8_t> Data;
+        uint32_t uSize = 0;
+        WRITE_VALUES(bmin[0], 3);
+        WRITE_VALUES(bmax[0], 3);
+        std::vector<uint8_t> BBoxData;
+        BBoxData.swap(Data);
+
+        std::string sNodeName = std::string("OOC.(") + sName + "-" + std::to_string((unsigned long long)p) + ")";
+        std::string sMeshName = sNodeName + ".mesh(" + sName + "-" + std::to_string((unsigned long long)p) + ")";
+        EncodeModel(sNodeName, sMeshName, sName, Part.uVertexCount, Type, Indices, Primitive, m_SolidColor, Data);
+
+        uint64_t uFootprint = CFileExportSTUFormat::GetChunkFootprint((uint32_t)VertexData.size()) +
+            CFileExportSTUFormat::GetChunkFootprint((uint32_t)BBoxData.size()) + CFileExportSTUFormat::GetChunkFootprint((uint32_t)Data.size());
+        if (m_uFileChunkCount > 0 && m_uFileData + uFootprint > MAX_FILE_DATA)
+        {
+            if (m_pOutputSink)
+            {
+                LOG_ERROR("'%s' does not fit in a single .stu, write it to a file instead of a sink.\n", path.c_str());
+                m_sLastError = "The model does not fit in a single .stu, write it to a file instead of a sink.";
+                return false;
+            }
+            std::string sNextPath = path + "." + std::to_string((unsigned long long)m_OutputFiles.size()) + ".stu";
+            LOG_INFO("Reached the size limit of a .stu, continuing in '%s'.\n", sNextPath.c_str());
+            if (!EndOutputFile() || !BeginOutputFile(sNextPath, EstimateFileSize(p, GetVertexDataSize(Type), sName.size())))
+            {
+                return false;
+            }
+        }
+
+        std::string sChunkNumber = std::to_string((unsigned long long)m_uFileChunkCount++);
+        if (!m_Export.WriteChunk(std::string("Vx:") + sChunkNumber, std::move(VertexData)) ||
+            !m_Export.WriteChunk(std::string("Vx:") + sChunkNumber + "BB", std::move(BBoxData)) ||
+            !m_Export.WriteChunk(std::string("Model:") + sChunkNumber, std::move(Data)))
+        {
+            return false;
+        }
+        m_uFileData += uFootprint;
+    }
+    return EndOutputFile();
+}
@@ -0,0 +1,137 @@
+#ifndef _YES_3D_MODEL_OUT_OF_CORE
+#define _YES_3D_MODEL_OUT_OF_CORE
+
+#include "CFileExportSTUFormat.h"
+#include "CTempFile.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+   Bounded-memory converter for meshes too large to load: OBJ, binary PLY and STL (binary or ASCII). Geometry is
+   parsed in fixed size windows and spilled to temp files, so memory use stays around the budget whatever the
+   size of the model; the temp files take a few times the size of the binary geometry on disk.
+
+   1. Parse: attributes go to one temp file per attribute, polygons are triangulated into corner keys (position,
+      texcoord and normal index). STL has no shared vertices, its corners are welded by position with hash
+      partitioning into buckets that fit the budget; smooth normals are accumulated from the facets.
+   2. Split: triangles are streamed, in file order, into parts of at most USHRT_MAX - 1 unique corners and
+      triangles (the limit the Assimp path splits at), which gives the 16 bit indices of every part.
+   3. Resolve: the corners every part needs are looked up by external sort on the attribute index, a sequential
+      join with the attribute file, and a second external sort back into part order.
+   4. Write: parts are assembled from the resolved streams into "Vx:N", "Vx:NBB" and "Model:N" chunks, one node
+      per part with no children, the layout of the OBJ path. A .stu stores its size in 32 bits, so once a file
+      would grow past 4GB the export continues in path + ".1.stu", path + ".2.stu" and so on.
+
+   Materials, groups and smoothing groups are not read, every part uses the default solid color. Models without
+   faces are exported as point clouds.
+*/
+class C3DModelOutOfCore
+{
+public:
+    C3DModelOutOfCore();
+    virtual ~C3DModelOutOfCore();
+
+    /* Memory used when no budget is set */
+    static const uint64_t uDefaultMemoryBudget = 512ull * 1024 * 1024;
+
+    /* Delete the temp files and drop everything kept from the last model. Options are kept. */
+    void Reset();
+
+    bool ExportToSTUFormat(const std::string &path, bool bFlipUV = true);
+
+    /* True if the model at path is in a format read here: OBJ, binary PLY or STL */
+    static bool CanRead(const std::string &path);
+
+    /* Memory for sort buffers and weld tables. Less memory means more temp file passes, not a failure. */
+    void SetMemoryBudget(uint64_t uBytes) { m_uMemoryBudget = uBytes; }
+
+    /* Directory for the temp files, next to the model when empty */
+    void SetTempDirectory(const std::string &sDirectory) { m_sTempDirectory = sDirectory; }
+
+    void SetDefaultSolidColor(float fRed, float fGreen, float fBlue) { m_SolidColor[0] = fRed; m_SolidColor[1] = fGreen;  m_SolidColor[2] = fBlue; }
+
+    /* Write each .stu through a memory mapping, preallocated to the size the parts are expected to take. Ignored
+       when writing into a sink. */
+    void SetMappedOutput(bool bMapped) { m_bMappedOutput = bMapped; }
+
+    /* Hand finished chunks to a background writer thread so encoding overlaps disk I/O. Ignored in mapped mode. */
+    void SetAsyncOutput(bool bAsync) { m_bAsyncOutput = bAsync; }
+
+    /* Write the .stu into pSink (not owned) instead of a file next to the model. The model then has to fit in a
+       single .stu, larger ones fail. */
+    void SetOutputSink(COutputSink * pSink) { m_pOutputSink = pSink; }
+
+    /* Files written by the last export, in order. Empty when writing into a sink, or when the export failed: the files
+       completed before the failure are deleted then. */
+    const std::vector<std::string> &GetOutputFiles() const { return m_OutputFiles; }
+
+    /* Why the last ExportToSTUFormat failed. Empty when it succeeded; kept by Reset, which the export itself calls. */
+    const std::string & GetLastError() const { return m_sLastError; }
+
+private:
+
+    struct PartInfo
+    {
+        uint32_t uVertexCount;
+        uint32_t uIndexCount;
+    };
+
+    bool ReadOBJ(const std::string &path);
+    bool ReadPLY(const std::string &path);
+    bool ReadSTL(const std::string &path);
+
+    /* Weld the STL corners in Corners (deleted afterwards), splitting them into buckets until one fits the budget */
+    template <typename SorterType>
+    bool WeldCorners(CTempFile &Corners, uint32_t uDepth, SorterType &CornerVertices);
+
+    bool SplitParts();
+    bool ResolveVertices();
+    bool WriteParts(const std::string &path, bool bFlipUV);
+
+    /* Expected size of a .stu holding the parts from uFirstPart on, as far as they fit in one file */
+    uint64_t EstimateFileSize(size_t uFirstPart, uint32_t uVertexSize, size_t uNameLength) const;
+
+    bool BeginOutputFile(const std::string &path, uint64_t uReserveSize);
+    bool EndOutputFile();
+
+    C3DModelOutOfCore(const C3DModelOutOfCore &);
+    C3DModelOutOfCore &operator=(const C3DModelOutOfCore &);
+
+    CFileExportSTUFormat m_Export;
+    bool m_bMappedOutput;
+    bool m_bAsyncOutput;
+    COutputSink * m_pOutputSink;
+    uint64_t m_uMemoryBudget;
+    std::string m_sTempDirectory;
+    std::string m_sWorkDirectory;
+    float m_SolidColor[3];
+
+    // Parse results, attribute files hold one record per attribute in file order.
+    CTempFile m_Vertices;
+    CTempFile m_Texcoords;
+    CTempFile m_Normals;
+    CTempFile m_Triangles;
+    uint64_t m_uNumVertices;
+    uint64_t m_uNumTexcoords;
+    uint64_t m_uNumNormals;
+    uint64_t m_uNumTriangles;
+    uint32_t m_uAttributes;
+    bool m_bSeparateTexcoords;
+    bool m_bSeparateNormals;
+
+    // Split and resolve results.
+    std::vector<PartInfo> m_Parts;
+    CTempFile m_Indices;
+    CTempFile m_Requests;
+    CTempFile m_Resolved;
+    uint64_t m_uNumSlots;
+
+    std::vector<std::string> m_OutputFiles;
+    uint64_t m_uFileData;
+    uint32_t m_uFileChunkCount;
+    std::string m_sLastError;
+};
+
+#endif // _YES_3D_MODEL_OUT_OF_CORE
@@ -1,5 +1,7 @@
 #include "C3DModelXML.h"
 #include "C3DModelDataStructures.h"
+#include "CLog.h"
+#include "CExportKernels.h"
 #include <climits>
 
 #define STU_EXPORT_SEQUENTIAL 1 //When enabled we write to the file at each model (much better memory usage, but may be slightly slower)
@@ -11,12 +13,9 @@ int                        collisionModelCount;
 int                        groundCollisionModelCount;
 */
 
-#define LOG_ERROR(...) printf("C3DModelXML:"); printf(__VA_ARGS__);
-#define LOG_INFO(...) printf("C3DModelXML:"); printf(__VA_ARGS__);
-
-#define WRITE_VALUE(x)          Data.insert(Data.end(), (uint8_t *)&(x), (uint8_t *)&(x) + sizeof(x)); uSize += sizeof(x);
-#define WRITE_VALUES(x, c)      Data.insert(Data.end(), (uint8_t *)&(x), (uint8_t *)&(x) + sizeof(x) * (c)); uSize += sizeof(x) * (c);
-#define WRITE_BYTES(x, y, c)    Data.insert(Data.end(), (uint8_t *)(x), (uint8_t *)(x) + sizeof(y) * (c)); uSize += sizeof(y) * (c);
+#define LOG_ERROR(...) STU_LOG_ERROR("C3DModelXML", __VA_ARGS__)
+#define LOG_INFO(...) STU_LOG_INFO("C3DModelXML", __VA_ARGS__)
+#define LOG_DEBUG(...) STU_LOG_DEBUG("C3DModelXML", __VA_ARGS__)
 
 static const std::string LOG_TAG("C3DModelXML");
 
@@ -24,6 +23,8 @@ C3DModelXML::C3DModelXML() :
 m_TotalMeshCount(0),
 m_uSubModelCount(0),
 m_uSubModelVertexCount(0),
+m_uUniqueOBJUnknownID(0),
+m_uUniqueOBJUnknownMeshID(0),
 m_pXmlDocument(NULL),
 m_bFlipUVonY(false),
 m_bFlipOnX(false),
@@ -41,7 +42,7 @@ C3DModelXML::~C3DModelXML()
     delete m_pXmlDocument;
 }
 
-void C3DModelXML::ParseVectorString(const char* str, std::vector<glm::vec3> *array, bool is2element)
+void ParseVectorString(const char* str, std::vector<glm::vec3> *array, bool is2element)
 {
     size_t stride = is2element ? 2 : 3;
     size_t stringLength = strlen(str);
@@ -81,7 +82,7 @@ void C3DModelXML::ParseVectorString(const char* str, std::vector<glm::vec3> *arr
     }
 }
 
-void C3DModelXML::WriteVertexChunk(const std::string &path, std::string sName, tinyxml2::XMLElement* pXmlModel, std::vector<glm::vec3> *vertices)
+void C3DModelXML::WriteVertexChunk(const std::string &path, const std::string &sName, tinyxml2::XMLElement* pXmlModel, const std::vector<glm::vec3> &vertices)
 {
     uint32_t uSize = 0;
     uint8_t bytes[128] = { 0 };
@@ -93,11 +94,11 @@ void C3DModelXML::WriteVertexChunk(const std::string &path, std::string sName, t
     bmax[0] = bmax[1] = bmax[2] = -std::numeric_limits<float>::max();
 
     //read the normals
-    std::vector<glm::vec3> *normals = new std::vector<glm::vec3>();
-    ParseVectorString(pXmlModel->FirstChildElement("normals")->FirstChild()->ToText()->Value(), normals);
+    std::vector<glm::vec3> normals;
+    ParseVectorString(pXmlModel->FirstChildElement("normals")->FirstChild()->ToText()->Value(), &normals);
 
     //read the texture coords
-    std::vector<glm::vec3> *diffuseUVs = new std::vector<glm::vec3>();
+    std::vector<glm::vec3> diffuseUVs;
     int         diffuseTextureIndex = -1;
     tinyxml2::XMLElement* pXmlCurMaterial = pXmlModel->FirstChildElement("material");
 
@@ -110,43 +111,43 @@ void C3DModelXML::WriteVertexChunk(const std::string &path, std::string sName, t
             if (diffuseTextureIndex > -1)
             {
                 ParseVectorString(pXmlCurMaterial->FirstChildElement("texture")->
-                    FirstChild()->ToText()->Value(), diffuseUVs, true);
+                    FirstChild()->ToText()->Value(), &diffuseUVs, true);
             }
         }
         pXmlCurMaterial = pXmlCurMaterial->NextSiblingElement("material");
     }
 
-    Data.reserve(sizeof(VertexDataWithNormals) * vertices->size());
-    if (Data.capacity() < (sizeof(VertexDataWithNormals) * vertices->size()))
+    Data.reserve(sizeof(VertexDataWithNormals) * vertices.size());
+    if (Data.capacity() < (sizeof(VertexDataWithNormals) * vertices.size()))
     {
         LOG_ERROR("Ran out of memory while exporting vertices from '%s' model.", path.c_str());
         return;
     }
 
-    if (vertices->size() != normals->size())
+    if (vertices.size() != normals.size())
     {
         LOG_ERROR("The model does not have a consistent number of normals to vertices.", path.c_str());
         return;
     }
-    if ((vertices->size() != diffuseUVs->size()) && (diffuseTextureIndex > -1))
+    if ((vertices.size() != diffuseUVs.size()) && (diffuseTextureIndex > -1))
     {
         LOG_ERROR("The model does not have a consistent number of UVs to vertices.", path.c_str());
         return;
     }
-    for (size_t vertexIndex = 0; vertexIndex < vertices->size(); ++vertexIndex)
+    for (size_t vertexIndex = 0; vertexIndex < vertices.size(); ++vertexIndex)
     {
-        Vertex.position.x = m_bFlipOnX ? -vertices->at(vertexIndex).x : vertices->at(vertexIndex).x;
-        Vertex.position.y = m_bFlipOnY ? -vertices->at(vertexIndex).y : vertices->at(vertexIndex).y;
-        Vertex.position.z = m_bFlipOnZ ? -vertices->at(vertexIndex).z : vertices->at(vertexIndex).z;
+        Vertex.position.x = m_bFlipOnX ? -vertices.at(vertexIndex).x : vertices.at(vertexIndex).x;
+        Vertex.position.y = m_bFlipOnY ? -vertices.at(vertexIndex).y : vertices.at(vertexIndex).y;
+        Vertex.position.z = m_bFlipOnZ ? -vertices.at(vertexIndex).z : vertices.at(vertexIndex).z;
 
-        Vertex.normal.x = m_bFlipOnX ? -normals->at(vertexIndex).x : normals->at(vertexIndex).x;
-        Vertex.normal.y = m_bFlipOnY ? -normals->at(vertexIndex).y : normals->at(vertexIndex).y;
-        Vertex.normal.z = m_bFlipOnZ ? -normals->at(vertexIndex).z : normals->at(vertexIndex).z;
+        Vertex.normal.x = m_bFlipOnX ? -normals.at(vertexIndex).x : normals.at(vertexIndex).x;
+        Vertex.normal.y = m_bFlipOnY ? -normals.at(vertexIndex).y : normals.at(vertexIndex).y;
+        Vertex.normal.z = m_bFlipOnZ ? -normals.at(vertexIndex).z : normals.at(vertexIndex).z;
 
         if (diffuseTextureIndex > -1)
         {
-            Vertex.texcoord.x = diffuseUVs->at(vertexIndex).x;
-            Vertex.texcoord.y = diffuseUVs->at(vertexIndex).y;
+            Vertex.texcoord.x = diffuseUVs.at(vertexIndex).x;
+            Vertex.texcoord.y = diffuseUVs.at(vertexIndex).y;
         }
 
         bmin[0] = std::min(Vertex.position.x, bmin[0]);
@@ -164,7 +165,7 @@ void C3DModelXML::WriteVertexChunk(const std::string &path, std::string sName, t
     sSTUPath.append(".stu");
     m_Export.AppendChunkToFile(sSTUPath, sName, &Data.at(0), (uint32_t)Data.size());
 #else
-    Export.WriteChunk(sName, &Data.at(0), Data.size());
+    m_Export.WriteChunk(sName, std::move(Data));
 #endif
     std::vector< uint8_t >().swap(Data);
 
@@ -179,7 +180,7 @@ void C3DModelXML::WriteVertexChunk(const std::string &path, std::string sName, t
 #if STU_EXPORT_SEQUENTIAL
     m_Export.AppendChunkToFile(sSTUPath, sName + "BB", &Data.at(0), (uint32_t)Data.size());
 #else
-    Export.WriteChunk(sName + "BB", &Data.at(0), Data.size());
+    m_Export.WriteChunk(sName + "BB", std::move(Data));
 #endif
     std::vector< uint8_t >().swap(Data);
 }
@@ -212,9 +213,12 @@ bool C3DModelXML::ExportToSTUFormat(const std::string &path, bool bFlipUV, bool
     m_bFlipOnZ = bFlipOnZ;
     m_uSubModelCount = 0;
     m_uSubModelVertexCount = 0;
+    m_uUniqueOBJUnknownID = 0;
+    m_uUniqueOBJUnknownMeshID = 0;
     m_bFlipUVonY = bFlipUV;
     m_Entries.clear();
     m_TotalMeshCount = 0;
+    m_Export.Reset();
 
     if (m_pXmlDocument->LoadFile(path.c_str()) != 0)
     {
@@ -264,7 +268,7 @@ bool C3DModelXML::ExportToSTUFormat(const std::string &path, bool bFlipUV, bool
         {
             nodeName = std::string("XML.(UNKNOWN-") + std::to_string(m_uUniqueOBJUnknownID++) + ")";
         }
-        LOG_INFO("Found node '%s'\n", nodeName.c_str());
+        LOG_DEBUG("Found node '%s'\n", nodeName.c_str());
 
         glm::mat4 matrix;
 
@@ -282,14 +286,13 @@ bool C3DModelXML::ExportToSTUFormat(const std::string &path, bool bFlipUV, bool
         WRITE_VALUE(uValue);
 
         std::string meshName;
-        static uint32_t sUniqueOBJUnknownMeshID = 0;
         if (strlen(name) > 0)
         {
-            meshName = nodeName + ".mesh(" + name + "-" + std::to_string(sUniqueOBJUnknownMeshID++) + ")";
+            meshName = nodeName + ".mesh(" + name + "-" + std::to_string(m_uUniqueOBJUnknownMeshID++) + ")";
         }
         else
         {
-            meshName = nodeName + ".mesh(UNKNOWN-" + std::to_string(sUniqueOBJUnknownMeshID++) + ")";
+            meshName = nodeName + ".mesh(UNKNOWN-" + std::to_string(m_uUniqueOBJUnknownMeshID++) + ")";
         }
         std::string VBOName = meshName + ".VBO";
         std::string IBOName = meshName + ".IBO";
@@ -302,10 +305,10 @@ bool C3DModelXML::ExportToSTUFormat(const std::string &path, bool bFlipUV, bool
         WRITE_VALUE(uValue);
 
         //read the vertices
-        std::vector<glm::vec3> *vertices = new std::vector<glm::vec3>();
-        ParseVectorString(pXmlModel->FirstChildElement("vertices")->FirstChild()->ToText()->Value(), vertices);
+        std::vector<glm::vec3> vertices;
+        ParseVectorString(pXmlModel->FirstChildElement("vertices")->FirstChild()->ToText()->Value(), &vertices);
 
-        uValue = (uint32_t)vertices->size();
+        uValue = (uint32_t)vertices.size();
         WRITE_VALUE(uValue);
 
         uValue = VertexDataType_Normals;
@@ -416,14 +419,20 @@ bool C3DModelXML::ExportToSTUFormat(const std::string &path, bool bFlipUV, bool
         sSTUPath.append(".stu");
         m_Export.AppendChunkToFile(sSTUPath, sChunkname, &Data.at(0), (uint32_t)Data.size());
 #else
-        m_Export.WriteChunk(sChunkname, &Data.at(0), (uint32_t)Data.size());
+        m_Export.WriteChunk(sChunkname, std::move(Data));
 #endif
         pXmlModel = pXmlModel->NextSiblingElement("model");
     }
 
+    // Sequential export stores each chunk as soon as it is made, without looking back at the result.
+    if (m_Export.HasAppendFailed())
+    {
+        return false;
+    }
+
 #if !STU_EXPORT_SEQUENTIAL
     std::string sSTUPath = path;
-    sSTUPath.Append(".stu");
+    sSTUPath.append(".stu");
     m_Export.ExportFile(sSTUPath);
 #endif
 
@@ -17,9 +17,7 @@ public:
     void SetDefaultSolidColor(float fRed, float fGreen, float fBlue) { m_SolidColor[0] = fRed; m_SolidColor[1] = fGreen;  m_SolidColor[2] = fBlue; }
 
 private:
-
-    void ParseVectorString(const char* str, std::vector<glm::vec3> *array, bool is2element = false);
-    void WriteVertexChunk(const std::string &path, std::string sName, tinyxml2::XMLElement* pXmlModel, std::vector<glm::vec3> *vertices);
+    void WriteVertexChunk(const std::string &path, const std::string &sName, tinyxml2::XMLElement* pXmlModel, const std::vector<glm::vec3> &vertices);
     void ExportSceneTree();
 
     struct MeshEntry {
@@ -37,6 +35,7 @@ private:
 
     CFileExportSTUFormat m_Export;
     uint32_t m_uUniqueOBJUnknownID;
+    uint32_t m_uUniqueOBJUnknownMeshID;
     float m_SolidColor[3];
     tinyxml2::XMLDocument * m_pXmlDocument;
     std::vector<std::string> m_Textures;
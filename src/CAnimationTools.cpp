@@ -0,0 +1,747 @@
+#include "CAnimationTools.h"
+#include "CFileExportSTUFormat.h"
+#include "CParallelFor.h"
+#include "CLog.h"
+#include "CExportKernels.h"
+
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstdio>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#define LOG_ERROR(...) STU_LOG_ERROR("CAnimationTools", __VA_ARGS__)
+
+static const float SMALLEST_THREE_RANGE = 0.70710678f; // 1 / sqrt(2)
+
+static float GetMaxComponentError(const glm::vec3 &a, const glm::vec3 &b)
+{
+    glm::vec3 Delta = glm::abs(a - b);
+    return std::max(Delta.x, std::max(Delta.y, Delta.z));
+}
+
+// Angle in radians between two unit rotations. Uses the chord length, |a - b| = 2 sin(angle / 4),
+// which stays accurate for the tiny angles we compare against unlike acos(dot).
+static float GetRotationError(const glm::quat &a, const glm::quat &b)
+{
+    glm::quat Aligned = glm::dot(a, b) < 0.0f ? -b : b;
+    glm::vec4 Delta(a.x - Aligned.x, a.y - Aligned.y, a.z - Aligned.z, a.w - Aligned.w);
+    float fHalfChord = std::min(glm::length(Delta) * 0.5f, 1.0f);
+    return 4.0f * std::asin(fHalfChord);
+}
+
+static glm::vec3 InterpolateKeys(const VectorKey &a, const VectorKey &b, double dTime)
+{
+    float t = (float)((dTime - a.mTime) / (b.mTime - a.mTime));
+    return glm::mix(a.mValue, b.mValue, t);
+}
+
+static glm::quat InterpolateKeys(const QuatKey &a, const QuatKey &b, double dTime)
+{
+    float t = (float)((dTime - a.mTime) / (b.mTime - a.mTime));
+    return glm::slerp(a.mValue, b.mValue, t);
+}
+
+static float GetKeyError(const VectorKey &a, const glm::vec3 &b) { return GetMaxComponentError(a.mValue, b); }
+static float GetKeyError(const QuatKey &a, const glm::quat &b) { return GetRotationError(a.mValue, b); }
+
+// True when every key strictly between uFirst and uLast is reproduced by interpolating those two within fTolerance
+template <class Key>
+static bool CanInterpolate(const std::vector<Key> &Keys, size_t uFirst, size_t uLast, float fTolerance)
+{
+    if (!(Keys[uLast].mTime > Keys[uFirst].mTime))
+    {
+        return false;
+    }
+    for (size_t i = uFirst + 1; i < uLast; ++i)
+    {
+        if (GetKeyError(Keys[i], InterpolateKeys(Keys[uFirst], Keys[uLast], Keys[i].mTime)) > fTolerance)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <class Key>
+static void ReduceTrack(std::vector<Key> &Keys, float fTolerance)
+{
+    if (Keys.size() <= 1)
+    {
+        return;
+    }
+
+    bool bConstant = true;
+    for (size_t i = 1; i < Keys.size() && bConstant; ++i)
+    {
+        bConstant = GetKeyError(Keys[i], Keys[0].mValue) <= fTolerance;
+    }
+    if (bConstant)
+    {
+        Keys.resize(1);
+        return;
+    }
+
+    // Greedily extend each segment from the last kept key until one of the skipped keys would be off by more than the tolerance.
+    std::vector<Key> Reduced;
+    Reduced.push_back(Keys[0]);
+    size_t uAnchor = 0;
+    for (size_t uEnd = 2; uEnd < Keys.size(); ++uEnd)
+    {
+        if (!CanInterpolate(Keys, uAnchor, uEnd, fTolerance))
+        {
+            uAnchor = uEnd - 1;
+            Reduced.push_back(Keys[uAnchor]);
+        }
+    }
+    Reduced.push_back(Keys.back());
+    Keys.swap(Reduced);
+}
+
+void CAnimationTools::ReduceKeys(std::vector<VectorKey> &Keys, float fTolerance)
+{
+    ReduceTrack(Keys, fTolerance);
+}
+
+void CAnimationTools::ReduceKeys(std::vector<QuatKey> &Keys, float fTolerance)
+{
+    // Keep consecutive keys in the same hemisphere so interpolation takes the short path.
+    for (size_t i = 1; i < Keys.size(); ++i)
+    {
+        if (glm::dot(Keys[i - 1].mValue, Keys[i].mValue) < 0.0f)
+        {
+            Keys[i].mValue = -Keys[i].mValue;
+        }
+    }
+    ReduceTrack(Keys, fTolerance);
+}
+
+void CAnimationTools::ReduceKeys(Animation &animation, const AnimationCompressionSettings &Settings)
+{
+    for (size_t i = 0; i < animation.mChannels.size(); ++i)
+    {
+        NodeAnim &channel = animation.mChannels[i];
+        ReduceKeys(channel.mPositionKeys, Settings.fPositionTolerance);
+        ReduceKeys(channel.mRotationKeys, Settings.fRotationTolerance);
+        ReduceKeys(channel.mScalingKeys, Settings.fScalingTolerance);
+    }
+}
+
+double CAnimationTools::GetTicksPerSecond(const Animation &animation)
+{
+    return animation.mTicksPerSecond > 0.0 ? animation.mTicksPerSecond : 25.0;
+}
+
+template <class Key>
+static bool IsKeyEarlier(double dTime, const Key &key)
+{
+    return dTime < key.mTime;
+}
+
+// Index of the last key at or before dTime, Keys must not be empty
+template <class Key>
+static size_t FindKey(const std::vector<Key> &Keys, double dTime)
+{
+    typename std::vector<Key>::const_iterator it = std::upper_bound(Keys.begin(), Keys.end(), dTime, IsKeyEarlier<Key>);
+    return it == Keys.begin() ? 0 : (size_t)(it - Keys.begin()) - 1;
+}
+
+glm::vec3 CAnimationTools::SampleKeys(const std::vector<VectorKey> &Keys, double dTime, const glm::vec3 &Default)
+{
+    if (Keys.empty())
+    {
+        return Default;
+    }
+    size_t uKey = FindKey(Keys, dTime);
+    if (uKey + 1 >= Keys.size() || dTime <= Keys[uKey].mTime)
+    {
+        return Keys[uKey].mValue;
+    }
+    return InterpolateKeys(Keys[uKey], Keys[uKey + 1], dTime);
+}
+
+glm::quat CAnimationTools::SampleKeys(const std::vector<QuatKey> &Keys, double dTime)
+{
+    if (Keys.empty())
+    {
+        return glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+    }
+    size_t uKey = FindKey(Keys, dTime);
+    if (uKey + 1 >= Keys.size() || dTime <= Keys[uKey].mTime)
+    {
+        return Keys[uKey].mValue;
+    }
+    return glm::normalize(InterpolateKeys(Keys[uKey], Keys[uKey + 1], dTime));
+}
+
+uint32_t CAnimationTools::GetResampledFrameCount(const Animation &animation, float fFrameRate)
+{
+    double dSeconds = std::max(animation.mDuration, 0.0) / GetTicksPerSecond(animation);
+    return (uint32_t)std::ceil(dSeconds * fFrameRate - 0.0001) + 1;
+}
+
+uint32_t CAnimationTools::WriteResampledAnimations(const std::vector<Animation> &Animations, float fFrameRate, std::vector<uint8_t> &Data)
+{
+    uint32_t uSize = 0;
+    uint32_t uValue = (uint32_t)Animations.size();
+    WRITE_VALUE(uValue);
+
+    for (size_t i = 0; i < Animations.size(); ++i)
+    {
+        const Animation &animation = Animations[i];
+        uint32_t uFrameCount = GetResampledFrameCount(animation, fFrameRate);
+        uint32_t uChannelCount = (uint32_t)animation.mChannels.size();
+        double dTicksPerFrame = GetTicksPerSecond(animation) / fFrameRate;
+
+        uSize += CFileExportSTUFormat::CopyString(animation.mName.c_str(), &Data);
+        WRITE_VALUE(fFrameRate);
+        WRITE_VALUE(uFrameCount);
+        WRITE_VALUE(uChannelCount);
+        for (uint32_t j = 0; j < uChannelCount; ++j)
+        {
+            uSize += CFileExportSTUFormat::CopyString(animation.mChannels[j].mNodeName.c_str(), &Data);
+        }
+
+        // Per frame: translations, then rotations, then scalings of every channel.
+        const size_t uFloatsPerFrame = (size_t)uChannelCount * (3 + 4 + 3);
+        std::vector<float> Frames(uFloatsPerFrame * uFrameCount);
+        if (Frames.empty())
+        {
+            continue;
+        }
+
+        // Every channel owns its own columns of the frame block, so channels can be sampled independently.
+        CParallelFor::Run(uChannelCount, 1, [&](uint32_t uBegin, uint32_t uEnd)
+        {
+            for (uint32_t j = uBegin; j < uEnd; ++j)
+            {
+                const NodeAnim &channel = animation.mChannels[j];
+                for (uint32_t uFrame = 0; uFrame < uFrameCount; ++uFrame)
+                {
+                    double dTime = std::min(uFrame * dTicksPerFrame, animation.mDuration);
+                    float *pFrame = &Frames[uFloatsPerFrame * uFrame];
+
+                    glm::vec3 T = SampleKeys(channel.mPositionKeys, dTime, glm::vec3(0.0f));
+                    glm::quat R = SampleKeys(channel.mRotationKeys, dTime);
+                    glm::vec3 S = SampleKeys(channel.mScalingKeys, dTime, glm::vec3(1.0f));
+
+                    float *pT = pFrame + j * 3;
+                    float *pR = pFrame + uChannelCount * 3 + j * 4;
+                    float *pS = pFrame + uChannelCount * 7 + j * 3;
+                    pT[0] = T.x; pT[1] = T.y; pT[2] = T.z;
+                    pR[0] = R.x; pR[1] = R.y; pR[2] = R.z; pR[3] = R.w;
+                    pS[0] = S.x; pS[1] = S.y; pS[2] = S.z;
+                }
+            }
+        });
+
+        WRITE_VALUES(Frames[0], Frames.size());
+    }
+    return uSize;
+}
+
+glm::mat4 CAnimationTools::ComposeTransform(const glm::vec3 &T, const glm::quat &R, const glm::vec3 &S)
+{
+    glm::mat4 Transform = glm::mat4_cast(R);
+    Transform[0] *= S.x;
+    Transform[1] *= S.y;
+    Transform[2] *= S.z;
+    Transform[3] = glm::vec4(T, 1.0f);
+    return Transform;
+}
+
+std::vector<int32_t> CAnimationTools::MapChannelsToNodes(const Animation &animation, const std::vector<SkeletonNode> &Nodes)
+{
+    std::map<uint32_t, int32_t> ChannelByHash;
+    for (size_t j = 0; j < animation.mChannels.size(); ++j)
+    {
+        ChannelByHash[CFileExportSTUFormat::MakeHashFromName(animation.mChannels[j].mNodeName)] = (int32_t)j;
+    }
+
+    std::vector<int32_t> NodeChannels(Nodes.size(), -1);
+    for (size_t n = 0; n < Nodes.size(); ++n)
+    {
+        std::map<uint32_t, int32_t>::const_iterator it = ChannelByHash.find(Nodes[n].mNameHash);
+        if (it != ChannelByHash.end())
+        {
+            NodeChannels[n] = it->second;
+        }
+    }
+    return NodeChannels;
+}
+
+void CAnimationTools::EvaluateGlobalTransforms(const Animation &animation, const std::vector<int32_t> &NodeChannels, const std::vector<SkeletonNode> &Nodes, double dTime, std::vector<glm::mat4> &Globals)
+{
+    Globals.resize(Nodes.size());
+    for (size_t n = 0; n < Nodes.size(); ++n)
+    {
+        glm::mat4 Local = Nodes[n].mLocalTransform;
+        if (NodeChannels[n] >= 0)
+        {
+            const NodeAnim &channel = animation.mChannels[NodeChannels[n]];
+            Local = ComposeTransform(SampleKeys(channel.mPositionKeys, dTime, glm::vec3(Local[3])),
+                SampleKeys(channel.mRotationKeys, dTime),
+                SampleKeys(channel.mScalingKeys, dTime, glm::vec3(1.0f)));
+        }
+        // Parents always come first, so their global transform is already known.
+        Globals[n] = Nodes[n].mParent >= 0 ? Globals[Nodes[n].mParent] * Local : Local;
+    }
+}
+
+uint32_t CAnimationTools::WriteBonePalettes(const std::vector<Animation> &Animations, const std::vector<SkeletonNode> &Nodes,
+    const std::map<uint32_t, uint32_t> &BoneMapping, const std::vector<BoneInfo> &Bones, const glm::mat4 &GlobalInverse,
+    float fFrameRate, bool bQuantize, std::vector<uint8_t> &Data)
+{
+    uint32_t uSize = 0;
+    uint32_t uValue = (uint32_t)Animations.size();
+    WRITE_VALUE(uValue);
+    uint32_t uBoneCount = (uint32_t)Bones.size();
+    WRITE_VALUE(uBoneCount);
+    uValue = bQuantize ? 1 : 0;
+    WRITE_VALUE(uValue);
+
+    // Nodes that drive a bone, and which bone
+    std::vector<uint32_t> BoneNodes;
+    std::vector<uint32_t> BoneIndices;
+    for (size_t n = 0; n < Nodes.size(); ++n)
+    {
+        std::map<uint32_t, uint32_t>::const_iterator it = BoneMapping.find(Nodes[n].mNameHash);
+        if (it != BoneMapping.end() && it->second < uBoneCount)
+        {
+            BoneNodes.push_back((uint32_t)n);
+            BoneIndices.push_back(it->second);
+        }
+    }
+
+    const size_t uFloatsPerFrame = (size_t)uBoneCount * 12;
+
+    for (size_t i = 0; i < Animations.size(); ++i)
+    {
+        const Animation &animation = Animations[i];
+        uint32_t uFrameCount = GetResampledFrameCount(animation, fFrameRate);
+        double dTicksPerFrame = GetTicksPerSecond(animation) / fFrameRate;
+        std::vector<int32_t> NodeChannels = MapChannelsToNodes(animation, Nodes);
+
+        uSize += CFileExportSTUFormat::CopyString(animation.mName.c_str(), &Data);
+        WRITE_VALUE(fFrameRate);
+        WRITE_VALUE(uFrameCount);
+
+        // Bones that no node drives keep an identity palette entry.
+        std::vector<float> Palettes(uFloatsPerFrame * uFrameCount, 0.0f);
+        for (size_t uEntry = 0; uEntry < Palettes.size(); uEntry += 12)
+        {
+            Palettes[uEntry + 0] = Palettes[uEntry + 5] = Palettes[uEntry + 10] = 1.0f;
+        }
+        if (Palettes.empty())
+        {
+            continue;
+        }
+
+        // Frames are independent, so each worker evaluates its own range of frames.
+        CParallelFor::Run(uFrameCount, 4, [&](uint32_t uBegin, uint32_t uEnd)
+        {
+            std::vector<glm::mat4> Globals;
+            for (uint32_t uFrame = uBegin; uFrame < uEnd; ++uFrame)
+            {
+                double dTime = std::min(uFrame * dTicksPerFrame, animation.mDuration);
+                EvaluateGlobalTransforms(animation, NodeChannels, Nodes, dTime, Globals);
+
+                float *pFrame = &Palettes[uFloatsPerFrame * uFrame];
+                for (size_t b = 0; b < BoneNodes.size(); ++b)
+                {
+                    glm::mat4 Palette = GlobalInverse * Globals[BoneNodes[b]] * Bones[BoneIndices[b]].BoneOffset;
+                    float *pEntry = pFrame + (size_t)BoneIndices[b] * 12;
+                    for (int r = 0; r < 3; ++r)
+                    {
+                        pEntry[r * 4 + 0] = Palette[0][r];
+                        pEntry[r * 4 + 1] = Palette[1][r];
+                        pEntry[r * 4 + 2] = Palette[2][r];
+                        pEntry[r * 4 + 3] = Palette[3][r];
+                    }
+                }
+            }
+        });
+
+        if (!bQuantize)
+        {
+            WRITE_VALUES(Palettes[0], Palettes.size());
+            continue;
+        }
+
+        float Min[12], Extent[12];
+        for (int c = 0; c < 12; ++c)
+        {
+            float fMin = std::numeric_limits<float>::max();
+            float fMax = -std::numeric_limits<float>::max();
+            for (size_t uEntry = c; uEntry < Palettes.size(); uEntry += 12)
+            {
+                fMin = std::min(fMin, Palettes[uEntry]);
+                fMax = std::max(fMax, Palettes[uEntry]);
+            }
+            Min[c] = fMin;
+            Extent[c] = fMax - fMin;
+        }
+        WRITE_VALUES(Min[0], 12);
+        WRITE_VALUES(Extent[0], 12);
+
+        std::vector<uint16_t> Quantized(Palettes.size());
+        for (size_t uEntry = 0; uEntry < Palettes.size(); ++uEntry)
+        {
+            size_t c = uEntry % 12;
+            Quantized[uEntry] = Extent[c] > 0.0f ? (uint16_t)((Palettes[uEntry] - Min[c]) / Extent[c] * 65535.0f + 0.5f) : 0;
+        }
+        WRITE_VALUES(Quantized[0], Quantized.size());
+    }
+    return uSize;
+}
+
+void CAnimationTools::DecomposeTransform(const glm::mat4 &Transform, glm::vec3 &T, glm::quat &R, glm::vec3 &S)
+{
+    T = glm::vec3(Transform[3]);
+
+    glm::vec3 Axes[3] = { glm::vec3(Transform[0]), glm::vec3(Transform[1]), glm::vec3(Transform[2]) };
+    S = glm::vec3(glm::length(Axes[0]), glm::length(Axes[1]), glm::length(Axes[2]));
+    // A mirrored basis is stored as a negative X scale.
+    if (glm::dot(glm::cross(Axes[0], Axes[1]), Axes[2]) < 0.0f)
+    {
+        S.x = -S.x;
+    }
+
+    glm::mat3 Rotation;
+    for (int c = 0; c < 3; ++c)
+    {
+        Rotation[c] = S[c] != 0.0f ? Axes[c] / S[c] : glm::vec3(c == 0, c == 1, c == 2);
+    }
+    R = glm::normalize(glm::quat_cast(Rotation));
+}
+
+template <class Value>
+static uint32_t WritePaddedShorts(const std::vector<Value> &Values, std::vector<uint8_t> &Data)
+{
+    uint32_t uSize = 0;
+    if (!Values.empty())
+    {
+        WRITE_VALUES(Values[0], Values.size());
+    }
+    if (Values.size() & 1)
+    {
+        int16_t nPadding = 0;
+        WRITE_VALUE(nPadding);
+    }
+    return uSize;
+}
+
+uint32_t CAnimationTools::WriteSkeleton(const std::vector<SkeletonNode> &Nodes, const std::map<uint32_t, uint32_t> &BoneMapping,
+    const std::vector<BoneInfo> &Bones, std::vector<uint8_t> &Data)
+{
+    uint32_t uSize = 0;
+
+    // Keep the bones and every ancestor of a bone. Walking backwards visits children before their parents.
+    std::vector<int32_t> BoneOfNode(Nodes.size(), -1);
+    std::vector<bool> Keep(Nodes.size(), false);
+    for (size_t n = Nodes.size(); n > 0; --n)
+    {
+        size_t uNode = n - 1;
+        std::map<uint32_t, uint32_t>::const_iterator it = BoneMapping.find(Nodes[uNode].mNameHash);
+        if (it != BoneMapping.end() && it->second < Bones.size())
+        {
+            BoneOfNode[uNode] = (int32_t)it->second;
+            Keep[uNode] = true;
+        }
+        if (Keep[uNode] && Nodes[uNode].mParent >= 0)
+        {
+            Keep[Nodes[uNode].mParent] = true;
+        }
+    }
+
+    std::vector<int32_t> JointOfNode(Nodes.size(), -1);
+    std::vector<uint32_t> Hashes;
+    std::vector<int16_t> Parents;
+    std::vector<int16_t> BoneIndices;
+    std::vector<glm::vec3> Translations;
+    std::vector<glm::quat> Rotations;
+    std::vector<glm::vec3> Scalings;
+    std::vector<float> InverseBinds;
+    std::vector<const std::string *> Names;
+
+    for (size_t n = 0; n < Nodes.size(); ++n)
+    {
+        if (!Keep[n])
+        {
+            continue;
+        }
+        JointOfNode[n] = (int32_t)Hashes.size();
+
+        // Parents precede children in Nodes, so the parent's joint index is already assigned.
+        Hashes.push_back(Nodes[n].mNameHash);
+        Parents.push_back((int16_t)(Nodes[n].mParent >= 0 ? JointOfNode[Nodes[n].mParent] : -1));
+        BoneIndices.push_back((int16_t)BoneOfNode[n]);
+
+        glm::vec3 T, S;
+        glm::quat R;
+        DecomposeTransform(Nodes[n].mLocalTransform, T, R, S);
+        Translations.push_back(T);
+        Rotations.push_back(R);
+        Scalings.push_back(S);
+
+        glm::mat4 InverseBind = BoneOfNode[n] >= 0 ? Bones[BoneOfNode[n]].BoneOffset : glm::mat4();
+        for (int r = 0; r < 3; ++r)
+        {
+            for (int c = 0; c < 4; ++c)
+            {
+                InverseBinds.push_back(InverseBind[c][r]);
+            }
+        }
+        Names.push_back(&Nodes[n].mName);
+    }
+
+    if (Hashes.size() > (size_t)std::numeric_limits<int16_t>::max())
+    {
+        LOG_ERROR("Skeleton has %u joints, more than int16 parent indices can address.\n", (uint32_t)Hashes.size());
+    }
+
+    uint32_t uValue = (uint32_t)Hashes.size();
+    WRITE_VALUE(uValue);
+    if (Hashes.empty())
+    {
+        return uSize;
+    }
+    WRITE_VALUES(Hashes[0], Hashes.size());
+    uSize += WritePaddedShorts(Parents, Data);
+    uSize += WritePaddedShorts(BoneIndices, Data);
+    WRITE_VALUES(Translations[0], Translations.size());
+    for (size_t j = 0; j < Rotations.size(); ++j)
+    {
+        float Rotation[4] = { Rotations[j].x, Rotations[j].y, Rotations[j].z, Rotations[j].w };
+        WRITE_VALUES(Rotation[0], 4);
+    }
+    WRITE_VALUES(Scalings[0], Scalings.size());
+    WRITE_VALUES(InverseBinds[0], InverseBinds.size());
+    for (size_t j = 0; j < Names.size(); ++j)
+    {
+        uSize += CFileExportSTUFormat::CopyString(Names[j]->c_str(), &Data);
+    }
+    return uSize;
+}
+
+uint32_t CAnimationTools::GetFrameIndex(double dTime, double dTicksPerSecond, float fFrameRate)
+{
+    if (dTicksPerSecond <= 0.0)
+    {
+        dTicksPerSecond = 25.0; // Assimp's default when the file does not say
+    }
+    double dFrame = std::floor(dTime / dTicksPerSecond * fFrameRate + 0.5);
+    if (dFrame <= 0.0)
+    {
+        return 0;
+    }
+    return dFrame >= (double)std::numeric_limits<uint16_t>::max() ? std::numeric_limits<uint16_t>::max() : (uint32_t)dFrame;
+}
+
+void CAnimationTools::PackQuaternion(const glm::quat &Value, uint16_t (&Packed)[3])
+{
+    glm::quat q = glm::normalize(Value);
+    float Components[4] = { q.x, q.y, q.z, q.w };
+
+    uint32_t uLargest = 0;
+    for (uint32_t i = 1; i < 4; ++i)
+    {
+        if (std::fabs(Components[i]) > std::fabs(Components[uLargest]))
+        {
+            uLargest = i;
+        }
+    }
+    // q and -q are the same rotation; flip so the dropped component is positive.
+    float fSign = Components[uLargest] < 0.0f ? -1.0f : 1.0f;
+
+    uint32_t uOut = 0;
+    for (uint32_t i = 0; i < 4; ++i)
+    {
+        if (i == uLargest)
+        {
+            continue;
+        }
+        float fNormalized = (Components[i] * fSign / SMALLEST_THREE_RANGE) * 0.5f + 0.5f;
+        fNormalized = std::min(std::max(fNormalized, 0.0f), 1.0f);
+        Packed[uOut++] = (uint16_t)(fNormalized * 32767.0f + 0.5f);
+    }
+    Packed[0] |= (uint16_t)((uLargest & 1) << 15);
+    Packed[1] |= (uint16_t)((uLargest >> 1) << 15);
+}
+
+glm::quat CAnimationTools::UnpackQuaternion(const uint16_t (&Packed)[3])
+{
+    uint32_t uLargest = ((Packed[0] >> 15) & 1) | (((Packed[1] >> 15) & 1) << 1);
+    float Components[4];
+    float fSumOfSquares = 0.0f;
+    uint32_t uIn = 0;
+    for (uint32_t i = 0; i < 4; ++i)
+    {
+        if (i == uLargest)
+        {
+            continue;
+        }
+        float fNormalized = (float)(Packed[uIn++] & 0x7FFF) / 32767.0f;
+        Components[i] = (fNormalized * 2.0f - 1.0f) * SMALLEST_THREE_RANGE;
+        fSumOfSquares += Components[i] * Components[i];
+    }
+    Components[uLargest] = std::sqrt(std::max(1.0f - fSumOfSquares, 0.0f));
+    return glm::quat(Components[3], Components[0], Components[1], Components[2]);
+}
+
+// Frame index per key, with keys that land on the same frame merged (the later key wins)
+template <class Key>
+static void SnapToFrames(const std::vector<Key> &Keys, double dTicksPerSecond, float fFrameRate, std::vector<uint16_t> &Frames, std::vector<size_t> &KeyIndices)
+{
+    Frames.clear();
+    KeyIndices.clear();
+    for (size_t i = 0; i < Keys.size(); ++i)
+    {
+        uint16_t uFrame = (uint16_t)CAnimationTools::GetFrameIndex(Keys[i].mTime, dTicksPerSecond, fFrameRate);
+        if (!Frames.empty() && Frames.back() == uFrame)
+        {
+            KeyIndices.back() = i;
+            continue;
+        }
+        Frames.push_back(uFrame);
+        KeyIndices.push_back(i);
+    }
+}
+
+static uint32_t WriteTrack(const std::vector<VectorKey> &Keys, double dTicksPerSecond, float fFrameRate, std::vector<uint8_t> &Data)
+{
+    uint32_t uSize = 0;
+    uint32_t uValue;
+
+    std::vector<uint16_t> Frames;
+    std::vector<size_t> KeyIndices;
+    SnapToFrames(Keys, dTicksPerSecond, fFrameRate, Frames, KeyIndices);
+
+    uValue = (uint32_t)Frames.size();
+    WRITE_VALUE(uValue);
+    if (Frames.size() == 1)
+    {
+        WRITE_VALUE(Keys[KeyIndices[0]].mValue);
+        return uSize;
+    }
+    if (Frames.empty())
+    {
+        return uSize;
+    }
+    WRITE_VALUES(Frames[0], Frames.size());
+
+    glm::vec3 Min(std::numeric_limits<float>::max());
+    glm::vec3 Max(-std::numeric_limits<float>::max());
+    for (size_t i = 0; i < KeyIndices.size(); ++i)
+    {
+        Min = glm::min(Min, Keys[KeyIndices[i]].mValue);
+        Max = glm::max(Max, Keys[KeyIndices[i]].mValue);
+    }
+    glm::vec3 Extent = Max - Min;
+    WRITE_VALUE(Min);
+    WRITE_VALUE(Extent);
+
+    for (size_t i = 0; i < KeyIndices.size(); ++i)
+    {
+        const glm::vec3 &Value = Keys[KeyIndices[i]].mValue;
+        uint16_t Quantized[3];
+        for (int c = 0; c < 3; ++c)
+        {
+            Quantized[c] = Extent[c] > 0.0f ? (uint16_t)((Value[c] - Min[c]) / Extent[c] * 65535.0f + 0.5f) : 0;
+        }
+        WRITE_VALUES(Quantized[0], 3);
+    }
+    return uSize;
+}
+
+static uint32_t WriteTrack(const std::vector<QuatKey> &Keys, double dTicksPerSecond, float fFrameRate, std::vector<uint8_t> &Data)
+{
+    uint32_t uSize = 0;
+    uint32_t uValue;
+
+    std::vector<uint16_t> Frames;
+    std::vector<size_t> KeyIndices;
+    SnapToFrames(Keys, dTicksPerSecond, fFrameRate, Frames, KeyIndices);
+
+    uValue = (uint32_t)Frames.size();
+    WRITE_VALUE(uValue);
+    if (Frames.size() == 1)
+    {
+        WRITE_VALUE(Keys[KeyIndices[0]].mValue);
+        return uSize;
+    }
+    if (Frames.empty())
+    {
+        return uSize;
+    }
+    WRITE_VALUES(Frames[0], Frames.size());
+
+    for (size_t i = 0; i < KeyIndices.size(); ++i)
+    {
+        uint16_t Packed[3];
+        CAnimationTools::PackQuaternion(Keys[KeyIndices[i]].mValue, Packed);
+        WRITE_VALUES(Packed[0], 3);
+    }
+    return uSize;
+}
+
+uint32_t CAnimationTools::WriteCompressedAnimations(const std::vector<Animation> &Animations, const AnimationCompressionSettings &Settings, std::vector<uint8_t> &Data)
+{
+    uint32_t uSize = 0;
+    uint32_t uValue = (uint32_t)Animations.size();
+    WRITE_VALUE(uValue);
+
+    for (size_t i = 0; i < Animations.size(); ++i)
+    {
+        const Animation &animation = Animations[i];
+        double dTicksPerSecond = animation.mTicksPerSecond;
+
+        uSize += CFileExportSTUFormat::CopyString(animation.mName.c_str(), &Data);
+
+        float fValue = Settings.fFrameRate;
+        WRITE_VALUE(fValue);
+        uValue = GetFrameIndex(animation.mDuration, dTicksPerSecond, Settings.fFrameRate);
+        if (uValue == std::numeric_limits<uint16_t>::max())
+        {
+            LOG_ERROR("Animation '%s' is longer than %u frames, later keys are clamped.\n", animation.mName.c_str(), uValue);
+        }
+        WRITE_VALUE(uValue);
+        uValue = (uint32_t)animation.mChannels.size();
+        WRITE_VALUE(uValue);
+
+        for (size_t j = 0; j < animation.mChannels.size(); ++j)
+        {
+            const NodeAnim &channel = animation.mChannels[j];
+            uSize += CFileExportSTUFormat::CopyString(channel.mNodeName.c_str(), &Data);
+
+            uValue = channel.mPostState;
+            WRITE_VALUE(uValue);
+            uValue = channel.mPreState;
+            WRITE_VALUE(uValue);
+
+            uSize += WriteTrack(channel.mPositionKeys, dTicksPerSecond, Settings.fFrameRate, Data);
+            uSize += WriteTrack(channel.mRotationKeys, dTicksPerSecond, Settings.fFrameRate, Data);
+            uSize += WriteTrack(channel.mScalingKeys, dTicksPerSecond, Settings.fFrameRate, Data);
+        }
+
+        uValue = (uint32_t)animation.mMeshChannels.size();
+        WRITE_VALUE(uValue);
+
+        for (size_t j = 0; j < animation.mMeshChannels.size(); ++j)
+        {
+            const MeshAnim &channel = animation.mMeshChannels[j];
+            uSize += CFileExportSTUFormat::CopyString(channel.mName.c_str(), &Data);
+
+            uValue = (uint32_t)channel.mKeys.size();
+            WRITE_VALUE(uValue);
+            for (size_t k = 0; k < channel.mKeys.size(); ++k)
+            {
+                uint16_t uFrame = (uint16_t)GetFrameIndex(channel.mKeys[k].mTime, dTicksPerSecond, Settings.fFrameRate);
+                WRITE_VALUE(uFrame);
+                WRITE_VALUE(channel.mKeys[k].mValue);
+            }
+        }
+    }
+    return uSize;
+}
@@ -0,0 +1,130 @@
+#ifndef ANIMATION_TOOLS_H_
+#define ANIMATION_TOOLS_H_
+
+#include "C3DModelDataStructures.h"
+
+#include <cstdint>
+#include <vector>
+#include <map>
+
+/* Error tolerances and sample rate used when compressing animations */
+struct AnimationCompressionSettings
+{
+    AnimationCompressionSettings()
+        : fPositionTolerance(0.0001f),
+        fRotationTolerance(0.0005f),
+        fScalingTolerance(0.0001f),
+        fFrameRate(30.0f)
+    {
+    }
+
+    float fPositionTolerance;   // maximum position error in model units
+    float fRotationTolerance;   // maximum rotation error in radians
+    float fScalingTolerance;    // maximum scaling error per axis
+    float fFrameRate;           // key times are snapped to frames at this rate
+};
+
+/*
+   Compressed animation chunk ("AnimationsQ"), written instead of "Animations" when compression is enabled:
+
+   uint32 animation count, then per animation:
+       string name, float frame rate, uint32 frame count, uint32 channel count
+       per channel: string node name, uint32 post state, uint32 pre state, then the position, rotation and scaling tracks.
+       uint32 mesh channel count, per mesh channel: string name, uint32 key count, then { uint16 frame, uint32 value } per key.
+
+   Track: uint32 key count. 0 = no keys, 1 = constant track followed by the raw value (3 or 4 floats).
+       Otherwise uint16 frame index per key followed by the values:
+       - vectors: float min[3], float extent[3], then 3 x uint16 per key, value = min + extent * q / 65535
+       - quaternions: 3 x uint16 per key in smallest-three form. The low 15 bits of each word hold a component
+         in [-1/sqrt(2), 1/sqrt(2)]; the top bits of the first two words hold the index (x,y,z,w = 0..3) of the
+         dropped largest component, which is always positive and rebuilt from the unit length.
+*/
+
+/*
+   Fixed-rate animation chunk ("AnimationsFR"), written next to "Animations" when resampling is enabled:
+
+   uint32 animation count, then per animation:
+       string name, float frame rate, uint32 frame count, uint32 channel count, channel count x string node name,
+       then frame count x { float3 translation[channel count], float4 rotation (x,y,z,w)[channel count], float3 scaling[channel count] }.
+
+   A pose is one contiguous block at offset frame * channel count * 40 bytes, frame = time in seconds * frame rate.
+*/
+/*
+   Baked bone palette chunk ("BonePalettes"):
+
+   uint32 animation count, uint32 bone count, uint32 quantized (0 or 1), then per animation:
+       string name, float frame rate, uint32 frame count, then
+       - not quantized: frame count x bone count x 12 floats
+       - quantized: float min[12], float extent[12], then frame count x bone count x 12 uint16, value = min + extent * q / 65535
+
+   Each palette entry is the top three rows of the final skinning matrix (row-major 3x4), indexed like "Bones".
+*/
+/*
+   Skeleton chunk ("Skeleton"), joints in parent-before-child order so a pose is one forward pass:
+
+   uint32 joint count, then arrays of joint count entries:
+       uint32 name hash, int16 parent joint (-1 for roots), int16 bone index into "Bones" and the vertex bone IDs (-1 for
+       joints that only carry the hierarchy), float3 bind translation, float4 bind rotation (x,y,z,w), float3 bind scaling,
+       12 floats inverse bind matrix (row-major 3x4, identity for joints without a bone), then one string name per joint.
+   Each int16 array is padded to a multiple of 4 bytes.
+*/
+class CAnimationTools
+{
+public:
+
+    /* Collapse constant tracks to a single key and drop keys that linear interpolation of their neighbours reproduces within tolerance */
+    static void ReduceKeys(Animation &animation, const AnimationCompressionSettings &Settings);
+
+    static void ReduceKeys(std::vector<VectorKey> &Keys, float fTolerance);
+    static void ReduceKeys(std::vector<QuatKey> &Keys, float fTolerance);
+
+    /* Append the compressed form of the animations (see "AnimationsQ" above) to Data, returns the number of bytes written */
+    static uint32_t WriteCompressedAnimations(const std::vector<Animation> &Animations, const AnimationCompressionSettings &Settings, std::vector<uint8_t> &Data);
+
+    /* Frame index of a key time given in ticks */
+    static uint32_t GetFrameIndex(double dTime, double dTicksPerSecond, float fFrameRate);
+
+    /* Ticks per second of the animation, with Assimp's default of 25 when the file does not say */
+    static double GetTicksPerSecond(const Animation &animation);
+
+    /* Value of a track at dTime (in ticks), clamped to the first and last keys. Empty tracks return Default / identity. */
+    static glm::vec3 SampleKeys(const std::vector<VectorKey> &Keys, double dTime, const glm::vec3 &Default);
+    static glm::quat SampleKeys(const std::vector<QuatKey> &Keys, double dTime);
+
+    /* Number of frames needed to cover the animation at fFrameRate, both ends included */
+    static uint32_t GetResampledFrameCount(const Animation &animation, float fFrameRate);
+
+    /* Append the fixed-rate form of the animations (see "AnimationsFR" above) to Data, returns the number of bytes written */
+    static uint32_t WriteResampledAnimations(const std::vector<Animation> &Animations, float fFrameRate, std::vector<uint8_t> &Data);
+
+    /* Local transform built from translation, rotation and scaling */
+    static glm::mat4 ComposeTransform(const glm::vec3 &T, const glm::quat &R, const glm::vec3 &S);
+
+    /* Index of the channel animating each node, or -1 */
+    static std::vector<int32_t> MapChannelsToNodes(const Animation &animation, const std::vector<SkeletonNode> &Nodes);
+
+    /* Global transform of every node at dTime (in ticks). Nodes without a channel keep their bind pose. */
+    static void EvaluateGlobalTransforms(const Animation &animation, const std::vector<int32_t> &NodeChannels, const std::vector<SkeletonNode> &Nodes, double dTime, std::vector<glm::mat4> &Globals);
+
+    /* Append fully evaluated skinning palettes of every animation (see "BonePalettes" above) to Data, returns the number of bytes written.
+       The palette of bone b is GlobalInverse * Global(node of b) * BoneOffset(b). */
+    static uint32_t WriteBonePalettes(const std::vector<Animation> &Animations, const std::vector<SkeletonNode> &Nodes,
+        const std::map<uint32_t, uint32_t> &BoneMapping, const std::vector<BoneInfo> &Bones, const glm::mat4 &GlobalInverse,
+        float fFrameRate, bool bQuantize, std::vector<uint8_t> &Data);
+
+    /* Split an affine transform into translation, rotation and scaling */
+    static void DecomposeTransform(const glm::mat4 &Transform, glm::vec3 &T, glm::quat &R, glm::vec3 &S);
+
+    /* Append the skeleton (see "Skeleton" above) to Data, returns the number of bytes written. Only bones and the
+       nodes connecting them to their roots are kept. */
+    static uint32_t WriteSkeleton(const std::vector<SkeletonNode> &Nodes, const std::map<uint32_t, uint32_t> &BoneMapping,
+        const std::vector<BoneInfo> &Bones, std::vector<uint8_t> &Data);
+
+    /* Pack a quaternion into three 16-bit words (smallest-three) */
+    static void PackQuaternion(const glm::quat &Value, uint16_t (&Packed)[3]);
+
+    /* Inverse of PackQuaternion() */
+    static glm::quat UnpackQuaternion(const uint16_t (&Packed)[3]);
+};
+
+#endif // ANIMATION_TOOLS_H_
@@ -0,0 +1,260 @@
+#include "CAssimpIOSystem.h"
+#include "CFileExportSTUFormat.h"
+#include "CLog.h"
+
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define LOG_ERROR(...) STU_LOG_ERROR("CAssimpIOSystem", __VA_ARGS__)
+
+// Paths reach us with mixed separators and "./" segments depending on the importer that builds them.
+static std::string NormalizePath(const std::string &sPath)
+{
+    std::string sResult = sPath;
+    std::replace(sResult.begin(), sResult.end(), '\\', '/');
+    while (sResult.compare(0, 2, "./") == 0)
+    {
+        sResult.erase(0, 2);
+    }
+    size_t uPos;
+    while ((uPos = sResult.find("/./")) != std::string::npos)
+    {
+        sResult.erase(uPos, 2);
+    }
+#ifdef _WIN32
+    std::transform(sResult.begin(), sResult.end(), sResult.begin(), ::tolower);
+#endif
+    return sResult;
+}
+
+static std::string GetFileName(const std::string &sNormalizedPath)
+{
+    size_t uPos = sNormalizedPath.find_last_of('/');
+    return uPos == std::string::npos ? sNormalizedPath : sNormalizedPath.substr(uPos + 1);
+}
+
+CMappedIOStream::CMappedIOStream(const void * pData, size_t uSize) :
+    m_pData((const uint8_t *)pData),
+    m_uSize(uSize),
+    m_uPosition(0),
+    m_bMapped(false)
+{
+}
+
+CMappedIOStream::~CMappedIOStream()
+{
+    if (m_bMapped)
+    {
+#ifdef _WIN32
+        UnmapViewOfFile(m_pData);
+#else
+        munmap((void *)m_pData, m_uSize);
+#endif
+    }
+}
+
+CMappedIOStream * CMappedIOStream::OpenFile(const std::string &path)
+{
+    const void * pView = YI_NULL;
+    size_t uSize = 0;
+    bool bOpened = false;
+
+#ifdef _WIN32
+    HANDLE hFile = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, YI_NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, YI_NULL);
+    if (hFile != INVALID_HANDLE_VALUE)
+    {
+        bOpened = true;
+        LARGE_INTEGER liSize;
+        if (GetFileSizeEx(hFile, &liSize) && liSize.QuadPart > 0)
+        {
+            uSize = (size_t)liSize.QuadPart;
+            HANDLE hSection = CreateFileMappingA(hFile, YI_NULL, PAGE_READONLY, 0, 0, YI_NULL);
+            if (hSection)
+            {
+                pView = MapViewOfFile(hSection, FILE_MAP_READ, 0, 0, 0);
+                // The view keeps the section alive.
+                CloseHandle(hSection);
+            }
+        }
+        CloseHandle(hFile);
+    }
+#else
+    int nFile = open(path.c_str(), O_RDONLY);
+    if (nFile >= 0)
+    {
+        bOpened = true;
+        struct stat Info;
+        if (fstat(nFile, &Info) == 0 && Info.st_size > 0)
+        {
+            uSize = (size_t)Info.st_size;
+            void * pMapping = mmap(YI_NULL, uSize, PROT_READ, MAP_PRIVATE, nFile, 0);
+            if (pMapping != MAP_FAILED)
+            {
+                pView = pMapping;
+#if defined(POSIX_MADV_SEQUENTIAL)
+                posix_madvise(pMapping, uSize, POSIX_MADV_SEQUENTIAL);
+#endif
+            }
+        }
+        close(nFile);
+    }
+#endif
+
+    if (!bOpened)
+    {
+        return YI_NULL;
+    }
+    if (pView)
+    {
+        CMappedIOStream * pStream = new CMappedIOStream(pView, uSize);
+        pStream->m_bMapped = true;
+        return pStream;
+    }
+
+    // Empty files and files on file systems that cannot be mapped are read into memory instead.
+    FILE * fp = fopen(path.c_str(), "rb");
+    if (!fp)
+    {
+        return YI_NULL;
+    }
+    CMappedIOStream * pStream = new CMappedIOStream(YI_NULL, 0);
+    uint8_t Block[64 * 1024];
+    size_t uRead;
+    while ((uRead = fread(Block, 1, sizeof(Block), fp)) > 0)
+    {
+        pStream->m_Copy.insert(pStream->m_Copy.end(), Block, Block + uRead);
+    }
+    fclose(fp);
+    pStream->m_uSize = pStream->m_Copy.size();
+    pStream->m_pData = pStream->m_Copy.empty() ? YI_NULL : &pStream->m_Copy[0];
+    return pStream;
+}
+
+size_t CMappedIOStream::Read(void * pvBuffer, size_t pSize, size_t pCount)
+{
+    if (pSize == 0 || pCount == 0)
+    {
+        return 0;
+    }
+    // Like fread, only whole elements are returned.
+    size_t uCount = (m_uSize - m_uPosition) / pSize;
+    if (uCount > pCount)
+    {
+        uCount = pCount;
+    }
+    if (uCount > 0)
+    {
+        memcpy(pvBuffer, m_pData + m_uPosition, uCount * pSize);
+        m_uPosition += uCount * pSize;
+    }
+    return uCount;
+}
+
+aiReturn CMappedIOStream::Seek(size_t pOffset, aiOrigin pOrigin)
+{
+    size_t uTarget;
+    switch (pOrigin)
+    {
+    case aiOrigin_SET:
+        uTarget = pOffset;
+        break;
+    case aiOrigin_CUR:
+        uTarget = m_uPosition + pOffset;
+        break;
+    case aiOrigin_END:
+        if (pOffset > m_uSize)
+        {
+            return aiReturn_FAILURE;
+        }
+        uTarget = m_uSize - pOffset;
+        break;
+    default:
+        return aiReturn_FAILURE;
+    }
+    if (uTarget > m_uSize)
+    {
+        return aiReturn_FAILURE;
+    }
+    m_uPosition = uTarget;
+    return aiReturn_SUCCESS;
+}
+
+void CAssimpIOSystem::AddMemoryFile(const std::string &sName, const void * pData, size_t uSize)
+{
+    MemoryFile File = { pData, uSize };
+    std::string sPath = NormalizePath(sName);
+    m_Files[sPath] = File;
+    m_FileNames[GetFileName(sPath)] = File;
+}
+
+const CAssimpIOSystem::MemoryFile * CAssimpIOSystem::FindMemoryFile(const std::string &sFile) const
+{
+    if (m_Files.empty())
+    {
+        return YI_NULL;
+    }
+    std::string sPath = NormalizePath(sFile);
+    std::map<std::string, MemoryFile>::const_iterator Itr = m_Files.find(sPath);
+    if (Itr != m_Files.end())
+    {
+        return &Itr->second;
+    }
+    Itr = m_FileNames.find(GetFileName(sPath));
+    return Itr != m_FileNames.end() ? &Itr->second : YI_NULL;
+}
+
+bool CAssimpIOSystem::Exists(const char * pFile) const
+{
+    if (FindMemoryFile(pFile))
+    {
+        return true;
+    }
+#ifdef _WIN32
+    DWORD uAttributes = GetFileAttributesA(pFile);
+    return uAttributes != INVALID_FILE_ATTRIBUTES && !(uAttributes & FILE_ATTRIBUTE_DIRECTORY);
+#else
+    struct stat Info;
+    return stat(pFile, &Info) == 0 && S_ISREG(Info.st_mode);
+#endif
+}
+
+char CAssimpIOSystem::getOsSeparator() const
+{
+#ifdef _WIN32
+    return '\\';
+#else
+    return '/';
+#endif
+}
+
+Assimp::IOStream * CAssimpIOSystem::Open(const char * pFile, const char * pMode)
+{
+    // Importers only read; anything else goes nowhere rather than into a source folder.
+    if (strchr(pMode, 'w') || strchr(pMode, 'a') || strchr(pMode, '+'))
+    {
+        LOG_ERROR("Refusing to open '%s' for writing.\n", pFile);
+        return YI_NULL;
+    }
+
+    const MemoryFile * pMemory = FindMemoryFile(pFile);
+    if (pMemory)
+    {
+        return new CMappedIOStream(pMemory->pData, pMemory->uSize);
+    }
+    return CMappedIOStream::OpenFile(pFile);
+}
+
+void CAssimpIOSystem::Close(Assimp::IOStream * pFile)
+{
+    delete pFile;
+}
@@ -0,0 +1,76 @@
+#ifndef ASSIMP_IO_SYSTEM_H_
+#define ASSIMP_IO_SYSTEM_H_
+
+#include "assimp/IOSystem.hpp"
+#include "assimp/IOStream.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+
+/* Read-only stream over a block of memory: a mapped file, a heap copy of one, or a buffer owned by the caller */
+class CMappedIOStream : public Assimp::IOStream
+{
+public:
+    /* Stream over uSize bytes at pData, which must outlive the stream */
+    CMappedIOStream(const void * pData, size_t uSize);
+
+    /* Map the file at path, or read it into memory when it cannot be mapped. Returns YI_NULL if it cannot be read. */
+    static CMappedIOStream * OpenFile(const std::string &path);
+
+    virtual ~CMappedIOStream();
+
+    virtual size_t Read(void * pvBuffer, size_t pSize, size_t pCount);
+    virtual size_t Write(const void * /*pvBuffer*/, size_t /*pSize*/, size_t /*pCount*/) { return 0; }
+    virtual aiReturn Seek(size_t pOffset, aiOrigin pOrigin);
+    virtual size_t Tell() const { return m_uPosition; }
+    virtual size_t FileSize() const { return m_uSize; }
+    virtual void Flush() {}
+
+private:
+    CMappedIOStream(const CMappedIOStream &);
+    CMappedIOStream &operator=(const CMappedIOStream &);
+
+    const uint8_t * m_pData;
+    size_t m_uSize;
+    size_t m_uPosition;
+    bool m_bMapped;                 // m_pData is a view that must be unmapped
+    std::vector<uint8_t> m_Copy;    // fallback when mapping fails
+};
+
+/*
+   Assimp file system that maps files instead of reading them through stdio buffers, and that can serve files
+   held in memory. Files registered with AddMemoryFile take precedence over the disk, so a model and the
+   files it references (materials, textures, .bin buffers) can all come from memory; references that are
+   not registered fall back to the disk. Memory files are matched by full path first, then by file name.
+   The importer takes ownership of the IO system passed to Importer::SetIOHandler.
+*/
+class CAssimpIOSystem : public Assimp::IOSystem
+{
+public:
+    CAssimpIOSystem() {}
+    virtual ~CAssimpIOSystem() {}
+
+    /* Serve uSize bytes at pData (not copied, must outlive the import) as the file sName */
+    void AddMemoryFile(const std::string &sName, const void * pData, size_t uSize);
+
+    virtual bool Exists(const char * pFile) const;
+    virtual char getOsSeparator() const;
+    virtual Assimp::IOStream * Open(const char * pFile, const char * pMode = "rb");
+    virtual void Close(Assimp::IOStream * pFile);
+
+private:
+    struct MemoryFile
+    {
+        const void * pData;
+        size_t uSize;
+    };
+
+    const MemoryFile * FindMemoryFile(const std::string &sFile) const;
+
+    std::map<std::string, MemoryFile> m_Files;      // by normalized path
+    std::map<std::string, MemoryFile> m_FileNames;  // by normalized file name
+};
+
+#endif // ASSIMP_IO_SYSTEM_H_
@@ -0,0 +1,166 @@
+#include "CAssimpPostProcess.h"
+#include "CFileExportSTUFormat.h"
+#include "CLog.h"
+#include "CTimer.h"
+
+#include <assimp/postprocess.h>
+
+#include <cstdio>
+#include <algorithm>
+
+#define LOG_ERROR(...) STU_LOG_ERROR("CAssimpPostProcess", __VA_ARGS__)
+
+struct PostProcessStep
+{
+    uint32_t uFlag;
+    const char * pName;
+};
+
+// Assimp's pipeline order (its post-processing step registry), used when the steps are run and timed one by one.
+// SplitLargeMeshes runs in two passes there, it is placed at the vertex pass since the exporter's limit is on vertices.
+static const PostProcessStep gSteps[] =
+{
+    { aiProcess_ValidateDataStructure,      "ValidateDataStructure" },
+    { aiProcess_MakeLeftHanded,             "MakeLeftHanded" },
+    { aiProcess_FlipUVs,                    "FlipUVs" },
+    { aiProcess_FlipWindingOrder,           "FlipWindingOrder" },
+    { aiProcess_RemoveComponent,            "RemoveComponent" },
+    { aiProcess_RemoveRedundantMaterials,   "RemoveRedundantMaterials" },
+    { aiProcess_FindInstances,              "FindInstances" },
+    { aiProcess_OptimizeGraph,              "OptimizeGraph" },
+    { aiProcess_OptimizeMeshes,             "OptimizeMeshes" },
+    { aiProcess_FindDegenerates,            "FindDegenerates" },
+    { aiProcess_GenUVCoords,                "GenUVCoords" },
+    { aiProcess_TransformUVCoords,          "TransformUVCoords" },
+    { aiProcess_PreTransformVertices,       "PreTransformVertices" },
+    { aiProcess_Triangulate,                "Triangulate" },
+    { aiProcess_SortByPType,                "SortByPType" },
+    { aiProcess_FindInvalidData,            "FindInvalidData" },
+    { aiProcess_FixInfacingNormals,         "FixInfacingNormals" },
+    { aiProcess_SplitByBoneCount,           "SplitByBoneCount" },
+    { aiProcess_GenNormals,                 "GenNormals" },
+    { aiProcess_GenSmoothNormals,           "GenSmoothNormals" },
+    { aiProcess_CalcTangentSpace,           "CalcTangentSpace" },
+    { aiProcess_JoinIdenticalVertices,      "JoinIdenticalVertices" },
+    { aiProcess_SplitLargeMeshes,           "SplitLargeMeshes" },
+    { aiProcess_Debone,                     "Debone" },
+    { aiProcess_LimitBoneWeights,           "LimitBoneWeights" },
+    { aiProcess_ImproveCacheLocality,       "ImproveCacheLocality" },
+};
+static const uint32_t uNumSteps = sizeof(gSteps) / sizeof(gSteps[0]);
+
+static const uint32_t uFastFlags = aiProcess_Triangulate | aiProcess_SortByPType | aiProcess_JoinIdenticalVertices |
+    aiProcess_SplitLargeMeshes | aiProcess_GenSmoothNormals | aiProcess_CalcTangentSpace | aiProcess_TransformUVCoords;
+
+static const uint32_t uBalancedFlags = uFastFlags | aiProcess_LimitBoneWeights | aiProcess_RemoveRedundantMaterials |
+    aiProcess_GenUVCoords;
+
+static const uint32_t uQualityFlags = aiProcessPreset_TargetRealtime_Quality | aiProcess_TransformUVCoords | aiProcess_Triangulate;
+
+static std::string ToLower(std::string sValue)
+{
+    std::transform(sValue.begin(), sValue.end(), sValue.begin(), ::tolower);
+    return sValue;
+}
+
+bool CAssimpPostProcess::GetProfileFlags(const std::string &sProfile, uint32_t &uFlags)
+{
+    std::string sName = ToLower(sProfile);
+    if (sName == "fast")
+    {
+        uFlags = uFastFlags;
+    }
+    else if (sName == "balanced")
+    {
+        uFlags = uBalancedFlags;
+    }
+    else if (sName == "quality")
+    {
+        uFlags = uQualityFlags;
+    }
+    else
+    {
+        LOG_ERROR("Unknown post-processing profile '%s', use fast, balanced or quality.\n", sProfile.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool CAssimpPostProcess::ApplyOverrides(const std::string &sOverrides, uint32_t &uFlags)
+{
+    size_t uStart = 0;
+    while (uStart < sOverrides.size())
+    {
+        size_t uEnd = sOverrides.find(',', uStart);
+        if (uEnd == std::string::npos)
+        {
+            uEnd = sOverrides.size();
+        }
+        std::string sItem = sOverrides.substr(uStart, uEnd - uStart);
+        uStart = uEnd + 1;
+        if (sItem.empty())
+        {
+            continue;
+        }
+
+        bool bEnable = sItem[0] != '-';
+        if (sItem[0] == '+' || sItem[0] == '-')
+        {
+            sItem.erase(0, 1);
+        }
+        std::string sName = ToLower(sItem);
+
+        uint32_t s = 0;
+        while (s < uNumSteps && ToLower(gSteps[s].pName) != sName)
+        {
+            s++;
+        }
+        if (s == uNumSteps)
+        {
+            LOG_ERROR("Unknown post-processing step '%s'.\n", sItem.c_str());
+            return false;
+        }
+        uFlags = bEnable ? (uFlags | gSteps[s].uFlag) : (uFlags & ~gSteps[s].uFlag);
+    }
+
+    // Assimp refuses both normal generators at once, the smooth one wins.
+    if ((uFlags & aiProcess_GenNormals) && (uFlags & aiProcess_GenSmoothNormals))
+    {
+        uFlags &= ~aiProcess_GenNormals;
+    }
+    return true;
+}
+
+const aiScene * CAssimpPostProcess::Apply(Assimp::Importer &Importer, uint32_t uFlags, bool bPerStep, std::vector<PostProcessStepTiming> &Timings)
+{
+    const aiScene * pScene = Importer.GetScene();
+    if (!bPerStep)
+    {
+        uint64_t uStartuS = CTimer::GetTimeuS();
+        pScene = Importer.ApplyPostProcessing(uFlags);
+        PostProcessStepTiming Timing = { "PostProcess", CTimer::GetTimeuS() - uStartuS };
+        Timings.push_back(Timing);
+        if (!pScene)
+        {
+            LOG_ERROR("Post-processing failed: %s\n", Importer.GetErrorString());
+        }
+        return pScene;
+    }
+
+    for (uint32_t s = 0; s < uNumSteps && pScene; ++s)
+    {
+        if (!(uFlags & gSteps[s].uFlag))
+        {
+            continue;
+        }
+        uint64_t uStartuS = CTimer::GetTimeuS();
+        pScene = Importer.ApplyPostProcessing(gSteps[s].uFlag);
+        PostProcessStepTiming Timing = { gSteps[s].pName, CTimer::GetTimeuS() - uStartuS };
+        Timings.push_back(Timing);
+        if (!pScene)
+        {
+            LOG_ERROR("Post-processing step %s failed: %s\n", gSteps[s].pName, Importer.GetErrorString());
+        }
+    }
+    return pScene;
+}
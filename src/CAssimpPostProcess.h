@@ -0,0 +1,46 @@
+#ifndef ASSIMP_POST_PROCESS_H_
+#define ASSIMP_POST_PROCESS_H_
+
+#include "assimp/Importer.hpp"
+#include "assimp/scene.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/* Time spent in one Assimp post-processing step, or in the import itself ("Import") */
+struct PostProcessStepTiming
+{
+    std::string sName;
+    uint64_t uTimeuS;
+};
+
+/*
+   Named sets of Assimp post-processing steps:
+
+   "fast"      Triangulate, SortByPType, JoinIdenticalVertices, SplitLargeMeshes, GenSmoothNormals, CalcTangentSpace,
+               TransformUVCoords. Only what the exporter needs; normals and tangents are only generated where they are
+               missing. JoinIdenticalVertices stays: without it every face corner is a vertex of its own.
+   "balanced"  "fast" plus LimitBoneWeights, RemoveRedundantMaterials, GenUVCoords.
+   "quality"   aiProcessPreset_TargetRealtime_Quality, Triangulate and TransformUVCoords (the previous behaviour).
+
+   Steps are named like their aiProcess_ flag without the prefix, e.g. "ImproveCacheLocality".
+*/
+class CAssimpPostProcess
+{
+public:
+
+    /* Flags of a named profile. Returns false for an unknown name. */
+    static bool GetProfileFlags(const std::string &sProfile, uint32_t &uFlags);
+
+    /* Apply a comma separated list of "+Step" / "-Step" to uFlags. Returns false for an unknown step. */
+    static bool ApplyOverrides(const std::string &sOverrides, uint32_t &uFlags);
+
+    /* Run the steps in uFlags on the scene held by Importer and append their time to Timings. Normally that is one
+       ApplyPostProcessing call, timed as "PostProcess", so Assimp orders the steps and shares its spatial sort between
+       them as in a single ReadFile. With bPerStep every step is applied and timed on its own, in Assimp's pipeline
+       order. Returns the processed scene, or YI_NULL if a step failed. */
+    static const aiScene * Apply(Assimp::Importer &Importer, uint32_t uFlags, bool bPerStep, std::vector<PostProcessStepTiming> &Timings);
+};
+
+#endif // ASSIMP_POST_PROCESS_H_
@@ -0,0 +1,126 @@
+#include "CAsyncSinkWriter.h"
+#include "CLog.h"
+
+#include <cstdio>
+
+#define LOG_ERROR(...) STU_LOG_ERROR("CAsyncSinkWriter", __VA_ARGS__)
+
+CAsyncSinkWriter::CAsyncSinkWriter() :
+    m_pSink(NULL),
+    m_uMaxQueuedBytes(0),
+    m_uQueuedBytes(0),
+    m_bClosing(false),
+    m_bFailed(false)
+{
+}
+
+CAsyncSinkWriter::~CAsyncSinkWriter()
+{
+    if (IsOpen())
+    {
+        Close();
+    }
+}
+
+bool CAsyncSinkWriter::Open(COutputSink * pSink, uint64_t uMaxQueuedBytes)
+{
+    if (IsOpen())
+    {
+        LOG_ERROR("The writer is still running.\n");
+        return false;
+    }
+    if (!pSink)
+    {
+        return false;
+    }
+
+    m_pSink = pSink;
+    m_uMaxQueuedBytes = uMaxQueuedBytes;
+    m_uQueuedBytes = 0;
+    m_bClosing = false;
+    m_bFailed = false;
+    m_Thread = std::thread(&CAsyncSinkWriter::WriterLoop, this);
+    return true;
+}
+
+bool CAsyncSinkWriter::Push(std::vector<uint8_t> &&Buffer)
+{
+    if (!IsOpen())
+    {
+        return false;
+    }
+    if (Buffer.empty())
+    {
+        return true;
+    }
+
+    uint64_t uSize = Buffer.size();
+    std::unique_lock<std::mutex> Lock(m_Mutex);
+    // A buffer larger than the limit is still accepted once the queue is empty, it just cannot overlap.
+    while (!m_bFailed && m_uQueuedBytes > 0 && m_uQueuedBytes + uSize > m_uMaxQueuedBytes)
+    {
+        m_QueueChanged.wait(Lock);
+    }
+    if (m_bFailed)
+    {
+        return false;
+    }
+    m_Queue.push_back(std::move(Buffer));
+    m_uQueuedBytes += uSize;
+    Lock.unlock();
+    m_QueueChanged.notify_all();
+    return true;
+}
+
+void CAsyncSinkWriter::WriterLoop()
+{
+    std::unique_lock<std::mutex> Lock(m_Mutex);
+    for (;;)
+    {
+        while (m_Queue.empty() && !m_bClosing)
+        {
+            m_QueueChanged.wait(Lock);
+        }
+        if (m_Queue.empty())
+        {
+            return;
+        }
+
+        // Keep the buffer counted until it is written so the producer cannot run further ahead than the limit.
+        std::vector<uint8_t> Buffer(std::move(m_Queue.front()));
+        m_Queue.pop_front();
+        bool bSkip = m_bFailed;
+        Lock.unlock();
+
+        bool bWritten = bSkip || m_pSink->Write(&Buffer[0], Buffer.size());
+        uint64_t uSize = Buffer.size();
+        std::vector<uint8_t>().swap(Buffer);
+
+        Lock.lock();
+        if (!bWritten)
+        {
+            LOG_ERROR("Cannot write %llu bytes.\n", (unsigned long long)uSize);
+            m_bFailed = true;
+        }
+        m_uQueuedBytes -= uSize;
+        m_QueueChanged.notify_all();
+    }
+}
+
+bool CAsyncSinkWriter::Close()
+{
+    if (!IsOpen())
+    {
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> Lock(m_Mutex);
+        m_bClosing = true;
+    }
+    m_QueueChanged.notify_all();
+    m_Thread.join();
+
+    m_pSink = NULL;
+    return !m_bFailed;
+}
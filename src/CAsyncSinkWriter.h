@@ -0,0 +1,55 @@
+#ifndef ASYNC_SINK_WRITER_H_
+#define ASYNC_SINK_WRITER_H_
+
+#include "COutputSink.h"
+
+#include <cstdint>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/*
+   Writes buffers to an output sink on a background thread, in the order they were queued. The producer only
+   blocks when more than uMaxQueuedBytes are waiting to be written, so encoding the next buffer overlaps the
+   write of the previous ones while memory use stays bounded. The sink must not be used by anyone else
+   between Open and Close.
+*/
+class CAsyncSinkWriter
+{
+public:
+    CAsyncSinkWriter();
+    virtual ~CAsyncSinkWriter();
+
+    /* Start the writer thread */
+    bool Open(COutputSink * pSink, uint64_t uMaxQueuedBytes);
+
+    /* Queue a buffer, taking ownership of it. Blocks while the queue is full. Returns false once a write has failed. */
+    bool Push(std::vector<uint8_t> &&Buffer);
+
+    /* Wait for the queue to drain and stop the thread. The sink is left open. Returns false if any write failed. */
+    bool Close();
+
+    /* True between Open and Close */
+    bool IsOpen() const { return m_pSink != NULL; }
+
+private:
+    void WriterLoop();
+
+    CAsyncSinkWriter(const CAsyncSinkWriter &);
+    CAsyncSinkWriter &operator=(const CAsyncSinkWriter &);
+
+    COutputSink * m_pSink;
+    std::thread m_Thread;
+
+    std::mutex m_Mutex;
+    std::condition_variable m_QueueChanged;
+    std::deque< std::vector<uint8_t> > m_Queue;
+    uint64_t m_uMaxQueuedBytes;
+    uint64_t m_uQueuedBytes;    // bytes waiting in m_Queue or being written
+    bool m_bClosing;
+    bool m_bFailed;
+};
+
+#endif // ASYNC_SINK_WRITER_H_
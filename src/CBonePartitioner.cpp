@@ -0,0 +1,265 @@
+#include "CBonePartitioner.h"
+#include "CLog.h"
+#include "CExportKernels.h"
+
+#include <cstdio>
+#include <algorithm>
+
+#define LOG_ERROR(...) STU_LOG_ERROR("CBonePartitioner", __VA_ARGS__)
+
+static const int32_t NO_PARTITION = -1;
+
+// Bones influencing a triangle, at most NUM_BONES_PER_VERTEX per corner.
+struct TriangleBones
+{
+    uint32_t uCount;
+    uint32_t IDs[CBonePartitioner::uMinPaletteSize];
+};
+
+static void GatherTriangleBones(const std::vector<uint32_t> &Indices, const std::vector<VertexBoneData> &Bones, uint32_t uTriangle, TriangleBones &Result)
+{
+    Result.uCount = 0;
+    for (uint32_t c = 0; c < 3; ++c)
+    {
+        uint32_t uVertex = Indices[uTriangle * 3 + c];
+        if (uVertex >= Bones.size())
+        {
+            continue;
+        }
+        for (uint32_t s = 0; s < NUM_BONES_PER_VERTEX; ++s)
+        {
+            const VertexBoneData::Data &Influence = Bones[uVertex].SortedData[s];
+            if (!(Influence.Weight > 0.0f))
+            {
+                break;
+            }
+            if (std::find(Result.IDs, Result.IDs + Result.uCount, Influence.ID) == Result.IDs + Result.uCount)
+            {
+                Result.IDs[Result.uCount++] = Influence.ID;
+            }
+        }
+    }
+}
+
+static VertexBoneData RemapInfluences(const VertexBoneData &Source, const std::vector<int32_t> &LocalBones)
+{
+    VertexBoneData Result = Source;
+    for (uint32_t s = 0; s < NUM_BONES_PER_VERTEX; ++s)
+    {
+        Result.SortedData[s].ID = Source.SortedData[s].Weight > 0.0f ? (uint32_t)LocalBones[Source.SortedData[s].ID] : 0;
+    }
+    return Result;
+}
+
+bool CBonePartitioner::Partition(const std::vector<uint32_t> &Indices, const std::vector<VertexBoneData> &Bones, uint32_t uMaxBones, BonePartitioning &Result)
+{
+    Result.Clear();
+
+    if (Indices.size() % 3 != 0)
+    {
+        LOG_ERROR("Bone partitioning needs a triangle list, got %u indices.\n", (uint32_t)Indices.size());
+        return false;
+    }
+    uMaxBones = std::max(uMaxBones, uMinPaletteSize);
+
+    const uint32_t uNumTriangles = (uint32_t)(Indices.size() / 3);
+    const uint32_t uNumVertices = (uint32_t)Bones.size();
+
+    // Bones of every triangle, and the triangles of every bone (compressed rows).
+    std::vector<TriangleBones> Triangles(uNumTriangles);
+    uint32_t uNumBoneIDs = 0;
+    for (uint32_t t = 0; t < uNumTriangles; ++t)
+    {
+        GatherTriangleBones(Indices, Bones, t, Triangles[t]);
+        for (uint32_t b = 0; b < Triangles[t].uCount; ++b)
+        {
+            uNumBoneIDs = std::max(uNumBoneIDs, Triangles[t].IDs[b] + 1);
+        }
+    }
+
+    std::vector<uint32_t> BoneTriangleStart(uNumBoneIDs + 1, 0);
+    for (uint32_t t = 0; t < uNumTriangles; ++t)
+    {
+        for (uint32_t b = 0; b < Triangles[t].uCount; ++b)
+        {
+            BoneTriangleStart[Triangles[t].IDs[b] + 1]++;
+        }
+    }
+    for (uint32_t b = 0; b < uNumBoneIDs; ++b)
+    {
+        BoneTriangleStart[b + 1] += BoneTriangleStart[b];
+    }
+    std::vector<uint32_t> BoneTriangles(BoneTriangleStart[uNumBoneIDs]);
+    {
+        std::vector<uint32_t> Fill(BoneTriangleStart.begin(), BoneTriangleStart.end() - 1);
+        for (uint32_t t = 0; t < uNumTriangles; ++t)
+        {
+            for (uint32_t b = 0; b < Triangles[t].uCount; ++b)
+            {
+                BoneTriangles[Fill[Triangles[t].IDs[b]]++] = t;
+            }
+        }
+    }
+
+    // Greedy growth. Candidates are bucketed by how many bones they would add to the palette; buckets are
+    // refreshed lazily, so stale entries are skipped when popped. Popping from the back favours triangles that
+    // just became cheaper, which are the neighbours of the bones added last and keeps partitions compact.
+    std::vector<int32_t> TrianglePartition(uNumTriangles, NO_PARTITION);
+    std::vector<uint32_t> Missing(uNumTriangles, 0);
+    std::vector<int32_t> LocalBones(uNumBoneIDs, NO_PARTITION);
+    std::vector< std::vector<uint32_t> > Buckets(uMinPaletteSize + 1);
+    uint32_t uRemaining = uNumTriangles;
+
+    while (uRemaining > 0)
+    {
+        int32_t nPartition = (int32_t)Result.Partitions.size();
+        Result.Partitions.push_back(BonePartition());
+        std::vector<uint32_t> &Palette = Result.Partitions.back().Palette;
+
+        for (size_t k = 0; k < Buckets.size(); ++k)
+        {
+            Buckets[k].clear();
+        }
+        for (uint32_t t = uNumTriangles; t > 0; --t)
+        {
+            if (TrianglePartition[t - 1] == NO_PARTITION)
+            {
+                Missing[t - 1] = Triangles[t - 1].uCount;
+                Buckets[Missing[t - 1]].push_back(t - 1);
+            }
+        }
+
+        for (;;)
+        {
+            uint32_t uFree = uMaxBones - (uint32_t)Palette.size();
+            int32_t nTriangle = -1;
+            for (uint32_t k = 0; k <= std::min(uFree, uMinPaletteSize) && nTriangle < 0; ++k)
+            {
+                std::vector<uint32_t> &Bucket = Buckets[k];
+                while (!Bucket.empty())
+                {
+                    uint32_t t = Bucket.back();
+                    Bucket.pop_back();
+                    if (TrianglePartition[t] == NO_PARTITION && Missing[t] == k)
+                    {
+                        nTriangle = (int32_t)t;
+                        break;
+                    }
+                }
+            }
+            if (nTriangle < 0)
+            {
+                break;
+            }
+
+            TrianglePartition[nTriangle] = nPartition;
+            uRemaining--;
+
+            const TriangleBones &Added = Triangles[nTriangle];
+            for (uint32_t b = 0; b < Added.uCount; ++b)
+            {
+                uint32_t uBone = Added.IDs[b];
+                if (LocalBones[uBone] != NO_PARTITION)
+                {
+                    continue;
+                }
+                LocalBones[uBone] = (int32_t)Palette.size();
+                Palette.push_back(uBone);
+                for (uint32_t i = BoneTriangleStart[uBone]; i < BoneTriangleStart[uBone + 1]; ++i)
+                {
+                    uint32_t t = BoneTriangles[i];
+                    if (TrianglePartition[t] == NO_PARTITION)
+                    {
+                        Missing[t]--;
+                        Buckets[Missing[t]].push_back(t);
+                    }
+                }
+            }
+        }
+
+        for (size_t b = 0; b < Palette.size(); ++b)
+        {
+            LocalBones[Palette[b]] = NO_PARTITION;
+        }
+    }
+
+    // Emit triangles grouped by partition, duplicating vertices already claimed by an earlier partition.
+    Result.Bones.assign(uNumVertices, VertexBoneData());
+    Result.Indices.reserve(Indices.size());
+    std::vector<int32_t> VertexPartition(uNumVertices, NO_PARTITION);
+    std::vector<int32_t> CopyPartition(uNumVertices, NO_PARTITION);
+    std::vector<uint32_t> CopyIndex(uNumVertices, 0);
+
+    for (size_t p = 0; p < Result.Partitions.size(); ++p)
+    {
+        BonePartition &Current = Result.Partitions[p];
+        for (size_t b = 0; b < Current.Palette.size(); ++b)
+        {
+            LocalBones[Current.Palette[b]] = (int32_t)b;
+        }
+
+        Current.uFirstIndex = (uint32_t)Result.Indices.size();
+        for (uint32_t t = 0; t < uNumTriangles; ++t)
+        {
+            if (TrianglePartition[t] != (int32_t)p)
+            {
+                continue;
+            }
+            for (uint32_t c = 0; c < 3; ++c)
+            {
+                uint32_t uVertex = Indices[t * 3 + c];
+                if (uVertex >= uNumVertices)
+                {
+                    // Unskinned vertex, nothing to remap.
+                    Result.Indices.push_back(uVertex);
+                }
+                else if (VertexPartition[uVertex] == NO_PARTITION || VertexPartition[uVertex] == (int32_t)p)
+                {
+                    VertexPartition[uVertex] = (int32_t)p;
+                    Result.Bones[uVertex] = RemapInfluences(Bones[uVertex], LocalBones);
+                    Result.Indices.push_back(uVertex);
+                }
+                else
+                {
+                    if (CopyPartition[uVertex] != (int32_t)p)
+                    {
+                        CopyPartition[uVertex] = (int32_t)p;
+                        CopyIndex[uVertex] = uNumVertices + (uint32_t)Result.DuplicatedVertices.size();
+                        Result.DuplicatedVertices.push_back(uVertex);
+                        Result.Bones.push_back(RemapInfluences(Bones[uVertex], LocalBones));
+                    }
+                    Result.Indices.push_back(CopyIndex[uVertex]);
+                }
+            }
+        }
+        Current.uIndexCount = (uint32_t)Result.Indices.size() - Current.uFirstIndex;
+
+        for (size_t b = 0; b < Current.Palette.size(); ++b)
+        {
+            LocalBones[Current.Palette[b]] = NO_PARTITION;
+        }
+    }
+
+    return true;
+}
+
+uint32_t CBonePartitioner::WritePartitions(const BonePartitioning &Partitioning, std::vector<uint8_t> &Data)
+{
+    uint32_t uSize = 0;
+    uint32_t uValue = (uint32_t)Partitioning.Partitions.size();
+    WRITE_VALUE(uValue);
+
+    for (size_t p = 0; p < Partitioning.Partitions.size(); ++p)
+    {
+        const BonePartition &Current = Partitioning.Partitions[p];
+        WRITE_VALUE(Current.uFirstIndex);
+        WRITE_VALUE(Current.uIndexCount);
+        uValue = (uint32_t)Current.Palette.size();
+        WRITE_VALUE(uValue);
+        if (uValue)
+        {
+            WRITE_VALUES(Current.Palette[0], uValue);
+        }
+    }
+    return uSize;
+}
@@ -0,0 +1,73 @@
+#ifndef BONE_PARTITIONER_H_
+#define BONE_PARTITIONER_H_
+
+#include "C3DModelDataStructures.h"
+
+#include <cstdint>
+#include <vector>
+
+/* A run of triangles that can be skinned with a single palette of at most uMaxBones bones */
+struct BonePartition
+{
+    uint32_t uFirstIndex;           // first index of the run in BonePartitioning::Indices
+    uint32_t uIndexCount;
+    std::vector<uint32_t> Palette;  // palette-local bone index -> index into "Bones"
+};
+
+/* Skinned mesh regrouped into bone partitions */
+struct BonePartitioning
+{
+    std::vector<BonePartition> Partitions;
+
+    // Triangle list grouped by partition. Vertices keep their index, except that a vertex shared by several
+    // partitions is duplicated for all but the first one; copies are appended after the source vertices.
+    std::vector<uint32_t> Indices;
+    std::vector<uint32_t> DuplicatedVertices;   // source vertex of every appended copy
+
+    // Influences of every vertex (source vertices then copies) with IDs local to the vertex's palette.
+    std::vector<VertexBoneData> Bones;
+
+    void Clear()
+    {
+        Partitions.clear();
+        Indices.clear();
+        DuplicatedVertices.clear();
+        Bones.clear();
+    }
+
+    bool IsEmpty() const { return Partitions.empty(); }
+
+    /* Source vertex to read attributes from for vertex uVertex of the partitioned mesh */
+    uint32_t GetSourceVertex(uint32_t uVertex, uint32_t uNumSourceVertices) const
+    {
+        return uVertex < uNumSourceVertices ? uVertex : DuplicatedVertices[uVertex - uNumSourceVertices];
+    }
+};
+
+/*
+   Bone partition chunk ("Vx:NBP"), written after "Vx:N" for skinned meshes when partitioning is enabled:
+
+   uint32 partition count, then per partition:
+       uint32 first index, uint32 index count, uint32 palette size, palette size x uint32 bone index into "Bones".
+
+   Bone IDs in the vertices are palette-local. Ranges address the index buffer, or the vertices directly
+   when the mesh has no index buffer (FBX).
+*/
+class CBonePartitioner
+{
+public:
+
+    /* Smallest palette that always fits a triangle */
+    static const uint32_t uMinPaletteSize = NUM_BONES_PER_VERTEX * 3;
+
+    /* Split the triangle list into partitions referencing at most uMaxBones bones each. Triangles are grown
+       greedily into the current partition, always taking the one that adds the fewest new bones, so a
+       partition is only closed when no remaining triangle fits. Triangles keep their relative order
+       within a partition. Returns false when Indices is not a triangle list. */
+    static bool Partition(const std::vector<uint32_t> &Indices, const std::vector<VertexBoneData> &Bones, uint32_t uMaxBones, BonePartitioning &Result);
+
+    /* Append the partition table (see "Vx:NBP" above) to Data, returns the number of bytes written */
+    static uint32_t WritePartitions(const BonePartitioning &Partitioning, std::vector<uint8_t> &Data);
+};
+
+#endif // BONE_PARTITIONER_H_
@@ -0,0 +1,259 @@
+#ifndef BOUNDED_QUEUE_H_
+#define BOUNDED_QUEUE_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <utility>
+#include <algorithm>
+
+/* Waits in a retry loop: spins a few times, then yields, then sleeps up to a millisecond. For waits on work
+   items that take far longer than a context switch. */
+class CBackoff
+{
+public:
+    CBackoff() : m_uRound(0) {}
+
+    void Pause()
+    {
+        if (m_uRound < 16)
+        {
+            // Busy wait, the other side is most likely about to finish.
+        }
+        else if (m_uRound < 64)
+        {
+            std::this_thread::yield();
+        }
+        else
+        {
+            uint32_t uSleepuS = std::min<uint32_t>(1000, 50u << std::min<uint32_t>(m_uRound - 64, 5));
+            std::this_thread::sleep_for(std::chrono::microseconds(uSleepuS));
+        }
+        m_uRound++;
+    }
+
+    void Reset() { m_uRound = 0; }
+
+private:
+    uint32_t m_uRound;
+};
+
+/*
+   Fixed capacity multi-producer multi-consumer queue without locks (the array queue of D. Vyukov): every cell
+   carries a sequence number telling producers and consumers whose turn it is, so TryPush and TryPop are a
+   compare-and-swap on a counter plus a move. Push and Pop block on a condition variable while the queue is full
+   or empty; the lock is only taken by threads that have to wait and by those waking them. T must be default
+   constructible and movable.
+*/
+template <typename T>
+class CBoundedQueue
+{
+public:
+
+    /* The capacity is rounded up to a power of two, at least 2 */
+    explicit CBoundedQueue(size_t uCapacity) :
+        m_uMask(RoundCapacity(uCapacity) - 1),
+        m_pCells(new Cell[m_uMask + 1]),
+        m_uEnqueue(0),
+        m_uDequeue(0),
+        m_bClosed(false),
+        m_uPushWaiters(0),
+        m_uPopWaiters(0)
+    {
+        for (size_t i = 0; i <= m_uMask; ++i)
+        {
+            m_pCells[i].uSequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    /* False if the queue is full */
+    bool TryPush(T &&Value)
+    {
+        if (!Enqueue(std::move(Value)))
+        {
+            return false;
+        }
+        WakeWaiters(m_uPopWaiters, m_NotEmpty);
+        return true;
+    }
+
+    /* False if the queue is empty */
+    bool TryPop(T &Value)
+    {
+        if (!Dequeue(Value))
+        {
+            return false;
+        }
+        WakeWaiters(m_uPushWaiters, m_NotFull);
+        return true;
+    }
+
+    /* Waits while the queue is full */
+    void Push(T &&Value)
+    {
+        if (!Enqueue(std::move(Value)))
+        {
+            std::unique_lock<std::mutex> Lock(m_WaitMutex);
+            m_uPushWaiters.fetch_add(1);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            while (!Enqueue(std::move(Value)))
+            {
+                m_NotFull.wait(Lock);
+            }
+            m_uPushWaiters.fetch_sub(1);
+        }
+        WakeWaiters(m_uPopWaiters, m_NotEmpty);
+    }
+
+    /* Waits while the queue is empty. False once the queue is closed and drained. */
+    bool Pop(T &Value)
+    {
+        if (!Dequeue(Value))
+        {
+            std::unique_lock<std::mutex> Lock(m_WaitMutex);
+            m_uPopWaiters.fetch_add(1);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            bool bPopped = Dequeue(Value);
+            while (!bPopped && !m_bClosed.load(std::memory_order_acquire))
+            {
+                m_NotEmpty.wait(Lock);
+                bPopped = Dequeue(Value);
+            }
+            // A value pushed before Close() is still returned, the last try above came after the flag was seen.
+            bPopped = bPopped || Dequeue(Value);
+            m_uPopWaiters.fetch_sub(1);
+            if (!bPopped)
+            {
+                return false;
+            }
+        }
+        WakeWaiters(m_uPushWaiters, m_NotFull);
+        return true;
+    }
+
+    /* Call once the last Push returned. Consumers return from Pop once the queue is empty. */
+    void Close()
+    {
+        {
+            std::lock_guard<std::mutex> Lock(m_WaitMutex);
+            m_bClosed.store(true, std::memory_order_release);
+        }
+        m_NotEmpty.notify_all();
+    }
+
+    size_t GetCapacity() const { return m_uMask + 1; }
+
+private:
+
+    bool Enqueue(T &&Value)
+    {
+        size_t uPosition = m_uEnqueue.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Cell &Target = m_pCells[uPosition & m_uMask];
+            size_t uSequence = Target.uSequence.load(std::memory_order_acquire);
+            intptr_t nDifference = (intptr_t)uSequence - (intptr_t)uPosition;
+            if (nDifference == 0)
+            {
+                if (m_uEnqueue.compare_exchange_weak(uPosition, uPosition + 1, std::memory_order_relaxed))
+                {
+                    Target.Value = std::move(Value);
+                    Target.uSequence.store(uPosition + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (nDifference < 0)
+            {
+                return false;
+            }
+            else
+            {
+                uPosition = m_uEnqueue.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool Dequeue(T &Value)
+    {
+        size_t uPosition = m_uDequeue.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Cell &Source = m_pCells[uPosition & m_uMask];
+            size_t uSequence = Source.uSequence.load(std::memory_order_acquire);
+            intptr_t nDifference = (intptr_t)uSequence - (intptr_t)(uPosition + 1);
+            if (nDifference == 0)
+            {
+                if (m_uDequeue.compare_exchange_weak(uPosition, uPosition + 1, std::memory_order_relaxed))
+                {
+                    Value = std::move(Source.Value);
+                    Source.uSequence.store(uPosition + m_uMask + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (nDifference < 0)
+            {
+                return false;
+            }
+            else
+            {
+                uPosition = m_uDequeue.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // A waiter counts itself, then tries once more before it sleeps. The fences order that count against the
+    // cell just published here: either this sees the waiter, or the waiter's last try sees the cell. Taking the
+    // lock before the notification makes sure a waiter that was seen is asleep, not between its try and its wait.
+    void WakeWaiters(std::atomic<uint32_t> &uWaiters, std::condition_variable &Waiting)
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (uWaiters.load(std::memory_order_relaxed) > 0)
+        {
+            {
+                std::lock_guard<std::mutex> Lock(m_WaitMutex);
+            }
+            Waiting.notify_all();
+        }
+    }
+
+    struct Cell
+    {
+        std::atomic<size_t> uSequence;
+        T Value;
+    };
+
+    static size_t RoundCapacity(size_t uCapacity)
+    {
+        size_t uRounded = 2;
+        while (uRounded < uCapacity)
+        {
+            uRounded <<= 1;
+        }
+        return uRounded;
+    }
+
+    CBoundedQueue(const CBoundedQueue &);
+    CBoundedQueue &operator=(const CBoundedQueue &);
+
+    // Producers and consumers update different counters, the padding keeps them on different cache lines.
+    size_t m_uMask;
+    std::unique_ptr<Cell[]> m_pCells;
+    char m_EnqueuePadding[64];
+    std::atomic<size_t> m_uEnqueue;
+    char m_DequeuePadding[64];
+    std::atomic<size_t> m_uDequeue;
+    char m_ClosedPadding[64];
+    std::atomic<bool> m_bClosed;
+    std::atomic<uint32_t> m_uPushWaiters;
+    std::atomic<uint32_t> m_uPopWaiters;
+    std::mutex m_WaitMutex;
+    std::condition_variable m_NotFull;
+    std::condition_variable m_NotEmpty;
+};
+
+#endif // BOUNDED_QUEUE_H_
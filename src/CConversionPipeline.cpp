@@ -0,0 +1,215 @@
+#include "CConversionPipeline.h"
+#include "CParallelFor.h"
+#include "CLog.h"
+#include "CTimer.h"
+
+#include <cstdio>
+#include <map>
+
+#define LOG_ERROR(...) STU_LOG_ERROR("CConversionPipeline", __VA_ARGS__)
+
+CConversionPipeline::CConversionPipeline() :
+    m_pSink(YI_NULL),
+    m_uMaxInFlight(0),
+    m_uInFlight(0),
+    m_uSubmitted(0),
+    m_bRunning(false)
+{
+}
+
+CConversionPipeline::~CConversionPipeline()
+{
+    Finish();
+}
+
+bool CConversionPipeline::Start(uint32_t uConvertThreads, uint32_t uMaxInFlight, COutputSink * pSink)
+{
+    if (m_bRunning)
+    {
+        LOG_ERROR("The pipeline is already running.\n");
+        return false;
+    }
+
+    if (uConvertThreads == 0)
+    {
+        uConvertThreads = CParallelFor::GetWorkerCount();
+    }
+    m_uMaxInFlight = uMaxInFlight > 0 ? uMaxInFlight : uConvertThreads * 2;
+    m_pSink = pSink;
+    m_uInFlight = 0;
+    m_uSubmitted = 0;
+    m_Results.clear();
+
+    // In-flight models bound both queues, so pushes never wait on a full queue.
+    m_pConvertQueue.reset(new JobQueue(m_uMaxInFlight));
+    m_pWriteQueue.reset(new JobQueue(m_uMaxInFlight));
+
+    m_bRunning = true;
+    m_WriteThread = std::thread(&CConversionPipeline::WriteLoop, this);
+    for (uint32_t i = 0; i < uConvertThreads; ++i)
+    {
+        m_ConvertThreads.push_back(std::thread(&CConversionPipeline::ConvertLoop, this));
+    }
+    return true;
+}
+
+bool CConversionPipeline::Submit(const std::string &path, const ConversionOptions &Options)
+{
+    if (!m_bRunning)
+    {
+        return false;
+    }
+
+    {
+        std::unique_lock<std::mutex> Lock(m_InFlightMutex);
+        while (m_uInFlight >= m_uMaxInFlight)
+        {
+            m_InFlightReleased.wait(Lock);
+        }
+        m_uInFlight++;
+    }
+
+    std::unique_ptr<Job> pJob(new Job());
+    pJob->uIndex = m_uSubmitted++;
+    pJob->sPath = path;
+    pJob->Options = Options;
+    pJob->bDeferred = (CImporterRegistry::GetCapabilities(C3DConversionContext::SelectImporter(path, Options)) & ImporterCapability_BoundedMemory) != 0;
+    if (!pJob->bDeferred)
+    {
+        // Encoded into memory, a background writer or a mapped file would only add a copy.
+        pJob->Options.bAsyncOutput = false;
+        pJob->Options.bMappedOutput = false;
+    }
+
+    m_pConvertQueue->Push(std::move(pJob));
+    return true;
+}
+
+const std::vector<ConversionResult> &CConversionPipeline::Finish()
+{
+    if (!m_bRunning)
+    {
+        return m_Results;
+    }
+
+    m_pConvertQueue->Close();
+    for (size_t i = 0; i < m_ConvertThreads.size(); ++i)
+    {
+        m_ConvertThreads[i].join();
+    }
+    m_ConvertThreads.clear();
+
+    m_pWriteQueue->Close();
+    m_WriteThread.join();
+
+    m_pConvertQueue.reset();
+    m_pWriteQueue.reset();
+    m_bRunning = false;
+    return m_Results;
+}
+
+void CConversionPipeline::ConvertLoop()
+{
+    // Kept for every model this worker converts, see C3DConversionContext.
+    C3DConversionContext Context;
+    std::unique_ptr<Job> pJob;
+    while (m_pConvertQueue->Pop(pJob))
+    {
+        if (!pJob->bDeferred)
+        {
+            pJob->Result = Context.Convert(pJob->sPath, pJob->Options, &pJob->Output);
+        }
+        m_pWriteQueue->Push(std::move(pJob));
+    }
+}
+
+void CConversionPipeline::WriteLoop()
+{
+    C3DConversionContext Context;
+    std::map< uint32_t, std::unique_ptr<Job> > Waiting;
+    uint32_t uNextIndex = 0;
+    std::unique_ptr<Job> pJob;
+    while (m_pWriteQueue->Pop(pJob))
+    {
+        if (!m_pSink)
+        {
+            WriteJob(*pJob, Context);
+            pJob.reset();
+            ReleaseInFlight();
+            continue;
+        }
+
+        // A shared sink gets the models in submission order, later ones wait for the ones still converting.
+        uint32_t uIndex = pJob->uIndex;
+        Waiting[uIndex] = std::move(pJob);
+        while (!Waiting.empty() && Waiting.begin()->first == uNextIndex)
+        {
+            WriteJob(*Waiting.begin()->second, Context);
+            Waiting.erase(Waiting.begin());
+            uNextIndex++;
+            ReleaseInFlight();
+        }
+    }
+}
+
+void CConversionPipeline::ReleaseInFlight()
+{
+    {
+        std::lock_guard<std::mutex> Lock(m_InFlightMutex);
+        m_uInFlight--;
+    }
+    m_InFlightReleased.notify_one();
+}
+
+void CConversionPipeline::WriteJob(Job &Target, C3DConversionContext &Context)
+{
+    if (Target.bDeferred)
+    {
+        Target.Result = Context.Convert(Target.sPath, Target.Options, m_pSink);
+    }
+    else
+    {
+        std::string sOutputPath = Target.sPath + ".stu";
+        if (!Target.Result.bSuccess)
+        {
+            if (!m_pSink)
+            {
+                // Same as a direct conversion, a failed model leaves no stale output behind.
+                std::remove(sOutputPath.c_str());
+            }
+        }
+        else
+        {
+            uint64_t uStartuS = CTimer::GetTimeuS();
+            const std::vector<uint8_t> &Buffer = Target.Output.GetBuffer();
+            bool bWritten = false;
+            if (m_pSink)
+            {
+                bWritten = Buffer.empty() || m_pSink->Write(&Buffer[0], Buffer.size());
+            }
+            else
+            {
+                CFileOutputSink File;
+                if (File.Open(sOutputPath))
+                {
+                    bWritten = Buffer.empty() || File.Write(&Buffer[0], Buffer.size());
+                    bWritten = File.Close() && bWritten;
+                }
+            }
+            if (!bWritten)
+            {
+                Target.Result.bSuccess = false;
+                Target.Result.sError = "Could not write '" + Target.sPath + "' into " + (m_pSink ? std::string("the output.") : "'" + sOutputPath + "'.");
+            }
+            Target.Result.uTimeuS += CTimer::GetTimeuS() - uStartuS;
+        }
+        std::vector<uint8_t> Released;
+        Target.Output.TakeBuffer(Released);
+    }
+
+    if (m_Results.size() <= Target.uIndex)
+    {
+        m_Results.resize(Target.uIndex + 1);
+    }
+    m_Results[Target.uIndex] = Target.Result;
+}
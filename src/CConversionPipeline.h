@@ -0,0 +1,88 @@
+#ifndef CONVERSION_PIPELINE_H_
+#define CONVERSION_PIPELINE_H_
+
+#include "C3DConverter.h"
+#include "CBoundedQueue.h"
+#include "COutputSink.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+/*
+   Converts a batch of models in stages connected by bounded queues, so the models of a batch are at
+   different stages at the same time and the CPU stays busy across the whole batch, not only within one model:
+
+   1. Submit: the caller queues models. It blocks once uMaxInFlight models are converting or waiting to be written,
+      which bounds the memory held by encoded models.
+   2. Convert: worker threads, each with its own C3DConversionContext, import, process and encode one model at a
+      time into memory.
+   3. Write: one thread writes the encoded models to path + ".stu" as they complete or, when the batch shares a
+      sink (e.g. stdout), into the sink in the order they were submitted.
+
+   Out-of-core conversions are not held in memory: the write stage runs them itself, in turn, straight into their
+   files or the sink.
+*/
+class CConversionPipeline
+{
+public:
+    CConversionPipeline();
+    virtual ~CConversionPipeline();
+
+    /* Start the stage threads. uConvertThreads 0 uses one per core, uMaxInFlight 0 twice as many models as convert
+       threads. pSink (not owned) receives every model of the batch, YI_NULL writes one .stu per model. */
+    bool Start(uint32_t uConvertThreads = 0, uint32_t uMaxInFlight = 0, COutputSink * pSink = YI_NULL);
+
+    /* Queue the model at path, converted with Options. Blocks while uMaxInFlight models are in the pipeline. */
+    bool Submit(const std::string &path, const ConversionOptions &Options);
+
+    /* Wait for every submitted model and stop the threads. Returns the results in submission order. */
+    const std::vector<ConversionResult> &Finish();
+
+    bool IsRunning() const { return m_bRunning; }
+
+    uint32_t GetConvertThreadCount() const { return (uint32_t)m_ConvertThreads.size(); }
+
+private:
+
+    struct Job
+    {
+        uint32_t uIndex;
+        std::string sPath;
+        ConversionOptions Options;
+        ConversionResult Result;
+        CMemoryOutputSink Output;
+        bool bDeferred;             // converted by the write stage
+    };
+
+    typedef CBoundedQueue< std::unique_ptr<Job> > JobQueue;
+
+    void ConvertLoop();
+    void WriteLoop();
+    void WriteJob(Job &Target, C3DConversionContext &Context);
+    void ReleaseInFlight();
+
+    CConversionPipeline(const CConversionPipeline &);
+    CConversionPipeline &operator=(const CConversionPipeline &);
+
+    COutputSink * m_pSink;
+    uint32_t m_uMaxInFlight;
+    std::unique_ptr<JobQueue> m_pConvertQueue;
+    std::unique_ptr<JobQueue> m_pWriteQueue;
+    std::vector<std::thread> m_ConvertThreads;
+    std::thread m_WriteThread;
+    std::mutex m_InFlightMutex;
+    std::condition_variable m_InFlightReleased;
+    uint32_t m_uInFlight;
+    uint32_t m_uSubmitted;
+    bool m_bRunning;
+
+    // Written by the write stage only, handed out by Finish once it stopped.
+    std::vector<ConversionResult> m_Results;
+};
+
+#endif // CONVERSION_PIPELINE_H_
@@ -0,0 +1,32 @@
+#ifndef EXPORT_KERNELS_H_
+#define EXPORT_KERNELS_H_
+
+#include "C3DModelDataStructures.h"
+
+#include <cstdint>
+#include <vector>
+
+struct aiMesh;
+struct BonePartitioning;
+
+/*
+   Inner loops of the exporters that need nothing of the converter they run in. They are shared by the converters
+   and by 3DConvertMicroBench, so what the benchmark times is the code that ships. Internal to the library.
+*/
+
+// Append x, c values starting at x, or c values of type y at the address x to the std::vector<uint8_t> Data of the
+// chunk being built, and add their size to uSize.
+#define WRITE_VALUE(x)          do {Data.insert(Data.end(), (uint8_t *)&(x), (uint8_t *)&(x) + sizeof(x)); uSize += sizeof(x);} while((void)0,0)
+#define WRITE_VALUES(x, c)      do {Data.insert(Data.end(), (uint8_t *)&(x), (uint8_t *)&(x) + sizeof(x) * (c)); uSize += sizeof(x) * (c);} while((void)0,0)
+#define WRITE_BYTES(x, y, c)    do {Data.insert(Data.end(), (uint8_t *)(x), (uint8_t *)(x) + sizeof(y) * (c)); uSize += sizeof(y) * (c);} while((void)0,0)
+
+/* Packs the vertices of pLayoutMesh, then the copies bone partitioning added, into pTarget in the layout Type and
+   returns their bounds. Bones are the influences of every vertex of a skinned mesh. In C3DModelAssimp.cpp. */
+void EncodeAssimpVertices(uint8_t *pTarget, const aiMesh *pLayoutMesh, VertexDataType Type, const std::vector<VertexBoneData> &Bones,
+    const BonePartitioning &Partitioning, bool bFlipUVonY, float bmin[3], float bmax[3]);
+
+/* Appends the numbers of str, separated by single spaces, to array three at a time, or two with is2element (z is
+   then 0). In C3DModelXML.cpp. */
+void ParseVectorString(const char* str, std::vector<glm::vec3> *array, bool is2element = false);
+
+#endif // EXPORT_KERNELS_H_
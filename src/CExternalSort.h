@@ -0,0 +1,291 @@
+#ifndef EXTERNAL_SORT_H_
+#define EXTERNAL_SORT_H_
+
+#include "CTempFile.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include <queue>
+#include <algorithm>
+
+/* Sorts more fixed size records than fit in memory. Records are collected in a buffer; a full buffer is sorted and
+   spilled to a temp file as a run. Finish merges the runs (in several passes when there are more than fit the
+   budget at once) and Next then returns the records in order. A sort that never fills the buffer stays in memory.
+   Equal records keep the order they were added in. Record must be trivially copyable, Less is a strict weak
+   ordering on it.
+
+   Everything the sorter allocates counts against uMemoryBudget: the buffer, the temporary buffer of stable_sort
+   (up to the size of the buffer again), the stdio buffer of every open temp file (CTempFile::uBufferSize) and
+   the read block of every run being merged. Budgets below that of a two-way merge, about three stdio buffers,
+   are rounded up to it. */
+template <typename Record, typename Less>
+class CExternalSorter
+{
+public:
+
+    /* Most runs merged at once, which also bounds the number of open temp files. Smaller budgets merge fewer. */
+    static const uint32_t uMaxMergeWays = 64;
+
+    /* Records read from a run at a time during the merge */
+    static const uint32_t uRunBlockRecords = 4096;
+
+    CExternalSorter(const std::string &sTempDirectory, uint64_t uMemoryBudget, Less Compare = Less()) :
+        m_sTempDirectory(sTempDirectory),
+        m_Compare(Compare),
+        m_uMaxBuffered(GetMaxBuffered(uMemoryBudget)),
+        m_uMergeWays(GetMergeWays(uMemoryBudget)),
+        m_uCount(0),
+        m_uNext(0),
+        m_bFinished(false),
+        m_bFailed(false)
+    {
+    }
+
+    bool Add(const Record &Value)
+    {
+        if (m_bFinished || m_bFailed)
+        {
+            return false;
+        }
+        if (m_Buffer.size() == m_Buffer.capacity())
+        {
+            // Grow by hand so the buffer never overshoots the budget the way push_back doubling would.
+            m_Buffer.reserve(std::min(m_uMaxBuffered, std::max<size_t>(m_Buffer.capacity() * 2, uRunBlockRecords)));
+        }
+        m_Buffer.push_back(Value);
+        m_uCount++;
+        if (m_Buffer.size() >= m_uMaxBuffered)
+        {
+            return SpillRun();
+        }
+        return true;
+    }
+
+    /* Stop adding records and prepare reading them back in order */
+    bool Finish()
+    {
+        if (m_bFinished || m_bFailed)
+        {
+            return !m_bFailed;
+        }
+        m_bFinished = true;
+
+        if (m_Runs.empty())
+        {
+            std::stable_sort(m_Buffer.begin(), m_Buffer.end(), m_Compare);
+            m_uNext = 0;
+            return true;
+        }
+
+        if (!m_Buffer.empty() && !SpillRun())
+        {
+            return false;
+        }
+        std::vector<Record>().swap(m_Buffer);
+
+        while (m_Runs.size() > m_uMergeWays)
+        {
+            std::vector< std::unique_ptr<CTempFile> > Merged;
+            for (size_t uFirst = 0; uFirst < m_Runs.size(); uFirst += m_uMergeWays)
+            {
+                size_t uLast = std::min<size_t>(uFirst + m_uMergeWays, m_Runs.size());
+                std::unique_ptr<CTempFile> pRun(new CTempFile());
+                if (!pRun->Create(m_sTempDirectory, "stu-sort") || !StartMerge(uFirst, uLast))
+                {
+                    m_bFailed = true;
+                    return false;
+                }
+                Record Value;
+                while (NextMerged(Value))
+                {
+                    if (!pRun->WriteRecord(Value))
+                    {
+                        m_bFailed = true;
+                        return false;
+                    }
+                }
+                for (size_t r = uFirst; r < uLast; ++r)
+                {
+                    m_Runs[r].reset();
+                }
+                Merged.push_back(std::move(pRun));
+            }
+            m_Runs.swap(Merged);
+        }
+
+        if (!StartMerge(0, m_Runs.size()))
+        {
+            m_bFailed = true;
+            return false;
+        }
+        return true;
+    }
+
+    /* Next record in order, false once all records were returned */
+    bool Next(Record &Value)
+    {
+        if (!m_bFinished || m_bFailed)
+        {
+            return false;
+        }
+        if (m_Runs.empty())
+        {
+            if (m_uNext >= m_Buffer.size())
+            {
+                return false;
+            }
+            Value = m_Buffer[m_uNext++];
+            return true;
+        }
+        return NextMerged(Value);
+    }
+
+    /* Number of records added */
+    uint64_t GetCount() const { return m_uCount; }
+
+    /* True if a temp file could not be written */
+    bool HasFailed() const { return m_bFailed; }
+
+private:
+
+    struct RunReader
+    {
+        CTempFile * pFile;
+        std::vector<Record> Block;
+        size_t uNext;
+    };
+
+    struct HeapEntry
+    {
+        Record Value;
+        uint32_t uReader;
+    };
+
+    // Inverted for std::priority_queue, ties go to the earlier run so the merge is stable.
+    struct HeapGreater
+    {
+        Less Compare;
+        HeapGreater(Less InCompare) : Compare(InCompare) {}
+        bool operator()(const HeapEntry &A, const HeapEntry &B) const
+        {
+            if (Compare(B.Value, A.Value))
+            {
+                return true;
+            }
+            if (Compare(A.Value, B.Value))
+            {
+                return false;
+            }
+            return A.uReader > B.uReader;
+        }
+    };
+
+    typedef std::priority_queue<HeapEntry, std::vector<HeapEntry>, HeapGreater> MergeHeap;
+
+    // Spilling a run holds the buffer, the temporary buffer of stable_sort and the stdio buffer of the run.
+    static size_t GetMaxBuffered(uint64_t uMemoryBudget)
+    {
+        uint64_t uSortBudget = uMemoryBudget > CTempFile::uBufferSize ? uMemoryBudget - CTempFile::uBufferSize : 0;
+        return (size_t)std::max<uint64_t>(uSortBudget / (2 * sizeof(Record)), uRunBlockRecords);
+    }
+
+    // A merge pass holds the stdio buffer, read block and heap entry of every input, and the stdio buffer of its
+    // output run (the final pass has none, its records go to Next).
+    static uint32_t GetMergeWays(uint64_t uMemoryBudget)
+    {
+        uint64_t uPerRun = CTempFile::uBufferSize + (uint64_t)uRunBlockRecords * sizeof(Record) + sizeof(HeapEntry);
+        uint64_t uInputBudget = uMemoryBudget > CTempFile::uBufferSize ? uMemoryBudget - CTempFile::uBufferSize : 0;
+        return (uint32_t)std::min<uint64_t>(std::max<uint64_t>(uInputBudget / uPerRun, 2), uMaxMergeWays);
+    }
+
+    bool SpillRun()
+    {
+        std::stable_sort(m_Buffer.begin(), m_Buffer.end(), m_Compare);
+        std::unique_ptr<CTempFile> pRun(new CTempFile());
+        if (!pRun->Create(m_sTempDirectory, "stu-sort") || !pRun->Write(&m_Buffer[0], (uint64_t)m_Buffer.size() * sizeof(Record)))
+        {
+            m_bFailed = true;
+            return false;
+        }
+        m_Runs.push_back(std::move(pRun));
+        m_Buffer.clear();
+        return true;
+    }
+
+    bool FillBlock(RunReader &Reader)
+    {
+        Reader.Block.resize(uRunBlockRecords);
+        uint64_t uRead = Reader.pFile->ReadSome(&Reader.Block[0], (uint64_t)uRunBlockRecords * sizeof(Record)) / sizeof(Record);
+        Reader.Block.resize((size_t)uRead);
+        Reader.uNext = 0;
+        return uRead > 0;
+    }
+
+    void PushNext(uint32_t uReader)
+    {
+        RunReader &Reader = m_Readers[uReader];
+        if (Reader.uNext >= Reader.Block.size() && !FillBlock(Reader))
+        {
+            std::vector<Record>().swap(Reader.Block);
+            return;
+        }
+        HeapEntry Entry;
+        Entry.Value = Reader.Block[Reader.uNext++];
+        Entry.uReader = uReader;
+        m_pHeap->push(Entry);
+    }
+
+    bool StartMerge(size_t uFirst, size_t uLast)
+    {
+        m_Readers.clear();
+        m_pHeap.reset(new MergeHeap(HeapGreater(m_Compare)));
+        m_Readers.resize(uLast - uFirst);
+        for (size_t r = uFirst; r < uLast; ++r)
+        {
+            if (!m_Runs[r]->Rewind())
+            {
+                return false;
+            }
+            m_Readers[r - uFirst].pFile = m_Runs[r].get();
+            m_Readers[r - uFirst].uNext = 0;
+        }
+        for (uint32_t r = 0; r < (uint32_t)m_Readers.size(); ++r)
+        {
+            PushNext(r);
+        }
+        return true;
+    }
+
+    bool NextMerged(Record &Value)
+    {
+        if (!m_pHeap || m_pHeap->empty())
+        {
+            return false;
+        }
+        HeapEntry Top = m_pHeap->top();
+        m_pHeap->pop();
+        Value = Top.Value;
+        PushNext(Top.uReader);
+        return true;
+    }
+
+    CExternalSorter(const CExternalSorter &);
+    CExternalSorter &operator=(const CExternalSorter &);
+
+    std::string m_sTempDirectory;
+    Less m_Compare;
+    size_t m_uMaxBuffered;
+    uint32_t m_uMergeWays;
+    std::vector<Record> m_Buffer;
+    std::vector< std::unique_ptr<CTempFile> > m_Runs;
+    std::vector<RunReader> m_Readers;
+    std::unique_ptr<MergeHeap> m_pHeap;
+    uint64_t m_uCount;
+    size_t m_uNext;
+    bool m_bFinished;
+    bool m_bFailed;
+};
+
+#endif // EXTERNAL_SORT_H_
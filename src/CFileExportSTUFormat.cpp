@@ -1,9 +1,19 @@
 #include "CFileExportSTUFormat.h"
+#include "CLog.h"
 
 #include <algorithm>
 
-#define LOG_ERROR(...) printf("C3DModelExport:"); printf(__VA_ARGS__);
-#define LOG_INFO(...) printf("C3DModelExport:"); printf(__VA_ARGS__);
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define LOG_ERROR(...) STU_LOG_ERROR("C3DModelExport", __VA_ARGS__)
+#define LOG_INFO(...) STU_LOG_INFO("C3DModelExport", __VA_ARGS__)
 
 #define YI_FLAG_COMPRESS_OUTPUT 0x100
 
@@ -84,7 +94,19 @@ std::string CFileExportSTUFormat::RemoveFoldersFromPaths(const std::string &sPat
     return sFile;
 }
 
-CFileExportSTUFormat::CFileExportSTUFormat()
+CFileExportSTUFormat::CFileExportSTUFormat() :
+    m_pMappedData(YI_NULL),
+    m_uMappedCapacity(0),
+    m_uMappedUsed(0),
+#ifdef _WIN32
+    m_hMappedFile(INVALID_HANDLE_VALUE),
+    m_hMappedSection(YI_NULL)
+#else
+    m_nMappedFile(-1),
+#endif
+    m_pStreamSink(YI_NULL),
+    m_uStreamSize(0),
+    m_bAppendFailed(false)
 {
     m_Buffer.clear();
     m_sVersion = m_ucVersion;
@@ -92,12 +114,24 @@ CFileExportSTUFormat::CFileExportSTUFormat()
 
 CFileExportSTUFormat::~CFileExportSTUFormat()
 {
-    std::vector< STU_CHUNK *>::iterator it = m_Buffer.begin();
-    for (; it != m_Buffer.end(); ++it)
+    Reset();
+}
+
+void CFileExportSTUFormat::Reset()
+{
+    // An export still in progress here was abandoned, finishing it would leave a valid looking but incomplete file.
+    if (IsMapped())
+    {
+        LOG_ERROR("Discarding unfinished mapped export '%s'.", m_sMappedPath.c_str());
+        DiscardMappedFile();
+    }
+    if (IsStreaming())
     {
-        delete (*it);
+        LOG_ERROR("Discarding unfinished streamed export.");
+        DiscardStream();
     }
     m_Buffer.clear();
+    m_bAppendFailed = false;
 }
 
 uint32_t CFileExportSTUFormat::MakeHashFromName(const std::string &sName)
@@ -117,10 +151,44 @@ uint32_t CFileExportSTUFormat::MakeHashFromName(const std::string &sName)
 #endif
 }
 
-bool CFileExportSTUFormat::AppendChunkToFile(const std::string &path, const std::string &sName, void * pData, uint32_t uLength)
+void CFileExportSTUFormat::EncodeSize(unsigned char * pTarget, uint32_t uSize)
+{
+    pTarget[0] = (unsigned char)(uSize >> 24);
+    pTarget[1] = (unsigned char)(uSize >> 16);
+    pTarget[2] = (unsigned char)(uSize >> 8);
+    pTarget[3] = (unsigned char)(uSize);
+}
+
+void CFileExportSTUFormat::FillChunkHeader(STU_HEADER &Header, const std::string &sName, uint32_t uLength)
+{
+    strncpy(Header.Name, sName.c_str(), 19);
+    Header.NameHash = MakeHashFromName(Header.Name);
+    EncodeSize(Header.ChunkSizeInfo, uLength);
+}
+
+bool CFileExportSTUFormat::AppendChunkToFile(const std::string &path, const std::string &sName, const void * pData, uint32_t uLength)
+{
+    // The chunks after a missing one are refused too, the file could not be completed anyway.
+    if (m_bAppendFailed)
+    {
+        return false;
+    }
+    if (!AppendChunk(path, sName, pData, uLength))
+    {
+        m_bAppendFailed = true;
+        if (!IsMapped() && !IsStreaming())
+        {
+            LOG_ERROR("Deleting incomplete file '%s'.", path.c_str());
+            remove(path.c_str());
+        }
+        return false;
+    }
+    return true;
+}
+
+bool CFileExportSTUFormat::AppendChunk(const std::string &path, const std::string &sName, const void * pData, uint32_t uLength)
 {
     uint32_t uSize = uLength;
-    uint32_t uRemainder = 0;
     uint32_t nRealSize = 0;
 
     bool bResult = false;
@@ -139,6 +207,25 @@ bool CFileExportSTUFormat::AppendChunkToFile(const std::string &path, const std:
         return bResult;
     }
 
+    if (IsMapped() && path == m_sMappedPath)
+    {
+        uint8_t * pTarget = MapChunk(sName, uLength);
+        if (!pTarget)
+        {
+            return bResult;
+        }
+        memcpy(pTarget, pData, uLength);
+        bResult = true;
+        return bResult;
+    }
+
+    if (IsStreaming())
+    {
+        const uint8_t * pBytes = (const uint8_t *)pData;
+        bResult = StreamChunk(sName, std::vector< uint8_t >(pBytes, pBytes + uLength));
+        return bResult;
+    }
+
     FILE * fp = fopen(path.c_str(), "rb");
     if (fp)
     {
@@ -146,18 +233,21 @@ bool CFileExportSTUFormat::AppendChunkToFile(const std::string &path, const std:
         if (fread(&FileHeader, sizeof(unsigned char), sizeof(FileHeader), fp) != sizeof(FileHeader))
         {
             LOG_ERROR("Cannot read file header.");
+            fclose(fp);
             return bResult;
         }
         //Check Magic Bytes
         if (FileHeader.Magic[0] != m_ucMagic[0] || FileHeader.Magic[1] != m_ucMagic[1] || FileHeader.Magic[2] != m_ucMagic[2])
         {
             LOG_ERROR("File magic bytes do not match.");
+            fclose(fp);
             return bResult;
         }
         m_sVersion = FileHeader.Version;
         if (FileHeader.Version[0] != gMaxVersionSupported[0] || FileHeader.Version[1] != gMaxVersionSupported[1] || FileHeader.Version[2] != gMaxVersionSupported[2])
         {
             LOG_ERROR("File version is newer than supported by this application.");
+            fclose(fp);
             return bResult;
         }
 
@@ -171,6 +261,7 @@ bool CFileExportSTUFormat::AppendChunkToFile(const std::string &path, const std:
         if (uSize != (nRealSize - sizeof(FileHeader)))
         {
             LOG_ERROR("File size info does not match.");
+            fclose(fp);
             return bResult;
         }
         fclose(fp);
@@ -181,34 +272,15 @@ bool CFileExportSTUFormat::AppendChunkToFile(const std::string &path, const std:
         uSize = 0;
     }
 
-    //Create new chunk for saving
-    STU_CHUNK * Chunk = new STU_CHUNK;
-    uint32_t uUsed;
-
-    strncpy(Chunk->Header.Name, sName.c_str(), 19);
-
-    uUsed = uLength;
-
-    Chunk->Header.ChunkSizeInfo[0] = uUsed >> 24;
-    uRemainder = uUsed - (Chunk->Header.ChunkSizeInfo[0] << 24);
-    Chunk->Header.ChunkSizeInfo[1] = (uRemainder >> 16);
-    uRemainder -= (Chunk->Header.ChunkSizeInfo[0] << 16);
-    Chunk->Header.ChunkSizeInfo[2] = (uRemainder >> 8);
-    uRemainder -= (Chunk->Header.ChunkSizeInfo[0] << 8);
-    Chunk->Header.ChunkSizeInfo[3] = uRemainder;
-    Chunk->Header.NameHash = MakeHashFromName(Chunk->Header.Name);
+    //Create new chunk header for saving
+    STU_HEADER ChunkHeader;
+    FillChunkHeader(ChunkHeader, sName, uLength);
 
     //Update the file heading info
     uSize += sizeof(STU_HEADER);
     uSize += uLength;
     
-    FileHeader.FileSizeInfo[0] = uSize >> 24;
-    uRemainder = uSize - (FileHeader.FileSizeInfo[0] << 24);
-    FileHeader.FileSizeInfo[1] = (uRemainder >> 16);
-    uRemainder -= (FileHeader.FileSizeInfo[0] << 16);
-    FileHeader.FileSizeInfo[2] = (uRemainder >> 8);
-    uRemainder -= (FileHeader.FileSizeInfo[0] << 8);
-    FileHeader.FileSizeInfo[3] = uRemainder;
+    EncodeSize(FileHeader.FileSizeInfo, uSize);
 
     fp = fopen(path.c_str(), "r+b");
     if (!fp)
@@ -225,24 +297,31 @@ bool CFileExportSTUFormat::AppendChunkToFile(const std::string &path, const std:
     if (fwrite(&FileHeader, sizeof(unsigned char), sizeof(FileHeader), fp) != sizeof(FileHeader))
     {
         LOG_ERROR("Cannot write file header.");
+        fclose(fp);
         return bResult;
     }
 
     //Add new data
     fseek(fp, nRealSize, SEEK_SET);
 
-    if (fwrite(&Chunk->Header, sizeof(unsigned char), sizeof(Chunk->Header), fp) != sizeof(Chunk->Header))
+    if (fwrite(&ChunkHeader, sizeof(unsigned char), sizeof(ChunkHeader), fp) != sizeof(ChunkHeader))
     {
         LOG_ERROR("Cannot write chunk header.");
+        fclose(fp);
         return bResult;
     }
     if (fwrite(pData, sizeof(unsigned char), uLength, fp) != uLength)
     {
         LOG_ERROR("Cannot write chunk data.");
+        fclose(fp);
         return bResult;
     }
 
-    fclose(fp);
+    if (fclose(fp) != 0)
+    {
+        LOG_ERROR("Cannot close file.");
+        return bResult;
+    }
 
     bResult = true;
     return bResult;
@@ -250,101 +329,496 @@ bool CFileExportSTUFormat::AppendChunkToFile(const std::string &path, const std:
 
 bool CFileExportSTUFormat::ExportFile(const std::string &path)
 {
-    bool bResult = false;
-    STU_FILE_HEADER FileHeader;
-
     const char * pPath = path.c_str();
     if (!pPath)
     {
         LOG_ERROR("No filename given.");
-        return bResult;
+        return false;
     }
 
+    if (m_Buffer.empty())
+    {
+        LOG_ERROR("Nothing to write!");
+        return false;
+    }
+
+    CFileOutputSink Sink;
+    if (!Sink.Open(path))
+    {
+        LOG_ERROR("Could not open file.");
+        return false;
+    }
+    return ExportFile(Sink);
+}
+
+bool CFileExportSTUFormat::ExportFile(COutputSink &Sink)
+{
+    bool bResult = false;
+    STU_FILE_HEADER FileHeader;
+
     uint32_t uSize = 0;
-    uint32_t uRemainder = 0;
-    std::vector< STU_CHUNK *>::iterator Itr = m_Buffer.begin();
-    std::vector< STU_CHUNK *>::iterator End = m_Buffer.end();
+    std::vector< STU_CHUNK >::const_iterator Itr = m_Buffer.begin();
+    std::vector< STU_CHUNK >::const_iterator End = m_Buffer.end();
     while (Itr != End)
     {
         uSize += sizeof(STU_HEADER);
-        uSize += (*Itr)->GetDataSize();
+        uSize += Itr->GetDataSize();
         Itr++;
     }
     if (uSize == 0)
     {
         LOG_ERROR("Nothing to write!");
+        Sink.Close();
         return bResult;
     }
-    FileHeader.FileSizeInfo[0] = uSize >> 24;
-    uRemainder = uSize - (FileHeader.FileSizeInfo[0] << 24);
-    FileHeader.FileSizeInfo[1] = (uRemainder >> 16);
-    uRemainder -= (FileHeader.FileSizeInfo[0] << 16);
-    FileHeader.FileSizeInfo[2] = (uRemainder >> 8);
-    uRemainder -= (FileHeader.FileSizeInfo[0] << 8);
-    FileHeader.FileSizeInfo[3] = uRemainder;
+    EncodeSize(FileHeader.FileSizeInfo, uSize);
 
-    FILE * fp = fopen(path.c_str(), "wb");
-    if (!fp)
-    {
-        LOG_ERROR("Could not open file.");
-        return bResult;
-    }
-    //Read file header
-    if (fwrite(&FileHeader, sizeof(unsigned char), sizeof(FileHeader), fp) != sizeof(FileHeader))
+    // The size is known up front, so even sinks that cannot seek get a regular header.
+    if (!Sink.Write(&FileHeader, sizeof(FileHeader)))
     {
         LOG_ERROR("Cannot write file header.");
+        Sink.Close();
         return bResult;
     }
 
     Itr = m_Buffer.begin();
     while (Itr != End)
     {
-        if (fwrite(&(*Itr)->Header, sizeof(unsigned char), sizeof((*Itr)->Header), fp) != sizeof((*Itr)->Header))
+        if (!Sink.Write(&Itr->Header, sizeof(Itr->Header)))
         {
             LOG_ERROR("Cannot write chunk header.");
+            Sink.Close();
             return bResult;
         }
-        if (fwrite((void*)((*Itr)->GetData()), sizeof(unsigned char), (*Itr)->GetDataSize(), fp) != (*Itr)->GetDataSize())
+        if (!Sink.Write(Itr->GetData(), Itr->GetDataSize()))
         {
             LOG_ERROR("Cannot write chunk data.");
+            Sink.Close();
             return bResult;
         }
         Itr++;
     }
 
-    fclose(fp);
+    bResult = Sink.Close();
+    return bResult;
+}
+
+bool CFileExportSTUFormat::WriteChunk(const std::string &sName, const void * pData, uint32_t uLength)
+{
+    if (m_bAppendFailed)
+    {
+        return false;
+    }
+    if (IsMapped())
+    {
+        uint8_t * pTarget = MapChunk(sName, uLength);
+        if (!pTarget)
+        {
+            return false;
+        }
+        memcpy(pTarget, pData, uLength);
+        return true;
+    }
+
+    const uint8_t * pBytes = (const uint8_t *)pData;
+    return WriteChunk(sName, std::vector< uint8_t >(pBytes, pBytes + uLength));
+}
+
+bool CFileExportSTUFormat::WriteChunk(const std::string &sName, std::vector< uint8_t > &&Data)
+{
+    bool bResult = false;
+
+    if (m_bAppendFailed)
+    {
+        return bResult;
+    }
+    if (IsMapped())
+    {
+        return WriteChunk(sName, Data.empty() ? YI_NULL : &Data[0], (uint32_t)Data.size());
+    }
+    if (IsStreaming())
+    {
+        return StreamChunk(sName, std::move(Data));
+    }
+
+    STU_HEADER ChunkHeader;
+    FillChunkHeader(ChunkHeader, sName, (uint32_t)Data.size());
+
+    m_Buffer.push_back(STU_CHUNK(ChunkHeader, std::move(Data)));
 
     bResult = true;
+
     return bResult;
 }
 
-bool CFileExportSTUFormat::WriteChunk(const std::string &sName, void * pData, uint32_t uLength)
+bool CFileExportSTUFormat::BeginMappedFile(const std::string &path, uint64_t uReserveSize)
 {
-    bool bResult = false;
+    if (IsMapped())
+    {
+        LOG_ERROR("A mapped export is already in progress.");
+        return false;
+    }
+
+    uReserveSize = std::max(uReserveSize, GetFileHeaderFootprint());
+
+#ifdef _WIN32
+    m_hMappedFile = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, YI_NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, YI_NULL);
+    if (m_hMappedFile == INVALID_HANDLE_VALUE)
+    {
+        LOG_ERROR("Could not open file.");
+        return false;
+    }
+#else
+    m_nMappedFile = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (m_nMappedFile < 0)
+    {
+        LOG_ERROR("Could not open file.");
+        return false;
+    }
+#endif
+
+    m_sMappedPath = path;
+    m_uMappedUsed = GetFileHeaderFootprint();
+    if (!MapFileView(uReserveSize))
+    {
+        LOG_ERROR("Could not map %llu bytes for '%s'.", (unsigned long long)uReserveSize, path.c_str());
+        DiscardMappedFile();
+        return false;
+    }
+    return true;
+}
+
+bool CFileExportSTUFormat::MapFileView(uint64_t uSize)
+{
+#ifdef _WIN32
+    m_hMappedSection = CreateFileMappingA(m_hMappedFile, YI_NULL, PAGE_READWRITE, (DWORD)(uSize >> 32), (DWORD)(uSize & 0xFFFFFFFF), YI_NULL);
+    if (!m_hMappedSection)
+    {
+        return false;
+    }
+    m_pMappedData = (uint8_t *)MapViewOfFile(m_hMappedSection, FILE_MAP_ALL_ACCESS, 0, 0, (SIZE_T)uSize);
+    if (!m_pMappedData)
+    {
+        CloseHandle(m_hMappedSection);
+        m_hMappedSection = YI_NULL;
+        return false;
+    }
+#else
+    // Reserve the blocks up front so the kernels never fault on a sparse file that cannot be backed.
+#if defined(__linux__)
+    if (posix_fallocate(m_nMappedFile, 0, (off_t)uSize) != 0)
+#endif
+    {
+        if (ftruncate(m_nMappedFile, (off_t)uSize) != 0)
+        {
+            return false;
+        }
+    }
+    void * pView = mmap(YI_NULL, (size_t)uSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_nMappedFile, 0);
+    if (pView == MAP_FAILED)
+    {
+        return false;
+    }
+    m_pMappedData = (uint8_t *)pView;
+#endif
+    m_uMappedCapacity = uSize;
+    return true;
+}
 
-    STU_CHUNK * Chunk = new STU_CHUNK;
-    uint32_t uUsed;
+void CFileExportSTUFormat::UnmapFileView()
+{
+    if (!m_pMappedData)
+    {
+        return;
+    }
+#ifdef _WIN32
+    FlushViewOfFile(m_pMappedData, 0);
+    UnmapViewOfFile(m_pMappedData);
+    CloseHandle(m_hMappedSection);
+    m_hMappedSection = YI_NULL;
+#else
+    munmap(m_pMappedData, (size_t)m_uMappedCapacity);
+#endif
+    m_pMappedData = YI_NULL;
+    m_uMappedCapacity = 0;
+}
 
-    uint32_t uRemainder;
-    strncpy(Chunk->Header.Name, sName.c_str(), 19);
-    Chunk->Header.NameHash = MakeHashFromName(Chunk->Header.Name);
+void CFileExportSTUFormat::DiscardMappedFile()
+{
+    UnmapFileView();
+#ifdef _WIN32
+    if (m_hMappedFile != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_hMappedFile);
+        m_hMappedFile = INVALID_HANDLE_VALUE;
+    }
+    if (!m_sMappedPath.empty())
+    {
+        DeleteFileA(m_sMappedPath.c_str());
+    }
+#else
+    if (m_nMappedFile >= 0)
+    {
+        close(m_nMappedFile);
+        m_nMappedFile = -1;
+    }
+    if (!m_sMappedPath.empty())
+    {
+        unlink(m_sMappedPath.c_str());
+    }
+#endif
+    m_sMappedPath.clear();
+    m_uMappedUsed = 0;
+}
 
-    uUsed = uLength;
+bool CFileExportSTUFormat::EnsureMappedCapacity(uint64_t uRequired)
+{
+    if (uRequired <= m_uMappedCapacity)
+    {
+        return true;
+    }
 
-    Chunk->Header.ChunkSizeInfo[0] = uUsed >> 24;
-    uRemainder = uUsed - (Chunk->Header.ChunkSizeInfo[0] << 24);
-    Chunk->Header.ChunkSizeInfo[1] = (uRemainder >> 16);
-    uRemainder -= (Chunk->Header.ChunkSizeInfo[0] << 16);
-    Chunk->Header.ChunkSizeInfo[2] = (uRemainder >> 8);
-    uRemainder -= (Chunk->Header.ChunkSizeInfo[0] << 8);
-    Chunk->Header.ChunkSizeInfo[3] = uRemainder;
+    // The sizing pass underestimated, grow geometrically so repeated misses stay cheap.
+    uint64_t uNewCapacity = std::max(uRequired, m_uMappedCapacity + m_uMappedCapacity / 2);
+    LOG_INFO("Growing mapped output from %llu to %llu bytes.\n", (unsigned long long)m_uMappedCapacity, (unsigned long long)uNewCapacity);
+    UnmapFileView();
+    if (!MapFileView(uNewCapacity))
+    {
+        // The chunks written so far are gone with the view, nothing of the file can be kept.
+        DiscardMappedFile();
+        return false;
+    }
+    return true;
+}
 
-    Chunk->AllocateForData(uLength);
-    Chunk->SetData((uint8_t *)pData, uLength);
+uint8_t * CFileExportSTUFormat::MapChunk(const std::string &sName, uint32_t uLength)
+{
+    if (!IsMapped())
+    {
+        LOG_ERROR("No mapped export in progress.");
+        return YI_NULL;
+    }
+
+    uint64_t uOffset = m_uMappedUsed;
+    if (!EnsureMappedCapacity(uOffset + GetChunkFootprint(uLength)))
+    {
+        // Sticky, so the next chunk for this path does not fall back to a plain append into a fresh, truncated file.
+        LOG_ERROR("Could not grow the mapped file, the export was discarded.");
+        m_bAppendFailed = true;
+        return YI_NULL;
+    }
 
-    m_Buffer.insert(m_Buffer.end(), Chunk);
+    STU_HEADER Header;
+    FillChunkHeader(Header, sName, uLength);
+    memcpy(m_pMappedData + uOffset, &Header, sizeof(Header));
 
-    bResult = true;
+    m_uMappedUsed = uOffset + GetChunkFootprint(uLength);
+    return m_pMappedData + uOffset + sizeof(Header);
+}
+
+uint8_t * CFileExportSTUFormat::GetChunkTarget(const std::string &sName, uint32_t uLength, std::vector< uint8_t > &Staging)
+{
+    if (IsMapped())
+    {
+        return MapChunk(sName, uLength);
+    }
+
+    Staging.resize(uLength);
+    if (uLength == 0 || Staging.size() != uLength)
+    {
+        return YI_NULL;
+    }
+    return &Staging[0];
+}
+
+bool CFileExportSTUFormat::EndMappedFile()
+{
+    if (!IsMapped())
+    {
+        return false;
+    }
+
+    // The file header stores the size in 32 bits, a larger file could not be read back.
+    uint64_t uDataSize = m_uMappedUsed - GetFileHeaderFootprint();
+    if (uDataSize >= uStreamedSize)
+    {
+        LOG_ERROR("Mapped file '%s' exceeds the 4GB limit of the file header, the export was discarded.", m_sMappedPath.c_str());
+        DiscardMappedFile();
+        return false;
+    }
+
+    bool bResult = true;
+    STU_FILE_HEADER FileHeader;
+    EncodeSize(FileHeader.FileSizeInfo, (uint32_t)uDataSize);
+    memcpy(m_pMappedData, &FileHeader, sizeof(FileHeader));
 
+    UnmapFileView();
+
+#ifdef _WIN32
+    LARGE_INTEGER liSize;
+    liSize.QuadPart = (LONGLONG)m_uMappedUsed;
+    if (!SetFilePointerEx(m_hMappedFile, liSize, YI_NULL, FILE_BEGIN) || !SetEndOfFile(m_hMappedFile))
+    {
+        LOG_ERROR("Could not trim mapped file '%s'.", m_sMappedPath.c_str());
+        bResult = false;
+    }
+    CloseHandle(m_hMappedFile);
+    m_hMappedFile = INVALID_HANDLE_VALUE;
+#else
+    if (ftruncate(m_nMappedFile, (off_t)m_uMappedUsed) != 0)
+    {
+        LOG_ERROR("Could not trim mapped file '%s'.", m_sMappedPath.c_str());
+        bResult = false;
+    }
+    close(m_nMappedFile);
+    m_nMappedFile = -1;
+#endif
+
+    m_sMappedPath.clear();
+    m_uMappedUsed = 0;
     return bResult;
 }
+
+bool CFileExportSTUFormat::BeginStream(const std::string &path, bool bAsync, uint64_t uMaxQueuedBytes)
+{
+    if (IsStreaming() || IsMapped())
+    {
+        LOG_ERROR("An export is already in progress.");
+        return false;
+    }
+    if (!m_StreamFile.Open(path))
+    {
+        return false;
+    }
+    if (!BeginStream(&m_StreamFile, bAsync, uMaxQueuedBytes))
+    {
+        m_StreamFile.Close();
+        return false;
+    }
+    return true;
+}
+
+bool CFileExportSTUFormat::BeginStream(COutputSink * pSink, bool bAsync, uint64_t uMaxQueuedBytes)
+{
+    if (IsStreaming() || IsMapped())
+    {
+        LOG_ERROR("An export is already in progress.");
+        return false;
+    }
+    if (!pSink)
+    {
+        LOG_ERROR("No output sink given.");
+        return false;
+    }
+
+    // Seekable sinks get the real size once the stream ends.
+    STU_FILE_HEADER FileHeader;
+    EncodeSize(FileHeader.FileSizeInfo, pSink->CanSeek() ? 0 : uStreamedSize);
+    if (!pSink->Write(&FileHeader, sizeof(FileHeader)))
+    {
+        LOG_ERROR("Cannot write file header.");
+        return false;
+    }
+    if (bAsync && !m_StreamWriter.Open(pSink, uMaxQueuedBytes))
+    {
+        return false;
+    }
+
+    m_pStreamSink = pSink;
+    m_uStreamSize = 0;
+    return true;
+}
+
+bool CFileExportSTUFormat::StreamChunk(const std::string &sName, std::vector< uint8_t > &&Data)
+{
+    if (Data.empty())
+    {
+        LOG_ERROR("Nothing to write!");
+        return false;
+    }
+
+    STU_HEADER ChunkHeader;
+    FillChunkHeader(ChunkHeader, sName, (uint32_t)Data.size());
+    m_uStreamSize += GetChunkFootprint((uint32_t)Data.size());
+
+    if (m_StreamWriter.IsOpen())
+    {
+        const uint8_t * pHeader = (const uint8_t *)&ChunkHeader;
+        return m_StreamWriter.Push(std::vector< uint8_t >(pHeader, pHeader + sizeof(ChunkHeader))) && m_StreamWriter.Push(std::move(Data));
+    }
+    return m_pStreamSink->Write(&ChunkHeader, sizeof(ChunkHeader)) && m_pStreamSink->Write(&Data[0], Data.size());
+}
+
+bool CFileExportSTUFormat::EndStream()
+{
+    if (!IsStreaming())
+    {
+        return false;
+    }
+
+    bool bResult = true;
+    if (m_StreamWriter.IsOpen())
+    {
+        bResult = m_StreamWriter.Close();
+    }
+    if (m_uStreamSize >= uStreamedSize)
+    {
+        LOG_ERROR("Streamed file exceeds the 4GB limit of the file header.");
+        bResult = false;
+    }
+
+    if (m_pStreamSink->CanSeek())
+    {
+        STU_FILE_HEADER FileHeader;
+        EncodeSize(FileHeader.FileSizeInfo, (uint32_t)m_uStreamSize);
+        if (!m_pStreamSink->WriteAt(0, &FileHeader, sizeof(FileHeader)))
+        {
+            LOG_ERROR("Cannot write file header.");
+            bResult = false;
+        }
+    }
+    else
+    {
+        unsigned char Trailer[4];
+        EncodeSize(Trailer, (uint32_t)m_uStreamSize);
+        STU_HEADER ChunkHeader;
+        FillChunkHeader(ChunkHeader, "StreamEnd", sizeof(Trailer));
+        if (!m_pStreamSink->Write(&ChunkHeader, sizeof(ChunkHeader)) || !m_pStreamSink->Write(Trailer, sizeof(Trailer)))
+        {
+            LOG_ERROR("Cannot write stream trailer.");
+            bResult = false;
+        }
+    }
+
+    if (!m_pStreamSink->Close())
+    {
+        bResult = false;
+    }
+
+    // As in DiscardStream, only a file opened here is taken back.
+    if (!bResult && m_pStreamSink == &m_StreamFile)
+    {
+        LOG_ERROR("Deleting incomplete file '%s'.", m_StreamFile.GetPath().c_str());
+        remove(m_StreamFile.GetPath().c_str());
+    }
+    m_pStreamSink = YI_NULL;
+    m_uStreamSize = 0;
+    return bResult;
+}
+
+void CFileExportSTUFormat::DiscardStream()
+{
+    if (m_StreamWriter.IsOpen())
+    {
+        m_StreamWriter.Close();
+    }
+    m_pStreamSink->Close();
+
+    // Only a file opened here can be taken back, a sink given by the caller just stops receiving data.
+    if (m_pStreamSink == &m_StreamFile)
+    {
+        remove(m_StreamFile.GetPath().c_str());
+    }
+    m_pStreamSink = YI_NULL;
+    m_uStreamSize = 0;
+}
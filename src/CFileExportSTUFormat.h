@@ -7,6 +7,10 @@
 #define YI_NULL nullptr
 #include <cstdint>
 #include <vector>
+#include <utility>
+
+#include "COutputSink.h"
+#include "CAsyncSinkWriter.h"
 
 class CFileExportSTUFormat
 {
@@ -17,6 +21,9 @@ public:
 
     static const uint32_t uMaxTextLength = 255;
 
+    /* Default amount of finished chunk data allowed to wait for the writer thread of an async stream */
+    static const uint64_t uDefaultAsyncQueueBytes = 64 * 1024 * 1024;
+
     enum STU_IMPORT_EXPORT_FLAGS
     {
         STU_IMPORT_EXPORT_FLAGS_NONE = 0,
@@ -40,6 +47,10 @@ public:
             Leader[1] = '$';
         }
     };
+    /* A file streamed into a sink that cannot seek has uStreamedSize in FileSizeInfo and ends with a "StreamEnd"
+       chunk whose 4 byte payload is the size of the data before it, encoded like FileSizeInfo. */
+    static const uint32_t uStreamedSize = 0xFFFFFFFF;
+
     struct STU_FILE_HEADER
     {
         unsigned char Magic[3];
@@ -63,65 +74,118 @@ public:
         STU_HEADER Header;
         STU_CHUNK()
         {
-            m_Data.clear();
         }
-        ~STU_CHUNK()
+        /* Take ownership of the chunk payload without copying it */
+        STU_CHUNK(const STU_HEADER &ChunkHeader, std::vector<uint8_t> &&Data) :
+            Header(ChunkHeader),
+            m_Data(std::move(Data))
+        {
+        }
+        STU_CHUNK(STU_CHUNK &&Other) :
+            Header(Other.Header),
+            m_Data(std::move(Other.m_Data))
         {
-            std::vector< uint8_t >().swap(m_Data);
-            m_uAllocation = 0;
         }
-        bool AllocateForData(uint32_t nSize)
+        STU_CHUNK &operator=(STU_CHUNK &&Other)
         {
-            m_Data.resize(nSize);
-            if (m_Data.size() == nSize)
-            {
-                m_uAllocation = nSize;
-                return true;
-            }
-            else
-            {
-                m_uAllocation = 0;
-                return false;
-            }
+            Header = Other.Header;
+            m_Data = std::move(Other.m_Data);
+            return *this;
         }
-        void SetData(uint8_t * pData, uint32_t uLen)
+        const std::vector<uint8_t> &GetDataVector() const
         {
-            m_Data.resize(uLen);
-            m_uAllocation = uLen;
-            m_Data.assign(pData, pData + uLen);
-            }
-        std::vector<uint8_t> GetDataVector() const
-            {
             return m_Data;
         }
-        uint8_t * GetData() const
+        const uint8_t * GetData() const
         {
-            return (uint8_t *)&m_Data[0];
+            return m_Data.empty() ? YI_NULL : &m_Data[0];
         }
         uint32_t GetDataSize() const
         {
-            return m_uAllocation;
+            return (uint32_t)m_Data.size();
         }
 
     protected:
         std::vector<uint8_t> m_Data;
-        uint32_t m_uAllocation;
+
+    private:
+        STU_CHUNK(const STU_CHUNK &);
+        STU_CHUNK &operator=(const STU_CHUNK &);
     };
 
     static unsigned char m_ucMagic[];
     static unsigned char m_ucVersion[];
 
+    /* Discard any mapped or streamed export still in progress, deleting its partial file, and drop the stored chunks, so the
+       next file starts empty. An export is only kept once EndMappedFile or EndStream succeeded. */
+    void Reset();
+
     /* Save stored file data  */
     bool ExportFile(const std::string &path);
 
+    /* Save stored file data into Sink, which is closed afterwards */
+    bool ExportFile(COutputSink &Sink);
+
     /* Check is the files exists */
     bool CheckFileExists(const std::string &path);
 
-    /* store new chunk data */
-    bool WriteChunk(const std::string &sName, void * pData, uint32_t uLength);
+    /* store new chunk data (copies the data) */
+    bool WriteChunk(const std::string &sName, const void * pData, uint32_t uLength);
+
+    /* store new chunk data, taking ownership of the buffer */
+    bool WriteChunk(const std::string &sName, std::vector< uint8_t > &&Data);
 
     /* append chunk data to an existing file. This cna be used for very large models to break apart the process for memory optimization, or to add new features to save files. */
-    bool AppendChunkToFile(const std::string &path, const std::string &sName, void * pData, uint32_t uLength);
+    bool AppendChunkToFile(const std::string &path, const std::string &sName, const void * pData, uint32_t uLength);
+
+    /* True once an AppendChunkToFile call failed, or the mapped file could not grow and was discarded, since the last Reset.
+       Later AppendChunkToFile and WriteChunk calls fail as well, and a file appended to directly (neither mapped nor
+       streamed) has been deleted. */
+    bool HasAppendFailed() const { return m_bAppendFailed; }
+
+    /* Start a memory-mapped export. The file is preallocated to uReserveSize bytes (the result of a sizing pass) and mapped, and
+       chunks are then placed directly at their final location. While the mapping is active, WriteChunk and AppendChunkToFile for
+       this path are routed into it as well. */
+    bool BeginMappedFile(const std::string &path, uint64_t uReserveSize);
+
+    /* Reserve space for a chunk in the mapped file and return where the uLength bytes of chunk data must be written.
+       The pointer is only valid until the next chunk is placed in the mapping (MapChunk, GetChunkTarget, WriteChunk or
+       AppendChunkToFile): if the sizing pass underestimated, that call grows the file and maps it at a new address.
+       Returns YI_NULL on failure, in which case the mapped export has been discarded. */
+    uint8_t * MapChunk(const std::string &sName, uint32_t uLength);
+
+    /* Get the destination for uLength bytes of chunk data: straight into the mapped file when a mapped export is active,
+       otherwise into Staging, which the caller then stores with AppendChunkToFile or WriteChunk. Returns YI_NULL on failure. */
+    uint8_t * GetChunkTarget(const std::string &sName, uint32_t uLength, std::vector< uint8_t > &Staging);
+
+    /* Write the file header, trim the file to the data actually written and release the mapping. A file too large for the
+       32 bit size of the header is discarded and false returned. */
+    bool EndMappedFile();
+
+    /* True while a mapped export is in progress */
+    bool IsMapped() const { return m_pMappedData != YI_NULL; }
+
+    /* Start a streamed export into pSink (not owned). Every chunk is written as soon as it is stored, or with bAsync handed to
+       a background thread that writes chunks in order while the caller encodes the next ones; once more than uMaxQueuedBytes
+       are pending the caller waits. While the stream is active, WriteChunk and AppendChunkToFile are routed into it whatever
+       path they name. Sinks that cannot seek get a streamed file (see uStreamedSize). */
+    bool BeginStream(COutputSink * pSink, bool bAsync = false, uint64_t uMaxQueuedBytes = uDefaultAsyncQueueBytes);
+
+    /* Same, into a new file at path */
+    bool BeginStream(const std::string &path, bool bAsync = false, uint64_t uMaxQueuedBytes = uDefaultAsyncQueueBytes);
+
+    /* Wait for the pending chunks, complete the file header (or write the trailer) and close the sink. On failure a file
+       opened by BeginStream(path) is deleted. */
+    bool EndStream();
+
+    /* True while a streamed export is in progress */
+    bool IsStreaming() const { return m_pStreamSink != YI_NULL; }
+
+    /* Number of bytes a chunk of uLength bytes occupies in the file */
+    static uint64_t GetChunkFootprint(uint32_t uLength) { return sizeof(STU_HEADER) + (uint64_t)uLength; }
+
+    /* Number of bytes the file header occupies in the file */
+    static uint64_t GetFileHeaderFootprint() { return sizeof(STU_FILE_HEADER); }
 
     /* Copy a string into our output array, respecting the maximum size */
     static uint32_t CopyString(const char * pString, std::vector< uint8_t > * Target);
@@ -137,8 +201,52 @@ public:
 
 private:
 
-    std::vector< STU_CHUNK *> m_Buffer;
+    /* Store a size as 4 big endian bytes, as used by the chunk and file headers */
+    static void EncodeSize(unsigned char * pTarget, uint32_t uSize);
+
+    /* Fill a chunk header for the given name and data length */
+    static void FillChunkHeader(STU_HEADER &Header, const std::string &sName, uint32_t uLength);
+
+    /* Append one chunk, see AppendChunkToFile */
+    bool AppendChunk(const std::string &path, const std::string &sName, const void * pData, uint32_t uLength);
+
+    /* Write a chunk into the active stream */
+    bool StreamChunk(const std::string &sName, std::vector< uint8_t > &&Data);
+
+    /* Make sure the mapping can hold uRequired bytes, growing the file if needed */
+    bool EnsureMappedCapacity(uint64_t uRequired);
+    bool MapFileView(uint64_t uSize);
+    void UnmapFileView();
+
+    /* Release the mapping and the file handle of the mapped export and delete its file */
+    void DiscardMappedFile();
+
+    /* Stop the streamed export without completing it, deleting the file if it was opened by BeginStream(path) */
+    void DiscardStream();
+
+    CFileExportSTUFormat(const CFileExportSTUFormat &);
+    CFileExportSTUFormat &operator=(const CFileExportSTUFormat &);
+
+    std::vector< STU_CHUNK > m_Buffer;
     unsigned char * m_sVersion;
+
+    std::string m_sMappedPath;
+    uint8_t * m_pMappedData;
+    uint64_t m_uMappedCapacity;
+    uint64_t m_uMappedUsed;
+#ifdef _WIN32
+    void * m_hMappedFile;
+    void * m_hMappedSection;
+#else
+    int m_nMappedFile;
+#endif
+
+    COutputSink * m_pStreamSink;
+    CFileOutputSink m_StreamFile;
+    CAsyncSinkWriter m_StreamWriter;
+    uint64_t m_uStreamSize;
+
+    bool m_bAppendFailed;
 };
 
 #endif
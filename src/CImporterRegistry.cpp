@@ -0,0 +1,204 @@
+#include "CImporterRegistry.h"
+#include "CFileExportSTUFormat.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+
+// Enough for every signature below, including the COLLADA root element after an XML declaration.
+static const size_t uSignatureBytes = 256;
+
+struct ImporterEntry
+{
+    ImporterType Type;
+    const char * pName;
+    uint32_t uFormats;          // 1 << ModelFormat
+    uint32_t uCapabilities;
+};
+
+// Fastest first. The OBJ importer only parses what the exporter needs; the FBX SDK is the reference reader for
+// FBX. Assimp reads every format, from files or memory, and is the fallback. The out-of-core converter is last,
+// it goes through temp files and is only picked when bounded memory is required.
+static const ImporterEntry gImporters[] =
+{
+    { ImporterType_OBJ, "OBJ", 1u << ModelFormat_OBJ, ImporterCapability_None },
+    { ImporterType_FBXSDK, "FBX SDK", 1u << ModelFormat_FBX,
+        ImporterCapability_Skinning | ImporterCapability_Animations | ImporterCapability_MorphTargets },
+    { ImporterType_Assimp, "Assimp", ~0u,
+        ImporterCapability_MemorySource | ImporterCapability_Skinning | ImporterCapability_Animations |
+        ImporterCapability_MorphTargets | ImporterCapability_PostProcessing },
+    { ImporterType_OutOfCore, "Out-of-core", (1u << ModelFormat_OBJ) | (1u << ModelFormat_PLY) | (1u << ModelFormat_STL),
+        ImporterCapability_BoundedMemory },
+};
+static const uint32_t uNumImporters = sizeof(gImporters) / sizeof(gImporters[0]);
+
+struct FormatExtension
+{
+    ModelFormat Format;
+    const char * pExtension;
+};
+
+static const FormatExtension gExtensions[] =
+{
+    { ModelFormat_FBX, ".fbx" },
+    { ModelFormat_OBJ, ".obj" },
+    { ModelFormat_PLY, ".ply" },
+    { ModelFormat_STL, ".stl" },
+    { ModelFormat_GLTF, ".gltf" },
+    { ModelFormat_GLB, ".glb" },
+    { ModelFormat_Collada, ".dae" },
+    { ModelFormat_X, ".x" },
+    { ModelFormat_3DS, ".3ds" },
+    { ModelFormat_Blend, ".blend" },
+};
+static const uint32_t uNumExtensions = sizeof(gExtensions) / sizeof(gExtensions[0]);
+
+static const char * gFormatNames[ModelFormat_Count] =
+{
+    "unknown", "FBX", "OBJ", "PLY", "STL", "glTF", "GLB", "COLLADA", "DirectX X", "3DS", "Blender",
+};
+
+static bool StartsWith(const uint8_t * pData, size_t uSize, const char * pPrefix)
+{
+    size_t uLength = strlen(pPrefix);
+    return uSize >= uLength && memcmp(pData, pPrefix, uLength) == 0;
+}
+
+static bool Contains(const uint8_t * pData, size_t uSize, const char * pText)
+{
+    size_t uLength = strlen(pText);
+    for (size_t i = 0; i + uLength <= uSize; ++i)
+    {
+        if (memcmp(pData + i, pText, uLength) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint16_t ReadUInt16LE(const uint8_t * pData)
+{
+    return (uint16_t)(pData[0] | (pData[1] << 8));
+}
+
+ModelFormat CImporterRegistry::DetectFormatFromSignature(const uint8_t * pData, size_t uSize)
+{
+    if (StartsWith(pData, uSize, "Kaydara FBX Binary"))
+    {
+        return ModelFormat_FBX;
+    }
+    if (StartsWith(pData, uSize, "glTF"))
+    {
+        return ModelFormat_GLB;
+    }
+    if (StartsWith(pData, uSize, "BLENDER"))
+    {
+        return ModelFormat_Blend;
+    }
+    if (StartsWith(pData, uSize, "xof "))
+    {
+        return ModelFormat_X;
+    }
+    if (StartsWith(pData, uSize, "ply\n") || StartsWith(pData, uSize, "ply\r"))
+    {
+        return ModelFormat_PLY;
+    }
+
+    // 3DS starts with the main chunk (0x4D4D) followed by the version or editor chunk.
+    if (uSize >= 8 && ReadUInt16LE(pData) == 0x4D4D && (ReadUInt16LE(pData + 6) == 0x0002 || ReadUInt16LE(pData + 6) == 0x3D3D))
+    {
+        return ModelFormat_3DS;
+    }
+
+    // Text formats may start with a UTF-8 byte order mark and blank lines.
+    size_t uStart = StartsWith(pData, uSize, "\xEF\xBB\xBF") ? 3 : 0;
+    while (uStart < uSize && (pData[uStart] == ' ' || pData[uStart] == '\t' || pData[uStart] == '\r' || pData[uStart] == '\n'))
+    {
+        uStart++;
+    }
+    if (StartsWith(pData + uStart, uSize - uStart, "; FBX"))
+    {
+        return ModelFormat_FBX;
+    }
+    if (StartsWith(pData + uStart, uSize - uStart, "<?xml") && Contains(pData + uStart, uSize - uStart, "<COLLADA"))
+    {
+        return ModelFormat_Collada;
+    }
+    return ModelFormat_Unknown;
+}
+
+ModelFormat CImporterRegistry::DetectFormatFromExtension(const std::string &sName)
+{
+    for (uint32_t i = 0; i < uNumExtensions; ++i)
+    {
+        if (CFileExportSTUFormat::EndsWithIgnoreCase(sName, gExtensions[i].pExtension))
+        {
+            return gExtensions[i].Format;
+        }
+    }
+    return ModelFormat_Unknown;
+}
+
+ModelFormat CImporterRegistry::DetectFormat(const std::string &path)
+{
+    uint8_t Signature[uSignatureBytes];
+    size_t uSize = 0;
+    std::ifstream File(path.c_str(), std::ios::binary);
+    if (File)
+    {
+        File.read((char *)Signature, sizeof(Signature));
+        uSize = (size_t)File.gcount();
+    }
+
+    ModelFormat Format = DetectFormatFromSignature(Signature, uSize);
+    return Format != ModelFormat_Unknown ? Format : DetectFormatFromExtension(path);
+}
+
+ModelFormat CImporterRegistry::DetectFormat(const void * pData, size_t uSize, const std::string &sName)
+{
+    ModelFormat Format = pData ? DetectFormatFromSignature((const uint8_t *)pData, std::min(uSize, uSignatureBytes)) : ModelFormat_Unknown;
+    return Format != ModelFormat_Unknown ? Format : DetectFormatFromExtension(sName);
+}
+
+ImporterType CImporterRegistry::SelectImporter(ModelFormat Format, uint32_t uRequiredCapabilities)
+{
+    for (uint32_t i = 0; i < uNumImporters; ++i)
+    {
+        if ((gImporters[i].uFormats & (1u << Format)) && (gImporters[i].uCapabilities & uRequiredCapabilities) == uRequiredCapabilities)
+        {
+            return gImporters[i].Type;
+        }
+    }
+    return ImporterType_Assimp;
+}
+
+uint32_t CImporterRegistry::GetCapabilities(ImporterType Importer)
+{
+    for (uint32_t i = 0; i < uNumImporters; ++i)
+    {
+        if (gImporters[i].Type == Importer)
+        {
+            return gImporters[i].uCapabilities;
+        }
+    }
+    return ImporterCapability_None;
+}
+
+const char * CImporterRegistry::GetImporterName(ImporterType Importer)
+{
+    for (uint32_t i = 0; i < uNumImporters; ++i)
+    {
+        if (gImporters[i].Type == Importer)
+        {
+            return gImporters[i].pName;
+        }
+    }
+    return "unknown";
+}
+
+const char * CImporterRegistry::GetFormatName(ModelFormat Format)
+{
+    return Format < ModelFormat_Count ? gFormatNames[Format] : gFormatNames[ModelFormat_Unknown];
+}
@@ -0,0 +1,74 @@
+#ifndef IMPORTER_REGISTRY_H_
+#define IMPORTER_REGISTRY_H_
+
+#include <cstdint>
+#include <string>
+
+/* Model formats the registry tells apart. Everything else is ModelFormat_Unknown and goes to Assimp. */
+enum ModelFormat
+{
+    ModelFormat_Unknown,
+    ModelFormat_FBX,
+    ModelFormat_OBJ,
+    ModelFormat_PLY,
+    ModelFormat_STL,
+    ModelFormat_GLTF,
+    ModelFormat_GLB,
+    ModelFormat_Collada,
+    ModelFormat_X,
+    ModelFormat_3DS,
+    ModelFormat_Blend,
+    ModelFormat_Count,
+};
+
+enum ImporterType
+{
+    ImporterType_FBXSDK,
+    ImporterType_OBJ,
+    ImporterType_Assimp,
+    ImporterType_OutOfCore,
+};
+
+/* What an importer can do beyond reading its formats, used to skip importers a conversion cannot use */
+enum ImporterCapability
+{
+    ImporterCapability_None = 0x0,
+    ImporterCapability_MemorySource = 0x1,      // reads models from memory, not only from files
+    ImporterCapability_Skinning = 0x2,
+    ImporterCapability_Animations = 0x4,
+    ImporterCapability_MorphTargets = 0x8,
+    ImporterCapability_PostProcessing = 0x10,   // Assimp post-processing profiles and step overrides
+    ImporterCapability_BoundedMemory = 0x20,    // memory use does not grow with the size of the model
+};
+
+/*
+   Picks the importer for a model. The format comes from the file signature where it has one (binary and ASCII
+   FBX, PLY, binary glTF, COLLADA, DirectX X, 3DS, Blender), otherwise from the extension, so "a.fbx.backup.obj"
+   is an OBJ unless its content says otherwise. Importers are tried fastest first and the first one that reads
+   the format and has every required capability is used; Assimp reads everything and is the fallback.
+*/
+class CImporterRegistry
+{
+public:
+
+    /* Format of the file at path, from its first bytes and then its extension */
+    static ModelFormat DetectFormat(const std::string &path);
+
+    /* Format of uSize bytes at pData, sName gives the extension fallback */
+    static ModelFormat DetectFormat(const void * pData, size_t uSize, const std::string &sName);
+
+    /* Fastest importer reading Format with all of uRequiredCapabilities (ImporterCapability flags) */
+    static ImporterType SelectImporter(ModelFormat Format, uint32_t uRequiredCapabilities);
+
+    /* Capabilities of an importer, as ImporterCapability flags */
+    static uint32_t GetCapabilities(ImporterType Importer);
+
+    static const char * GetImporterName(ImporterType Importer);
+    static const char * GetFormatName(ModelFormat Format);
+
+private:
+    static ModelFormat DetectFormatFromSignature(const uint8_t * pData, size_t uSize);
+    static ModelFormat DetectFormatFromExtension(const std::string &sName);
+};
+
+#endif // IMPORTER_REGISTRY_H_
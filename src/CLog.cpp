@@ -0,0 +1,294 @@
+#include "CLog.h"
+
+#include <cstdarg>
+#include <cstring>
+#include <cstdint>
+#include <chrono>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+
+// VS2013 has no thread_local, __declspec(thread) does the same for the plain pointers kept here.
+#if defined(_MSC_VER) && _MSC_VER < 1900
+#define STU_THREAD_LOCAL __declspec(thread)
+#else
+#define STU_THREAD_LOCAL thread_local
+#endif
+
+struct LogBuffer
+{
+    std::mutex Mutex;
+    char Data[CLog::uBufferSize];
+    size_t uUsed;
+    uint32_t uThread;           // thread number in JSON lines
+    uint32_t uGeneration;       // changes whenever the buffer changes hands
+    bool bClaimed;
+    bool bActive;               // written to since the last Flush()
+
+    LogBuffer() :
+        uUsed(0),
+        uThread(0),
+        uGeneration(0),
+        bClaimed(false),
+        bActive(false)
+    {
+    }
+};
+
+std::atomic<int> CLog::s_nLevel(LogLevel_Info > STU_LOG_MIN_LEVEL ? (int)LogLevel_Info : STU_LOG_MIN_LEVEL);
+
+static std::atomic<int> s_nFormat(LogFormat_Text);
+static const std::chrono::steady_clock::time_point s_Start = std::chrono::steady_clock::now();
+
+// Lock order: registry, then a buffer, then the output.
+static std::mutex s_RegistryMutex;
+static std::vector< std::unique_ptr<LogBuffer> > s_Buffers;
+static uint32_t s_uNextThread = 0;
+static std::mutex s_OutputMutex;
+static FILE * s_pOutput = NULL;     // stdout when NULL
+
+static STU_THREAD_LOCAL LogBuffer * t_pBuffer = NULL;
+static STU_THREAD_LOCAL uint32_t t_uGeneration = 0;
+
+static void WriteOut(const char * pData, size_t uSize, bool bFlushFile)
+{
+    std::lock_guard<std::mutex> Lock(s_OutputMutex);
+    FILE * pOutput = s_pOutput ? s_pOutput : stdout;
+    if (uSize > 0)
+    {
+        fwrite(pData, 1, uSize, pOutput);
+    }
+    if (bFlushFile)
+    {
+        fflush(pOutput);
+    }
+}
+
+// Returns the buffer of the calling thread, locked. A thread takes a free buffer the first time it logs, and again
+// if Flush() took its buffer back because the thread had gone quiet (most likely it had exited).
+static LogBuffer * LockThreadBuffer()
+{
+    LogBuffer * pBuffer = t_pBuffer;
+    if (pBuffer)
+    {
+        pBuffer->Mutex.lock();
+        if (pBuffer->uGeneration == t_uGeneration)
+        {
+            return pBuffer;
+        }
+        pBuffer->Mutex.unlock();
+    }
+
+    std::lock_guard<std::mutex> Lock(s_RegistryMutex);
+    pBuffer = NULL;
+    for (size_t i = 0; i < s_Buffers.size() && !pBuffer; ++i)
+    {
+        if (!s_Buffers[i]->bClaimed)
+        {
+            pBuffer = s_Buffers[i].get();
+        }
+    }
+    if (!pBuffer)
+    {
+        s_Buffers.push_back(std::unique_ptr<LogBuffer>(new LogBuffer()));
+        pBuffer = s_Buffers.back().get();
+    }
+    pBuffer->Mutex.lock();
+    pBuffer->bClaimed = true;
+    pBuffer->uGeneration++;
+    pBuffer->uThread = s_uNextThread++;
+    t_pBuffer = pBuffer;
+    t_uGeneration = pBuffer->uGeneration;
+    return pBuffer;
+}
+
+static void AppendJsonString(std::string &sLine, const char * pText, size_t uLength)
+{
+    sLine += '"';
+    for (size_t i = 0; i < uLength; ++i)
+    {
+        char c = pText[i];
+        switch (c)
+        {
+        case '"': sLine += "\\\""; break;
+        case '\\': sLine += "\\\\"; break;
+        case '\n': sLine += "\\n"; break;
+        case '\r': sLine += "\\r"; break;
+        case '\t': sLine += "\\t"; break;
+        default:
+            if ((unsigned char)c < 0x20)
+            {
+                char Escape[8];
+                snprintf(Escape, sizeof(Escape), "\\u%04x", (unsigned int)(unsigned char)c);
+                sLine += Escape;
+            }
+            else
+            {
+                sLine += c;
+            }
+            break;
+        }
+    }
+    sLine += '"';
+}
+
+void CLog::SetLevel(LogLevel eLevel)
+{
+    s_nLevel.store((int)eLevel, std::memory_order_relaxed);
+}
+
+void CLog::SetOutput(FILE * pOutput)
+{
+    Flush();
+    std::lock_guard<std::mutex> Lock(s_OutputMutex);
+    s_pOutput = pOutput;
+}
+
+void CLog::SetFormat(LogFormat eFormat)
+{
+    s_nFormat.store((int)eFormat, std::memory_order_relaxed);
+}
+
+const char * CLog::GetLevelName(LogLevel eLevel)
+{
+    switch (eLevel)
+    {
+    case LogLevel_Debug: return "debug";
+    case LogLevel_Info: return "info";
+    case LogLevel_Warning: return "warning";
+    case LogLevel_Error: return "error";
+    default: return "none";
+    }
+}
+
+bool CLog::ParseLevel(const char * pName, LogLevel &eLevel)
+{
+    for (int nLevel = LogLevel_Debug; nLevel <= LogLevel_None; ++nLevel)
+    {
+        if (strcmp(pName, GetLevelName((LogLevel)nLevel)) == 0)
+        {
+            eLevel = (LogLevel)nLevel;
+            return true;
+        }
+    }
+    return false;
+}
+
+void CLog::Write(LogLevel eLevel, const char * pTag, const char * pFormat, ...)
+{
+    char Message[1024];
+    std::vector<char> LongMessage;
+    const char * pMessage = Message;
+
+    va_list Args;
+    va_start(Args, pFormat);
+    int nLength = vsnprintf(Message, sizeof(Message), pFormat, Args);
+    va_end(Args);
+    if (nLength < 0)
+    {
+        return;
+    }
+    if ((size_t)nLength >= sizeof(Message))
+    {
+        LongMessage.resize((size_t)nLength + 1);
+        va_start(Args, pFormat);
+        vsnprintf(&LongMessage[0], LongMessage.size(), pFormat, Args);
+        va_end(Args);
+        pMessage = &LongMessage[0];
+    }
+
+    // Every message is one line, whether it ends in a newline or not.
+    size_t uLength = (size_t)nLength;
+    while (uLength > 0 && (pMessage[uLength - 1] == '\n' || pMessage[uLength - 1] == '\r'))
+    {
+        uLength--;
+    }
+    size_t uTagLength = strlen(pTag);
+
+    LogBuffer * pBuffer = LockThreadBuffer();
+    std::string sLine;
+    if (s_nFormat.load(std::memory_order_relaxed) == LogFormat_JsonLines)
+    {
+        double fTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - s_Start).count();
+        char Header[96];
+        snprintf(Header, sizeof(Header), "{\"time\":%.6f,\"thread\":%u,\"level\":\"%s\",\"tag\":", fTime, pBuffer->uThread, GetLevelName(eLevel));
+        sLine.reserve(uTagLength + uLength + 128);
+        sLine += Header;
+        AppendJsonString(sLine, pTag, uTagLength);
+        sLine += ",\"message\":";
+        AppendJsonString(sLine, pMessage, uLength);
+        sLine += "}\n";
+    }
+
+    size_t uLineSize = sLine.empty() ? uTagLength + uLength + 2 : sLine.size();
+    if (pBuffer->uUsed + uLineSize > uBufferSize)
+    {
+        WriteOut(pBuffer->Data, pBuffer->uUsed, false);
+        pBuffer->uUsed = 0;
+    }
+    if (uLineSize > uBufferSize)
+    {
+        if (sLine.empty())
+        {
+            sLine.reserve(uLineSize);
+            sLine.append(pTag, uTagLength);
+            sLine += ':';
+            sLine.append(pMessage, uLength);
+            sLine += '\n';
+        }
+        WriteOut(sLine.data(), sLine.size(), false);
+    }
+    else if (sLine.empty())
+    {
+        char * pLine = pBuffer->Data + pBuffer->uUsed;
+        memcpy(pLine, pTag, uTagLength);
+        pLine[uTagLength] = ':';
+        memcpy(pLine + uTagLength + 1, pMessage, uLength);
+        pLine[uLineSize - 1] = '\n';
+        pBuffer->uUsed += uLineSize;
+    }
+    else
+    {
+        memcpy(pBuffer->Data + pBuffer->uUsed, sLine.data(), uLineSize);
+        pBuffer->uUsed += uLineSize;
+    }
+    pBuffer->bActive = true;
+
+    if (eLevel >= LogLevel_Warning)
+    {
+        WriteOut(pBuffer->Data, pBuffer->uUsed, true);
+        pBuffer->uUsed = 0;
+    }
+    pBuffer->Mutex.unlock();
+}
+
+void CLog::Flush()
+{
+    std::lock_guard<std::mutex> Lock(s_RegistryMutex);
+    for (size_t i = 0; i < s_Buffers.size(); ++i)
+    {
+        LogBuffer &Buffer = *s_Buffers[i];
+        std::lock_guard<std::mutex> BufferLock(Buffer.Mutex);
+        WriteOut(Buffer.Data, Buffer.uUsed, false);
+        Buffer.uUsed = 0;
+
+        // Threads that logged nothing since the last flush give their buffer back, so the worker threads of
+        // every parallel loop do not each keep one for good. A thread that is still alive takes a new one.
+        if (Buffer.bClaimed && !Buffer.bActive && &Buffer != t_pBuffer)
+        {
+            Buffer.bClaimed = false;
+            Buffer.uGeneration++;
+        }
+        Buffer.bActive = false;
+    }
+    WriteOut(NULL, 0, true);
+}
+
+// Writes out whatever is still buffered when the process exits. Declared last so it runs before the buffers go.
+struct LogExitFlush
+{
+    ~LogExitFlush() { CLog::Flush(); }
+};
+
+static LogExitFlush s_ExitFlush;
@@ -0,0 +1,78 @@
+#ifndef LOG_H_
+#define LOG_H_
+
+#include <atomic>
+#include <cstdio>
+
+enum LogLevel
+{
+    LogLevel_Debug,
+    LogLevel_Info,
+    LogLevel_Warning,
+    LogLevel_Error,
+    LogLevel_None
+};
+
+enum LogFormat
+{
+    LogFormat_Text,         // "Tag:message", the format the converters always printed
+    LogFormat_JsonLines     // one JSON object per line: time, thread, level, tag and message
+};
+
+/* Messages below this level are compiled out. Define it to one of the LogLevel values (as a number) to change
+   it for a build, e.g. STU_LOG_MIN_LEVEL=2 keeps warnings and errors only. */
+#ifndef STU_LOG_MIN_LEVEL
+#ifdef _DEBUG
+#define STU_LOG_MIN_LEVEL 0
+#else
+#define STU_LOG_MIN_LEVEL 1
+#endif
+#endif
+
+#define STU_LOG(eLevel, sTag, ...) \
+    do { if ((int)(eLevel) >= STU_LOG_MIN_LEVEL && CLog::IsEnabled(eLevel)) { CLog::Write(eLevel, sTag, __VA_ARGS__); } } while (0)
+
+#define STU_LOG_DEBUG(sTag, ...) STU_LOG(LogLevel_Debug, sTag, __VA_ARGS__)
+#define STU_LOG_INFO(sTag, ...) STU_LOG(LogLevel_Info, sTag, __VA_ARGS__)
+#define STU_LOG_WARNING(sTag, ...) STU_LOG(LogLevel_Warning, sTag, __VA_ARGS__)
+#define STU_LOG_ERROR(sTag, ...) STU_LOG(LogLevel_Error, sTag, __VA_ARGS__)
+
+/*
+   Process wide log. Every thread formats its messages into a buffer of its own and the buffer is written out in
+   one batch when it is full, so logging from a hot loop costs a vsnprintf and a copy, and lines of concurrent
+   conversions never interleave mid-line. Warnings and errors write the buffer of their thread out at once.
+   Flush() writes out the buffers of all threads; the converter calls it at the end of every conversion, and it
+   runs once more at exit.
+*/
+class CLog
+{
+public:
+
+    /* Size of the buffer of each thread. Longer messages are written out on their own. */
+    static const size_t uBufferSize = 16 * 1024;
+
+    /* Messages below eLevel are dropped. Defaults to LogLevel_Info, or STU_LOG_MIN_LEVEL if that is higher. */
+    static void SetLevel(LogLevel eLevel);
+    static LogLevel GetLevel() { return (LogLevel)s_nLevel.load(std::memory_order_relaxed); }
+    static bool IsEnabled(LogLevel eLevel) { return (int)eLevel >= s_nLevel.load(std::memory_order_relaxed); }
+
+    /* Where the lines go, stdout by default. The file is not owned. Buffered lines are flushed first. */
+    static void SetOutput(FILE * pOutput);
+
+    static void SetFormat(LogFormat eFormat);
+
+    /* Name of a level as it appears in JSON lines, and its inverse, false for unknown names */
+    static const char * GetLevelName(LogLevel eLevel);
+    static bool ParseLevel(const char * pName, LogLevel &eLevel);
+
+    /* printf style message. A trailing newline is optional, every message is one line. */
+    static void Write(LogLevel eLevel, const char * pTag, const char * pFormat, ...);
+
+    /* Write out the buffered lines of all threads */
+    static void Flush();
+
+private:
+    static std::atomic<int> s_nLevel;
+};
+
+#endif // LOG_H_
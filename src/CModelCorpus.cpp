@@ -0,0 +1,900 @@
+#include "CModelCorpus.h"
+#include "CLog.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#define LOG_ERROR(...) STU_LOG_ERROR("CModelCorpus", __VA_ARGS__)
+
+// Keeps every mesh under 65535 vertices: a grid of 200 x 200 quads has 201 x 201 of them.
+static const uint32_t uMaxMeshTriangles = 80000;
+
+static const char * const s_FormatNames[CorpusFormat_Count] = { "OBJ", "XML", "PLY", "glTF", "DirectX" };
+static const char * const s_FormatExtensions[CorpusFormat_Count] = { ".obj", ".xml", ".ply", ".gltf", ".x" };
+
+// xorshift32, the same sequence everywhere, unlike the distributions of <random>.
+class CCorpusRandom
+{
+public:
+    explicit CCorpusRandom(uint32_t uSeed) : m_uState(uSeed ? uSeed : 0x9E3779B9u) {}
+
+    uint32_t Next()
+    {
+        m_uState ^= m_uState << 13;
+        m_uState ^= m_uState >> 17;
+        m_uState ^= m_uState << 5;
+        return m_uState;
+    }
+
+    /* In [0, 1) */
+    float NextFloat() { return (Next() >> 8) * (1.0f / 16777216.0f); }
+
+private:
+    uint32_t m_uState;
+};
+
+// Text is formatted by hand into a string and written once per mesh, fprintf per value is far slower.
+static void AppendFloat(std::string &Text, float fValue)
+{
+    char Buffer[32];
+    int nLength = snprintf(Buffer, sizeof(Buffer), "%.6g", fValue);
+    Text.append(Buffer, nLength);
+}
+
+static void AppendUInt(std::string &Text, uint32_t uValue)
+{
+    char Buffer[16];
+    int nLength = snprintf(Buffer, sizeof(Buffer), "%u", uValue);
+    Text.append(Buffer, nLength);
+}
+
+static void AppendBytes(std::vector<uint8_t> &Data, const void * pSource, size_t uSize)
+{
+    // The corpus is written in the byte order of the machine, little endian on every platform we build for.
+    const uint8_t * pBytes = (const uint8_t *)pSource;
+    Data.insert(Data.end(), pBytes, pBytes + uSize);
+}
+
+static bool WriteFile(const std::string &path, const void * pData, size_t uSize, FILE * pFile = NULL)
+{
+    bool bOwned = pFile == NULL;
+    if (bOwned)
+    {
+        pFile = fopen(path.c_str(), "wb");
+        if (!pFile)
+        {
+            LOG_ERROR("Could not create '%s'.\n", path.c_str());
+            return false;
+        }
+    }
+    bool bWritten = uSize == 0 || fwrite(pData, 1, uSize, pFile) == uSize;
+    if (bOwned)
+    {
+        bWritten = fclose(pFile) == 0 && bWritten;
+    }
+    if (!bWritten)
+    {
+        LOG_ERROR("Could not write '%s'.\n", path.c_str());
+    }
+    return bWritten;
+}
+
+static std::string EncodeBase64(const std::vector<uint8_t> &Data)
+{
+    static const char Alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string sEncoded;
+    sEncoded.reserve((Data.size() + 2) / 3 * 4);
+    size_t i = 0;
+    for (; i + 2 < Data.size(); i += 3)
+    {
+        uint32_t uBits = (Data[i] << 16) | (Data[i + 1] << 8) | Data[i + 2];
+        sEncoded += Alphabet[(uBits >> 18) & 63];
+        sEncoded += Alphabet[(uBits >> 12) & 63];
+        sEncoded += Alphabet[(uBits >> 6) & 63];
+        sEncoded += Alphabet[uBits & 63];
+    }
+    if (i < Data.size())
+    {
+        uint32_t uBits = (Data[i] << 16) | (i + 1 < Data.size() ? Data[i + 1] << 8 : 0);
+        sEncoded += Alphabet[(uBits >> 18) & 63];
+        sEncoded += Alphabet[(uBits >> 12) & 63];
+        sEncoded += i + 1 < Data.size() ? Alphabet[(uBits >> 6) & 63] : '=';
+        sEncoded += '=';
+    }
+    return sEncoded;
+}
+
+const char * CModelCorpus::GetFormatName(CorpusFormat Format)
+{
+    return Format < CorpusFormat_Count ? s_FormatNames[Format] : "unknown";
+}
+
+const char * CModelCorpus::GetFormatExtension(CorpusFormat Format)
+{
+    return Format < CorpusFormat_Count ? s_FormatExtensions[Format] : "";
+}
+
+bool CModelCorpus::CanStore(const CorpusSceneSpec &Spec, CorpusFormat Format)
+{
+    if (Format == CorpusFormat_X)
+    {
+        return true;
+    }
+    if (Format == CorpusFormat_GLTF)
+    {
+        // The glTF 2.0 importer of the bundled Assimp skips skins and animations, the case would not measure them.
+        return Spec.uBones == 0 && Spec.uAnimationFrames == 0;
+    }
+    return Spec.uDepth == 0 && Spec.uBones == 0 && Spec.uAnimationFrames == 0;
+}
+
+std::vector<CorpusSceneSpec> CModelCorpus::GetDefaultSpecs(uint32_t uScale)
+{
+    struct DefaultSpec
+    {
+        const char * pName;
+        uint32_t uTriangles;
+        uint32_t uMeshes;
+        uint32_t uDepth;
+        uint32_t uBones;
+        uint32_t uAnimationFrames;
+    };
+    static const DefaultSpec Defaults[] =
+    {
+        { "flat_small", 20000, 4, 0, 0, 0 },
+        { "flat_large", 1000000, 16, 0, 0, 0 },
+        { "flat_many_meshes", 200000, 256, 0, 0, 0 },
+        { "tree_deep", 200000, 64, 12, 0, 0 },
+        { "skinned", 200000, 8, 2, 48, 0 },
+        { "skinned_animated", 200000, 8, 2, 48, 600 },
+    };
+
+    std::vector<CorpusSceneSpec> Specs;
+    for (size_t i = 0; i < sizeof(Defaults) / sizeof(Defaults[0]); ++i)
+    {
+        CorpusSceneSpec Spec;
+        Spec.sName = Defaults[i].pName;
+        Spec.uTriangles = Defaults[i].uTriangles * std::max<uint32_t>(uScale, 1);
+        Spec.uMeshes = Defaults[i].uMeshes;
+        Spec.uDepth = Defaults[i].uDepth;
+        Spec.uBones = Defaults[i].uBones;
+        Spec.uAnimationFrames = Defaults[i].uAnimationFrames;
+        Spec.uSeed = (uint32_t)i + 1;
+        Specs.push_back(Spec);
+    }
+    return Specs;
+}
+
+std::string CModelCorpus::Write(const CorpusSceneSpec &Spec, CorpusFormat Format, const std::string &sDirectory)
+{
+    if (Format >= CorpusFormat_Count || Spec.uTriangles == 0)
+    {
+        LOG_ERROR("Nothing to write for '%s'.\n", Spec.sName.c_str());
+        return std::string();
+    }
+
+    std::string path = sDirectory;
+    if (!path.empty() && path[path.size() - 1] != '/' && path[path.size() - 1] != '\\')
+    {
+        path += '/';
+    }
+    path += Spec.sName + GetFormatExtension(Format);
+
+    std::vector<Mesh> Meshes;
+    BuildMeshes(Spec, Meshes);
+
+    bool bWritten = false;
+    switch (Format)
+    {
+    case CorpusFormat_OBJ:
+        bWritten = WriteOBJ(Spec, Meshes, path);
+        break;
+    case CorpusFormat_XML:
+        bWritten = WriteXML(Spec, Meshes, path);
+        break;
+    case CorpusFormat_PLY:
+        bWritten = WritePLY(Spec, Meshes, path);
+        break;
+    case CorpusFormat_GLTF:
+        bWritten = WriteGLTF(Spec, Meshes, path);
+        break;
+    default:
+        bWritten = WriteX(Spec, Meshes, path);
+        break;
+    }
+    return bWritten ? path : std::string();
+}
+
+uint32_t CModelCorpus::GetMeshCount(const CorpusSceneSpec &Spec)
+{
+    uint32_t uMeshes = std::max<uint32_t>(std::min(Spec.uMeshes, Spec.uTriangles), 1);
+    return std::max(uMeshes, (Spec.uTriangles + uMaxMeshTriangles - 1) / uMaxMeshTriangles);
+}
+
+void CModelCorpus::BuildMeshes(const CorpusSceneSpec &Spec, std::vector<Mesh> &Meshes)
+{
+    CCorpusRandom Random(Spec.uSeed);
+    uint32_t uMeshes = GetMeshCount(Spec);
+    Meshes.resize(uMeshes);
+
+    for (uint32_t uMesh = 0; uMesh < uMeshes; ++uMesh)
+    {
+        Mesh &Target = Meshes[uMesh];
+        uint32_t uTriangles = Spec.uTriangles / uMeshes + (uMesh < Spec.uTriangles % uMeshes ? 1 : 0);
+        uint32_t uQuads = (uTriangles + 1) / 2;
+        uint32_t uColumns = std::max<uint32_t>((uint32_t)std::ceil(std::sqrt((double)uQuads)), 1);
+        uint32_t uRows = std::max<uint32_t>((uQuads + uColumns - 1) / uColumns, 1);
+        uint32_t uVertices = (uColumns + 1) * (uRows + 1);
+
+        Target.Positions.reserve(uVertices * 3);
+        Target.Normals.reserve(uVertices * 3);
+        Target.Texcoords.reserve(uVertices * 2);
+        for (uint32_t uRow = 0; uRow <= uRows; ++uRow)
+        {
+            for (uint32_t uColumn = 0; uColumn <= uColumns; ++uColumn)
+            {
+                float fU = (float)uColumn / uColumns;
+                float fV = (float)uRow / uRows;
+                float fX = uMesh + fU * 0.9f;
+                Target.Positions.push_back(fX);
+                Target.Positions.push_back((Random.NextFloat() - 0.5f) * 0.02f);
+                Target.Positions.push_back(fV * 0.9f);
+
+                // Only sqrt, it is exact everywhere, so are the normals.
+                float fNormalX = (Random.NextFloat() - 0.5f) * 0.2f;
+                float fNormalZ = (Random.NextFloat() - 0.5f) * 0.2f;
+                float fLength = std::sqrt(fNormalX * fNormalX + 1.0f + fNormalZ * fNormalZ);
+                Target.Normals.push_back(fNormalX / fLength);
+                Target.Normals.push_back(1.0f / fLength);
+                Target.Normals.push_back(fNormalZ / fLength);
+
+                Target.Texcoords.push_back(fU);
+                Target.Texcoords.push_back(fV);
+
+                if (Spec.uBones > 0)
+                {
+                    // The bones are spread evenly over the width of the scene, every vertex follows the two nearest.
+                    float fBone = fX / uMeshes * (Spec.uBones - 1);
+                    uint32_t uBone = std::min((uint32_t)fBone, Spec.uBones - 1);
+                    uint32_t uNextBone = std::min(uBone + 1, Spec.uBones - 1);
+                    float fWeight = uNextBone == uBone ? 0.0f : fBone - uBone;
+                    uint16_t Joints[4] = { (uint16_t)uBone, (uint16_t)uNextBone, 0, 0 };
+                    float Weights[4] = { 1.0f - fWeight, fWeight, 0.0f, 0.0f };
+                    Target.Joints.insert(Target.Joints.end(), Joints, Joints + 4);
+                    Target.Weights.insert(Target.Weights.end(), Weights, Weights + 4);
+                }
+            }
+        }
+
+        Target.Indices.reserve(uTriangles * 3);
+        for (uint32_t uQuad = 0; uQuad < uQuads; ++uQuad)
+        {
+            uint32_t uRow = uQuad / uColumns;
+            uint32_t uColumn = uQuad % uColumns;
+            uint32_t uCorner = uRow * (uColumns + 1) + uColumn;
+            uint32_t Quad[6] = { uCorner, uCorner + uColumns + 1, uCorner + 1, uCorner + 1, uCorner + uColumns + 1, uCorner + uColumns + 2 };
+            uint32_t uCount = std::min<uint32_t>(6, (uTriangles - uQuad * 2) * 3);
+            Target.Indices.insert(Target.Indices.end(), Quad, Quad + uCount);
+        }
+    }
+}
+
+void CModelCorpus::BuildNodes(const CorpusSceneSpec &Spec, uint32_t uMeshes, SceneNodes &Nodes)
+{
+    Nodes.uFirstBone = 1 + Spec.uDepth;
+    Nodes.uFirstMesh = Nodes.uFirstBone + Spec.uBones;
+    Nodes.uFirstAnimated = Spec.uBones > 0 ? Nodes.uFirstBone : 0;
+    Nodes.uAnimated = Spec.uBones > 0 ? Spec.uBones : Spec.uDepth + 1;
+    Nodes.fBoneSpacing = Spec.uBones > 1 ? (float)uMeshes / (Spec.uBones - 1) : 0.0f;
+
+    Nodes.Children.assign(Nodes.uFirstMesh + uMeshes, std::vector<uint32_t>());
+    for (uint32_t uLevel = 1; uLevel <= Spec.uDepth; ++uLevel)
+    {
+        Nodes.Children[uLevel - 1].push_back(uLevel);
+    }
+    for (uint32_t uBone = 0; uBone < Spec.uBones; ++uBone)
+    {
+        Nodes.Children[uBone ? Nodes.uFirstBone + uBone - 1 : 0].push_back(Nodes.uFirstBone + uBone);
+    }
+    for (uint32_t uMesh = 0; uMesh < uMeshes; ++uMesh)
+    {
+        Nodes.Children[uMesh % (Spec.uDepth + 1)].push_back(Nodes.uFirstMesh + uMesh);
+    }
+}
+
+std::string CModelCorpus::GetNodeName(const SceneNodes &Nodes, uint32_t uNode)
+{
+    if (uNode == 0)
+    {
+        return "Root";
+    }
+    if (uNode < Nodes.uFirstBone)
+    {
+        return "Level" + std::to_string((unsigned long long)uNode);
+    }
+    if (uNode < Nodes.uFirstMesh)
+    {
+        return "Bone" + std::to_string((unsigned long long)(uNode - Nodes.uFirstBone));
+    }
+    return "Mesh" + std::to_string((unsigned long long)(uNode - Nodes.uFirstMesh));
+}
+
+bool CModelCorpus::GetNodeTranslation(const SceneNodes &Nodes, uint32_t uNode, float Translation[3])
+{
+    Translation[0] = Translation[1] = Translation[2] = 0.0f;
+    if (uNode > 0 && uNode < Nodes.uFirstBone)
+    {
+        Translation[1] = 0.125f;
+        return true;
+    }
+    if (uNode > Nodes.uFirstBone && uNode < Nodes.uFirstMesh)
+    {
+        Translation[0] = Nodes.fBoneSpacing;
+        return true;
+    }
+    return false;
+}
+
+void CModelCorpus::BuildRotations(const CorpusSceneSpec &Spec, const SceneNodes &Nodes, std::vector<float> &Rotations)
+{
+    // Small random rotations about z.
+    CCorpusRandom Random(Spec.uSeed ^ 0x5bd1e995u);
+    Rotations.resize((size_t)Nodes.uAnimated * Spec.uAnimationFrames * 4);
+    for (size_t i = 0; i < Rotations.size(); i += 4)
+    {
+        float fZ = (Random.NextFloat() - 0.5f) * 0.2f;
+        float fLength = std::sqrt(fZ * fZ + 1.0f);
+        Rotations[i] = 0.0f;
+        Rotations[i + 1] = 0.0f;
+        Rotations[i + 2] = fZ / fLength;
+        Rotations[i + 3] = 1.0f / fLength;
+    }
+}
+
+bool CModelCorpus::WriteOBJ(const CorpusSceneSpec &Spec, const std::vector<Mesh> &Meshes, const std::string &path)
+{
+    FILE * pFile = fopen(path.c_str(), "wb");
+    if (!pFile)
+    {
+        LOG_ERROR("Could not create '%s'.\n", path.c_str());
+        return false;
+    }
+
+    std::string Text = "# 3DConvert benchmark scene '" + Spec.sName + "'\n";
+    bool bWritten = true;
+    uint32_t uBase = 1;
+    for (size_t uMesh = 0; uMesh < Meshes.size() && bWritten; ++uMesh)
+    {
+        const Mesh &Source = Meshes[uMesh];
+        uint32_t uVertices = (uint32_t)Source.Positions.size() / 3;
+        Text += "o Mesh";
+        AppendUInt(Text, (uint32_t)uMesh);
+        Text += '\n';
+        for (uint32_t i = 0; i < uVertices; ++i)
+        {
+            Text += "v ";
+            AppendFloat(Text, Source.Positions[i * 3]);
+            Text += ' ';
+            AppendFloat(Text, Source.Positions[i * 3 + 1]);
+            Text += ' ';
+            AppendFloat(Text, Source.Positions[i * 3 + 2]);
+            Text += "\nvt ";
+            AppendFloat(Text, Source.Texcoords[i * 2]);
+            Text += ' ';
+            AppendFloat(Text, Source.Texcoords[i * 2 + 1]);
+            Text += "\nvn ";
+            AppendFloat(Text, Source.Normals[i * 3]);
+            Text += ' ';
+            AppendFloat(Text, Source.Normals[i * 3 + 1]);
+            Text += ' ';
+            AppendFloat(Text, Source.Normals[i * 3 + 2]);
+            Text += '\n';
+        }
+        for (size_t i = 0; i < Source.Indices.size(); ++i)
+        {
+            uint32_t uIndex = Source.Indices[i] + uBase;
+            Text += i % 3 == 0 ? "f " : " ";
+            for (int nAttribute = 0; nAttribute < 3; ++nAttribute)
+            {
+                AppendUInt(Text, uIndex);
+                if (nAttribute < 2)
+                {
+                    Text += '/';
+                }
+            }
+            if (i % 3 == 2)
+            {
+                Text += '\n';
+            }
+        }
+        uBase += uVertices;
+
+        bWritten = WriteFile(path, Text.data(), Text.size(), pFile);
+        Text.clear();
+    }
+    return fclose(pFile) == 0 && bWritten;
+}
+
+bool CModelCorpus::WriteXML(const CorpusSceneSpec &Spec, const std::vector<Mesh> &Meshes, const std::string &path)
+{
+    FILE * pFile = fopen(path.c_str(), "wb");
+    if (!pFile)
+    {
+        LOG_ERROR("Could not create '%s'.\n", path.c_str());
+        return false;
+    }
+
+    // C3DModelXML splits the lists at single spaces only, they must not contain line breaks.
+    std::string Text = "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n<!-- 3DConvert benchmark scene '" + Spec.sName + "' -->\n<scene>\n";
+    Text += "  <textures count=\"1\"><texture fileName=\"corpus.png\"/></textures>\n  <models count=\"";
+    AppendUInt(Text, (uint32_t)Meshes.size());
+    Text += "\">\n";
+
+    bool bWritten = true;
+    for (size_t uMesh = 0; uMesh < Meshes.size() && bWritten; ++uMesh)
+    {
+        const Mesh &Source = Meshes[uMesh];
+        Text += "    <model name=\"Mesh";
+        AppendUInt(Text, (uint32_t)uMesh);
+        Text += "\" isCollisionModel=\"false\">\n      <vertices>";
+        for (size_t i = 0; i < Source.Positions.size(); ++i)
+        {
+            if (i)
+            {
+                Text += ' ';
+            }
+            AppendFloat(Text, Source.Positions[i]);
+        }
+        Text += "</vertices>\n      <normals>";
+        for (size_t i = 0; i < Source.Normals.size(); ++i)
+        {
+            if (i)
+            {
+                Text += ' ';
+            }
+            AppendFloat(Text, Source.Normals[i]);
+        }
+        Text += "</normals>\n      <indices>";
+        for (size_t i = 0; i < Source.Indices.size(); ++i)
+        {
+            if (i)
+            {
+                Text += ' ';
+            }
+            AppendUInt(Text, Source.Indices[i]);
+        }
+        Text += "</indices>\n      <material name=\"diffuse\"><texture index=\"0\">";
+        for (size_t i = 0; i < Source.Texcoords.size(); ++i)
+        {
+            if (i)
+            {
+                Text += ' ';
+            }
+            AppendFloat(Text, Source.Texcoords[i]);
+        }
+        Text += "</texture></material>\n    </model>\n";
+
+        bWritten = WriteFile(path, Text.data(), Text.size(), pFile);
+        Text.clear();
+    }
+    Text += "  </models>\n</scene>\n";
+    bWritten = bWritten && WriteFile(path, Text.data(), Text.size(), pFile);
+    return fclose(pFile) == 0 && bWritten;
+}
+
+bool CModelCorpus::WritePLY(const CorpusSceneSpec &Spec, const std::vector<Mesh> &Meshes, const std::string &path)
+{
+    uint32_t uVertices = 0;
+    uint32_t uTriangles = 0;
+    for (size_t uMesh = 0; uMesh < Meshes.size(); ++uMesh)
+    {
+        uVertices += (uint32_t)Meshes[uMesh].Positions.size() / 3;
+        uTriangles += (uint32_t)Meshes[uMesh].Indices.size() / 3;
+    }
+
+    std::string Header = "ply\nformat binary_little_endian 1.0\ncomment 3DConvert benchmark scene '" + Spec.sName + "'\nelement vertex ";
+    AppendUInt(Header, uVertices);
+    Header += "\nproperty float x\nproperty float y\nproperty float z\nproperty float nx\nproperty float ny\nproperty float nz\n"
+        "property float s\nproperty float t\nelement face ";
+    AppendUInt(Header, uTriangles);
+    Header += "\nproperty list uchar int vertex_indices\nend_header\n";
+
+    std::vector<uint8_t> Data(Header.begin(), Header.end());
+    Data.reserve(Data.size() + uVertices * 8 * sizeof(float) + uTriangles * (1 + 3 * sizeof(int32_t)));
+    for (size_t uMesh = 0; uMesh < Meshes.size(); ++uMesh)
+    {
+        const Mesh &Source = Meshes[uMesh];
+        for (size_t i = 0; i < Source.Positions.size() / 3; ++i)
+        {
+            AppendBytes(Data, &Source.Positions[i * 3], 3 * sizeof(float));
+            AppendBytes(Data, &Source.Normals[i * 3], 3 * sizeof(float));
+            AppendBytes(Data, &Source.Texcoords[i * 2], 2 * sizeof(float));
+        }
+    }
+    uint32_t uBase = 0;
+    for (size_t uMesh = 0; uMesh < Meshes.size(); ++uMesh)
+    {
+        const Mesh &Source = Meshes[uMesh];
+        for (size_t i = 0; i < Source.Indices.size(); i += 3)
+        {
+            Data.push_back(3);
+            int32_t Triangle[3] = { (int32_t)(Source.Indices[i] + uBase), (int32_t)(Source.Indices[i + 1] + uBase), (int32_t)(Source.Indices[i + 2] + uBase) };
+            AppendBytes(Data, Triangle, sizeof(Triangle));
+        }
+        uBase += (uint32_t)Source.Positions.size() / 3;
+    }
+    return WriteFile(path, Data.data(), Data.size());
+}
+
+// Builds the JSON of a glTF file and its single binary buffer, one buffer view per accessor.
+class CGLTFWriter
+{
+public:
+    CGLTFWriter() : m_uAccessors(0) {}
+
+    uint32_t AddAccessor(const void * pData, uint32_t uCount, uint32_t uComponentType, const char * pType, uint32_t uComponents, uint32_t uComponentSize,
+        const float * pMin = NULL, const float * pMax = NULL)
+    {
+        while (m_Buffer.size() % 4)
+        {
+            m_Buffer.push_back(0);
+        }
+        size_t uOffset = m_Buffer.size();
+        size_t uSize = (size_t)uCount * uComponents * uComponentSize;
+        AppendBytes(m_Buffer, pData, uSize);
+
+        if (m_uAccessors)
+        {
+            m_sViews += ",";
+            m_sAccessors += ",";
+        }
+        m_sViews += "{\"buffer\":0,\"byteOffset\":" + std::to_string((unsigned long long)uOffset) + ",\"byteLength\":" + std::to_string((unsigned long long)uSize) + "}";
+        m_sAccessors += "{\"bufferView\":" + std::to_string((unsigned long long)m_uAccessors) + ",\"componentType\":" + std::to_string((unsigned long long)uComponentType) +
+            ",\"count\":" + std::to_string((unsigned long long)uCount) + ",\"type\":\"" + pType + "\"";
+        if (pMin && pMax)
+        {
+            m_sAccessors += ",\"min\":" + FormatArray(pMin, uComponents) + ",\"max\":" + FormatArray(pMax, uComponents);
+        }
+        m_sAccessors += "}";
+        return m_uAccessors++;
+    }
+
+    std::string FormatArray(const float * pValues, uint32_t uCount) const
+    {
+        std::string sArray = "[";
+        for (uint32_t i = 0; i < uCount; ++i)
+        {
+            char Buffer[32];
+            snprintf(Buffer, sizeof(Buffer), i ? ",%.9g" : "%.9g", pValues[i]);
+            sArray += Buffer;
+        }
+        return sArray + "]";
+    }
+
+    std::string GetJSON(const std::string &sScene) const
+    {
+        return "{\"asset\":{\"version\":\"2.0\",\"generator\":\"3DConvert benchmark corpus\"}," + sScene +
+            ",\"accessors\":[" + m_sAccessors + "],\"bufferViews\":[" + m_sViews + "],\"buffers\":[{\"byteLength\":" +
+            std::to_string((unsigned long long)m_Buffer.size()) + ",\"uri\":\"data:application/octet-stream;base64," + EncodeBase64(m_Buffer) + "\"}]}\n";
+    }
+
+private:
+    std::vector<uint8_t> m_Buffer;
+    std::string m_sAccessors;
+    std::string m_sViews;
+    uint32_t m_uAccessors;
+};
+
+bool CModelCorpus::WriteGLTF(const CorpusSceneSpec &Spec, const std::vector<Mesh> &Meshes, const std::string &path)
+{
+    // glTF component types
+    const uint32_t uUnsignedShort = 5123;
+    const uint32_t uUnsignedInt = 5125;
+    const uint32_t uFloat = 5126;
+
+    CGLTFWriter Writer;
+    std::string sMeshes;
+    for (size_t uMesh = 0; uMesh < Meshes.size(); ++uMesh)
+    {
+        const Mesh &Source = Meshes[uMesh];
+        uint32_t uVertices = (uint32_t)Source.Positions.size() / 3;
+        float Min[3] = { Source.Positions[0], Source.Positions[1], Source.Positions[2] };
+        float Max[3] = { Min[0], Min[1], Min[2] };
+        for (uint32_t i = 1; i < uVertices; ++i)
+        {
+            for (int nAxis = 0; nAxis < 3; ++nAxis)
+            {
+                Min[nAxis] = std::min(Min[nAxis], Source.Positions[i * 3 + nAxis]);
+                Max[nAxis] = std::max(Max[nAxis], Source.Positions[i * 3 + nAxis]);
+            }
+        }
+
+        uint32_t uPositions = Writer.AddAccessor(Source.Positions.data(), uVertices, uFloat, "VEC3", 3, 4, Min, Max);
+        uint32_t uNormals = Writer.AddAccessor(Source.Normals.data(), uVertices, uFloat, "VEC3", 3, 4);
+        uint32_t uTexcoords = Writer.AddAccessor(Source.Texcoords.data(), uVertices, uFloat, "VEC2", 2, 4);
+        uint32_t uIndices = Writer.AddAccessor(Source.Indices.data(), (uint32_t)Source.Indices.size(), uUnsignedInt, "SCALAR", 1, 4);
+
+        sMeshes += uMesh ? ",{\"name\":\"Mesh" : "{\"name\":\"Mesh";
+        sMeshes += std::to_string((unsigned long long)uMesh) + "\",\"primitives\":[{\"attributes\":{\"POSITION\":" + std::to_string((unsigned long long)uPositions) +
+            ",\"NORMAL\":" + std::to_string((unsigned long long)uNormals) + ",\"TEXCOORD_0\":" + std::to_string((unsigned long long)uTexcoords);
+        if (Spec.uBones > 0)
+        {
+            uint32_t uJoints = Writer.AddAccessor(Source.Joints.data(), uVertices, uUnsignedShort, "VEC4", 4, 2);
+            uint32_t uWeights = Writer.AddAccessor(Source.Weights.data(), uVertices, uFloat, "VEC4", 4, 4);
+            sMeshes += ",\"JOINTS_0\":" + std::to_string((unsigned long long)uJoints) + ",\"WEIGHTS_0\":" + std::to_string((unsigned long long)uWeights);
+        }
+        sMeshes += "},\"indices\":" + std::to_string((unsigned long long)uIndices) + ",\"mode\":4}]}";
+    }
+
+    SceneNodes Nodes;
+    BuildNodes(Spec, (uint32_t)Meshes.size(), Nodes);
+    std::string sNodes;
+    for (uint32_t uNode = 0; uNode < (uint32_t)Nodes.Children.size(); ++uNode)
+    {
+        sNodes += (uNode ? ",{\"name\":\"" : "{\"name\":\"") + GetNodeName(Nodes, uNode) + "\"";
+        float Translation[3];
+        if (GetNodeTranslation(Nodes, uNode, Translation))
+        {
+            sNodes += ",\"translation\":" + Writer.FormatArray(Translation, 3);
+        }
+        if (uNode >= Nodes.uFirstMesh)
+        {
+            sNodes += ",\"mesh\":" + std::to_string((unsigned long long)(uNode - Nodes.uFirstMesh));
+            if (Spec.uBones > 0)
+            {
+                sNodes += ",\"skin\":0";
+            }
+        }
+        const std::vector<uint32_t> &Children = Nodes.Children[uNode];
+        if (!Children.empty())
+        {
+            sNodes += ",\"children\":[";
+            for (size_t i = 0; i < Children.size(); ++i)
+            {
+                sNodes += (i ? "," : "") + std::to_string((unsigned long long)Children[i]);
+            }
+            sNodes += "]";
+        }
+        sNodes += "}";
+    }
+
+    std::string sScene = "\"scene\":0,\"scenes\":[{\"nodes\":[0]}],\"nodes\":[" + sNodes + "],\"meshes\":[" + sMeshes + "]";
+
+    if (Spec.uBones > 0)
+    {
+        // Bone b sits at x = b * spacing, its inverse bind matrix moves it back to the origin (column major).
+        std::vector<float> InverseBindMatrices(Spec.uBones * 16, 0.0f);
+        std::string sJoints;
+        for (uint32_t uBone = 0; uBone < Spec.uBones; ++uBone)
+        {
+            float * pMatrix = &InverseBindMatrices[uBone * 16];
+            pMatrix[0] = pMatrix[5] = pMatrix[10] = pMatrix[15] = 1.0f;
+            pMatrix[12] = -(float)uBone * Nodes.fBoneSpacing;
+            sJoints += (uBone ? "," : "") + std::to_string((unsigned long long)(Nodes.uFirstBone + uBone));
+        }
+        uint32_t uMatrices = Writer.AddAccessor(InverseBindMatrices.data(), Spec.uBones, uFloat, "MAT4", 16, 4);
+        sScene += ",\"skins\":[{\"inverseBindMatrices\":" + std::to_string((unsigned long long)uMatrices) + ",\"skeleton\":" +
+            std::to_string((unsigned long long)Nodes.uFirstBone) + ",\"joints\":[" + sJoints + "]}]";
+    }
+
+    if (Spec.uAnimationFrames > 0)
+    {
+        // 30 keys per second
+        std::vector<float> Times(Spec.uAnimationFrames);
+        for (uint32_t uFrame = 0; uFrame < Spec.uAnimationFrames; ++uFrame)
+        {
+            Times[uFrame] = uFrame / 30.0f;
+        }
+        float fFirstTime = Times.front();
+        float fLastTime = Times.back();
+        uint32_t uTimes = Writer.AddAccessor(Times.data(), Spec.uAnimationFrames, uFloat, "SCALAR", 1, 4, &fFirstTime, &fLastTime);
+
+        std::vector<float> Rotations;
+        BuildRotations(Spec, Nodes, Rotations);
+        std::string sSamplers;
+        std::string sChannels;
+        for (uint32_t uNode = 0; uNode < Nodes.uAnimated; ++uNode)
+        {
+            uint32_t uRotations = Writer.AddAccessor(&Rotations[(size_t)uNode * Spec.uAnimationFrames * 4], Spec.uAnimationFrames, uFloat, "VEC4", 4, 4);
+            sSamplers += (uNode ? ",{\"input\":" : "{\"input\":") + std::to_string((unsigned long long)uTimes) + ",\"output\":" +
+                std::to_string((unsigned long long)uRotations) + ",\"interpolation\":\"LINEAR\"}";
+            sChannels += (uNode ? ",{\"sampler\":" : "{\"sampler\":") + std::to_string((unsigned long long)uNode) + ",\"target\":{\"node\":" +
+                std::to_string((unsigned long long)(Nodes.uFirstAnimated + uNode)) + ",\"path\":\"rotation\"}}";
+        }
+        sScene += ",\"animations\":[{\"name\":\"Take\",\"samplers\":[" + sSamplers + "],\"channels\":[" + sChannels + "]}]";
+    }
+
+    std::string sJSON = Writer.GetJSON(sScene);
+    return WriteFile(path, sJSON.data(), sJSON.size());
+}
+
+// Identity but for the translation, the layout of a Direct3D matrix: row vectors, the translation in the last row.
+static void AppendXMatrix(std::string &Text, const float Translation[3])
+{
+    Text += "1,0,0,0,0,1,0,0,0,0,1,0,";
+    for (int nAxis = 0; nAxis < 3; ++nAxis)
+    {
+        AppendFloat(Text, Translation[nAxis]);
+        Text += ',';
+    }
+    Text += "1;;";
+}
+
+bool CModelCorpus::WriteX(const CorpusSceneSpec &Spec, const std::vector<Mesh> &Meshes, const std::string &path)
+{
+    SceneNodes Nodes;
+    BuildNodes(Spec, (uint32_t)Meshes.size(), Nodes);
+
+    std::string Text = "xof 0303txt 0032\n// 3DConvert benchmark scene '" + Spec.sName + "'\n";
+    if (Spec.uAnimationFrames > 0)
+    {
+        // Key times are whole ticks, one per key.
+        Text += "AnimTicksPerSecond { 30; }\n";
+    }
+    AppendXFrame(Spec, Meshes, Nodes, 0, Text);
+
+    if (Spec.uAnimationFrames > 0)
+    {
+        std::vector<float> Rotations;
+        BuildRotations(Spec, Nodes, Rotations);
+        Text += "AnimationSet Take {\n";
+        for (uint32_t uNode = 0; uNode < Nodes.uAnimated; ++uNode)
+        {
+            // Rotation keys: time; 4; w, x, y, z;;
+            Text += "Animation {\n{ " + GetNodeName(Nodes, Nodes.uFirstAnimated + uNode) + " }\nAnimationKey {\n0;\n";
+            AppendUInt(Text, Spec.uAnimationFrames);
+            Text += ";\n";
+            const float * pRotation = &Rotations[(size_t)uNode * Spec.uAnimationFrames * 4];
+            for (uint32_t uFrame = 0; uFrame < Spec.uAnimationFrames; ++uFrame, pRotation += 4)
+            {
+                AppendUInt(Text, uFrame);
+                Text += ";4;";
+                AppendFloat(Text, pRotation[3]);
+                for (int nAxis = 0; nAxis < 3; ++nAxis)
+                {
+                    Text += ',';
+                    AppendFloat(Text, pRotation[nAxis]);
+                }
+                Text += uFrame + 1 < Spec.uAnimationFrames ? ";;,\n" : ";;;\n";
+            }
+            Text += "}\n}\n";
+        }
+        Text += "}\n";
+    }
+    return WriteFile(path, Text.data(), Text.size());
+}
+
+void CModelCorpus::AppendXFrame(const CorpusSceneSpec &Spec, const std::vector<Mesh> &Meshes, const SceneNodes &Nodes, uint32_t uNode, std::string &Text)
+{
+    float Translation[3];
+    GetNodeTranslation(Nodes, uNode, Translation);
+    Text += "Frame " + GetNodeName(Nodes, uNode) + " {\nFrameTransformMatrix {\n";
+    AppendXMatrix(Text, Translation);
+    Text += "\n}\n";
+    if (uNode >= Nodes.uFirstMesh)
+    {
+        AppendXMesh(Spec, Meshes[uNode - Nodes.uFirstMesh], Nodes, uNode - Nodes.uFirstMesh, Text);
+    }
+    const std::vector<uint32_t> &Children = Nodes.Children[uNode];
+    for (size_t i = 0; i < Children.size(); ++i)
+    {
+        AppendXFrame(Spec, Meshes, Nodes, Children[i], Text);
+    }
+    Text += "}\n";
+}
+
+void CModelCorpus::AppendXMesh(const CorpusSceneSpec &Spec, const Mesh &Source, const SceneNodes &Nodes, uint32_t uMesh, std::string &Text)
+{
+    // Every list ends with ";;", its items are separated by ",", the values in an item by ";".
+    uint32_t uVertices = (uint32_t)Source.Positions.size() / 3;
+    uint32_t uTriangles = (uint32_t)Source.Indices.size() / 3;
+    std::string sFaces;
+    AppendUInt(sFaces, uTriangles);
+    sFaces += ";\n";
+    for (uint32_t i = 0; i < uTriangles; ++i)
+    {
+        sFaces += "3;";
+        AppendUInt(sFaces, Source.Indices[i * 3]);
+        sFaces += ',';
+        AppendUInt(sFaces, Source.Indices[i * 3 + 1]);
+        sFaces += ',';
+        AppendUInt(sFaces, Source.Indices[i * 3 + 2]);
+        sFaces += i + 1 < uTriangles ? ";,\n" : ";;\n";
+    }
+
+    Text += "Mesh Mesh";
+    AppendUInt(Text, uMesh);
+    Text += " {\n";
+    for (int nList = 0; nList < 2; ++nList)
+    {
+        const std::vector<float> &Vectors = nList ? Source.Normals : Source.Positions;
+        if (nList)
+        {
+            Text += "MeshNormals {\n";
+        }
+        AppendUInt(Text, uVertices);
+        Text += ";\n";
+        for (uint32_t i = 0; i < uVertices; ++i)
+        {
+            AppendFloat(Text, Vectors[i * 3]);
+            Text += ';';
+            AppendFloat(Text, Vectors[i * 3 + 1]);
+            Text += ';';
+            AppendFloat(Text, Vectors[i * 3 + 2]);
+            Text += i + 1 < uVertices ? ";,\n" : ";;\n";
+        }
+        Text += sFaces;
+    }
+    Text += "}\nMeshTextureCoords {\n";
+    AppendUInt(Text, uVertices);
+    Text += ";\n";
+    for (uint32_t i = 0; i < uVertices; ++i)
+    {
+        AppendFloat(Text, Source.Texcoords[i * 2]);
+        Text += ';';
+        AppendFloat(Text, Source.Texcoords[i * 2 + 1]);
+        Text += i + 1 < uVertices ? ";,\n" : ";;\n";
+    }
+    Text += "}\nMeshMaterialList {\n1;\n";
+    AppendUInt(Text, uTriangles);
+    Text += ";\n";
+    for (uint32_t i = 0; i < uTriangles; ++i)
+    {
+        Text += i + 1 < uTriangles ? "0," : "0;;\n";
+    }
+    Text += "Material Default {\n1;1;1;1;;\n0;\n0;0;0;;\n0;0;0;;\n}\n}\n";
+
+    if (Spec.uBones > 0)
+    {
+        // One SkinWeights per bone that moves a vertex of this mesh, the zero weights of BuildMeshes are left out.
+        std::vector< std::vector<uint32_t> > BoneVertices(Spec.uBones);
+        std::vector< std::vector<float> > BoneWeights(Spec.uBones);
+        for (uint32_t i = 0; i < uVertices * 4; ++i)
+        {
+            if (Source.Weights[i] > 0.0f)
+            {
+                BoneVertices[Source.Joints[i]].push_back(i / 4);
+                BoneWeights[Source.Joints[i]].push_back(Source.Weights[i]);
+            }
+        }
+        uint32_t uBones = 0;
+        for (uint32_t uBone = 0; uBone < Spec.uBones; ++uBone)
+        {
+            uBones += BoneVertices[uBone].empty() ? 0 : 1;
+        }
+
+        Text += "XSkinMeshHeader {\n2;\n2;\n";
+        AppendUInt(Text, uBones);
+        Text += ";\n}\n";
+        for (uint32_t uBone = 0; uBone < Spec.uBones; ++uBone)
+        {
+            const std::vector<uint32_t> &Vertices = BoneVertices[uBone];
+            if (Vertices.empty())
+            {
+                continue;
+            }
+            Text += "SkinWeights {\n\"Bone";
+            AppendUInt(Text, uBone);
+            Text += "\";\n";
+            AppendUInt(Text, (uint32_t)Vertices.size());
+            Text += ";\n";
+            for (size_t i = 0; i < Vertices.size(); ++i)
+            {
+                AppendUInt(Text, Vertices[i]);
+                Text += i + 1 < Vertices.size() ? "," : ";\n";
+            }
+            for (size_t i = 0; i < Vertices.size(); ++i)
+            {
+                AppendFloat(Text, BoneWeights[uBone][i]);
+                Text += i + 1 < Vertices.size() ? "," : ";\n";
+            }
+            // The inverse bind matrix, the same as in glTF.
+            float Translation[3] = { -(float)uBone * Nodes.fBoneSpacing, 0.0f, 0.0f };
+            AppendXMatrix(Text, Translation);
+            Text += "\n}\n";
+        }
+    }
+    Text += "}\n";
+}
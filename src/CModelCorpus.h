@@ -0,0 +1,104 @@
+#ifndef MODEL_CORPUS_H_
+#define MODEL_CORPUS_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum CorpusFormat
+{
+    CorpusFormat_OBJ,
+    CorpusFormat_XML,           // the schema read by C3DModelXML
+    CorpusFormat_PLY,           // binary little endian, every mesh merged into one
+    CorpusFormat_GLTF,          // glTF 2.0 with the buffer embedded as a data URI, static scenes only
+    CorpusFormat_X,             // DirectX text
+    CorpusFormat_Count
+};
+
+/* Shape of one synthetic scene. The same spec always gives the same file, byte for byte, on every platform. */
+struct CorpusSceneSpec
+{
+    std::string sName;
+    uint32_t uTriangles;        // over all meshes
+    uint32_t uMeshes;           // raised so no mesh has more than 65535 vertices, the limit of the XML indices
+    uint32_t uDepth;            // levels of nodes under the root the meshes hang from
+    uint32_t uBones;            // 0 for a static scene
+    uint32_t uAnimationFrames;  // keys per animated node: the bones, or the levels of a static scene; 0 for none
+    uint32_t uSeed;
+
+    CorpusSceneSpec() :
+        uTriangles(0),
+        uMeshes(1),
+        uDepth(0),
+        uBones(0),
+        uAnimationFrames(0),
+        uSeed(1)
+    {
+    }
+};
+
+/*
+   Generates the scenes of the benchmark corpus. Every mesh is a jittered grid of triangles laid out next to the
+   others along x, so the importers see realistic vertex sharing and every scene has the same bounds per mesh.
+   glTF and DirectX store the hierarchy, only DirectX the skin and the animation: the bundled Assimp reads neither
+   from glTF 2.0. OBJ, XML and PLY get the same meshes, flat.
+*/
+class CModelCorpus
+{
+public:
+
+    /* Writes Spec to sDirectory/<sName>.<extension>. Returns the path, empty on failure. */
+    static std::string Write(const CorpusSceneSpec &Spec, CorpusFormat Format, const std::string &sDirectory);
+
+    /* False when Format, or its importer, would drop part of the scene: the hierarchy, the skin or the animation */
+    static bool CanStore(const CorpusSceneSpec &Spec, CorpusFormat Format);
+
+    /* The scenes the benchmark runs by default. uScale multiplies their triangle counts. */
+    static std::vector<CorpusSceneSpec> GetDefaultSpecs(uint32_t uScale = 1);
+
+    static const char * GetFormatName(CorpusFormat Format);
+    static const char * GetFormatExtension(CorpusFormat Format);
+
+private:
+
+    struct Mesh
+    {
+        std::vector<float> Positions;       // x y z
+        std::vector<float> Normals;         // x y z
+        std::vector<float> Texcoords;       // u v
+        std::vector<uint32_t> Indices;
+        std::vector<uint16_t> Joints;       // 4 per vertex, skinned scenes only
+        std::vector<float> Weights;         // 4 per vertex, skinned scenes only
+    };
+
+    /* The nodes of the formats with a hierarchy: the root, a chain of uDepth levels, a chain of bones under the
+       root, then one node per mesh hanging from the root or one of the levels in turn. */
+    struct SceneNodes
+    {
+        uint32_t uFirstBone;
+        uint32_t uFirstMesh;
+        uint32_t uFirstAnimated;
+        uint32_t uAnimated;                 // the bones, or the root and the levels of a static scene
+        float fBoneSpacing;                 // along x, bone b sits at b * fBoneSpacing
+        std::vector< std::vector<uint32_t> > Children;
+    };
+
+    static uint32_t GetMeshCount(const CorpusSceneSpec &Spec);
+    static void BuildMeshes(const CorpusSceneSpec &Spec, std::vector<Mesh> &Meshes);
+    static void BuildNodes(const CorpusSceneSpec &Spec, uint32_t uMeshes, SceneNodes &Nodes);
+    static std::string GetNodeName(const SceneNodes &Nodes, uint32_t uNode);
+    static bool GetNodeTranslation(const SceneNodes &Nodes, uint32_t uNode, float Translation[3]);
+
+    /* uAnimationFrames rotations about z, x y z w, for every animated node in turn */
+    static void BuildRotations(const CorpusSceneSpec &Spec, const SceneNodes &Nodes, std::vector<float> &Rotations);
+
+    static bool WriteOBJ(const CorpusSceneSpec &Spec, const std::vector<Mesh> &Meshes, const std::string &path);
+    static bool WriteXML(const CorpusSceneSpec &Spec, const std::vector<Mesh> &Meshes, const std::string &path);
+    static bool WritePLY(const CorpusSceneSpec &Spec, const std::vector<Mesh> &Meshes, const std::string &path);
+    static bool WriteGLTF(const CorpusSceneSpec &Spec, const std::vector<Mesh> &Meshes, const std::string &path);
+    static bool WriteX(const CorpusSceneSpec &Spec, const std::vector<Mesh> &Meshes, const std::string &path);
+    static void AppendXFrame(const CorpusSceneSpec &Spec, const std::vector<Mesh> &Meshes, const SceneNodes &Nodes, uint32_t uNode, std::string &Text);
+    static void AppendXMesh(const CorpusSceneSpec &Spec, const Mesh &Source, const SceneNodes &Nodes, uint32_t uMesh, std::string &Text);
+};
+
+#endif // MODEL_CORPUS_H_
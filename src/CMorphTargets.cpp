@@ -0,0 +1,171 @@
+#include "CMorphTargets.h"
+#include "CFileExportSTUFormat.h"
+#include "CExportKernels.h"
+
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+
+static bool IsZeroDelta(const glm::vec3 &Delta, float fTolerance)
+{
+    return std::fabs(Delta.x) <= fTolerance && std::fabs(Delta.y) <= fTolerance && std::fabs(Delta.z) <= fTolerance;
+}
+
+// Signed quantization keeps an exact zero, so axes a target does not touch decode to no movement.
+static int32_t QuantizeSigned(float fValue, float fScale, int32_t nMax)
+{
+    if (fScale <= 0.0f)
+    {
+        return 0;
+    }
+    int32_t nValue = (int32_t)std::floor(fValue / fScale * (float)nMax + 0.5f);
+    return std::max(-nMax, std::min(nMax, nValue));
+}
+
+void CMorphTargets::MakeSparse(const std::vector<glm::vec3> &PositionDeltas, const std::vector<glm::vec3> &NormalDeltas,
+    const std::vector<uint32_t> &OutputToSource, float fTolerance, MorphTarget &Target)
+{
+    Target.mIndices.clear();
+    Target.mPositionDeltas.clear();
+    Target.mNormalDeltas.clear();
+
+    bool bNormals = false;
+    for (size_t v = 0; v < NormalDeltas.size() && !bNormals; ++v)
+    {
+        bNormals = !IsZeroDelta(NormalDeltas[v], fTolerance);
+    }
+
+    uint32_t uNumOutput = OutputToSource.empty() ? (uint32_t)PositionDeltas.size() : (uint32_t)OutputToSource.size();
+    for (uint32_t v = 0; v < uNumOutput; ++v)
+    {
+        uint32_t uSource = OutputToSource.empty() ? v : OutputToSource[v];
+        if (uSource >= PositionDeltas.size())
+        {
+            continue;
+        }
+        const glm::vec3 &Position = PositionDeltas[uSource];
+        glm::vec3 Normal = bNormals && uSource < NormalDeltas.size() ? NormalDeltas[uSource] : glm::vec3(0.0f);
+        if (IsZeroDelta(Position, fTolerance) && IsZeroDelta(Normal, fTolerance))
+        {
+            continue;
+        }
+        Target.mIndices.push_back(v);
+        Target.mPositionDeltas.push_back(Position);
+        if (bNormals)
+        {
+            Target.mNormalDeltas.push_back(Normal);
+        }
+    }
+}
+
+uint32_t CMorphTargets::WriteMorphTargets(const std::vector<MorphTarget> &Targets, std::vector<uint8_t> &Data)
+{
+    uint32_t uSize = 0;
+    uint32_t uValue = (uint32_t)Targets.size();
+    WRITE_VALUE(uValue);
+
+    for (size_t t = 0; t < Targets.size(); ++t)
+    {
+        const MorphTarget &Target = Targets[t];
+        uint32_t uTargetStart = uSize;
+        uint32_t uNumVertices = (uint32_t)Target.mIndices.size();
+        bool bNormals = !Target.mNormalDeltas.empty();
+
+        uSize += CFileExportSTUFormat::CopyString(Target.mName.c_str(), &Data);
+        WRITE_VALUE(uNumVertices);
+        uValue = bNormals ? 1 : 0;
+        WRITE_VALUE(uValue);
+        if (uNumVertices)
+        {
+            WRITE_VALUES(Target.mIndices[0], uNumVertices);
+        }
+
+        glm::vec3 PositionScale(0.0f);
+        for (uint32_t v = 0; v < uNumVertices; ++v)
+        {
+            PositionScale = glm::max(PositionScale, glm::abs(Target.mPositionDeltas[v]));
+        }
+        WRITE_VALUES(PositionScale[0], 3);
+        for (uint32_t v = 0; v < uNumVertices; ++v)
+        {
+            int16_t Packed[3];
+            for (int c = 0; c < 3; ++c)
+            {
+                Packed[c] = (int16_t)QuantizeSigned(Target.mPositionDeltas[v][c], PositionScale[c], 32767);
+            }
+            WRITE_VALUES(Packed[0], 3);
+        }
+
+        if (bNormals)
+        {
+            float fNormalScale = 0.0f;
+            for (uint32_t v = 0; v < uNumVertices; ++v)
+            {
+                glm::vec3 Magnitude = glm::abs(Target.mNormalDeltas[v]);
+                fNormalScale = std::max(fNormalScale, std::max(Magnitude.x, std::max(Magnitude.y, Magnitude.z)));
+            }
+            WRITE_VALUE(fNormalScale);
+            for (uint32_t v = 0; v < uNumVertices; ++v)
+            {
+                int8_t Packed[3];
+                for (int c = 0; c < 3; ++c)
+                {
+                    Packed[c] = (int8_t)QuantizeSigned(Target.mNormalDeltas[v][c], fNormalScale, 127);
+                }
+                WRITE_VALUES(Packed[0], 3);
+            }
+        }
+
+        while ((uSize - uTargetStart) % 4 != 0)
+        {
+            uint8_t uPadding = 0;
+            WRITE_VALUE(uPadding);
+        }
+    }
+    return uSize;
+}
+
+bool CMorphTargets::HasMorphAnimations(const std::vector<Animation> &Animations)
+{
+    for (size_t i = 0; i < Animations.size(); ++i)
+    {
+        if (!Animations[i].mMorphChannels.empty())
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+uint32_t CMorphTargets::WriteMorphAnimations(const std::vector<Animation> &Animations, std::vector<uint8_t> &Data)
+{
+    uint32_t uSize = 0;
+    uint32_t uValue = (uint32_t)Animations.size();
+    WRITE_VALUE(uValue);
+
+    for (size_t i = 0; i < Animations.size(); ++i)
+    {
+        const Animation &animation = Animations[i];
+        uSize += CFileExportSTUFormat::CopyString(animation.mName.c_str(), &Data);
+        WRITE_VALUE(animation.mTicksPerSecond);
+        uValue = (uint32_t)animation.mMorphChannels.size();
+        WRITE_VALUE(uValue);
+
+        for (size_t j = 0; j < animation.mMorphChannels.size(); ++j)
+        {
+            const MorphWeightAnim &channel = animation.mMorphChannels[j];
+            uSize += CFileExportSTUFormat::CopyString(channel.mMeshName.c_str(), &Data);
+            WRITE_VALUE(channel.mTarget);
+            uValue = (uint32_t)channel.mInterpolation;
+            WRITE_VALUE(uValue);
+            uValue = (uint32_t)channel.mKeys.size();
+            WRITE_VALUE(uValue);
+            for (size_t k = 0; k < channel.mKeys.size(); ++k)
+            {
+                float Key[2] = { (float)channel.mKeys[k].mTime, channel.mKeys[k].mValue };
+                WRITE_VALUES(Key[0], 2);
+            }
+        }
+    }
+    return uSize;
+}
@@ -0,0 +1,46 @@
+#ifndef MORPH_TARGETS_H_
+#define MORPH_TARGETS_H_
+
+#include "C3DModelDataStructures.h"
+
+#include <cstdint>
+#include <vector>
+
+/*
+   Morph target chunk ("Vx:NMT"), written after "Vx:N" for meshes with blend shapes:
+
+   uint32 target count, then per target:
+       string name, uint32 vertex count, uint32 has normals (0 or 1),
+       vertex count x uint32 vertex index (ascending, into "Vx:N"),
+       float position scale[3], vertex count x int16[3] position delta, delta = scale * q / 32767
+       if has normals: float normal scale, vertex count x int8[3] normal delta, delta = scale * q / 127
+   Each target is padded to a multiple of 4 bytes. Vertices not listed are not moved by the target.
+
+   Morph weight chunk ("MorphAnimations"):
+
+   uint32 animation count, then per animation:
+       string name, double ticks per second, uint32 track count, then per track:
+       string mesh name, uint32 target index, uint32 interpolation (0 linear, 1 step), uint32 key count,
+       key count x { float time in ticks, float weight (0..1) }
+*/
+class CMorphTargets
+{
+public:
+
+    /* Build the sparse form of a target from per source vertex deltas. Output vertex v reads source vertex
+       OutputToSource[v], or v itself when OutputToSource is empty. Vertices whose position and normal deltas
+       are all within fTolerance are dropped. NormalDeltas may be empty. */
+    static void MakeSparse(const std::vector<glm::vec3> &PositionDeltas, const std::vector<glm::vec3> &NormalDeltas,
+        const std::vector<uint32_t> &OutputToSource, float fTolerance, MorphTarget &Target);
+
+    /* Append the targets of one mesh (see "Vx:NMT" above) to Data, returns the number of bytes written */
+    static uint32_t WriteMorphTargets(const std::vector<MorphTarget> &Targets, std::vector<uint8_t> &Data);
+
+    /* True when any animation carries morph weight curves */
+    static bool HasMorphAnimations(const std::vector<Animation> &Animations);
+
+    /* Append the morph weight curves (see "MorphAnimations" above) to Data, returns the number of bytes written */
+    static uint32_t WriteMorphAnimations(const std::vector<Animation> &Animations, std::vector<uint8_t> &Data);
+};
+
+#endif // MORPH_TARGETS_H_
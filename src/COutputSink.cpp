@@ -0,0 +1,209 @@
+#include "COutputSink.h"
+#include "CLog.h"
+
+#include <cstring>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <unistd.h>
+#endif
+
+#define LOG_ERROR(...) STU_LOG_ERROR("COutputSink", __VA_ARGS__)
+
+CFileOutputSink::CFileOutputSink() :
+    m_pFile(NULL)
+{
+}
+
+CFileOutputSink::~CFileOutputSink()
+{
+    if (m_pFile)
+    {
+        Close();
+    }
+}
+
+bool CFileOutputSink::Open(const std::string &path)
+{
+    if (m_pFile)
+    {
+        LOG_ERROR("'%s' is still open.\n", m_sPath.c_str());
+        return false;
+    }
+    m_pFile = fopen(path.c_str(), "wb");
+    if (!m_pFile)
+    {
+        LOG_ERROR("Could not open file '%s'.\n", path.c_str());
+        return false;
+    }
+    m_sPath = path;
+    m_uSize = 0;
+    return true;
+}
+
+bool CFileOutputSink::Write(const void * pData, uint64_t uSize)
+{
+    if (!m_pFile)
+    {
+        return false;
+    }
+    if (fwrite(pData, sizeof(uint8_t), (size_t)uSize, m_pFile) != uSize)
+    {
+        LOG_ERROR("Cannot write %llu bytes to '%s'.\n", (unsigned long long)uSize, m_sPath.c_str());
+        return false;
+    }
+    m_uSize += uSize;
+    return true;
+}
+
+bool CFileOutputSink::WriteAt(uint64_t uOffset, const void * pData, uint64_t uSize)
+{
+    if (!m_pFile || uOffset + uSize > m_uSize)
+    {
+        return false;
+    }
+    // Offsets past 2GB need the 64 bit seek of the platform.
+#ifdef _WIN32
+    bool bSeek = _fseeki64(m_pFile, (__int64)uOffset, SEEK_SET) == 0;
+#else
+    bool bSeek = fseeko(m_pFile, (off_t)uOffset, SEEK_SET) == 0;
+#endif
+    bool bResult = bSeek && fwrite(pData, sizeof(uint8_t), (size_t)uSize, m_pFile) == uSize;
+#ifdef _WIN32
+    bResult = _fseeki64(m_pFile, 0, SEEK_END) == 0 && bResult;
+#else
+    bResult = fseeko(m_pFile, 0, SEEK_END) == 0 && bResult;
+#endif
+    if (!bResult)
+    {
+        LOG_ERROR("Cannot update %llu bytes at %llu in '%s'.\n", (unsigned long long)uSize, (unsigned long long)uOffset, m_sPath.c_str());
+    }
+    return bResult;
+}
+
+bool CFileOutputSink::Close()
+{
+    if (!m_pFile)
+    {
+        return false;
+    }
+    bool bResult = fclose(m_pFile) == 0;
+    if (!bResult)
+    {
+        LOG_ERROR("Cannot flush '%s'.\n", m_sPath.c_str());
+    }
+    m_pFile = NULL;
+    return bResult;
+}
+
+bool CMemoryOutputSink::Write(const void * pData, uint64_t uSize)
+{
+    const uint8_t * pBytes = (const uint8_t *)pData;
+    m_Buffer.insert(m_Buffer.end(), pBytes, pBytes + uSize);
+    m_uSize += uSize;
+    return true;
+}
+
+bool CMemoryOutputSink::WriteAt(uint64_t uOffset, const void * pData, uint64_t uSize)
+{
+    if (uOffset + uSize > m_Buffer.size())
+    {
+        return false;
+    }
+    memcpy(&m_Buffer[(size_t)uOffset], pData, (size_t)uSize);
+    return true;
+}
+
+CStdoutOutputSink::CStdoutOutputSink() :
+    m_pPipe(NULL)
+{
+}
+
+CStdoutOutputSink::~CStdoutOutputSink()
+{
+    if (m_pPipe)
+    {
+        fclose(m_pPipe);
+    }
+}
+
+bool CStdoutOutputSink::Open()
+{
+    if (m_pPipe)
+    {
+        return true;
+    }
+    CLog::Flush();
+    fflush(stdout);
+#ifdef _WIN32
+    int nPipe = _dup(_fileno(stdout));
+    if (nPipe < 0 || _dup2(_fileno(stderr), _fileno(stdout)) != 0)
+    {
+        LOG_ERROR("Cannot take over stdout.\n");
+        if (nPipe >= 0)
+        {
+            _close(nPipe);
+        }
+        return false;
+    }
+    _setmode(nPipe, _O_BINARY);
+    m_pPipe = _fdopen(nPipe, "wb");
+    if (!m_pPipe)
+    {
+        // Give stdout its pipe back.
+        _dup2(nPipe, _fileno(stdout));
+        _close(nPipe);
+    }
+#else
+    int nPipe = dup(fileno(stdout));
+    if (nPipe < 0 || dup2(fileno(stderr), fileno(stdout)) < 0)
+    {
+        LOG_ERROR("Cannot take over stdout.\n");
+        if (nPipe >= 0)
+        {
+            close(nPipe);
+        }
+        return false;
+    }
+    m_pPipe = fdopen(nPipe, "wb");
+    if (!m_pPipe)
+    {
+        // Give stdout its pipe back.
+        dup2(nPipe, fileno(stdout));
+        close(nPipe);
+    }
+#endif
+    if (!m_pPipe)
+    {
+        LOG_ERROR("Cannot open the output pipe.\n");
+        return false;
+    }
+    m_uSize = 0;
+    return true;
+}
+
+bool CStdoutOutputSink::Write(const void * pData, uint64_t uSize)
+{
+    if (!m_pPipe)
+    {
+        return false;
+    }
+    if (fwrite(pData, sizeof(uint8_t), (size_t)uSize, m_pPipe) != uSize)
+    {
+        LOG_ERROR("Cannot write %llu bytes to the output pipe.\n", (unsigned long long)uSize);
+        return false;
+    }
+    m_uSize += uSize;
+    return true;
+}
+
+bool CStdoutOutputSink::Close()
+{
+    if (!m_pPipe)
+    {
+        return false;
+    }
+    return fflush(m_pPipe) == 0;
+}
@@ -0,0 +1,103 @@
+#ifndef OUTPUT_SINK_H_
+#define OUTPUT_SINK_H_
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/* Destination of an exported .stu. Bytes are written sequentially; sinks that can seek also allow patching
+   bytes already written, which is how the file header gets its final size. */
+class COutputSink
+{
+public:
+    virtual ~COutputSink() {}
+
+    /* Append uSize bytes */
+    virtual bool Write(const void * pData, uint64_t uSize) = 0;
+
+    /* True if WriteAt can be used */
+    virtual bool CanSeek() const = 0;
+
+    /* Overwrite uSize bytes at uOffset, which must lie within what was already written */
+    virtual bool WriteAt(uint64_t uOffset, const void * pData, uint64_t uSize) = 0;
+
+    /* Flush and release the destination. Returns false if anything could not be written. */
+    virtual bool Close() = 0;
+
+    /* Number of bytes written so far */
+    uint64_t GetSize() const { return m_uSize; }
+
+protected:
+    COutputSink() : m_uSize(0) {}
+
+    uint64_t m_uSize;
+
+private:
+    COutputSink(const COutputSink &);
+    COutputSink &operator=(const COutputSink &);
+};
+
+/* Regular file, truncated on Open */
+class CFileOutputSink : public COutputSink
+{
+public:
+    CFileOutputSink();
+    virtual ~CFileOutputSink();
+
+    bool Open(const std::string &path);
+
+    virtual bool Write(const void * pData, uint64_t uSize);
+    virtual bool CanSeek() const { return true; }
+    virtual bool WriteAt(uint64_t uOffset, const void * pData, uint64_t uSize);
+    virtual bool Close();
+
+    const std::string &GetPath() const { return m_sPath; }
+
+private:
+    std::string m_sPath;
+    FILE * m_pFile;
+};
+
+/* Growable memory buffer, for callers that upload or parse the result without touching the disk */
+class CMemoryOutputSink : public COutputSink
+{
+public:
+    CMemoryOutputSink() {}
+
+    virtual bool Write(const void * pData, uint64_t uSize);
+    virtual bool CanSeek() const { return true; }
+    virtual bool WriteAt(uint64_t uOffset, const void * pData, uint64_t uSize);
+    virtual bool Close() { return true; }
+
+    const std::vector<uint8_t> &GetBuffer() const { return m_Buffer; }
+
+    /* Move the written bytes out, leaving the sink empty */
+    void TakeBuffer(std::vector<uint8_t> &Target) { Target.swap(m_Buffer); std::vector<uint8_t>().swap(m_Buffer); m_uSize = 0; }
+
+private:
+    std::vector<uint8_t> m_Buffer;
+};
+
+/* Standard output, for piping into another process. It cannot seek, so the exporter streams the file
+   (see CFileExportSTUFormat::BeginStream). Open takes over the real stdout: from then on printf output
+   goes to stderr so log lines cannot end up inside the stream. Close only flushes, so several exports
+   can be streamed back to back; the pipe is released by the destructor. */
+class CStdoutOutputSink : public COutputSink
+{
+public:
+    CStdoutOutputSink();
+    virtual ~CStdoutOutputSink();
+
+    bool Open();
+
+    virtual bool Write(const void * pData, uint64_t uSize);
+    virtual bool CanSeek() const { return false; }
+    virtual bool WriteAt(uint64_t /*uOffset*/, const void * /*pData*/, uint64_t /*uSize*/) { return false; }
+    virtual bool Close();
+
+private:
+    FILE * m_pPipe;
+};
+
+#endif // OUTPUT_SINK_H_
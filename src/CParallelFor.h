@@ -0,0 +1,31 @@
+#ifndef PARALLEL_FOR_H_
+#define PARALLEL_FOR_H_
+
+#include "CTaskScheduler.h"
+
+#include <cstdint>
+#include <thread>
+#include <functional>
+
+class CParallelFor
+{
+public:
+
+    /* Number of hardware threads, which Run() spreads the work over. Falls back to 1 when the hardware concurrency is unknown. */
+    static uint32_t GetWorkerCount()
+    {
+        uint32_t uWorkers = (uint32_t)std::thread::hardware_concurrency();
+        return uWorkers > 0 ? uWorkers : 1;
+    }
+
+    /* Splits [0, uCount) into contiguous ranges of at least uMinPerTask elements and calls Func(uBegin, uEnd)
+       for each of them. Each range is processed by exactly one thread, so work partitioned by range does
+       not need any locking. The ranges run as tasks of the shared pool, no thread is started per call, and
+       the calling thread takes part; with too little work to split everything runs inline. */
+    static void Run(uint32_t uCount, uint32_t uMinPerTask, const std::function<void(uint32_t uBegin, uint32_t uEnd)> &Func)
+    {
+        CTaskScheduler::GetShared().ParallelFor(uCount, uMinPerTask, Func);
+    }
+};
+
+#endif // PARALLEL_FOR_H_
@@ -0,0 +1,266 @@
+#include "CTaskScheduler.h"
+#include "CParallelFor.h"
+#include "CBoundedQueue.h"
+#include "CTimer.h"
+
+#include <chrono>
+#include <algorithm>
+
+// VS2013 has no thread_local; the worker identity kept here is plain data, which __declspec(thread) supports.
+#if defined(_MSC_VER) && _MSC_VER < 1900
+#define STU_THREAD_LOCAL __declspec(thread)
+#else
+#define STU_THREAD_LOCAL thread_local
+#endif
+
+static STU_THREAD_LOCAL const CTaskScheduler * t_pScheduler = NULL;
+static STU_THREAD_LOCAL uint32_t t_uWorker = 0;
+
+static std::once_flag s_SharedOnce;
+static CTaskScheduler * s_pShared = NULL;
+
+CTaskScheduler::CTaskScheduler(uint32_t uWorkers) :
+    m_uQueued(0),
+    m_uSleeping(0),
+    m_bStopping(false)
+{
+    if (uWorkers == 0)
+    {
+        uWorkers = std::max<uint32_t>(CParallelFor::GetWorkerCount(), 2) - 1;
+    }
+    for (uint32_t i = 0; i <= uWorkers; ++i)
+    {
+        m_Workers.push_back(std::unique_ptr<Worker>(new Worker()));
+    }
+    for (uint32_t i = 0; i < uWorkers; ++i)
+    {
+        m_Workers[i]->Thread = std::thread(&CTaskScheduler::WorkerLoop, this, i);
+    }
+}
+
+CTaskScheduler::~CTaskScheduler()
+{
+    {
+        std::lock_guard<std::mutex> Lock(m_SleepMutex);
+        m_bStopping = true;
+    }
+    m_WorkAvailable.notify_all();
+    for (size_t i = 0; i < m_Workers.size(); ++i)
+    {
+        if (m_Workers[i]->Thread.joinable())
+        {
+            m_Workers[i]->Thread.join();
+        }
+    }
+}
+
+CTaskScheduler &CTaskScheduler::GetShared()
+{
+    // Never destroyed, its workers would otherwise be joined while the static destructors run.
+    std::call_once(s_SharedOnce, [] { s_pShared = new CTaskScheduler(); });
+    return *s_pShared;
+}
+
+uint32_t CTaskScheduler::GetCurrentWorker() const
+{
+    return t_pScheduler == this ? t_uWorker : (uint32_t)m_Workers.size() - 1;
+}
+
+void CTaskScheduler::Spawn(CTaskGroup &Group, Task Func)
+{
+    Group.m_uPending.fetch_add(1, std::memory_order_relaxed);
+
+    QueuedTask Queued;
+    Queued.Func = std::move(Func);
+    Queued.pGroup = &Group;
+
+    // Counted before it is queued so the count never drops below zero. Sleepers count themselves before they
+    // check m_uQueued, so either they see the task or the notification below sees them.
+    m_uQueued++;
+    Worker &Self = *m_Workers[GetCurrentWorker()];
+    {
+        std::lock_guard<std::mutex> Lock(Self.Mutex);
+        Self.Tasks.push_back(std::move(Queued));
+    }
+    if (m_uSleeping.load() > 0)
+    {
+        std::lock_guard<std::mutex> Lock(m_SleepMutex);
+        m_WorkAvailable.notify_one();
+    }
+}
+
+bool CTaskScheduler::PopTask(uint32_t uSelf, QueuedTask &Task, bool &bStolen)
+{
+    if (m_uQueued.load(std::memory_order_relaxed) == 0)
+    {
+        return false;
+    }
+
+    // Own tasks newest first, then the tasks spawned from outside the pool, then steal the oldest task of
+    // another worker, starting after this one so thieves spread over the victims.
+    uint32_t uShared = (uint32_t)m_Workers.size() - 1;
+    uint32_t uCount = (uint32_t)m_Workers.size();
+    for (uint32_t uStep = 0; uStep <= uCount; ++uStep)
+    {
+        uint32_t uVictim = uStep == 0 ? uSelf : uStep == 1 ? uShared : (uSelf + uStep - 1) % uCount;
+        if ((uStep > 0 && uVictim == uSelf) || (uStep > 1 && uVictim == uShared))
+        {
+            continue;
+        }
+
+        Worker &Victim = *m_Workers[uVictim];
+        std::lock_guard<std::mutex> Lock(Victim.Mutex);
+        if (Victim.Tasks.empty())
+        {
+            continue;
+        }
+        if (uVictim == uSelf)
+        {
+            Task = std::move(Victim.Tasks.back());
+            Victim.Tasks.pop_back();
+        }
+        else
+        {
+            Task = std::move(Victim.Tasks.front());
+            Victim.Tasks.pop_front();
+        }
+        m_uQueued--;
+        bStolen = uVictim != uSelf && uVictim != uShared;
+        return true;
+    }
+    return false;
+}
+
+bool CTaskScheduler::RunTask(uint32_t uSelf)
+{
+    QueuedTask Queued;
+    bool bStolen = false;
+    if (!PopTask(uSelf, Queued, bStolen))
+    {
+        return false;
+    }
+
+    Queued.Func();
+    Queued.Func = Task();
+
+    Worker &Self = *m_Workers[uSelf];
+    Self.uTasksRun.fetch_add(1, std::memory_order_relaxed);
+    if (bStolen)
+    {
+        Self.uTasksStolen.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // The waiter may destroy the group as soon as it sees it done, nothing may touch it after this.
+    Queued.pGroup->m_uPending.fetch_sub(1, std::memory_order_acq_rel);
+    return true;
+}
+
+void CTaskScheduler::Wait(CTaskGroup &Group)
+{
+    uint32_t uSelf = GetCurrentWorker();
+    CBackoff Backoff;
+    uint64_t uIdleStartuS = 0;
+    while (!Group.IsDone())
+    {
+        if (RunTask(uSelf))
+        {
+            if (uIdleStartuS)
+            {
+                m_Workers[uSelf]->uIdleTimeuS.fetch_add(CTimer::GetTimeuS() - uIdleStartuS, std::memory_order_relaxed);
+                uIdleStartuS = 0;
+            }
+            Backoff.Reset();
+            continue;
+        }
+
+        // The remaining tasks of the group are running elsewhere.
+        if (!uIdleStartuS)
+        {
+            uIdleStartuS = CTimer::GetTimeuS();
+        }
+        Backoff.Pause();
+    }
+    if (uIdleStartuS)
+    {
+        m_Workers[uSelf]->uIdleTimeuS.fetch_add(CTimer::GetTimeuS() - uIdleStartuS, std::memory_order_relaxed);
+    }
+}
+
+void CTaskScheduler::ParallelFor(uint32_t uCount, uint32_t uMinPerTask, const std::function<void(uint32_t uBegin, uint32_t uEnd)> &Func)
+{
+    if (uCount == 0)
+    {
+        return;
+    }
+
+    uMinPerTask = std::max<uint32_t>(uMinPerTask, 1);
+    uint32_t uTasks = std::min<uint32_t>(GetWorkerCount() + 1, (uCount + uMinPerTask - 1) / uMinPerTask);
+    if (uTasks <= 1)
+    {
+        Func(0, uCount);
+        return;
+    }
+
+    // The calling thread takes the first range itself.
+    uint32_t uPerTask = (uCount + uTasks - 1) / uTasks;
+    CTaskGroup Group;
+    for (uint32_t uTask = 1; uTask < uTasks; ++uTask)
+    {
+        uint32_t uBegin = uTask * uPerTask;
+        uint32_t uEnd = std::min(uBegin + uPerTask, uCount);
+        if (uBegin >= uEnd)
+        {
+            break;
+        }
+        Spawn(Group, [&Func, uBegin, uEnd] { Func(uBegin, uEnd); });
+    }
+    Func(0, std::min(uPerTask, uCount));
+    Wait(Group);
+}
+
+void CTaskScheduler::WorkerLoop(uint32_t uWorker)
+{
+    t_pScheduler = this;
+    t_uWorker = uWorker;
+
+    Worker &Self = *m_Workers[uWorker];
+    while (!m_bStopping.load())
+    {
+        if (RunTask(uWorker))
+        {
+            continue;
+        }
+
+        uint64_t uIdleStartuS = CTimer::GetTimeuS();
+        {
+            std::unique_lock<std::mutex> Lock(m_SleepMutex);
+            m_uSleeping++;
+            // Every spawn notifies a sleeper, the timeout is only a safety net.
+            m_WorkAvailable.wait_for(Lock, std::chrono::milliseconds(10), [this] { return m_bStopping.load() || m_uQueued.load() > 0; });
+            m_uSleeping--;
+        }
+        Self.uIdleTimeuS.fetch_add(CTimer::GetTimeuS() - uIdleStartuS, std::memory_order_relaxed);
+    }
+}
+
+std::vector<TaskWorkerStats> CTaskScheduler::GetStats() const
+{
+    std::vector<TaskWorkerStats> Stats(m_Workers.size());
+    for (size_t i = 0; i < m_Workers.size(); ++i)
+    {
+        Stats[i].uTasksRun = m_Workers[i]->uTasksRun.load(std::memory_order_relaxed);
+        Stats[i].uTasksStolen = m_Workers[i]->uTasksStolen.load(std::memory_order_relaxed);
+        Stats[i].uIdleTimeuS = m_Workers[i]->uIdleTimeuS.load(std::memory_order_relaxed);
+    }
+    return Stats;
+}
+
+void CTaskScheduler::ResetStats()
+{
+    for (size_t i = 0; i < m_Workers.size(); ++i)
+    {
+        m_Workers[i]->uTasksRun.store(0, std::memory_order_relaxed);
+        m_Workers[i]->uTasksStolen.store(0, std::memory_order_relaxed);
+        m_Workers[i]->uIdleTimeuS.store(0, std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,119 @@
+#ifndef TASK_SCHEDULER_H_
+#define TASK_SCHEDULER_H_
+
+#include <cstdint>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <functional>
+
+/* What one worker did since the scheduler started or since ResetStats(), to tune the size of the tasks: many
+   steals and a lot of idle time mean the tasks are too coarse, many tiny tasks run mean they are too fine. */
+struct TaskWorkerStats
+{
+    uint64_t uTasksRun;         // including the stolen ones
+    uint64_t uTasksStolen;      // taken from the deque of another worker
+    uint64_t uIdleTimeuS;       // time spent waiting for a task
+
+    TaskWorkerStats() :
+        uTasksRun(0),
+        uTasksStolen(0),
+        uIdleTimeuS(0)
+    {
+    }
+};
+
+/* Tasks that are waited for together. A task may spawn more tasks into its own or any other group. */
+class CTaskGroup
+{
+public:
+    CTaskGroup() : m_uPending(0) {}
+
+    bool IsDone() const { return m_uPending.load(std::memory_order_acquire) == 0; }
+
+private:
+    friend class CTaskScheduler;
+
+    CTaskGroup(const CTaskGroup &);
+    CTaskGroup &operator=(const CTaskGroup &);
+
+    std::atomic<uint32_t> m_uPending;
+};
+
+/*
+   Work-stealing thread pool for nested parallelism, e.g. a task per scene node that spawns tasks for its child
+   nodes and meshes. Every worker has a deque of its own: it pushes and pops the tasks it spawns at the back, so
+   it keeps working depth first on data that is still in its cache, while idle workers steal from the front,
+   where the oldest and usually largest pieces of work are. Tasks spawned from other threads go to a shared
+   deque. Wait() runs tasks until the group is done instead of blocking, so tasks can wait for the tasks they
+   spawned and the calling thread counts as one more worker.
+*/
+class CTaskScheduler
+{
+public:
+    typedef std::function<void()> Task;
+
+    /* uWorkers 0 starts one worker per core but one, the core of the thread that waits */
+    explicit CTaskScheduler(uint32_t uWorkers = 0);
+    virtual ~CTaskScheduler();
+
+    /* Pool shared by all conversions of the process, created on first use */
+    static CTaskScheduler &GetShared();
+
+    void Spawn(CTaskGroup &Group, Task Func);
+
+    /* Runs tasks, the group's or others', until every task of the group has finished */
+    void Wait(CTaskGroup &Group);
+
+    /* Same contract as CParallelFor::Run, on the workers of this pool. Can be called from a task. */
+    void ParallelFor(uint32_t uCount, uint32_t uMinPerTask, const std::function<void(uint32_t uBegin, uint32_t uEnd)> &Func);
+
+    uint32_t GetWorkerCount() const { return (uint32_t)m_Workers.size() - 1; }
+
+    /* One entry per worker, then one for the threads that ran tasks while waiting in Wait() */
+    std::vector<TaskWorkerStats> GetStats() const;
+    void ResetStats();
+
+private:
+
+    struct QueuedTask
+    {
+        Task Func;
+        CTaskGroup * pGroup;
+    };
+
+    // The last worker has no thread, its deque takes the tasks spawned from outside the pool.
+    struct Worker
+    {
+        std::mutex Mutex;
+        std::deque<QueuedTask> Tasks;
+        std::thread Thread;
+        std::atomic<uint64_t> uTasksRun;
+        std::atomic<uint64_t> uTasksStolen;
+        std::atomic<uint64_t> uIdleTimeuS;
+        char Padding[64];           // workers are allocated one by one, keeps their counters apart
+
+        Worker() : uTasksRun(0), uTasksStolen(0), uIdleTimeuS(0) {}
+    };
+
+    void WorkerLoop(uint32_t uWorker);
+    uint32_t GetCurrentWorker() const;
+    bool PopTask(uint32_t uSelf, QueuedTask &Task, bool &bStolen);
+    bool RunTask(uint32_t uSelf);
+
+    CTaskScheduler(const CTaskScheduler &);
+    CTaskScheduler &operator=(const CTaskScheduler &);
+
+    std::vector< std::unique_ptr<Worker> > m_Workers;
+    std::atomic<uint32_t> m_uQueued;            // tasks in all deques
+    std::atomic<uint32_t> m_uSleeping;
+    std::atomic<bool> m_bStopping;
+    std::mutex m_SleepMutex;
+    std::condition_variable m_WorkAvailable;
+};
+
+#endif // TASK_SCHEDULER_H_
@@ -0,0 +1,117 @@
+#include "CTempFile.h"
+#include "CLog.h"
+
+#include <atomic>
+#include <chrono>
+
+#ifdef _WIN32
+#include <process.h>
+#define GET_PROCESS_ID _getpid
+#else
+#include <unistd.h>
+#define GET_PROCESS_ID getpid
+#endif
+
+#define LOG_ERROR(...) STU_LOG_ERROR("CTempFile", __VA_ARGS__)
+
+static std::atomic<uint32_t> s_uNextTempFile(0);
+
+CTempFile::CTempFile() :
+    m_pFile(NULL),
+    m_uSize(0),
+    m_bWriting(false)
+{
+}
+
+CTempFile::~CTempFile()
+{
+    Close();
+}
+
+bool CTempFile::Create(const std::string &sDirectory, const std::string &sPrefix)
+{
+    Close();
+
+    // Process id and start time keep concurrent conversions sharing a directory apart.
+    uint64_t uStamp = (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+    std::string sName = sPrefix + "." + std::to_string((unsigned long long)GET_PROCESS_ID()) + "." + std::to_string((unsigned long long)(uStamp & 0xFFFFFF)) + "." + std::to_string((unsigned long long)s_uNextTempFile++) + ".tmp";
+    if (sDirectory.empty())
+    {
+        m_sPath = sName;
+    }
+    else
+    {
+        char cLast = sDirectory[sDirectory.size() - 1];
+        m_sPath = (cLast == '/' || cLast == '\\') ? sDirectory + sName : sDirectory + "/" + sName;
+    }
+
+    m_pFile = fopen(m_sPath.c_str(), "w+b");
+    if (!m_pFile)
+    {
+        LOG_ERROR("Could not create temporary file '%s'.\n", m_sPath.c_str());
+        m_sPath.clear();
+        return false;
+    }
+    setvbuf(m_pFile, NULL, _IOFBF, uBufferSize);
+    m_uSize = 0;
+    m_bWriting = true;
+    return true;
+}
+
+void CTempFile::Close()
+{
+    if (m_pFile)
+    {
+        fclose(m_pFile);
+        m_pFile = NULL;
+        remove(m_sPath.c_str());
+    }
+    m_sPath.clear();
+    m_uSize = 0;
+    m_bWriting = false;
+}
+
+bool CTempFile::Write(const void * pData, uint64_t uSize)
+{
+    if (!m_pFile || !m_bWriting)
+    {
+        return false;
+    }
+    if (fwrite(pData, 1, (size_t)uSize, m_pFile) != uSize)
+    {
+        LOG_ERROR("Cannot write %llu bytes to '%s', is the disk full?\n", (unsigned long long)uSize, m_sPath.c_str());
+        return false;
+    }
+    m_uSize += uSize;
+    return true;
+}
+
+bool CTempFile::Read(void * pData, uint64_t uSize)
+{
+    return ReadSome(pData, uSize) == uSize;
+}
+
+uint64_t CTempFile::ReadSome(void * pData, uint64_t uSize)
+{
+    if (!m_pFile || m_bWriting)
+    {
+        return 0;
+    }
+    return fread(pData, 1, (size_t)uSize, m_pFile);
+}
+
+bool CTempFile::Rewind()
+{
+    if (!m_pFile)
+    {
+        return false;
+    }
+    if (m_bWriting && fflush(m_pFile) != 0)
+    {
+        LOG_ERROR("Cannot flush '%s'.\n", m_sPath.c_str());
+        return false;
+    }
+    rewind(m_pFile);
+    m_bWriting = false;
+    return true;
+}
@@ -0,0 +1,63 @@
+#ifndef TEMP_FILE_H_
+#define TEMP_FILE_H_
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+/* Scratch file for data that does not fit in memory. It is written sequentially, then rewound and read back
+   sequentially, as often as needed. The file is deleted when closed. */
+class CTempFile
+{
+public:
+    CTempFile();
+    virtual ~CTempFile();
+
+    /* Buffer size given to the C runtime for every temp file */
+    static const size_t uBufferSize = 1024 * 1024;
+
+    /* Create a new empty file in sDirectory (the current directory when empty). The name starts with sPrefix. */
+    bool Create(const std::string &sDirectory, const std::string &sPrefix);
+
+    /* Close and delete the file */
+    void Close();
+
+    bool Write(const void * pData, uint64_t uSize);
+
+    /* Read exactly uSize bytes, false at the end of the file */
+    bool Read(void * pData, uint64_t uSize);
+
+    /* Read up to uSize bytes, returns the number of bytes read */
+    uint64_t ReadSome(void * pData, uint64_t uSize);
+
+    /* Go back to the start of the file for reading */
+    bool Rewind();
+
+    bool IsOpen() const { return m_pFile != NULL; }
+
+    /* Number of bytes written */
+    uint64_t GetSize() const { return m_uSize; }
+
+    const std::string &GetPath() const { return m_sPath; }
+
+    template <typename T>
+    bool WriteRecord(const T &Record) { return Write(&Record, sizeof(T)); }
+
+    template <typename T>
+    bool ReadRecord(T &Record) { return Read(&Record, sizeof(T)); }
+
+    /* Number of records of type T written */
+    template <typename T>
+    uint64_t GetRecordCount() const { return m_uSize / sizeof(T); }
+
+private:
+    CTempFile(const CTempFile &);
+    CTempFile &operator=(const CTempFile &);
+
+    std::string m_sPath;
+    FILE * m_pFile;
+    uint64_t m_uSize;
+    bool m_bWriting;
+};
+
+#endif // TEMP_FILE_H_
@@ -0,0 +1,49 @@
+#include "CTimer.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <chrono>
+#endif
+
+#ifdef _WIN32
+static uint64_t GetCounterFrequency()
+{
+    static uint64_t s_uFrequency = 0;
+    if (s_uFrequency == 0)
+    {
+        LARGE_INTEGER Frequency;
+        QueryPerformanceFrequency(&Frequency);
+        s_uFrequency = (uint64_t)Frequency.QuadPart;
+    }
+    return s_uFrequency;
+}
+
+// Whole seconds and the remainder are scaled separately, the counter times a billion overflows after days.
+static uint64_t ReadCounter(uint64_t uUnitsPerSecond)
+{
+    LARGE_INTEGER Counter;
+    QueryPerformanceCounter(&Counter);
+    uint64_t uFrequency = GetCounterFrequency();
+    uint64_t uTicks = (uint64_t)Counter.QuadPart;
+    return uTicks / uFrequency * uUnitsPerSecond + uTicks % uFrequency * uUnitsPerSecond / uFrequency;
+}
+#endif
+
+uint64_t CTimer::GetTimeuS()
+{
+#ifdef _WIN32
+    return ReadCounter(1000000);
+#else
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+uint64_t CTimer::GetTimeNs()
+{
+#ifdef _WIN32
+    return ReadCounter(1000000000);
+#else
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
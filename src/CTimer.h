@@ -0,0 +1,18 @@
+#ifndef TIMER_H_
+#define TIMER_H_
+
+#include <cstdint>
+
+/* Monotonic clock for timing conversions and kernels. VS2013's steady_clock ticks with the system clock
+   (about 1 ms, often 15.6 ms), so Windows reads the performance counter instead. */
+class CTimer
+{
+public:
+    static uint64_t GetTimeuS();
+    static uint64_t GetTimeNs();
+
+private:
+    CTimer();
+};
+
+#endif // TIMER_H_
@@ -50,10 +50,10 @@ int TangentVelocityFlagToIndex(int flags)
     return 0;
 }
 
-void InitializeSdkObjects(FbxManager*& pManager, FbxScene*& pScene)
+static FbxManager* InitializeSdkManager()
 {
     //The first thing to do is to create the FBX Manager which is the object allocator for almost all the classes in the SDK
-    pManager = FbxManager::Create();
+    FbxManager* pManager = FbxManager::Create();
     if( !pManager )
     {
         FBXSDK_printf("Error: Unable to create FBX Manager!\n");
@@ -68,6 +68,38 @@ void InitializeSdkObjects(FbxManager*& pManager, FbxScene*& pScene)
     //Load plugins from the executable directory (optional)
     FbxString lPath = FbxGetApplicationDirectory();
     pManager->LoadPluginsDirectory(lPath.Buffer());
+    return pManager;
+}
+
+// File scope rather than function statics, VS2013 does not initialize those thread safely.
+static FbxManager* gSharedSdkManager = NULL;
+static std::mutex gSharedSdkMutex;
+
+static void DestroySharedSdkManager()
+{
+    DestroySdkObjects(gSharedSdkManager, true);
+    gSharedSdkManager = NULL;
+}
+
+FbxManager* GetSharedSdkManager()
+{
+    std::lock_guard<std::mutex> Lock(gSharedSdkMutex);
+    if (!gSharedSdkManager)
+    {
+        gSharedSdkManager = InitializeSdkManager();
+        atexit(DestroySharedSdkManager);
+    }
+    return gSharedSdkManager;
+}
+
+std::mutex& GetSharedSdkMutex()
+{
+    return gSharedSdkMutex;
+}
+
+void InitializeSdkObjects(FbxManager*& pManager, FbxScene*& pScene)
+{
+    pManager = InitializeSdkManager();
 
     //Create an FBX scene. This object holds most objects imported/exported from/to files.
     pScene = FbxScene::Create(pManager, "My Scene");
@@ -3200,7 +3232,7 @@ void DisplayColor(const char* pHeader, FbxColor pValue, const char* pSuffix /* =
     FBXSDK_printf(lString);
 }
 
-bool LoadScene(FbxManager* pManager, FbxDocument* pScene, const char* pFilename)
+bool LoadScene(FbxManager* pManager, FbxDocument* pScene, const char* pFilename, std::string* pError)
 {
     int lFileMajor, lFileMinor, lFileRevision;
     int lSDKMajor,  lSDKMinor,  lSDKRevision;
@@ -3231,6 +3263,11 @@ bool LoadScene(FbxManager* pManager, FbxDocument* pScene, const char* pFilename)
             FBXSDK_printf("FBX file format version for file '%s' is %d.%d.%d\n\n", pFilename, lFileMajor, lFileMinor, lFileRevision);
         }
 
+        if (pError)
+        {
+            *pError = error.Buffer();
+        }
+        lImporter->Destroy();
         return false;
     }
 
@@ -3306,6 +3343,11 @@ bool LoadScene(FbxManager* pManager, FbxDocument* pScene, const char* pFilename)
         }
     }
 
+    if (!lStatus && pError)
+    {
+        *pError = lImporter->GetStatus().GetErrorString();
+    }
+
     // Destroy the importer.
     lImporter->Destroy();
 
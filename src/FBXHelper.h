@@ -2,11 +2,19 @@
 #define FBX_HELPER_H
 
 #include <fbxsdk.h>
+#include <mutex>
+#include <string>
 
 void InitializeSdkObjects(FbxManager*& pManager, FbxScene*& pScene);
+
+// Process-wide manager, created with its IO plugins on first use and destroyed at exit. The SDK is not thread
+// safe, hold the lock from GetSharedSdkMutex() while using the manager or anything created from it.
+FbxManager* GetSharedSdkManager();
+std::mutex& GetSharedSdkMutex();
 void DestroySdkObjects(FbxManager* pManager, bool pExitStatus);
 bool SaveScene(FbxManager* pManager, FbxDocument* pScene, const char* pFilename, int pFileFormat, bool pEmbedMedia);
-bool LoadScene(FbxManager* pManager, FbxDocument* pScene, const char* pFilename);
+// Import pFilename into pScene. On failure pError, when given, receives the importer's status message.
+bool LoadScene(FbxManager* pManager, FbxDocument* pScene, const char* pFilename, std::string* pError = NULL);
 
 //SR: These are not REALLY needed, but may useful for info or debugging
 